@@ -72,6 +72,7 @@ It handles initialization and termination by subclassing wxApp.
 #include "AboutDialog.h"
 #include "AColor.h"
 #include "AudioIO.h"
+#include "BatchCommands.h"
 #include "Benchmark.h"
 #include "Clipboard.h"
 #include "CrashReport.h"
@@ -112,8 +113,7 @@ It handles initialization and termination by subclassing wxApp.
 #include "prefs/KeyConfigPrefs.h"
 #endif
 
-//temporarily commented out till it is added to all projects
-//#include "Profiler.h"
+#include "Profiler.h"
 
 #include "ModuleManager.h"
 
@@ -424,9 +424,8 @@ static void QuitAudacity(bool bForce)
 #endif
    CloseScreenshotTools();
 
-   //print out profile if we have one by deleting it
-   //temporarily commented out till it is added to all projects
-   //DELETE Profiler::Instance();
+   //write out the profile if we have one
+   Profiler::Finish();
 
    //remove our logger
    std::unique_ptr<wxLog>{ wxLog::SetActiveTarget(NULL) }; // DELETE
@@ -1241,8 +1240,30 @@ bool AudacityApp::OnInit()
    }
 #endif
 
+   // Only look for --isolated now; the command line is parsed again, with
+   // any complaints, after initialization
+   if (auto parser = ParseCommandLine(false))
+      parser->Found(wxT("isolated"), &mIsolatedDir);
+
    // Initialize preferences and language
    wxFileName configFileName(FileNames::DataDir(), wxT("audacity.cfg"));
+   if (!mIsolatedDir.empty()) {
+      // Begin with the settings and plug-in registry of the copy that
+      // started this one, but don't write them back
+      if (!wxFileName::DirExists(mIsolatedDir))
+         wxFileName::Mkdir(mIsolatedDir, 0755, wxPATH_MKDIR_FULL);
+      const auto isolate = [&](const FilePath &path){
+         wxFileName isolatedFileName(path);
+         isolatedFileName.SetPath(mIsolatedDir);
+         if (!isolatedFileName.FileExists() && wxFileName::FileExists(path))
+            wxCopyFile(path, isolatedFileName.GetFullPath());
+         return isolatedFileName;
+      };
+      isolate(FileNames::PluginRegistry());
+      isolate(FileNames::PluginSettings());
+      FileNames::SetPluginConfigDir(mIsolatedDir);
+      configFileName = isolate(configFileName.GetFullPath());
+   }
    InitPreferences( configFileName );
    PopulatePreferences();
    // This test must follow PopulatePreferences, because if an error message
@@ -1311,6 +1332,13 @@ bool AudacityApp::OnInit()
       Sequence::SetMaxDiskBlockSize(lval);
    }
 
+   wxString tracePath;
+   if (parser->Found(wxT("trace"), &tracePath))
+   {
+      Profiler::SetThreadName("Main thread");
+      Profiler::Start(tracePath);
+   }
+
    // BG: Create a temporary window to set as the top window
    wxImage logoimage((const char **)AudacityLogoWithName_xpm);
    logoimage.Rescale(logoimage.GetWidth() / 2, logoimage.GetHeight() / 2);
@@ -1416,7 +1444,10 @@ bool AudacityApp::OnInit()
       }
    }
 
-   if( ProjectSettings::Get( *project ).GetShowSplashScreen() ){
+   // A copy that processes part of a batch for another shows nothing more
+   if (parser->Found(wxT("batch-macro")))
+      GetProjectFrame( *project ).Iconize();
+   else if( ProjectSettings::Get( *project ).GetShowSplashScreen() ){
       // This may do a check-for-updates at every start up.
       // Mainly this is to tell users of ALPHAS who don't know that they have an ALPHA.
       // Disabled for now, after discussion.
@@ -1459,6 +1490,29 @@ bool AudacityApp::OnInit()
             QuitAudacity(true);
          }
 
+         wxString benchmarkPath;
+         if (parser->Found(wxT("benchmark"), &benchmarkPath))
+         {
+            if (!RunHeadlessBenchmark( *project, benchmarkPath )) {
+               wxFprintf(stderr, "Benchmark failed\n");
+               mExitCode = 1;
+            }
+            QuitAudacity(true);
+         }
+
+         wxString batchMacro;
+         if (parser->Found(wxT("batch-macro"), &batchMacro))
+         {
+            FilePaths files;
+            for (size_t i = 0, cnt = parser->GetParamCount(); i < cnt; i++)
+               files.push_back(parser->GetParam(i));
+            if (!MacroCommands::ApplyMacroToFiles( *project, batchMacro, files ))
+               mExitCode = 1;
+            QuitAudacity(true);
+            // Don't open the files again
+            return;
+         }
+
          // As of wx3, there's no need to process the filename arguments as they
          // will be sent via the MacOpenFile() method.
 #if !defined(__WXMAC__)
@@ -1573,6 +1627,15 @@ void SetToExtantDirectory( wxString & result, const wxString & dir ){
 
 bool AudacityApp::InitTempDir()
 {
+   if (!mIsolatedDir.empty()) {
+      // The directory belongs to this copy alone, so there is no other
+      // instance to check for, nor to receive its files
+      if (!wxFileName::DirExists(mIsolatedDir))
+         return false;
+      FileNames::UpdateDefaultPath(FileNames::Operation::Temp, mIsolatedDir);
+      return true;
+   }
+
    // We need to find a temp directory location.
    auto tempFromPrefs = FileNames::TempDir();
    auto tempDefaultLoc = FileNames::DefaultTempDir();
@@ -1933,7 +1996,7 @@ void AudacityApp::OnSocketEvent(wxSocketEvent & evt)
 
 #endif
 
-std::unique_ptr<wxCmdLineParser> AudacityApp::ParseCommandLine()
+std::unique_ptr<wxCmdLineParser> AudacityApp::ParseCommandLine(bool giveUsage)
 {
    auto parser = std::make_unique<wxCmdLineParser>(argc, argv);
    if (!parser)
@@ -1953,6 +2016,31 @@ std::unique_ptr<wxCmdLineParser> AudacityApp::ParseCommandLine()
    /*i18n-hint: This runs a set of automatic tests on Audacity itself */
    parser->AddSwitch(wxT("t"), wxT("test"), _("run self diagnostics"));
 
+   /*i18n-hint: This runs timing tests on Audacity itself, without showing
+    *           any dialog, and saves the results to a file.  A display is
+    *           still required. */
+   parser->AddOption(wxT(""), wxT("benchmark"),
+                     _("run performance benchmarks and write JSON results to the file (needs a display)"),
+                     wxCMD_LINE_VAL_STRING);
+
+   /*i18n-hint: This records timings of Audacity's work until it quits,
+    *           and saves them to a file for viewing in a web browser */
+   parser->AddOption(wxT(""), wxT("trace"),
+                     _("record a profile and write it to the file in Chrome trace format"),
+                     wxCMD_LINE_VAL_STRING);
+
+   /*i18n-hint: This applies a macro to the files named on the command
+    *           line, then quits, with a nonzero exit status on failure */
+   parser->AddOption(wxT(""), wxT("batch-macro"),
+                     _("apply the named macro to the files, then quit"),
+                     wxCMD_LINE_VAL_STRING);
+
+   /*i18n-hint: This makes Audacity keep its settings and temporary files
+    *           in the given directory, apart from any other copy */
+   parser->AddOption(wxT(""), wxT("isolated"),
+                     _("keep settings and temporary files in the directory, apart from other copies of Audacity"),
+                     wxCMD_LINE_VAL_STRING);
+
    /*i18n-hint: This displays the Audacity version */
    parser->AddSwitch(wxT("v"), wxT("version"), _("display Audacity version"));
 
@@ -1963,7 +2051,7 @@ std::unique_ptr<wxCmdLineParser> AudacityApp::ParseCommandLine()
                     wxCMD_LINE_PARAM_MULTIPLE | wxCMD_LINE_PARAM_OPTIONAL);
 
    // Run the parser
-   if (parser->Parse() == 0)
+   if (parser->Parse(giveUsage) == 0)
       return parser;
 
    return{};
@@ -2002,6 +2090,13 @@ void AudacityApp::OnEndSession(wxCloseEvent & event)
    }
 }
 
+int AudacityApp::OnRun()
+{
+   const auto result = wxApp::OnRun();
+   // The main loop ends normally even when quitting after a failure
+   return mExitCode != 0 ? mExitCode : result;
+}
+
 int AudacityApp::OnExit()
 {
    gIsQuitting = true;
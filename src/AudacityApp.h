@@ -43,6 +43,7 @@ class AudacityApp final : public wxApp {
    AudacityApp();
    ~AudacityApp();
    bool OnInit(void) override;
+   int OnRun() override;
    int OnExit(void) override;
    void OnFatalException() override;
    bool OnExceptionInMainLoop() override;
@@ -102,12 +103,19 @@ class AudacityApp final : public wxApp {
 
    wxTimer mTimer;
 
+   // Nonzero when a command line action such as --benchmark failed
+   int mExitCode{ 0 };
+
+   // From --isolated; holds the settings and temporary files of a copy of
+   // Audacity that another started, apart from those of any other copy
+   wxString mIsolatedDir;
+
    void InitCommandHandler();
 
    bool InitTempDir();
    bool CreateSingleInstanceChecker(const wxString &dir);
 
-   std::unique_ptr<wxCmdLineParser> ParseCommandLine();
+   std::unique_ptr<wxCmdLineParser> ParseCommandLine(bool giveUsage = true);
 
 #if defined(__WXMSW__)
    std::unique_ptr<IPCServ> mIPCServ;
@@ -460,7 +460,12 @@ time warp info and AudioIOListener and whether the playback is looped.
 #include "RingBuffer.h"
 #include "prefs/GUISettings.h"
 #include "Prefs.h"
+#include "Profiler.h"
 #include "Project.h"
+#include "SampleBlock.h"
+#include "Sequence.h"
+#include "ThreadPool.h"
+#include "WaveClip.h"
 #include "WaveTrack.h"
 
 #include "effects/RealtimeEffectManager.h"
@@ -1248,6 +1253,9 @@ bool AudioIO::StartPortAudioStream(const AudioIOStartStreamOptions &options,
    mInputMeter.Release();
    mOutputMeter.Release();
 
+   // The callback thread must find an event buffer ready for it
+   Profiler::Reserve();
+
    mLastPaError = paNoError;
    // pick a rate to do the audio I/O at, from those available. The project
    // rate is suggested, but we may get something else if it isn't supported
@@ -1567,6 +1575,11 @@ int AudioIO::StartStream(const TransportTracks &tracks,
 
    mSeek    = 0;
    mLastRecordingOffset = 0;
+   {
+      std::lock_guard< std::mutex > lock{ mAudioThreadStatisticsMutex };
+      mAudioThreadStatistics = {};
+   }
+   mPlaybackSamplesProduced.store( 0, std::memory_order_relaxed );
    mCaptureTracks = tracks.captureTracks;
    mPlaybackTracks = tracks.playbackTracks;
 #ifdef EXPERIMENTAL_MIDI_OUT
@@ -1734,11 +1747,15 @@ int AudioIO::StartStream(const TransportTracks &tracks,
       mScrubState.reset();
 #endif
 
+   if (mPlaybackSchedule.Looping())
+      PinPlaybackBlocks(t0, t1);
+
    // We signal the audio thread to call FillBuffers, to prime the RingBuffers
    // so that they will have data in them when the stream starts.  Having the
    // audio thread call FillBuffers here makes the code more predictable, since
    // FillBuffers will ALWAYS get called from the Audio thread.
    mAudioThreadShouldCallFillBuffersOnce = true;
+   WakeAudioThread();
 
    while( mAudioThreadShouldCallFillBuffersOnce ) {
       auto interval = 50ull;
@@ -1781,6 +1798,7 @@ int AudioIO::StartStream(const TransportTracks &tracks,
       // playback, since our ring buffers have been primed already with 4 sec
       // of audio, but then we might be scrubbing, so do it.
       mAudioThreadFillBuffersLoopRunning = true;
+      WakeAudioThread();
 
       // Now start the PortAudio stream!
       PaError err;
@@ -1912,6 +1930,11 @@ bool AudioIO::AllocateBuffers(
             mPlaybackQueueMinimum =
                std::min( mPlaybackQueueMinimum, playbackBufferSize );
 
+            // Allow for the few samples that FillBuffers and RingBuffer
+            // leave unused
+            mPlaybackWakeThreshold = playbackBufferSize -
+               std::min( playbackBufferSize, mPlaybackSamplesToCopy + 16 );
+
             for (unsigned int i = 0; i < mPlaybackTracks.size(); i++)
             {
                // Bug 1763 - We must fade in from zero to avoid a click on starting.
@@ -1954,6 +1977,14 @@ bool AudioIO::AllocateBuffers(
                   mRate, floatSample, false);
                mPlaybackMixers[i]->ApplyTrackGains(false);
             }
+
+            // Keep the threads of the last stream if the count is unchanged
+            const auto nThreads = std::max< size_t >( 1,
+               std::min( GetMixerThreadCount(), mPlaybackTracks.size() ) );
+            if (nThreads == 1)
+               mMixerPool.reset();
+            else if (!mMixerPool || mMixerPool->GetThreadCount() != nThreads)
+               mMixerPool = std::make_unique<ThreadPool>( nThreads );
          }
 
          if( mNumCaptureChannels > 0 )
@@ -2036,6 +2067,61 @@ void AudioIO::StartStreamCleanup(bool bOnlyBuffers)
 #ifdef EXPERIMENTAL_SCRUBBING_SUPPORT
    mScrubState.reset();
 #endif
+
+   UnpinPlaybackBlocks();
+}
+
+void AudioIO::PinPlaybackBlocks(double t0, double t1)
+{
+   if (mPlaybackTracks.empty() || !mOwningProject)
+      return;
+   if (t0 > t1)
+      std::swap(t0, t1);
+
+   auto &pFactory =
+      WaveTrackFactory::Get( *mOwningProject ).GetSampleBlockFactory();
+   const auto capacity = pFactory->GetCacheStatistics().capacity;
+   if (capacity == 0)
+      return;
+
+   // Pin no more than the cache can hold, in order of playback
+   SampleBlockFactory::SampleBlockIDs ids;
+   size_t bytes = 0;
+   for (const auto &pTrack : mPlaybackTracks) {
+      for (const auto &clip : pTrack->GetClips()) {
+         if (clip->GetEndTime() <= t0 || clip->GetStartTime() >= t1)
+            continue;
+         const auto sequence = clip->GetSequence();
+         if (sequence->GetNumSamples() == 0)
+            continue;
+         sampleCount s0, s1;
+         clip->TimeToSamplesClip(t0, &s0);
+         clip->TimeToSamplesClip(t1, &s1);
+         const auto &blocks = sequence->GetBlockArray();
+         const auto sampleSize = SAMPLE_SIZE(sequence->GetSampleFormat());
+         for (auto ii = sequence->FindBlock(
+                 std::min(s0, sequence->GetNumSamples() - 1)),
+              nn = static_cast<int>(blocks.size());
+              ii < nn && blocks[ii].start < s1; ++ii) {
+            const auto &sb = blocks[ii].sb;
+            bytes += sb->GetSampleCount() * sampleSize;
+            if (bytes > capacity)
+               break;
+            ids.insert(sb->GetBlockID());
+         }
+      }
+   }
+
+   pFactory->SetPinnedBlocks( std::move( ids ) );
+   mpPinnedBlockFactory = pFactory;
+}
+
+void AudioIO::UnpinPlaybackBlocks()
+{
+   if (mpPinnedBlockFactory) {
+      mpPinnedBlockFactory->SetPinnedBlocks( {} );
+      mpPinnedBlockFactory.reset();
+   }
 }
 
 #ifdef EXPERIMENTAL_MIDI_OUT
@@ -2315,6 +2401,7 @@ void AudioIO::StopStream()
       // call FillBuffers one last time (it normally would not do so since
       // Pa_GetStreamActive() would now return false
       mAudioThreadShouldCallFillBuffersOnce = true;
+      WakeAudioThread();
 
       while( mAudioThreadShouldCallFillBuffersOnce )
       {
@@ -2396,6 +2483,7 @@ void AudioIO::StopStream()
 
    mInputMeter.Release();
    mOutputMeter.Release();
+   UnpinPlaybackBlocks();
    mOwningProject = nullptr;
 
    if (pListener && mNumCaptureChannels > 0)
@@ -2576,6 +2664,8 @@ finished:
 
 AudioThread::ExitCode AudioThread::Entry()
 {
+   Profiler::SetThreadName("Audio thread");
+
    AudioIO *gAudioIO;
    while( !TestDestroy() &&
       nullptr != ( gAudioIO = AudioIO::Get() ) )
@@ -2583,6 +2673,8 @@ AudioThread::ExitCode AudioThread::Entry()
       using Clock = std::chrono::steady_clock;
       auto loopPassStart = Clock::now();
       const auto interval = ScrubPollInterval_ms;
+      const bool signalled =
+         gAudioIO->mAudioThreadWakeRequested.exchange( false );
 
       // Set LoopActive outside the tests to avoid race condition
       gAudioIO->mAudioThreadFillBuffersLoopActive = true;
@@ -2593,15 +2685,24 @@ AudioThread::ExitCode AudioThread::Entry()
       }
       else if( gAudioIO->mAudioThreadFillBuffersLoopRunning )
       {
-         gAudioIO->FillBuffers();
+         gAudioIO->FillBuffersMeasured( signalled );
       }
       gAudioIO->mAudioThreadFillBuffersLoopActive = false;
 
       if ( gAudioIO->mPlaybackSchedule.Interactive() )
          std::this_thread::sleep_until(
             loopPassStart + std::chrono::milliseconds( interval ) );
-      else
-         Sleep(10);
+      else {
+         // Wait for the callback to signal that the playback buffers have
+         // room for a refill; but poll anyway, for recording and for
+         // requests from the main thread, more slowly when idle
+         const auto timeout = std::chrono::milliseconds(
+            gAudioIO->mAudioThreadFillBuffersLoopRunning ? 10 : 50 );
+         std::unique_lock< std::mutex > lock{ gAudioIO->mAudioThreadMutex };
+         gAudioIO->mAudioThreadCondition.wait_for( lock, timeout, [&]{
+            return gAudioIO->mAudioThreadWakeRequested.load(
+               std::memory_order_relaxed ); } );
+      }
    }
 
    return 0;
@@ -2630,6 +2731,71 @@ MidiThread::ExitCode MidiThread::Entry()
 }
 #endif
 
+void AudioIoCallback::WakeAudioThread()
+{
+   if ( mAudioThreadWakeRequested.load( std::memory_order_relaxed ) )
+      // Already requested
+      return;
+   mAudioThreadWakeTime.store(
+      std::chrono::steady_clock::now().time_since_epoch().count(),
+      std::memory_order_relaxed );
+   mAudioThreadWakeRequested.store( true );
+   // Notify without locking the mutex, which the PortAudio thread must not
+   // wait for.  A wakeup that is lost this way is recovered by the timeout.
+   mAudioThreadCondition.notify_one();
+}
+
+void AudioIO::FillBuffersMeasured(bool signalled)
+{
+   using Clock = std::chrono::steady_clock;
+   const auto start = Clock::now();
+   const auto margin = mPlaybackTracks.empty()
+      ? 0.0
+      : GetCommonlyReadyPlayback() / mRate;
+   const auto produced =
+      mPlaybackSamplesProduced.load( std::memory_order_relaxed );
+
+   FillBuffers();
+
+   const auto total =
+      mPlaybackSamplesProduced.load( std::memory_order_relaxed );
+   if (total == produced)
+      // Nothing to measure
+      return;
+
+   std::lock_guard< std::mutex > lock{ mAudioThreadStatisticsMutex };
+   auto &stats = mAudioThreadStatistics;
+   stats.samplesProduced = total;
+   stats.minUnderrunMargin = (stats.fills == 0)
+      ? margin
+      : std::min( stats.minUnderrunMargin, margin );
+   ++stats.fills;
+   if (signalled) {
+      const auto requested = Clock::time_point{ Clock::duration{
+         mAudioThreadWakeTime.load( std::memory_order_relaxed ) } };
+      const auto latency =
+         std::chrono::duration<double>{ start - requested }.count();
+      ++stats.signalledFills;
+      stats.meanWakeLatency +=
+         (latency - stats.meanWakeLatency) / stats.signalledFills;
+      stats.maxWakeLatency = std::max( stats.maxWakeLatency, latency );
+   }
+}
+
+AudioThreadStatistics AudioIO::GetAudioThreadStatistics() const
+{
+   std::lock_guard< std::mutex > lock{ mAudioThreadStatisticsMutex };
+   return mAudioThreadStatistics;
+}
+
+size_t AudioIO::GetMixerThreadCount()
+{
+   const auto count = gPrefs->Read(wxT("/AudioIO/MixerThreads"), 0L);
+   if (count <= 0)
+      return ThreadPool::HardwareThreadCount();
+   return count;
+}
+
 size_t AudioIO::GetCommonlyFreePlayback()
 {
    auto commonlyAvail = mPlaybackBuffers[0]->AvailForPut();
@@ -2667,6 +2833,8 @@ size_t AudioIO::GetCommonlyAvailCapture()
 // (which communicates with the audio device).
 void AudioIO::FillBuffers()
 {
+   PROFILE_SCOPE("AudioIO::FillBuffers");
+
    unsigned int i;
 
    auto delayedHandler = [this] ( AudacityException * pException ) {
@@ -2778,30 +2946,56 @@ void AudioIO::FillBuffers()
                (mPlaybackSchedule.Interactive() ? mScrubSpeed : 1.0),
                frames);
 
-            for (i = 0; i < mPlaybackTracks.size(); i++)
+            if (frames > 0)
             {
-               // The mixer here isn't actually mixing: it's just doing
+               // The mixers here aren't actually mixing: each is just doing
                // resampling, format conversion, and possibly time track
-               // warping
-               samplePtr warpedSamples;
-
-               if (frames > 0)
-               {
-                  size_t processed = 0;
-                  if ( toProcess )
-                     processed = mPlaybackMixers[i]->Process( toProcess );
-                  //wxASSERT(processed <= toProcess);
-                  warpedSamples = mPlaybackMixers[i]->GetBuffer();
-                  const auto put = mPlaybackBuffers[i]->Put(
-                     warpedSamples, floatSample, processed, frames - processed);
-                  // wxASSERT(put == frames);
+               // warping for one track.  They are independent, so the pool
+               // may run them concurrently.
+               const auto renderTrack = [&](size_t iTrack) {
+                  // Render directly into the storage of the ring buffer,
+                  // which may be in two pieces if it wraps around
+                  auto &ringBuffer = *mPlaybackBuffers[iTrack];
+                  const auto spans = ringBuffer.GetWriteSpans( frames );
+                  auto toRender = toProcess;
+                  for (const auto &span : { spans.first, spans.second }) {
+                     size_t processed = 0;
+                     const auto request = std::min( span.samples, toRender );
+                     if ( request )
+                        processed =
+                           mPlaybackMixers[iTrack]->Process( request, &span.ptr );
+                     //wxASSERT(processed <= request);
+                     // Pad with zeroes after the end of the mixer's output
+                     ClearSamples( span.ptr, floatSample,
+                        processed, span.samples - processed );
+                     // Once the mixer falls short, pad all the rest
+                     toRender = (processed < request) ? 0 : toRender - processed;
+                  }
+               };
+               if (mMixerPool)
+                  mMixerPool->ForEach( mPlaybackTracks.size(), renderTrack );
+               else
+                  for (i = 0; i < mPlaybackTracks.size(); i++)
+                     renderTrack( i );
+
+               // Join:  publish the samples to the callback only after all
+               // tracks are rendered, always in the same order, and still
+               // after the time queue update above
+               for (i = 0; i < mPlaybackTracks.size(); i++) {
+                  auto &ringBuffer = *mPlaybackBuffers[i];
+                  // The same spans that renderTrack filled
+                  const auto spans = ringBuffer.GetWriteSpans( frames );
+                  ringBuffer.CommitWrite(
+                     spans.first.samples + spans.second.samples );
+                  // wxASSERT(committed == frames);
                   // but we can't assert in this thread
-                  wxUnusedVar(put);
-               }               
+               }
             }
 
             available -= frames;
             wxASSERT(available >= 0);
+            mPlaybackSamplesProduced.fetch_add(
+               frames, std::memory_order_relaxed );
 
             switch (mPlaybackSchedule.mPlayMode)
             {
@@ -3832,18 +4026,116 @@ bool AudioIoCallback::FillOutputBuffers(
       return true;
    }
 
+   auto & em = RealtimeEffectManager::Get();
+   em.RealtimeProcessStart();
+
+   // Effects may process several groups (tracks) at once, on other threads,
+   // so collect that many before mixing them in order; but bound the stack
+   // used for buffers
+   const size_t maxStackBytes = 1 << 17;
+   const auto maxPending = std::max<size_t>(1, std::min<size_t>(
+      em.RealtimeGetConcurrency(),
+      maxStackBytes / (numPlaybackChannels * sizeof(float) *
+         std::max<size_t>(1, framesPerBuffer))));
+   const auto numSlots = maxPending * numPlaybackChannels;
+
    // ------ MEMORY ALLOCATION ----------------------
    // These are small structures.
-   WaveTrack **chans = (WaveTrack **) alloca(numPlaybackChannels * sizeof(WaveTrack *));
-   float **tempBufs = (float **) alloca(numPlaybackChannels * sizeof(float *));
+   // Each pending group has numPlaybackChannels of each of these slots
+   WaveTrack **chans = (WaveTrack **) alloca(numSlots * sizeof(WaveTrack *));
+   float **tempBufs = (float **) alloca(numSlots * sizeof(float *));
+   // Either tempBufs, or storage of the ring buffers read in place
+   float **chanBufs = (float **) alloca(numSlots * sizeof(float *));
+   // Ring buffers to release after their storage is used in place, or null
+   RingBuffer **inPlace = (RingBuffer **) alloca(numSlots * sizeof(RingBuffer *));
+
+   struct PendingGroup {
+      int group;
+      int chanCnt;
+      decltype(framesPerBuffer) len;
+      bool drop;
+      bool dropQuickly;
+      bool process;
+   };
+   PendingGroup *pending =
+      (PendingGroup *) alloca(maxPending * sizeof(PendingGroup));
+   // Arguments of RealtimeProcessGroups
+   int *groups = (int *) alloca(maxPending * sizeof(int));
+   unsigned *groupChans = (unsigned *) alloca(maxPending * sizeof(unsigned));
+   float ***groupBufs = (float ***) alloca(maxPending * sizeof(float **));
+   size_t *groupLens = (size_t *) alloca(maxPending * sizeof(size_t));
 
    // And these are larger structures....
-   for (unsigned int c = 0; c < numPlaybackChannels; c++)
+   for (unsigned int c = 0; c < numSlots; c++)
       tempBufs[c] = (float *) alloca(framesPerBuffer * sizeof(float));
    // ------ End of MEMORY ALLOCATION ---------------
 
-   auto & em = RealtimeEffectManager::Get();
-   em.RealtimeProcessStart();
+   // Now the writer may reuse storage that was read in place
+   auto releaseInPlace = [&](size_t first, int count) {
+      for (int c = 0; c < count; c++)
+         if (inPlace[first + c]) {
+            inPlace[first + c]->CommitRead(framesPerBuffer);
+            inPlace[first + c] = nullptr;
+         }
+   };
+   for (unsigned int c = 0; c < numSlots; c++)
+      inPlace[c] = nullptr;
+
+   size_t numPending = 0;
+
+   // Apply effects to the pending groups, then mix them in track order
+   auto flushPending = [&] {
+      size_t numProcess = 0;
+      for (size_t p = 0; p < numPending; p++) {
+         if (pending[p].process) {
+            groups[numProcess] = pending[p].group;
+            groupChans[numProcess] = pending[p].chanCnt;
+            groupBufs[numProcess] = chanBufs + p * numPlaybackChannels;
+            groupLens[numProcess] = pending[p].len;
+            numProcess++;
+         }
+      }
+      em.RealtimeProcessGroups(
+         numProcess, groups, groupChans, groupBufs, groupLens);
+
+      for (size_t p = 0, q = 0; p < numPending; p++) {
+         const auto &entry = pending[p];
+         const auto first = p * numPlaybackChannels;
+         auto len = entry.process ? groupLens[q++] : entry.len;
+
+         CallbackCheckCompletion(mCallbackReturn, len);
+         if (entry.dropQuickly) { // no samples to process, they've been discarded
+            releaseInPlace(first, entry.chanCnt);
+            continue;
+         }
+
+         // Our channels aren't silent.  We need to pass their data on.
+         //
+         // Note that there are two kinds of channel count.
+         // c and chanCnt are counting channels in the Tracks.
+         // chan (and numPlayBackChannels) is counting output channels on the device.
+         // chan = 0 is left channel
+         // chan = 1 is right channel.
+         //
+         // Each channel in the tracks can output to more than one channel on the device.
+         // For example mono channels output to both left and right output channels.
+         if (len > 0) for (int c = 0; c < entry.chanCnt; c++)
+         {
+            auto vt = chans[first + c];
+
+            if (vt->GetChannelIgnoringPan() == Track::LeftChannel ||
+                  vt->GetChannelIgnoringPan() == Track::MonoChannel )
+               AddToOutputChannel( 0, outputMeterFloats, outputFloats, tempFloats, chanBufs[first + c], entry.drop, len, vt);
+
+            if (vt->GetChannelIgnoringPan() == Track::RightChannel ||
+                  vt->GetChannelIgnoringPan() == Track::MonoChannel  )
+               AddToOutputChannel( 1, outputMeterFloats, outputFloats, tempFloats, chanBufs[first + c], entry.drop, len, vt);
+         }
+
+         releaseInPlace(first, entry.chanCnt);
+      }
+      numPending = 0;
+   };
 
    bool selected = false;
    int group = 0;
@@ -3871,7 +4163,8 @@ bool AudioIoCallback::FillOutputBuffers(
    for (unsigned t = 0; t < numPlaybackTracks; t++)
    {
       WaveTrack *vt = mPlaybackTracks[t].get();
-      chans[chanCnt] = vt;
+      const auto first = numPending * numPlaybackChannels;
+      chans[first + chanCnt] = vt;
 
       // TODO: more-than-two-channels
       auto nextTrack =
@@ -3890,7 +4183,7 @@ bool AudioIoCallback::FillOutputBuffers(
          // IF mono THEN clear 'the other' channel.
          if ( lastChannel && (numPlaybackChannels>1)) {
             // TODO: more-than-two-channels
-            memset(tempBufs[1], 0, framesPerBuffer * sizeof(float));
+            memset(tempBufs[first + 1], 0, framesPerBuffer * sizeof(float));
          }
          drop = TrackShouldBeSilent( *vt );
          dropQuickly = drop;
@@ -3909,19 +4202,32 @@ bool AudioIoCallback::FillOutputBuffers(
       }
       else
       {
-         len = mPlaybackBuffers[t]->Get((samplePtr)tempBufs[chanCnt],
+         auto &ringBuffer = *mPlaybackBuffers[t];
+         const auto spans = ringBuffer.GetReadSpans(toGet);
+         if (toGet == framesPerBuffer && spans.first.samples == toGet) {
+            // Avoid a copy when the samples are contiguous; effects may
+            // then overwrite them in place, which is harmless
+            chanBufs[first + chanCnt] = (float *)spans.first.ptr;
+            inPlace[first + chanCnt] = &ringBuffer;
+            len = toGet;
+         }
+         else {
+            chanBufs[first + chanCnt] = tempBufs[first + chanCnt];
+            inPlace[first + chanCnt] = nullptr;
+            len = ringBuffer.Get((samplePtr)tempBufs[first + chanCnt],
                                                    floatSample,
                                                    toGet);
-         // wxASSERT( len == toGet );
-         if (len < framesPerBuffer)
-            // This used to happen normally at the end of non-looping
-            // plays, but it can also be an anomalous case where the
-            // supply from FillBuffers fails to keep up with the
-            // real-time demand in this thread (see bug 1932).  We
-            // must supply something to the sound card, so pad it with
-            // zeroes and not random garbage.
-            memset((void*)&tempBufs[chanCnt][len], 0,
-               (framesPerBuffer - len) * sizeof(float));
+            // wxASSERT( len == toGet );
+            if (len < framesPerBuffer)
+               // This used to happen normally at the end of non-looping
+               // plays, but it can also be an anomalous case where the
+               // supply from FillBuffers fails to keep up with the
+               // real-time demand in this thread (see bug 1932).  We
+               // must supply something to the sound card, so pad it with
+               // zeroes and not random garbage.
+               memset((void*)&tempBufs[first + chanCnt][len], 0,
+                  (framesPerBuffer - len) * sizeof(float));
+         }
          chanCnt++;
       }
 
@@ -3938,41 +4244,15 @@ bool AudioIoCallback::FillOutputBuffers(
          continue;
 
       // Last channel of a track seen now
-      len = mMaxFramesOutput;
-
-      if( !dropQuickly && selected )
-         len = em.RealtimeProcess(group, chanCnt, tempBufs, len);
+      pending[numPending++] = { group, chanCnt, mMaxFramesOutput,
+         drop, dropQuickly, !dropQuickly && selected };
       group++;
-
-      CallbackCheckCompletion(mCallbackReturn, len);
-      if (dropQuickly) // no samples to process, they've been discarded
-         continue;
-
-      // Our channels aren't silent.  We need to pass their data on.
-      //
-      // Note that there are two kinds of channel count.
-      // c and chanCnt are counting channels in the Tracks.
-      // chan (and numPlayBackChannels) is counting output channels on the device.
-      // chan = 0 is left channel
-      // chan = 1 is right channel.
-      //
-      // Each channel in the tracks can output to more than one channel on the device.
-      // For example mono channels output to both left and right output channels.
-      if (len > 0) for (int c = 0; c < chanCnt; c++)
-      {
-         vt = chans[c];
-
-         if (vt->GetChannelIgnoringPan() == Track::LeftChannel ||
-               vt->GetChannelIgnoringPan() == Track::MonoChannel )
-            AddToOutputChannel( 0, outputMeterFloats, outputFloats, tempFloats, tempBufs[c], drop, len, vt);
-
-         if (vt->GetChannelIgnoringPan() == Track::RightChannel ||
-               vt->GetChannelIgnoringPan() == Track::MonoChannel  )
-            AddToOutputChannel( 1, outputMeterFloats, outputFloats, tempFloats, tempBufs[c], drop, len, vt);
-      }
-
       chanCnt = 0;
+
+      if (numPending == maxPending)
+         flushPending();
    }
+   flushPending();
 
    // Poke: If there are no playback tracks, then the earlier check
    // about the time indicator being past the end won't happen;
@@ -4359,6 +4639,9 @@ int AudioIoCallback::AudioCallback(const void *inputBuffer, void *outputBuffer,
                           const PaStreamCallbackTimeInfo *timeInfo,
                           const PaStreamCallbackFlags statusFlags, void * WXUNUSED(userData) )
 {
+   Profiler::SetThreadName("Audio callback", false);
+   PROFILE_SCOPE("AudioIoCallback::AudioCallback");
+
    mbHasSoloTracks = CountSoloingTracks() > 0 ;
    mCallbackReturn = paContinue;
 
@@ -4434,6 +4717,12 @@ int AudioIoCallback::AudioCallback(const void *inputBuffer, void *outputBuffer,
          outputMeterFloats))
       return mCallbackReturn;
 
+   // Wake the audio thread as soon as there is room for a refill, rather
+   // than letting it poll
+   if (mNumPlaybackChannels > 0 && !mPlaybackTracks.empty() &&
+       GetCommonlyReadyPlayback() <= mPlaybackWakeThreshold)
+      WakeAudioThread();
+
    // To move the cursor onwards.  (uses mMaxFramesOutput)
    UpdateTimePosition(framesPerBuffer);
 
@@ -4490,6 +4779,7 @@ int AudioIoCallback::CallbackDoSeek()
 
    // Reload the ring buffers
    mAudioThreadShouldCallFillBuffersOnce = true;
+   WakeAudioThread();
    while( mAudioThreadShouldCallFillBuffersOnce )
    {
       wxMilliSleep( 50 );
@@ -4497,6 +4787,7 @@ int AudioIoCallback::CallbackDoSeek()
 
    // Reenable the audio thread
    mAudioThreadFillBuffersLoopRunning = true;
+   WakeAudioThread();
 
    return paContinue;
 }
@@ -19,7 +19,10 @@
 
 #include "Experimental.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <utility>
 #include <wx/atomic.h> // member variable
 
@@ -54,10 +57,13 @@ class RingBuffer;
 class Mixer;
 class Resample;
 class AudioThread;
+class ThreadPool;
 class SelectedRegion;
 
 class AudacityProject;
 
+class SampleBlockFactory;
+
 class WaveTrack;
 using WaveTrackArray = std::vector < std::shared_ptr < WaveTrack > >;
 using WaveTrackConstArray = std::vector < std::shared_ptr < const WaveTrack > >;
@@ -68,6 +74,22 @@ typedef int PaError;
 
 bool ValidateDeviceNames();
 
+//! Measurements of the audio thread's refilling of the playback buffers
+struct AudioThreadStatistics
+{
+   //! Passes of the audio thread that refilled playback buffers
+   unsigned long long fills = 0;
+   //! How many of those passes the callback woke, instead of a timeout
+   unsigned long long signalledFills = 0;
+   //! Seconds from the callback's wake request to the start of refilling
+   double meanWakeLatency = 0;
+   double maxWakeLatency = 0;
+   //! Samples produced for each playback track
+   unsigned long long samplesProduced = 0;
+   //! Least seconds of playback queued at the start of any refill
+   double minUnderrunMargin = 0;
+};
+
 #define MAX_MIDI_BUFFER_SIZE 5000
 #define DEFAULT_SYNTH_LATENCY 5
 
@@ -458,6 +480,17 @@ public:
    volatile bool       mAudioThreadFillBuffersLoopRunning;
    volatile bool       mAudioThreadFillBuffersLoopActive;
 
+   /// Let the audio thread wake before its polling interval ends
+   void WakeAudioThread();
+   std::mutex          mAudioThreadMutex;
+   std::condition_variable mAudioThreadCondition;
+   std::atomic<bool>   mAudioThreadWakeRequested{ false };
+   /// When the last wake was requested, in steady_clock ticks
+   std::atomic<long long> mAudioThreadWakeTime{ 0 };
+   /// The callback wakes the audio thread when no more than this many
+   /// samples remain queued, which means FillBuffers has work
+   size_t              mPlaybackWakeThreshold{ 0 };
+
    wxLongLong          mLastPlaybackTimeMillis;
 
 #ifdef EXPERIMENTAL_MIDI_OUT
@@ -615,6 +648,15 @@ public:
    wxLongLong GetLastPlaybackTime() const { return mLastPlaybackTimeMillis; }
    AudacityProject *GetOwningProject() const { return mOwningProject; }
 
+   /** \brief Measurements of refilling for the current or last stream */
+   AudioThreadStatistics GetAudioThreadStatistics() const;
+
+   /** \brief How many threads, including the audio thread, render the
+    * playback tracks in parallel
+    *
+    * Read from preferences; zero there means one per hardware thread */
+   static size_t GetMixerThreadCount();
+
 #ifdef EXPERIMENTAL_MIDI_OUT
    /** \brief Compute the current PortMidi timestamp time.
     *
@@ -744,6 +786,20 @@ private:
                              sampleFormat captureFormat);
    void FillBuffers();
 
+   /** \brief FillBuffers, and update the statistics
+    *
+    * @param signalled whether the callback woke the audio thread */
+   void FillBuffersMeasured(bool signalled);
+
+   mutable std::mutex  mAudioThreadStatisticsMutex;
+   AudioThreadStatistics mAudioThreadStatistics;
+   /// Samples produced for each playback track by FillBuffers; reset by
+   /// the main thread before the audio thread begins the stream
+   std::atomic<unsigned long long> mPlaybackSamplesProduced{ 0 };
+
+   /// Runs the playback mixers of several tracks at once in FillBuffers
+   std::unique_ptr<ThreadPool> mMixerPool;
+
 #ifdef EXPERIMENTAL_MIDI_OUT
    void PrepareMidiIterator(bool send = true, double offset = 0);
    bool StartPortMidiStream();
@@ -788,6 +844,14 @@ private:
      *
      * If bOnlyBuffers is specified, it only cleans up the buffers. */
    void StartStreamCleanup(bool bOnlyBuffers = false);
+
+   /** \brief Keep sample blocks of a looped play region in memory
+     *
+     * So each repetition after the first does not read the database */
+   void PinPlaybackBlocks(double t0, double t1);
+   void UnpinPlaybackBlocks();
+
+   std::shared_ptr<SampleBlockFactory> mpPinnedBlockFactory;
 };
 
 static constexpr unsigned ScrubPollInterval_ms = 50;
@@ -26,9 +26,12 @@ processing.  See also MacrosWindow and ApplyMacroDialog.
 #include <wx/textfile.h>
 #include <wx/time.h>
 
+#include "AudacityException.h"
 #include "Project.h"
 #include "ProjectAudioManager.h"
+#include "ProjectFileManager.h"
 #include "ProjectHistory.h"
+#include "ProjectManager.h"
 #include "ProjectSettings.h"
 #include "ProjectWindow.h"
 #include "commands/CommandManager.h"
@@ -796,6 +799,36 @@ bool MacroCommands::ApplyMacro(
    return true;
 }
 
+bool MacroCommands::ApplyMacroToFile(
+   const MacroCommandsCatalog &catalog, const FilePath &fileName )
+{
+   ProjectFileManager::Get(mProject).Import(fileName);
+   ProjectWindow::Get(mProject).ZoomAfterImport(nullptr);
+   SelectUtilities::DoSelectAll(mProject);
+   return ApplyMacro(catalog);
+}
+
+bool MacroCommands::ApplyMacroToFiles( AudacityProject &project,
+   const wxString &macro, const FilePaths &files )
+{
+   const MacroCommandsCatalog catalog{ &project };
+   MacroCommands commands{ project };
+   if (commands.ReadMacro(macro).empty())
+      return false;
+
+   for (const auto &file : files) {
+      auto success = GuardedCall< bool >( [&]{
+         return commands.ApplyMacroToFile(catalog, file); } );
+
+      // Ensure project is completely reset
+      ProjectManager::Get(project).ResetProjectToEmpty();
+
+      if (!success)
+         return false;
+   }
+   return true;
+}
+
 // AbortBatch() allows a premature terminatation of a batch.
 void MacroCommands::AbortBatch()
 {
@@ -63,6 +63,15 @@ class MacroCommands final {
  public:
    bool ApplyMacro( const MacroCommandsCatalog &catalog,
       const wxString & filename = {});
+   //! Import the file into the empty project, select all, and apply the
+   //! macro last read; the caller resets the project afterward
+   bool ApplyMacroToFile( const MacroCommandsCatalog &catalog,
+      const FilePath &fileName );
+   //! Apply the named macro to each file in turn, in the empty project,
+   //! stopping at the first failure; for a copy of Audacity that another
+   //! started to process part of a batch
+   static bool ApplyMacroToFiles( AudacityProject &project,
+      const wxString &macro, const FilePaths &files );
    static bool HandleTextualCommand( CommandManager &commandManager,
       const CommandID & Str,
       const CommandContext & context, CommandFlag flags, bool alwaysEnabled);
@@ -19,6 +19,12 @@
 
 #include <wx/setup.h> // for wxUSE_* macros
 
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
 #ifdef __WXMSW__
     #include  <wx/ownerdrw.h>
 #endif
@@ -34,12 +40,20 @@
 #include <wx/listctrl.h>
 #include <wx/radiobut.h>
 #include <wx/button.h>
+#include <wx/file.h>
+#include <wx/filename.h>
 #include <wx/imaglist.h>
+#include <wx/log.h>
+#include <wx/process.h>
 #include <wx/settings.h>
+#include <wx/spinctrl.h>
+#include <wx/utils.h>
 
 #include "ShuttleGui.h"
 #include "Menus.h"
+#include "PlatformCompatibility.h"
 #include "Prefs.h"
+#include "Profiler.h"
 #include "Project.h"
 #include "ProjectFileManager.h"
 #include "ProjectHistory.h"
@@ -65,6 +79,12 @@
 #include "widgets/WindowAccessible.h"
 #endif
 
+namespace {
+// Above one, each file is processed in another copy of Audacity
+const auto ConcurrentFilesKey = wxT("/Batch/ConcurrentFiles");
+enum : int { MaxConcurrentFiles = 32 };
+}
+
 #define MacrosListID       7001
 #define CommandsListID     7002
 #define ApplyToProjectID   7003
@@ -162,6 +182,8 @@ void ApplyMacroDialog::PopulateOrExchange(ShuttleGui &S)
       // so that name can be set on a standard control
       btn->SetAccessible(safenew WindowAccessible(btn));
 #endif
+      mConcurrency = S.AddSpinCtrl( XXO("&At once:"),
+         gPrefs->Read(ConcurrentFilesKey, 1L), MaxConcurrentFiles, 1 );
    }
    S.EndHorizontalLay();
 
@@ -317,6 +339,204 @@ void ApplyMacroDialog::ApplyMacroToProject( int iMacro, bool bHasGui )
    Raise();
 }
 
+namespace {
+
+//! Reads the next few files of a batch on another thread, so that the disk
+//! or network is busy while the main thread applies the macro, and import
+//! then finds the files in the system's cache
+class FileReadAhead
+{
+public:
+   FileReadAhead(const wxArrayString &files, size_t lookAhead)
+      : mFiles{ files }
+      , mLookAhead{ lookAhead }
+   {
+      mThread = std::thread{ [this]{ Read(); } };
+   }
+
+   ~FileReadAhead()
+   {
+      {
+         std::lock_guard<std::mutex> lock{ mMutex };
+         mStop = true;
+      }
+      mChanged.notify_one();
+      mThread.join();
+   }
+
+   //! The main thread begins the file at index; read no further than
+   //! lookAhead files past it
+   void Advance(size_t index)
+   {
+      {
+         std::lock_guard<std::mutex> lock{ mMutex };
+         mCurrent = index;
+      }
+      mChanged.notify_one();
+   }
+
+private:
+   void Read()
+   {
+      Profiler::SetThreadName("Batch read-ahead");
+
+      // Contents are discarded; only the cached pages matter
+      enum : size_t { BufferSize = 1 << 20 };
+      ArrayOf<char> buffer{ BufferSize };
+
+      for (size_t ii = 0; ii < mFiles.size(); ++ii) {
+         {
+            std::unique_lock<std::mutex> lock{ mMutex };
+            mChanged.wait(lock, [&]{
+               return mStop || ii <= mCurrent + mLookAhead; });
+            if (mStop)
+               return;
+            if (ii < mCurrent)
+               // Too late to help
+               continue;
+         }
+
+         wxLogNull noLog;
+         wxFile file;
+         if (!file.Open(mFiles[ii]))
+            continue;
+         PROFILE_SCOPE("FileReadAhead::Read");
+         while (file.Read(buffer.get(), BufferSize) > 0) {
+            std::lock_guard<std::mutex> lock{ mMutex };
+            if (mStop)
+               return;
+         }
+      }
+   }
+
+   const wxArrayString &mFiles;
+   const size_t mLookAhead;
+   std::thread mThread;
+
+   std::mutex mMutex;
+   std::condition_variable mChanged;
+   // These are guarded by mMutex
+   size_t mCurrent{ 0 };
+   bool mStop{ false };
+};
+
+//! Another copy of Audacity, applying the macro to one file of the batch
+class BatchProcess final : public wxProcess
+{
+public:
+   bool IsActive() const { return mActive; }
+   int GetStatus() const { return mStatus; }
+
+   void OnTerminate(int WXUNUSED( pid ), int status) override
+   {
+      mStatus = status;
+      mActive = false;
+   }
+
+private:
+   bool mActive{ true };
+   int mStatus{ -1 };
+};
+
+using BatchClock = std::chrono::steady_clock;
+using BatchReport =
+   std::function< void(size_t index, bool success, BatchClock::duration) >;
+
+//! Apply the macro to the files in other copies of Audacity, up to
+//! concurrency at once, each with its own project, temporary files and
+//! settings, so no file's processing can affect another's
+/*! Like the serial loop, this starts no more files after a failure or
+ cancellation.  Files are reported in the order of the list, whatever order
+ they finish in. */
+void ApplyMacroInProcesses( const wxString &macro,
+   const wxArrayString &files, size_t concurrency, wxListCtrl &fileList,
+   const std::function< bool() > &cancelled, const BatchReport &report )
+{
+   struct Job {
+      std::unique_ptr< BatchProcess > process;
+      wxString dir;
+      BatchClock::time_point start;
+      BatchClock::duration duration{};
+      bool done{ false };
+      bool success{ false };
+   };
+   std::vector< Job > jobs( files.size() );
+
+   const auto &exePath = PlatformCompatibility::GetExecutablePath();
+   const auto tempDir = FileNames::TempDir();
+   const auto pid = wxGetProcessId();
+
+   const auto finish = [&](size_t index, bool success){
+      auto &job = jobs[index];
+      job.done = true;
+      job.success = success;
+      job.duration = BatchClock::now() - job.start;
+      fileList.SetItemImage(index, 0, 0);
+      wxFileName::Rmdir(job.dir, wxPATH_RMDIR_RECURSIVE);
+   };
+
+   size_t next = 0, reported = 0, running = 0;
+   bool stop = false;
+   while (reported < next || (!stop && next < files.size())) {
+      while (!stop && running < concurrency && next < files.size()) {
+         auto &job = jobs[next];
+         job.dir = wxFileName( tempDir,
+            wxString::Format( wxT("batch-%lu-%d"), pid, (int)next ) )
+               .GetFullPath();
+         wxFileName::Mkdir(job.dir, 0755, wxPATH_MKDIR_FULL);
+
+         // "--" so that a file name may begin with a dash
+         const wxString args[] = { exePath,
+            wxT("--isolated"), job.dir, wxT("--batch-macro"), macro,
+            wxT("--"), files[next] };
+         std::vector< const wchar_t* > argv;
+         for (const auto &arg : args)
+            argv.push_back( arg.wc_str() );
+         argv.push_back( nullptr );
+
+         job.process = std::make_unique< BatchProcess >();
+         job.start = BatchClock::now();
+         if (wxExecute( argv.data(), wxEXEC_ASYNC, job.process.get() ) == 0) {
+            finish(next, false);
+            stop = true;
+         }
+         else {
+            ++running;
+            fileList.SetItemImage(next, 1, 1);
+            fileList.EnsureVisible(next);
+         }
+         ++next;
+      }
+
+      wxMilliSleep(10);
+      wxTheApp->Yield();
+
+      for (size_t ii = reported; ii < next; ++ii) {
+         auto &job = jobs[ii];
+         if (!job.done && !job.process->IsActive()) {
+            --running;
+            finish(ii, job.process->GetStatus() == 0);
+            if (!job.success)
+               stop = true;
+         }
+      }
+
+      // One line per file, in the order of the list
+      for (; reported < next && jobs[reported].done; ++reported)
+         report(reported,
+            jobs[reported].success, jobs[reported].duration);
+
+      if (!stop && cancelled()) {
+         stop = true;
+         for (size_t ii = reported; ii < next; ++ii)
+            if (!jobs[ii].done)
+               wxProcess::Kill(jobs[ii].process->GetPid(), wxSIGTERM);
+      }
+   }
+}
+
+}
+
 void ApplyMacroDialog::OnApplyToFiles(wxCommandEvent & WXUNUSED(event))
 {
    long item = mMacros->GetNextItem(-1,
@@ -328,7 +548,11 @@ void ApplyMacroDialog::OnApplyToFiles(wxCommandEvent & WXUNUSED(event))
    }
 
    wxString name = mMacros->GetItemText(item);
+   const size_t concurrency = mConcurrency ? mConcurrency->GetValue() : 1;
    gPrefs->Write(wxT("/Batch/ActiveMacro"), name);
+   gPrefs->Write(ConcurrentFilesKey, (long)concurrency);
+   // Other copies of Audacity that process the files begin with these
+   // settings
    gPrefs->Flush();
 
    AudacityProject *project = &mProject;
@@ -434,33 +658,78 @@ void ApplyMacroDialog::OnApplyToFiles(wxCommandEvent & WXUNUSED(event))
    mMacroCommands.ReadMacro(name); 
    {
       wxWindowDisabler wd(&activityWin);
-      for (i = 0; i < (int)files.size(); i++) {
-         if (i > 0) {
-            //Clear the arrow in previous item.
-            fileList->SetItemImage(i - 1, 0, 0);
+
+      const auto seconds = [](BatchClock::duration duration){
+         return std::chrono::duration<double>(duration).count(); };
+      const auto batchStart = BatchClock::now();
+      wxULongLong totalBytes = 0;
+      int processed = 0;
+
+      wxLogMessage(wxT("Applying macro '%s' to %d files, %d at once"),
+         name, (int)files.size(), (int)concurrency);
+
+      const auto report = [&](size_t index, bool success,
+         BatchClock::duration duration){
+         // One line per file, in the order of the list
+         wxLogMessage(wxT("%d/%d %s: %s in %.2f s"),
+            (int)index + 1, (int)files.size(), files[index],
+            success ? wxT("done") : wxT("stopped"),
+            seconds(duration));
+
+         if (success) {
+            ++processed;
+            const auto size = wxFileName::GetSize(files[index]);
+            if (size != wxInvalidSize)
+               totalBytes += size;
          }
-         fileList->SetItemImage(i, 1, 1);
-         fileList->EnsureVisible(i);
+      };
+
+      if (concurrency > 1)
+         ApplyMacroInProcesses( name, files, concurrency, *fileList,
+            [&]{ return !activityWin.IsShown() || mAbort; }, report );
+      else {
+         // The macro runs on the main thread, against this project; but
+         // reading of later files can overlap it
+         FileReadAhead readAhead{ files, 2 };
+
+         for (i = 0; i < (int)files.size(); i++) {
+            if (i > 0) {
+               //Clear the arrow in previous item.
+               fileList->SetItemImage(i - 1, 0, 0);
+            }
+            fileList->SetItemImage(i, 1, 1);
+            fileList->EnsureVisible(i);
+
+            readAhead.Advance(i);
+            const auto fileStart = BatchClock::now();
 
-         auto success = GuardedCall< bool >([&] {
-            ProjectFileManager::Get(*project).Import(files[i]);
-            ProjectWindow::Get(*project).ZoomAfterImport(nullptr);
-            SelectUtilities::DoSelectAll(*project);
-            if (!mMacroCommands.ApplyMacro(mCatalog))
-               return false;
+            auto success = GuardedCall< bool >([&] {
+               if (!mMacroCommands.ApplyMacroToFile(mCatalog, files[i]))
+                  return false;
 
-            if (!activityWin.IsShown() || mAbort)
-               return false;
+               if (!activityWin.IsShown() || mAbort)
+                  return false;
 
-            return true;
-         });
+               return true;
+            });
 
-         // Ensure project is completely reset
-         ProjectManager::Get(*project).ResetProjectToEmpty();
+            // Ensure project is completely reset
+            ProjectManager::Get(*project).ResetProjectToEmpty();
 
-         if (!success)
-            break;
+            report(i, success, BatchClock::now() - fileStart);
+
+            if (!success)
+               break;
+         }
       }
+
+      const auto elapsed = seconds(BatchClock::now() - batchStart);
+      wxLogMessage(
+         wxT("Processed %d of %d files, %.1f MB, in %.1f s: %.2f files/min, %.2f MB/s"),
+         processed, (int)files.size(), totalBytes.ToDouble() / 1048576,
+         elapsed,
+         elapsed > 0 ? processed * 60 / elapsed : 0.0,
+         elapsed > 0 ? totalBytes.ToDouble() / 1048576 / elapsed : 0.0);
    }
 
    Show();
@@ -671,6 +940,8 @@ void MacrosWindow::PopulateOrExchange(ShuttleGui & S)
       // so that name can be set on a standard control
       btn->SetAccessible(safenew WindowAccessible(btn));
 #endif
+      mConcurrency = S.AddSpinCtrl( XXO("&At once:"),
+         gPrefs->Read(ConcurrentFilesKey, 1L), MaxConcurrentFiles, 1 );
       S.AddSpace( 10,10,1 );
       // Bug 2524 OK button does much the same as cancel, so remove it.
       // OnCancel prompts you if there has been a change.
@@ -21,6 +21,7 @@ class wxTextCtrl;
 class wxListCtrl;
 class wxListEvent;
 class wxButton;
+class wxSpinCtrl;
 class wxTextCtrl;
 class AudacityProject;
 class ShuttleGui;
@@ -53,6 +54,7 @@ class ApplyMacroDialog : public wxDialogWrapper {
    wxListCtrl *mMacros;
    MacroCommands mMacroCommands; /// Provides list of available commands.
 
+   wxSpinCtrl *mConcurrency{};   /// How many files to process at once
    wxButton *mResize;
    wxButton *mOK;
    wxButton *mCancel;
@@ -18,6 +18,12 @@ of sample block storage.
 #include "Audacity.h"
 #include "Benchmark.h"
 
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <wx/app.h>
 #include <wx/log.h>
 #include <wx/textctrl.h>
@@ -25,20 +31,29 @@ of sample block storage.
 #include <wx/checkbox.h>
 #include <wx/choice.h>
 #include <wx/dialog.h>
+#include <wx/ffile.h>
 #include <wx/sizer.h>
 #include <wx/stattext.h>
 #include <wx/timer.h>
 #include <wx/utils.h>
 #include <wx/valgen.h>
 #include <wx/valtext.h>
+#include <wx/wxcrtvararg.h>
 #include <wx/intl.h>
 
+#include "AudioIO.h"
+#include "Internat.h"
+#include "Mix.h"
+#include "RealFFTf.h"
+#include "effects/Effect.h"
+#include "effects/RealtimeEffectManager.h"
 #include "SampleBlock.h"
 #include "ShuttleGui.h"
 #include "Project.h"
 #include "WaveClip.h"
 #include "WaveTrack.h"
 #include "Sequence.h"
+#include "ThreadPool.h"
 #include "Prefs.h"
 #include "ProjectSettings.h"
 #include "ViewInfo.h"
@@ -571,6 +586,10 @@ void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
    Printf( XO("At 44100 Hz, %d bytes per sample, the estimated number of\n simultaneous tracks that could be played at once: %.1f\n" )
       .Format( SAMPLE_SIZE(SampleFormat), (nChunks*chunkSize/44100.0)/(elapsed/1000.0) ) );
 
+   Printf( XO("Playback renders tracks on %d threads (%d hardware threads available).\n" )
+      .Format( (int)AudioIO::GetMixerThreadCount(),
+         (int)ThreadPool::HardwareThreadCount() ) );
+
    goto success;
 
  fail:
@@ -581,3 +600,450 @@ void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
    Printf( XO("Benchmark completed successfully.\n") );
    HoldPrint(false);
 }
+
+//
+// Headless benchmark suite
+//
+
+namespace {
+
+//! Collects timings, and writes them as JSON for comparison between builds
+class BenchmarkResults
+{
+public:
+   using Parameters =
+      std::initializer_list< std::pair< const char*, double > >;
+
+   //! Time one call of the function, which processes the given number of
+   //! samples (or other items), and record it under the name
+   template< typename Function >
+   void Measure( const char *name, Parameters parameters,
+      double items, const Function &function )
+   {
+      using Clock = std::chrono::steady_clock;
+      const auto start = Clock::now();
+      function();
+      const std::chrono::duration<double, std::milli> elapsed =
+         Clock::now() - start;
+      Record( name, parameters, items, elapsed.count() );
+   }
+
+   //! Record a result timed by the caller, whose parameters may include
+   //! counts known only after the run
+   void Record( const char *name, Parameters parameters,
+      double items, double milliseconds )
+   {
+      mResults.push_back(
+         { name, { parameters.begin(), parameters.end() },
+           items, milliseconds } );
+   }
+
+   wxString ToJSON() const;
+
+private:
+   struct Result {
+      std::string name;
+      std::vector< std::pair< std::string, double > > parameters;
+      double items;
+      double milliseconds;
+   };
+   std::vector< Result > mResults;
+};
+
+wxString BenchmarkResults::ToJSON() const
+{
+   // Always use the dot for the decimal separator, whatever the locale
+   const auto number = [](double value){
+      return Internat::ToString( value, 3 ); };
+
+   wxString json;
+   json << wxT("{\n  \"version\": \"") << AUDACITY_VERSION_STRING
+      << wxT("\",\n  \"results\": [");
+   const char *separator = "";
+   for (const auto &result : mResults) {
+      json << separator << wxT("\n    { \"name\": \"") << result.name.c_str()
+         << wxT("\"");
+      for (const auto &parameter : result.parameters)
+         json << wxT(", \"") << parameter.first.c_str() << wxT("\": ")
+            << number( parameter.second );
+      json << wxT(", \"milliseconds\": ") << number( result.milliseconds );
+      if (result.milliseconds > 0)
+         json << wxT(", \"itemsPerSecond\": ")
+            << number( 1000.0 * result.items / result.milliseconds );
+      json << wxT(" }");
+      separator = ",";
+   }
+   json << wxT("\n  ]\n}\n");
+   return json;
+}
+
+using BenchmarkSample = float;
+const auto BenchmarkFormat = floatSample;
+const double BenchmarkRate = 44100.0;
+
+ArrayOf<BenchmarkSample> RandomSamples( size_t len )
+{
+   ArrayOf<BenchmarkSample> samples{ len };
+   for (size_t ii = 0; ii < len; ++ii)
+      samples[ii] = (rand() % 65536) / 32768.0f - 1.0f;
+   return samples;
+}
+
+void BenchmarkSequence( BenchmarkResults &results,
+   const SampleBlockFactoryPtr &pFactory )
+{
+   const size_t appendLen = 1 << 16;
+   const size_t nAppends = 256; // 64 MB of float samples
+   const auto data = RandomSamples( appendLen );
+
+   Sequence sequence{ pFactory, BenchmarkFormat };
+   results.Measure( "Sequence::Append",
+      { { "appends", nAppends }, { "samples", appendLen } },
+      nAppends * appendLen, [&]{
+         for (size_t ii = 0; ii < nAppends; ++ii)
+            sequence.Append(
+               (samplePtr)data.get(), BenchmarkFormat, appendLen );
+   } );
+
+   // Edits are at pseudo-random positions that straddle block boundaries
+   const int nEdits = 200;
+   const size_t editLen = 12345;
+   results.Measure( "Sequence::Copy+Paste", { { "edits", nEdits } },
+      nEdits, [&]{
+         for (int ii = 0; ii < nEdits; ++ii) {
+            const auto len = sequence.GetNumSamples();
+            const sampleCount s0 = rand() % (len - editLen).as_long_long();
+            const sampleCount s1 = rand() % len.as_long_long();
+            const auto copy =
+               sequence.Copy( pFactory, s0, s0 + editLen );
+            sequence.Paste( s1, copy.get() );
+         }
+   } );
+   results.Measure( "Sequence::Delete", { { "edits", nEdits } },
+      nEdits, [&]{
+         for (int ii = 0; ii < nEdits; ++ii) {
+            const auto len = sequence.GetNumSamples();
+            const sampleCount s0 = rand() % (len - editLen).as_long_long();
+            sequence.Delete( s0, editLen );
+         }
+   } );
+
+   // Wave display from summaries, when zoomed out, and from samples, when
+   // zoomed in
+   const size_t columns = 1000;
+   Floats min{ columns }, max{ columns }, rms{ columns };
+   ArrayOf<int> bl{ columns };
+   ArrayOf<sampleCount> where{ columns + 1 };
+   for (auto samplesPerColumn :
+      { sequence.GetNumSamples().as_double() / columns, 256.0, 4.0 }) {
+      for (size_t ii = 0; ii <= columns; ++ii)
+         where[ii] = sampleCount( ii * samplesPerColumn );
+      const int repeats = 20;
+      results.Measure( "Sequence::GetWaveDisplay",
+         { { "columns", columns }, { "samplesPerColumn", samplesPerColumn },
+           { "repeats", repeats } },
+         repeats * columns, [&]{
+            for (int ii = 0; ii < repeats; ++ii)
+               sequence.GetWaveDisplay( min.get(), max.get(), rms.get(),
+                  bl.get(), columns, where.get() );
+      } );
+   }
+}
+
+void BenchmarkSampleBlocks( BenchmarkResults &results,
+   const SampleBlockFactoryPtr &pFactory )
+{
+   const auto blockLen =
+      Sequence::GetMaxDiskBlockSize() / sizeof(BenchmarkSample);
+   // Small enough to fit in the default cache of sample blocks
+   const size_t nBlocks = 32;
+   const auto data = RandomSamples( blockLen );
+
+   std::vector< SampleBlockPtr > blocks;
+   results.Measure( "SqliteSampleBlock::Commit",
+      { { "blocks", nBlocks }, { "samples", blockLen } },
+      nBlocks * blockLen, [&]{
+         for (size_t ii = 0; ii < nBlocks; ++ii)
+            blocks.push_back( pFactory->Create(
+               (samplePtr)data.get(), blockLen, BenchmarkFormat ) );
+   } );
+   blocks.clear();
+
+   results.Measure( "SqliteSampleBlock::Commit (batched)",
+      { { "blocks", nBlocks }, { "samples", blockLen } },
+      nBlocks * blockLen, [&]{
+         auto batch = pFactory->BeginBatch();
+         for (size_t ii = 0; ii < nBlocks; ++ii)
+            blocks.push_back( pFactory->Create(
+               (samplePtr)data.get(), blockLen, BenchmarkFormat ) );
+   } );
+
+   // The first pass reads the database, the second the cache
+   ArrayOf<BenchmarkSample> buffer{ blockLen };
+   for (auto name : { "SqliteSampleBlock::GetSamples (database)",
+                      "SqliteSampleBlock::GetSamples (cache)" })
+      results.Measure( name,
+         { { "blocks", nBlocks }, { "samples", blockLen } },
+         nBlocks * blockLen, [&]{
+            for (const auto &pBlock : blocks)
+               pBlock->GetSamples(
+                  (samplePtr)buffer.get(), BenchmarkFormat, 0, blockLen );
+      } );
+}
+
+void BenchmarkLongImport( BenchmarkResults &results,
+   const SampleBlockFactoryPtr &pFactory, const ProjectSettings &settings )
+{
+   // Append as the importers do, one read at a time, in one batch, for a
+   // mono recording of a few hours in 32-bit float
+   const double hours = 2.0;
+   const auto totalLen = sampleCount( hours * 3600 * BenchmarkRate );
+
+   WaveTrackFactory trackFactory{ settings, pFactory };
+   auto pTrack = trackFactory.NewWaveTrack( BenchmarkFormat, BenchmarkRate );
+   const auto readLen = pTrack->GetMaxBlockSize();
+   const auto data = RandomSamples( readLen );
+
+   using Clock = std::chrono::steady_clock;
+   const auto start = Clock::now();
+   {
+      auto batch = pFactory->BeginBatch();
+      for (sampleCount done = 0; done < totalLen;) {
+         const auto len = limitSampleBufferSize( readLen, totalLen - done );
+         pTrack->Append( (samplePtr)data.get(), BenchmarkFormat, len );
+         done += len;
+      }
+      pTrack->Flush();
+   }
+   const std::chrono::duration<double, std::milli> elapsed =
+      Clock::now() - start;
+
+   size_t nBlocks = 0;
+   for (const auto &pClip : pTrack->GetClips())
+      nBlocks += pClip->GetSequenceBlockArray()->size();
+
+   // Items are blocks, so the JSON rate is blocks per second
+   results.Record( "WaveTrack::Append (long import)",
+      { { "hours", hours }, { "samples", totalLen.as_double() },
+        { "blocks", nBlocks } },
+      nBlocks, elapsed.count() );
+}
+
+void BenchmarkMixer( BenchmarkResults &results,
+   const SampleBlockFactoryPtr &pFactory, const ProjectSettings &settings )
+{
+   const double duration = 5.0;
+   const auto trackLen = size_t( duration * BenchmarkRate );
+   const auto data = RandomSamples( trackLen );
+
+   WaveTrackFactory trackFactory{ settings, pFactory };
+   std::vector< std::shared_ptr< WaveTrack > > tracks;
+   for (auto nTracks : { 1, 4, 16, 64 }) {
+      while (tracks.size() < size_t( nTracks )) {
+         auto pTrack =
+            trackFactory.NewWaveTrack( BenchmarkFormat, BenchmarkRate );
+         pTrack->Append( (samplePtr)data.get(), BenchmarkFormat, trackLen );
+         pTrack->Flush();
+         tracks.push_back( pTrack );
+      }
+
+      const WaveTrackConstArray inputs{ tracks.begin(), tracks.end() };
+      const size_t bufferSize = 4096;
+      for (auto highQuality : { false, true }) {
+         // Resample too, as playback at another rate would
+         for (auto outRate : { BenchmarkRate, 48000.0 }) {
+            Mixer mixer{ inputs, true, Mixer::WarpOptions{ nullptr },
+               0.0, duration, 2, bufferSize, false,
+               outRate, BenchmarkFormat, highQuality };
+            results.Measure( "Mixer::Process",
+               { { "tracks", nTracks }, { "rate", outRate },
+                 { "highQuality", highQuality } },
+               nTracks * trackLen, [&]{
+                  while (mixer.Process( bufferSize ) > 0)
+                     ;
+            } );
+         }
+      }
+   }
+}
+
+//! Time the transform with each kernel that this processor supports, and
+//! check that every kernel gives the same results as the scalar code
+/*! @return whether they were all the same */
+bool BenchmarkFFT( BenchmarkResults &results )
+{
+   bool same = true;
+   const auto best = BestFFTKernel();
+   // Every power of two size that the spectrum and spectrogram code uses
+   for (size_t size = 8; size <= 65536; size *= 2) {
+      const auto hFFT = GetFFT( size );
+      const auto input = RandomSamples( size );
+      Floats expected{ size }, expectedInverse{ size };
+      std::copy( input.get(), input.get() + size, expected.get() );
+      std::copy( input.get(), input.get() + size, expectedInverse.get() );
+      RealFFTf( expected.get(), hFFT.get(), FFTKernel::Scalar );
+      InverseRealFFTf( expectedInverse.get(), hFFT.get(), FFTKernel::Scalar );
+
+      auto buffer = RandomSamples( size );
+      // Do about the same amount of work for each size
+      const auto repeats = std::max< size_t >( 16, (1 << 24) / size );
+      for (int kernel = 0; kernel <= int( best ); ++kernel) {
+         const auto fftKernel = FFTKernel( kernel );
+         std::copy( input.get(), input.get() + size, buffer.get() );
+         RealFFTf( buffer.get(), hFFT.get(), fftKernel );
+         if (!std::equal( buffer.get(), buffer.get() + size, expected.get() )) {
+            wxFprintf( stderr, "RealFFTf (%s) differs from scalar, size %d\n",
+               FFTKernelName( fftKernel ), (int)size );
+            same = false;
+         }
+         std::copy( input.get(), input.get() + size, buffer.get() );
+         InverseRealFFTf( buffer.get(), hFFT.get(), fftKernel );
+         if (!std::equal(
+            buffer.get(), buffer.get() + size, expectedInverse.get() )) {
+            wxFprintf( stderr,
+               "InverseRealFFTf (%s) differs from scalar, size %d\n",
+               FFTKernelName( fftKernel ), (int)size );
+            same = false;
+         }
+
+         const std::string name =
+            std::string{ "RealFFTf (" } + FFTKernelName( fftKernel ) + ")";
+         results.Measure( name.c_str(),
+            { { "size", size }, { "repeats", repeats } },
+            repeats * size, [&]{
+               for (size_t ii = 0; ii < repeats; ++ii)
+                  RealFFTf( buffer.get(), hFFT.get(), fftKernel );
+         } );
+      }
+   }
+   return same;
+}
+
+//! Pass-through effect that notices being processed after its removal
+class BenchmarkRealtimeEffect final : public Effect
+{
+public:
+   explicit BenchmarkRealtimeEffect( std::atomic<bool> &reclaimedLate )
+      : mReclaimedLate{ reclaimedLate }
+   {}
+
+   unsigned GetAudioInCount() override { return 1; }
+   unsigned GetAudioOutCount() override { return 1; }
+
+   size_t RealtimeProcess( int, float **inbuf, float **outbuf,
+      size_t numSamples ) override
+   {
+      // The removing thread sets the flag only after RealtimeRemoveEffect
+      // returns, when the audio thread should have let go of the effect
+      if (removed.load( std::memory_order_acquire ))
+         mReclaimedLate.store( true, std::memory_order_relaxed );
+      std::copy( inbuf[0], inbuf[0] + numSamples, outbuf[0] );
+      return numSamples;
+   }
+
+   std::atomic<bool> removed{ false };
+
+private:
+   std::atomic<bool> &mReclaimedLate;
+};
+
+bool BenchmarkRealtimeEffects( BenchmarkResults &results )
+{
+   // The test plays the part of the audio thread, so there must be no other
+   auto &manager = RealtimeEffectManager::Get();
+   if (AudioIO::Get()->IsBusy() || manager.RealtimeIsActive())
+      return true;
+
+   const size_t cycles = 200;
+   const size_t persistent = 2;
+   const size_t blockSize = 256;
+   const auto blockDuration = std::chrono::duration_cast<
+      std::chrono::steady_clock::duration >(
+         std::chrono::duration<double>( blockSize / BenchmarkRate ) );
+
+   // Effects outlive the test, so that a late call into a removed one
+   // touches only memory that is still valid
+   std::atomic<bool> reclaimedLate{ false };
+   std::vector< std::unique_ptr< BenchmarkRealtimeEffect > > effects;
+   for (size_t ii = 0; ii < persistent + cycles; ++ii)
+      effects.push_back(
+         std::make_unique< BenchmarkRealtimeEffect >( reclaimedLate ) );
+
+   manager.RealtimeInitialize( BenchmarkRate );
+   manager.RealtimeAddProcessor( 0, 1, BenchmarkRate );
+   for (size_t ii = 0; ii < persistent; ++ii)
+      manager.RealtimeAddEffect( effects[ii].get() );
+
+   // Simulated audio callbacks, paced as the device would call them
+   std::atomic<bool> done{ false };
+   size_t callbacks = 0;
+   std::thread audioThread{ [&]{
+      Floats buffer{ blockSize };
+      std::fill( buffer.get(), buffer.get() + blockSize, 0.0f );
+      float *buffers[] = { buffer.get() };
+      auto next = std::chrono::steady_clock::now();
+      while (!done.load( std::memory_order_acquire )) {
+         manager.RealtimeProcessStart();
+         manager.RealtimeProcess( 0, 1, buffers, blockSize );
+         manager.RealtimeProcessEnd();
+         ++callbacks;
+         next += blockDuration;
+         std::this_thread::sleep_until( next );
+      }
+   } };
+
+   using Clock = std::chrono::steady_clock;
+   const auto start = Clock::now();
+   for (size_t ii = persistent; ii < persistent + cycles; ++ii) {
+      auto &effect = *effects[ii];
+      manager.RealtimeAddEffect( &effect );
+      manager.RealtimeRemoveEffect( &effect );
+      effect.removed.store( true, std::memory_order_release );
+   }
+   const std::chrono::duration<double, std::milli> elapsed =
+      Clock::now() - start;
+
+   done.store( true, std::memory_order_release );
+   audioThread.join();
+   const auto misses = manager.GetRealtimeDeadlineMisses();
+
+   for (size_t ii = 0; ii < persistent; ++ii)
+      manager.RealtimeRemoveEffect( effects[ii].get() );
+   manager.RealtimeFinalize();
+
+   results.Record( "RealtimeEffectManager add and remove",
+      { { "cycles", cycles }, { "callbacks", callbacks },
+        { "deadline misses", misses } },
+      cycles, elapsed.count() );
+
+   const bool safe = !reclaimedLate.load( std::memory_order_relaxed );
+   if (!safe)
+      wxFprintf( stderr,
+         "A removed realtime effect was processed after its removal\n" );
+   return safe;
+}
+
+bool RunHeadlessBenchmark(
+   AudacityProject &project, const wxString &outputPath )
+{
+   // Reproducible data and edits
+   srand( 1 );
+
+   BenchmarkResults results;
+   const auto pFactory = SampleBlockFactory::New( project );
+
+   bool success = GuardedCall< bool >( [&]{
+      BenchmarkSequence( results, pFactory );
+      BenchmarkSampleBlocks( results, pFactory );
+      BenchmarkLongImport(
+         results, pFactory, ProjectSettings::Get( project ) );
+      BenchmarkMixer( results, pFactory, ProjectSettings::Get( project ) );
+      const bool fftSame = BenchmarkFFT( results );
+      return BenchmarkRealtimeEffects( results ) && fftSame;
+   }, MakeSimpleGuard( false ) );
+
+   wxFFile file( outputPath, wxT("w") );
+   if (!file.IsOpened() || !file.Write( results.ToJSON() ))
+      success = false;
+   return success;
+}
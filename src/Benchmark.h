@@ -12,7 +12,19 @@
 #define __AUDACITY_BENCHMARK__
 
 class AudacityProject;
+class wxString;
 
 void RunBenchmark( wxWindow *parent, AudacityProject &project );
 
+//! Time Sequence editing and display, sample block storage, long imports,
+//! mixing and FFT, without any user interface, and write the results to a
+//! JSON file
+/*! This runs inside the application, for the --benchmark option, so it
+    still needs wxWidgets initialized and a display, though it shows no
+    window */
+/*! @return whether all benchmarks ran, the vectorized FFT kernels agreed
+    with the scalar code, and the file was written */
+bool RunHeadlessBenchmark(
+   AudacityProject &project, const wxString &outputPath );
+
 #endif // define __AUDACITY_BENCHMARK__
@@ -13,6 +13,8 @@ Paul Licameli -- split from ProjectFileIO.cpp
 
 #include "sqlite3.h"
 
+#include <set>
+
 #include <wx/progdlg.h>
 #include <wx/string.h>
 
@@ -34,6 +36,41 @@ static const char *FastConfig =
    "PRAGMA <schema>.synchronous = OFF;"
    "PRAGMA <schema>.journal_mode = OFF;";
 
+namespace {
+
+//! Connections whose statements exiting threads must finalize
+struct OpenConnections
+{
+   std::mutex mutex;
+   std::set<DBConnection*> connections;
+};
+
+OpenConnections &GetOpenConnections()
+{
+   static OpenConnections openConnections;
+   return openConnections;
+}
+
+std::atomic<unsigned long long> sNextThreadKey{ 1 };
+
+}
+
+//! Owned by each thread that prepares statements
+struct DBConnection::ThreadStatements
+{
+   ~ThreadStatements()
+   {
+      auto &open = GetOpenConnections();
+      std::lock_guard<std::mutex> lock{ open.mutex };
+      for (auto pConnection : open.connections)
+         pConnection->FinalizeStatements(key);
+   }
+
+   const unsigned long long key{ sNextThreadKey++ };
+};
+
+thread_local DBConnection::ThreadStatements DBConnection::sThreadStatements;
+
 DBConnection::DBConnection(const std::weak_ptr<AudacityProject> &pProject)
 :  mpProject{ pProject }
 {
@@ -105,6 +142,12 @@ bool DBConnection::Open(const char *fileName)
    // Install our checkpoint hook
    sqlite3_wal_hook(mDB, CheckpointHook, this);
 
+   {
+      auto &open = GetOpenConnections();
+      std::lock_guard<std::mutex> lock{ open.mutex };
+      open.connections.insert(this);
+   }
+
    return mDB;
 }
 
@@ -160,12 +203,23 @@ bool DBConnection::Close()
    // And wait for it to do so
    mCheckpointThread.join();
 
+   // Exiting threads no longer need to finalize statements here.  This
+   // waits for any thread that is doing so now.
+   {
+      auto &open = GetOpenConnections();
+      std::lock_guard<std::mutex> lock{ open.mutex };
+      open.connections.erase(this);
+   }
+
    // We're done with the prepared statements
-   for (auto stmt : mStatements)
    {
-      sqlite3_finalize(stmt.second);
+      std::lock_guard<std::mutex> guard(mStatementMutex);
+      for (auto stmt : mStatements)
+      {
+         sqlite3_finalize(stmt.second);
+      }
+      mStatements.clear();
    }
-   mStatements.clear();
 
    // Close the DB
    rc = sqlite3_close(mDB);
@@ -240,10 +294,15 @@ const wxString DBConnection::GetLastMessage() const
 
 sqlite3_stmt *DBConnection::Prepare(enum StatementID id, const char *sql)
 {
+   std::lock_guard<std::mutex> guard(mStatementMutex);
+
    int rc;
+   // A prepared statement must not be used by two threads at once, so the
+   // cache is keyed by thread too
+   StatementIndex ndx(id, sThreadStatements.key);
 
    // Return an existing statement if it's already been prepared
-   auto iter = mStatements.find(id);
+   auto iter = mStatements.find(ndx);
    if (iter != mStatements.end())
    {
       return iter->second;
@@ -259,15 +318,32 @@ sqlite3_stmt *DBConnection::Prepare(enum StatementID id, const char *sql)
    }
 
    // And remember it
-   mStatements.insert({id, stmt});
+   mStatements.insert({ndx, stmt});
 
    return stmt;
 }
 
+void DBConnection::FinalizeStatements(unsigned long long threadKey)
+{
+   std::lock_guard<std::mutex> guard(mStatementMutex);
+   for (auto iter = mStatements.begin(); iter != mStatements.end();)
+   {
+      if (iter->first.second == threadKey)
+      {
+         sqlite3_finalize(iter->second);
+         iter = mStatements.erase(iter);
+      }
+      else
+         ++iter;
+   }
+}
+
 sqlite3_stmt *DBConnection::GetStatement(enum StatementID id)
 {
+   std::lock_guard<std::mutex> guard(mStatementMutex);
+
    // Look it up
-   auto iter = mStatements.find(id);
+   auto iter = mStatements.find({id, sThreadStatements.key});
 
    // It should always be there
    wxASSERT(iter != mStatements.end());
@@ -61,7 +61,18 @@ public:
       InsertSampleBlock,
       DeleteSampleBlock,
       GetRootPage,
-      GetDBPage
+      GetDBPage,
+      GetSpectrumTile,
+      SetSpectrumTile,
+      InsertPlaceholderBlock,
+      InsertPendingBlock,
+      LoadPendingBlock,
+      UpdateSampleBlock,
+      DeletePendingBlock,
+      GetSampleSums,
+      SetSampleSums,
+      TouchSpectrumSettings,
+      AddSpectrumSettings
    };
    sqlite3_stmt *GetStatement(enum StatementID id);
    sqlite3_stmt *Prepare(enum StatementID id, const char *sql);
@@ -101,7 +112,16 @@ private:
    std::atomic_bool mCheckpointPending{ false };
    std::atomic_bool mCheckpointActive{ false };
 
-   std::map<enum StatementID, sqlite3_stmt *> mStatements;
+   // Statements are prepared once for each thread that uses them, because
+   // one statement can't be stepped by several threads at once.  Threads are
+   // keyed by a number never reused, unlike std::thread::id, and their
+   // statements are finalized when they exit.
+   struct ThreadStatements;
+   static thread_local ThreadStatements sThreadStatements;
+   void FinalizeStatements(unsigned long long threadKey);
+   std::mutex mStatementMutex;
+   using StatementIndex = std::pair<enum StatementID, unsigned long long>;
+   std::map<StatementIndex, sqlite3_stmt *> mStatements;
 
    TranslatableString mLastError;
    TranslatableString mLibraryError;
@@ -48,6 +48,7 @@ used throughout Audacity into this one place.
 #endif
 
 static wxString gDataDir;
+static wxString gPluginConfigDir;
 
 const FileNames::FileType
      FileNames::AllFiles{ XO("All files"), { wxT("") } }
@@ -326,12 +327,19 @@ FilePath FileNames::PlugInDir()
 
 FilePath FileNames::PluginRegistry()
 {
-   return wxFileName( DataDir(), wxT("pluginregistry.cfg") ).GetFullPath();
+   return wxFileName( gPluginConfigDir.empty() ? DataDir() : gPluginConfigDir,
+      wxT("pluginregistry.cfg") ).GetFullPath();
 }
 
 FilePath FileNames::PluginSettings()
 {
-   return wxFileName( DataDir(), wxT("pluginsettings.cfg") ).GetFullPath();
+   return wxFileName( gPluginConfigDir.empty() ? DataDir() : gPluginConfigDir,
+      wxT("pluginsettings.cfg") ).GetFullPath();
+}
+
+void FileNames::SetPluginConfigDir(const FilePath &dir)
+{
+   gPluginConfigDir = dir;
 }
 
 FilePath FileNames::BaseDir()
@@ -104,6 +104,9 @@ namespace FileNames
    FilePath NRPFile();
    FilePath PluginRegistry();
    FilePath PluginSettings();
+   /** \brief Keep the two files above in dir, instead of DataDir(), so that
+    * a copy of Audacity may change them without affecting other copies */
+   void SetPluginConfigDir(const FilePath &dir);
 
    FilePath BaseDir();
    FilePath ModulesDir();
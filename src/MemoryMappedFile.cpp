@@ -0,0 +1,85 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  MemoryMappedFile.cpp
+
+**********************************************************************/
+
+#include "MemoryMappedFile.h"
+
+#include <limits>
+
+#if defined(__WXMSW__)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__WXMSW__)
+
+MemoryMappedFile::MemoryMappedFile(const FilePath &path)
+{
+   const auto file = CreateFileW(path.wc_str(), GENERIC_READ, FILE_SHARE_READ,
+      nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+   if (file == INVALID_HANDLE_VALUE)
+      return;
+
+   LARGE_INTEGER size;
+   if (GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+       static_cast<unsigned long long>(size.QuadPart) <=
+          std::numeric_limits<size_t>::max()) {
+      // The view keeps the mapping open after its handle is closed
+      const auto mapping =
+         CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (mapping) {
+         mData = static_cast<const unsigned char *>(
+            MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+         if (mData)
+            mSize = static_cast<size_t>(size.QuadPart);
+         CloseHandle(mapping);
+      }
+   }
+   CloseHandle(file);
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+   if (mData)
+      UnmapViewOfFile(mData);
+}
+
+#else
+
+MemoryMappedFile::MemoryMappedFile(const FilePath &path)
+{
+   const auto fd = open(path.fn_str(), O_RDONLY);
+   if (fd < 0)
+      return;
+
+   struct stat st;
+   if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+       static_cast<unsigned long long>(st.st_size) <=
+          std::numeric_limits<size_t>::max()) {
+      const auto size = static_cast<size_t>(st.st_size);
+      // The mapping stays valid after the descriptor is closed
+      const auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+         madvise(data, size, MADV_SEQUENTIAL);
+         mData = static_cast<const unsigned char *>(data);
+         mSize = size;
+      }
+   }
+   close(fd);
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+   if (mData)
+      munmap(const_cast<unsigned char *>(mData), mSize);
+}
+
+#endif
@@ -0,0 +1,44 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  MemoryMappedFile.h
+
+**********************************************************************//**
+
+\class MemoryMappedFile
+\brief Maps the whole of a file into memory, read-only, for as long as the
+object lives.
+
+Mapping fails, leaving the object empty, for a file that can't be opened,
+an empty file, or one too large for the address space; callers should then
+read the file another way.
+
+*//*******************************************************************/
+
+#ifndef __AUDACITY_MEMORY_MAPPED_FILE__
+#define __AUDACITY_MEMORY_MAPPED_FILE__
+
+#include <cstddef>
+
+#include "audacity/Types.h"
+
+class MemoryMappedFile
+{
+public:
+   //! Map the file, hinting that it will be read from beginning to end
+   explicit MemoryMappedFile(const FilePath &path);
+   MemoryMappedFile(const MemoryMappedFile&) = delete;
+   MemoryMappedFile &operator=(const MemoryMappedFile&) = delete;
+   ~MemoryMappedFile();
+
+   //! @return null if mapping failed
+   const unsigned char *Data() const { return mData; }
+   size_t Size() const { return mSize; }
+
+private:
+   const unsigned char *mData{};
+   size_t mSize{ 0 };
+};
+
+#endif
@@ -611,6 +611,54 @@ size_t Mixer::MixSameRate(int *channelFlags, WaveTrackCache &cache,
 }
 
 size_t Mixer::Process(size_t maxToProcess)
+{
+   const auto maxOut = MixToTemp(maxToProcess);
+
+   if(mInterleaved) {
+      for(size_t c=0; c<mNumChannels; c++) {
+         CopySamples(mDither, mTemp[0].ptr() + (c * SAMPLE_SIZE(floatSample)),
+            floatSample,
+            mBuffer[0].ptr() + (c * SAMPLE_SIZE(mFormat)),
+            mFormat,
+            maxOut,
+            mHighQuality,
+            mNumChannels,
+            mNumChannels);
+      }
+   }
+   else {
+      for(size_t c=0; c<mNumBuffers; c++) {
+         CopySamples(mDither, mTemp[c].ptr(),
+            floatSample,
+            mBuffer[c].ptr(),
+            mFormat,
+            maxOut,
+            mHighQuality);
+      }
+   }
+
+   return maxOut;
+}
+
+size_t Mixer::Process(size_t maxToProcess, const samplePtr destinations[])
+{
+   wxASSERT(!mInterleaved);
+
+   const auto maxOut = MixToTemp(maxToProcess);
+
+   for(size_t c=0; c<mNumBuffers; c++) {
+      CopySamples(mDither, mTemp[c].ptr(),
+         floatSample,
+         destinations[c],
+         mFormat,
+         maxOut,
+         mHighQuality);
+   }
+
+   return maxOut;
+}
+
+size_t Mixer::MixToTemp(size_t maxToProcess)
 {
    // MB: this is wrong! mT represented warped time, and mTime is too inaccurate to use
    // it here. It's also unnecessary I think.
@@ -668,28 +716,6 @@ size_t Mixer::Process(size_t maxToProcess)
          // forwards (the usual)
          mTime = std::min(std::max(t, mTime), mT1);
    }
-   if(mInterleaved) {
-      for(size_t c=0; c<mNumChannels; c++) {
-         CopySamples(mTemp[0].ptr() + (c * SAMPLE_SIZE(floatSample)),
-            floatSample,
-            mBuffer[0].ptr() + (c * SAMPLE_SIZE(mFormat)),
-            mFormat,
-            maxOut,
-            mHighQuality,
-            mNumChannels,
-            mNumChannels);
-      }
-   }
-   else {
-      for(size_t c=0; c<mNumBuffers; c++) {
-         CopySamples(mTemp[c].ptr(),
-            floatSample,
-            mBuffer[c].ptr(),
-            mFormat,
-            maxOut,
-            mHighQuality);
-      }
-   }
    // MB: this doesn't take warping into account, replaced with code based on mSamplePos
    //mT += (maxOut / mRate);
 
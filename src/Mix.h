@@ -20,6 +20,7 @@
 #ifndef __AUDACITY_MIX__
 #define __AUDACITY_MIX__
 
+#include "Dither.h"
 #include "SampleFormat.h"
 #include <vector>
 
@@ -123,6 +124,11 @@ class AUDACITY_DLL_API Mixer {
    /// more samples that must be processed.
    size_t Process(size_t maxSamples);
 
+   /// Like Process(), but put the samples of each channel, converted to
+   /// the output format, into destinations[channel], instead of the buffers
+   /// that GetBuffer() returns.  Output must not be interleaved.
+   size_t Process(size_t maxSamples, const samplePtr destinations[]);
+
    /// Restart processing at beginning of buffer next time
    /// Process() is called.
    void Restart();
@@ -149,6 +155,8 @@ class AUDACITY_DLL_API Mixer {
  private:
 
    void Clear();
+   /// Mix into mTemp; return number of output samples
+   size_t MixToTemp(size_t maxToProcess);
    size_t MixSameRate(int *channelFlags, WaveTrackCache &cache,
                            sampleCount *pos);
 
@@ -194,6 +202,8 @@ class AUDACITY_DLL_API Mixer {
    double           mRate;
    double           mSpeed;
    bool             mHighQuality;
+   // Not shared with other mixers, which may convert on other threads
+   Dither           mDither;
    std::vector<double> mMinFactor, mMaxFactor;
 
    bool             mMayThrow;
@@ -0,0 +1,232 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  PCMFileReference.cpp
+
+**********************************************************************/
+
+#include "PCMFileReference.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#if defined(__WXMSW__)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MemoryX.h"
+#include "SampleFormat.h"
+
+namespace {
+
+template< typename Output, unsigned Bytes, bool BigEndian, bool Float >
+void ConvertSamples(
+   const unsigned char *src, size_t stride, Output *dest, size_t len)
+{
+   for (size_t ii = 0; ii < len; ++ii, src += stride) {
+      // The most significant byte goes to the top of 32 bits
+      unsigned value = 0;
+      for (unsigned b = 0; b < Bytes; ++b)
+         value |= unsigned(src[BigEndian ? b : Bytes - 1 - b]) << (24 - 8 * b);
+      if (std::is_same<Output, short>::value)
+         dest[ii] = static_cast<short>(static_cast<int>(value) >> 16);
+      else if (Float) {
+         float f;
+         memcpy(&f, &value, sizeof f);
+         dest[ii] = f;
+      }
+      else
+         dest[ii] = static_cast<int>(value) * (1.0f / 2147483648.0f);
+   }
+}
+
+template< typename Output, unsigned Bytes, bool Float = false >
+void ConvertSamples(const PCMFileReference::Layout &layout,
+   const unsigned char *src, size_t stride, samplePtr dest, size_t len)
+{
+   const auto out = reinterpret_cast<Output *>(dest);
+   if (layout.bigEndian)
+      ConvertSamples<Output, Bytes, true, Float>(src, stride, out, len);
+   else
+      ConvertSamples<Output, Bytes, false, Float>(src, stride, out, len);
+}
+
+}
+
+#if defined(__WXMSW__)
+
+struct PCMFileReference::File
+{
+   explicit File(const FilePath &path)
+      // Let other programs change or delete the file; reads then fail
+      : handle{ CreateFileW(path.wc_str(), GENERIC_READ,
+         FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+         nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr) }
+   {}
+   ~File()
+   {
+      if (IsOpen())
+         CloseHandle(handle);
+   }
+
+   bool IsOpen() const { return handle != INVALID_HANDLE_VALUE; }
+
+   bool GetSize(unsigned long long &size) const
+   {
+      LARGE_INTEGER result;
+      if (!GetFileSizeEx(handle, &result))
+         return false;
+      size = result.QuadPart;
+      return true;
+   }
+
+   //! Thread-safe, because each read gives its own offset
+   bool Read(unsigned long long offset, unsigned char *dest, size_t size) const
+   {
+      while (size > 0) {
+         OVERLAPPED overlapped{};
+         overlapped.Offset = static_cast<DWORD>(offset);
+         overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+         const auto request = static_cast<DWORD>(
+            std::min<size_t>(size, 1 << 30));
+         DWORD count = 0;
+         if (!ReadFile(handle, dest, request, &count, &overlapped) ||
+             count == 0)
+            // An error, or the end of a file that was truncated
+            return false;
+         dest += count, size -= count, offset += count;
+      }
+      return true;
+   }
+
+   const HANDLE handle;
+};
+
+#else
+
+struct PCMFileReference::File
+{
+   explicit File(const FilePath &path)
+      : fd{ open(path.fn_str(), O_RDONLY) }
+   {}
+   ~File()
+   {
+      if (IsOpen())
+         close(fd);
+   }
+
+   bool IsOpen() const { return fd >= 0; }
+
+   bool GetSize(unsigned long long &size) const
+   {
+      struct stat st;
+      if (fstat(fd, &st) != 0)
+         return false;
+      size = st.st_size;
+      return true;
+   }
+
+   //! Thread-safe, because each read gives its own offset
+   bool Read(unsigned long long offset, unsigned char *dest, size_t size) const
+   {
+      while (size > 0) {
+         const auto count = pread(fd, dest, size, offset);
+         if (count < 0 && errno == EINTR)
+            continue;
+         if (count <= 0)
+            // An error, or the end of a file that was truncated
+            return false;
+         dest += count, size -= count, offset += count;
+      }
+      return true;
+   }
+
+   const int fd;
+};
+
+#endif
+
+PCMFileReference::PCMFileReference(const FilePath &path,
+   std::unique_ptr<File> pFile, unsigned long long fileSize,
+   const Layout &layout)
+   : mPath{ path }
+   , mpFile{ std::move(pFile) }
+   , mFileSize{ fileSize }
+   , mLayout{ layout }
+{
+}
+
+PCMFileReference::~PCMFileReference() = default;
+
+std::shared_ptr<PCMFileReference> PCMFileReference::DoOpen(
+   const FilePath &path, const Layout &layout,
+   const unsigned long long *pFileSize)
+{
+   auto pFile = std::make_unique<File>(path);
+   unsigned long long size;
+   if (!pFile->IsOpen() || !pFile->GetSize(size) ||
+       (pFileSize && size != *pFileSize) || layout.offset > size ||
+       (size - layout.offset) / (layout.bytes * layout.channels) <
+          layout.frames)
+      return {};
+   // Not make_shared, because the constructor is private
+   return std::shared_ptr<PCMFileReference>{
+      safenew PCMFileReference{ path, std::move(pFile), size, layout } };
+}
+
+std::shared_ptr<PCMFileReference> PCMFileReference::Open(
+   const FilePath &path, const Layout &layout)
+{
+   return DoOpen(path, layout, nullptr);
+}
+
+std::shared_ptr<PCMFileReference> PCMFileReference::Reopen(
+   const FilePath &path, unsigned long long fileSize, const Layout &layout)
+{
+   return DoOpen(path, layout, &fileSize);
+}
+
+bool PCMFileReference::Read(unsigned channel, unsigned long long start,
+   samplePtr dest, sampleFormat format, size_t len) const
+{
+   if (len == 0)
+      return true;
+
+   // Whole frames are read, and the channel picked out of them
+   const auto frameBytes = mLayout.bytes * mLayout.channels;
+   std::vector<unsigned char> frames(len * frameBytes);
+   if (start > mLayout.frames || len > mLayout.frames - start ||
+       !mpFile->Read(mLayout.offset + start * frameBytes,
+          frames.data(), frames.size())) {
+      ClearSamples(dest, format, 0, len);
+      return false;
+   }
+   Convert(mLayout, frames.data() + channel * mLayout.bytes, frameBytes,
+      dest, format, len);
+   return true;
+}
+
+void PCMFileReference::Convert(const Layout &layout,
+   const unsigned char *src, size_t stride,
+   samplePtr dest, sampleFormat format, size_t len)
+{
+   if (format == int16Sample)
+      // Only for 16 bit files
+      ConvertSamples<short, 2>(layout, src, stride, dest, len);
+   else if (layout.isFloat)
+      ConvertSamples<float, 4, true>(layout, src, stride, dest, len);
+   else if (layout.bytes == 2)
+      ConvertSamples<float, 2>(layout, src, stride, dest, len);
+   else if (layout.bytes == 3)
+      ConvertSamples<float, 3>(layout, src, stride, dest, len);
+   else
+      ConvertSamples<float, 4>(layout, src, stride, dest, len);
+}
@@ -0,0 +1,89 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  PCMFileReference.h
+
+**********************************************************************//**
+
+\class PCMFileReference
+\brief The uncompressed samples of a WAV or AIFF file outside the project,
+which sample blocks may read on demand instead of copying them at import
+time.
+
+Reading is thread-safe.  The file stays open, but is not mapped into
+memory, so that another program truncating or rewriting it causes read
+errors, not crashes.  Its size is remembered, so that a project reopened
+later can detect some changes.
+
+*//*******************************************************************/
+
+#ifndef __AUDACITY_PCM_FILE_REFERENCE__
+#define __AUDACITY_PCM_FILE_REFERENCE__
+
+#include <memory>
+
+#include "audacity/Types.h"
+
+class PCMFileReference
+{
+public:
+   //! Where and how the interleaved samples lie in the file
+   struct Layout
+   {
+      unsigned long long offset; //!< of the first frame
+      unsigned bytes; //!< per sample
+      bool isFloat;
+      bool bigEndian;
+      unsigned channels;
+      unsigned long long frames;
+   };
+
+   //! Open the file, as when it is first imported
+   /*! @return null if the file can't be opened, or is too short for the
+    layout */
+   static std::shared_ptr<PCMFileReference> Open(
+      const FilePath &path, const Layout &layout);
+
+   //! Open the file again, as when a project that refers to it is reopened
+   /*! @return null if the file can't be opened, or its size is not the
+    remembered size */
+   static std::shared_ptr<PCMFileReference> Reopen(const FilePath &path,
+      unsigned long long fileSize, const Layout &layout);
+
+   ~PCMFileReference();
+
+   const FilePath &GetPath() const { return mPath; }
+   unsigned long long GetFileSize() const { return mFileSize; }
+   const Layout &GetLayout() const { return mLayout; }
+
+   //! Convert samples of one channel, as libsndfile would read them
+   /*! @param format int16Sample only for 16 bit integer files, or
+    floatSample
+    @return false, with dest filled with zeroes, if the file could not be
+    read */
+   bool Read(unsigned channel, unsigned long long start,
+      samplePtr dest, sampleFormat format, size_t len) const;
+
+   //! Convert len samples, each stride bytes after the previous, from src
+   //! in the given layout
+   static void Convert(const Layout &layout,
+      const unsigned char *src, size_t stride,
+      samplePtr dest, sampleFormat format, size_t len);
+
+private:
+   struct File;
+
+   PCMFileReference(const FilePath &path, std::unique_ptr<File> pFile,
+      unsigned long long fileSize, const Layout &layout);
+
+   static std::shared_ptr<PCMFileReference> DoOpen(const FilePath &path,
+      const Layout &layout, const unsigned long long *pFileSize);
+
+   const FilePath mPath;
+   const std::unique_ptr<File> mpFile;
+   const unsigned long long mFileSize;
+   const Layout mLayout;
+};
+
+#endif
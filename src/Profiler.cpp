@@ -8,149 +8,279 @@
   Audacity(R) is copyright (c) 1999-2008 Audacity Team.
   License: GPL v2.  See License.txt.
 
-******************************************************************//**
+**********************************************************************/
 
-\class Profiler
-\brief A simple profiler to measure the average time lengths that a
-particular task/function takes.  Currently not thread-safe and not thread-smart,
-but it will probably work fine if you use it on a high level.
+#include "Audacity.h"
+#include "Profiler.h"
 
-\class TaskProfile
-\brief a simple class to keep track of one task that may be called multiple times.
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
 
-*//*******************************************************************/
+#include <wx/ffile.h>
+#include <wx/log.h>
+#include <wx/string.h>
 
-#include "Audacity.h"
-#include "Profiler.h"
+#include "MemoryX.h"
+
+namespace {
 
-#include <stdio.h>
-#include <string.h>
-#include <wx/crt.h>
+struct Event {
+   const char *name;
+   long long start;
+   long long end;
+};
 
-///write to a profile at the end of the test.
-Profiler::~Profiler()
+//! Events of one thread: written by that thread only, without locking, and
+//! read by Finish
+struct ThreadEvents : std::enable_shared_from_this<ThreadEvents>
 {
-   if(mTasks.size())
+   // Bigger than any likely trace of the audio thread in a few minutes
+   enum : size_t { Capacity = 1 << 16 };
+
+   explicit ThreadEvents(int id) : mId{ id } {}
+
+   void Append(const Event &event)
    {
-      //print everything out.  append to a log.
-      FILE* log = fopen("AudacityProfilerLog.txt", "a");
-      time_t now;
-
-      time(&now);
-      wxFprintf(log,"Audacity Profiler Run, Ended at ");
-      wxFprintf(log,"%s",ctime(&now));
-      wxFprintf(log,"****************************************\n");
-      //print out the tasks
-      for(int i=0;i<(int)mTasks.size();i++)
-      {
-         if(mTasks[i]->mNumHits>0)
-         {
-            wxFprintf(log,"Task: %s\n(begins at line %d in %s)\n\n",mTasks[i]->mDescription.get(), mTasks[i]->mLine, mTasks[i]->mFileName.get());
-            wxFprintf(log,"Number of times run: %d\n",mTasks[i]->mNumHits);
-            wxFprintf(log,"Total run time (seconds): %f\n", (double)mTasks[i]->mCumTime/CLOCKS_PER_SEC);
-            wxFprintf(log,"Average run time (seconds): %f\n",mTasks[i]->ComputeAverageRunTime());
-
-            if(i < ((int)mTasks.size()) -1)
-               wxFprintf(log,"----------------------------\n");
-         }
+      const auto written = mWritten.load(std::memory_order_relaxed);
+      if (written - mRead.load(std::memory_order_acquire) >= Capacity) {
+         // Drop rather than wait or allocate in the hot path
+         mDropped.fetch_add(1, std::memory_order_relaxed);
+         return;
       }
-      wxFprintf(log,"\n****************************************\n\n\n");
+      mEvents[written % Capacity] = event;
+      mWritten.store(written + 1, std::memory_order_release);
+   }
 
-      fclose(log);
+   template< typename Function > void Consume(const Function &function)
+   {
+      const auto read = mRead.load(std::memory_order_relaxed);
+      const auto written = mWritten.load(std::memory_order_acquire);
+      for (auto ii = read; ii < written; ++ii)
+         function(mEvents[ii % Capacity]);
+      mRead.store(written, std::memory_order_release);
    }
-}
 
-///start the task timer.
-void Profiler::Begin(const char* fileName, int lineNum, const char* taskDescription)
-{
-   std::lock_guard<std::mutex> guard{ mTasksMutex };
-   GetOrCreateTaskProfile(fileName,lineNum)->Begin(fileName,lineNum,taskDescription);
-}
+   const int mId;
+   std::atomic<const char*> mName{ nullptr };
+   std::atomic<bool> mAlive{ true };
+   std::atomic<unsigned long> mDropped{ 0 };
 
-///end the task timer.
-void Profiler::End(const char* fileName, int lineNum, const char* taskDescription)
-{
-   std::lock_guard<std::mutex> guard{ mTasksMutex };
-   TaskProfile* tp;
-   tp=GetTaskProfileByDescription(taskDescription);
-   if(tp)
-      tp->End(fileName,lineNum,taskDescription);
-}
+private:
+   ArrayOf<Event> mEvents{ Capacity };
+   std::atomic<size_t> mWritten{ 0 };
+   std::atomic<size_t> mRead{ 0 };
+};
 
-///Gets the singleton instance
-Profiler* Profiler::Instance()
+struct Registry
 {
-   static Profiler pro;
-   //this isn't 100% threadsafe but I think Okay for this purpose.
+   // Enough for the audio callback and a few other threads that begin to
+   // record before the next Reserve
+   enum : size_t { Spares = 8 };
 
-   return &pro;
-}
+   //! Allocate buffers for empty spare slots; mutex must be locked
+   void Refill()
+   {
+      for (auto &spare : spares) {
+         if (!spare.load(std::memory_order_relaxed))
+            spare.store(Add().get(), std::memory_order_release);
+      }
+   }
 
-///find a taskProfile for the given task, otherwise create
-TaskProfile* Profiler::GetOrCreateTaskProfile(const char* fileName, int lineNum)
-{
-   for(int i=0;i<(int)mTasks.size();i++)
+   //! Allocate a buffer; mutex must be locked
+   const std::shared_ptr<ThreadEvents> &Add()
    {
-      if(strcmp(fileName, mTasks[i]->mFileName.get())==0 && lineNum == mTasks[i]->mLine)
-         return mTasks[i].get();
+      threads.push_back(std::make_shared<ThreadEvents>(nextId++));
+      return threads.back();
+   }
+
+   //! Take a spare buffer without locking or allocating
+   /*! @return null if there is none */
+   ThreadEvents *Claim()
+   {
+      for (auto &spare : spares) {
+         if (spare.load(std::memory_order_relaxed))
+            if (auto pEvents =
+                spare.exchange(nullptr, std::memory_order_acquire))
+               return pEvents;
+      }
+      return nullptr;
    }
 
-   auto tp = std::make_unique<TaskProfile>();
-   mTasks.push_back(std::move(tp));
-   return mTasks.back().get();
+   std::mutex mutex;
+   // Guarded by mutex:
+   std::vector< std::shared_ptr<ThreadEvents> > threads;
+   int nextId{ 1 };
+   wxString path;
+   long long startTime{ 0 };
+
+   // Buffers, also in threads, that no thread has yet taken
+   std::atomic<ThreadEvents*> spares[Spares]{};
+   // Events of threads that found no spare
+   std::atomic<unsigned long> dropped{ 0 };
+};
+
+Registry &GetRegistry()
+{
+   static Registry registry;
+   return registry;
 }
 
-TaskProfile* Profiler::GetTaskProfileByDescription(const char* description)
+//! Owned by each thread that records any event, and also by the registry,
+//! so that events outlive the thread until written
+struct ThreadEventsHolder
 {
-   for(int i=0;i<(int)mTasks.size();i++)
+   ~ThreadEventsHolder()
+   {
+      if (pEvents)
+         pEvents->mAlive.store(false, std::memory_order_relaxed);
+   }
+   //! Never allocates nor locks
+   /*! @return null if the thread has no buffer and there is no spare */
+   ThreadEvents *Get()
+   {
+      if (!pEvents) {
+         if (auto pSpare = GetRegistry().Claim())
+            Take(pSpare->shared_from_this());
+      }
+      return pEvents.get();
+   }
+
+   //! Like Get, but allocates if there is no spare
+   void Allocate()
    {
-      if(strcmp(description, mTasks[i]->mDescription.get())==0)
-         return mTasks[i].get();
+      if (!Get()) {
+         auto &registry = GetRegistry();
+         std::lock_guard<std::mutex> lock{ registry.mutex };
+         Take(registry.Add());
+      }
    }
 
-   return NULL;
+   void Take(std::shared_ptr<ThreadEvents> pNew)
+   {
+      pEvents = std::move(pNew);
+      pEvents->mName.store(name, std::memory_order_relaxed);
+   }
+
+   std::shared_ptr<ThreadEvents> pEvents;
+   const char *name{ nullptr };
+};
+
+thread_local ThreadEventsHolder sThreadEvents;
+
+//! The subset of JSON string escapes that names and paths may need
+wxString Quote(const wxString &str)
+{
+   wxString result{ wxT("\"") };
+   for (auto ch : str) {
+      if (ch == wxT('"') || ch == wxT('\\'))
+         result << wxT('\\');
+      result << ch;
+   }
+   return result << wxT("\"");
+}
 
 }
 
+std::atomic<bool> Profiler::sRecording{ false };
 
-///Task Profile
-TaskProfile::TaskProfile()
+void Profiler::Start(const wxString &path)
 {
-   mCumTime=0;
-   mNumHits=0;
+   auto &registry = GetRegistry();
+   std::lock_guard<std::mutex> lock{ registry.mutex };
+   for (auto &pEvents : registry.threads)
+      pEvents->Consume([](const Event&){});
+   registry.path = path;
+   registry.startTime = Now();
+   registry.dropped.store(0, std::memory_order_relaxed);
+   registry.Refill();
+   sRecording.store(true, std::memory_order_relaxed);
 }
 
-TaskProfile::~TaskProfile()
+void Profiler::Reserve()
 {
+   if (!IsRecording())
+      return;
+   auto &registry = GetRegistry();
+   std::lock_guard<std::mutex> lock{ registry.mutex };
+   registry.Refill();
 }
 
-///start the task timer.
-void TaskProfile::Begin(const char* fileName, int lineNum, const char* taskDescription)
+bool Profiler::Finish()
 {
-   if(!mFileName)
-   {
-      mFileName.reinit( strlen(fileName) + 1 );
-      strcpy(mFileName.get(), fileName);
-      mDescription.reinit( strlen(taskDescription) + 1 );
-      strcpy(mDescription.get(), taskDescription);
-      mLine = lineNum;
+   if (!sRecording.exchange(false, std::memory_order_relaxed))
+      return false;
+
+   auto &registry = GetRegistry();
+   std::lock_guard<std::mutex> lock{ registry.mutex };
+
+   // Chrome expects microseconds
+   const auto microseconds = [&](long long nanoseconds){
+      return wxString::Format(wxT("%lld.%03lld"),
+         nanoseconds / 1000, nanoseconds % 1000);
+   };
+
+   wxString trace{ wxT("{\"traceEvents\":[\n") };
+   const char *separator = "";
+   for (const auto &pEvents : registry.threads) {
+      const auto tid = wxString::Format(wxT("%d"), pEvents->mId);
+      if (auto name = pEvents->mName.load(std::memory_order_relaxed)) {
+         trace << separator
+            << wxT("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":")
+            << tid << wxT(",\"args\":{\"name\":") << Quote(name)
+            << wxT("}}");
+         separator = ",\n";
+      }
+      pEvents->Consume([&](const Event &event){
+         // Skip events that began before Start
+         if (event.start < registry.startTime)
+            return;
+         trace << separator
+            << wxT("{\"name\":") << Quote(event.name)
+            << wxT(",\"ph\":\"X\",\"pid\":1,\"tid\":") << tid
+            << wxT(",\"ts\":")
+            << microseconds(event.start - registry.startTime)
+            << wxT(",\"dur\":") << microseconds(event.end - event.start)
+            << wxT("}");
+         separator = ",\n";
+      });
+      if (auto dropped =
+          pEvents->mDropped.exchange(0, std::memory_order_relaxed))
+         wxLogDebug(wxT("Profiler dropped %lu events of thread %d"),
+            dropped, pEvents->mId);
    }
+   trace << wxT("\n]}\n");
+   if (auto dropped =
+       registry.dropped.exchange(0, std::memory_order_relaxed))
+      wxLogDebug(wxT("Profiler dropped %lu events of threads without buffers"),
+         dropped);
 
-   mLastTime = clock();
+   // Forget threads that are gone, now that their events are written
+   auto &threads = registry.threads;
+   threads.erase(std::remove_if(threads.begin(), threads.end(),
+      [](const std::shared_ptr<ThreadEvents> &pEvents){
+         return !pEvents->mAlive.load(std::memory_order_relaxed); }),
+      threads.end());
 
+   wxFFile file(registry.path, wxT("w"));
+   return file.IsOpened() && file.Write(trace);
 }
 
-///end the task timer.
-void TaskProfile::End(const char* WXUNUSED(fileName), int WXUNUSED(lineNum), const char* WXUNUSED(taskDescription))
+void Profiler::SetThreadName(const char *name, bool mayAllocate)
 {
-   mCumTime += clock() - mLastTime;
-   mNumHits++;
+   sThreadEvents.name = name;
+   if (sThreadEvents.pEvents)
+      sThreadEvents.pEvents->mName.store(name, std::memory_order_relaxed);
+   else if (mayAllocate && IsRecording())
+      // Leave the spares to threads that can't allocate
+      sThreadEvents.Allocate();
 }
 
-double TaskProfile::ComputeAverageRunTime()
+void Profiler::Record(const char *name, long long start, long long end)
 {
-   if(mNumHits)
-      return (double) ((double)mCumTime/CLOCKS_PER_SEC)/mNumHits;
+   if (auto pEvents = sThreadEvents.Get())
+      pEvents->Append({ name, start, end });
    else
-      return 0.0;
+      GetRegistry().dropped.fetch_add(1, std::memory_order_relaxed);
 }
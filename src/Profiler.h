@@ -11,82 +11,95 @@
 ******************************************************************//**
 
 \class Profiler
-\brief A simple profiler to measure the average time lengths that a
-particular task/function takes.  Currently not thread-safe and not thread-smart,
-but it will probably work fine if you use it on a high level.
-
-\class TaskProfile
-\brief a simple class to keep track of one task that may be called multiple times.
-
-*//*******************************************************************/
-
+\brief Records when scopes of interest begin and end, on any thread, and
+writes them to a file in Chrome's trace event format, which chrome://tracing
+or ui.perfetto.dev can show as a timeline.
 
+Each thread appends to its own buffer without locking, so scopes may be
+placed in the audio callback and on worker threads.  Buffers are allocated
+in advance, by Start and Reserve, and a thread takes one the first time it
+records, without allocating or locking.  While not recording, a scope costs
+one atomic load.
 
+\class Profiler::Scope
+\brief Records one event, lasting for its own lifetime, if the Profiler
+was recording when it was constructed
 
+*//*******************************************************************/
 
 #ifndef __AUDACITY_PROFILER__
 #define __AUDACITY_PROFILER__
-#include <mutex>
-#include <vector>
-#include <time.h>
-#include "MemoryX.h"
 
+#include <atomic>
+#include <chrono>
 
-#define BEGIN_TASK_PROFILING(TASK_DESCRIPTION) Profiler::Instance()->Begin(__FILE__,__LINE__,TASK_DESCRIPTION)
-#define END_TASK_PROFILING(TASK_DESCRIPTION) Profiler::Instance()->End(__FILE__,__LINE__,TASK_DESCRIPTION)
+class wxString;
 
-class TaskProfile;
 class Profiler
 {
- public:
-
-   ///write to a profile at the end of the test.
-   virtual ~Profiler();
-
-   ///start the task timer.
-   void Begin(const char* fileName, int lineNum, const char* taskDescription);
-   ///end the task timer.
-   void End(const char* fileName, int lineNum, const char* taskDescription);
-
-   ///Gets the singleton instance
-   static Profiler* Instance();
-
-  protected:
-   ///private constructor - Singleton.
-   Profiler(){};
+public:
+   //! Discard any old events, and begin recording
+   /*! @param path where Finish will write the trace */
+   static void Start(const wxString &path);
+
+   //! Stop recording, and write all events since Start to its path
+   /*! Does nothing if not started.  @return whether the file was written */
+   static bool Finish();
+
+   //! While recording, make enough buffers ready for threads that have not
+   //! yet recorded any event
+   /*! Call it from the main thread before starting threads, such as the
+    audio callback, that must not allocate.  If no buffer is ready, such a
+    thread drops its events. */
+   static void Reserve();
+
+   static bool IsRecording()
+   { return sRecording.load(std::memory_order_relaxed); }
+
+   //! Label the calling thread in the trace
+   /*! @param name must be a string literal, or otherwise outlive the
+    Profiler
+    @param mayAllocate if recording, whether the thread may allocate its
+    buffer now, rather than take one made by Reserve */
+   static void SetThreadName(const char *name, bool mayAllocate = true);
+
+   class Scope
+   {
+   public:
+      //! @param name must be a string literal, or otherwise outlive the
+      //! Profiler
+      explicit Scope(const char *name)
+         : mName{ IsRecording() ? name : nullptr }
+         , mStart{ mName ? Now() : 0 }
+      {}
+      ~Scope() { if (mName) Record(mName, mStart, Now()); }
+
+      Scope(const Scope&) = delete;
+      Scope &operator=(const Scope&) = delete;
+
+   private:
+      const char *const mName;
+      const long long mStart;
+   };
 
-   ///find a taskProfile for the given task, otherwise create
-   TaskProfile* GetOrCreateTaskProfile(const char* fileName, int lineNum);
-   TaskProfile* GetTaskProfileByDescription(const char* description);
+private:
+   //! Nanoseconds, on a monotonic clock
+   static long long Now()
+   {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+         std::chrono::steady_clock::now().time_since_epoch() ).count();
+   }
 
-   //List of current Task to do.
-   std::vector<std::unique_ptr<TaskProfile>> mTasks;
-   //mutex for above variable
-   std::mutex mTasksMutex;
+   static void Record(const char *name, long long start, long long end);
 
+   static std::atomic<bool> sRecording;
 };
 
- class TaskProfile
-   {
-   public:
-      TaskProfile();
-      virtual ~TaskProfile();
-
-      ///start the task timer.
-      void Begin(const char* fileName, int lineNum, const char* taskDescription);
-      ///end the task timer.
-      void End(const char* fileName, int lineNum, const char* taskDescription);
-
-      double ComputeAverageRunTime();
-
-      ArrayOf<char> mFileName;
-      int mLine;
-      ArrayOf<char> mDescription;
-      int mNumHits;
-      clock_t mCumTime;
-      clock_t mLastTime;
-   };
+#define PROFILER_CONCATENATE2(a, b) a ## b
+#define PROFILER_CONCATENATE(a, b) PROFILER_CONCATENATE2(a, b)
 
+//! Record an event with the given name for the rest of the enclosing block
+#define PROFILE_SCOPE(NAME) \
+   Profiler::Scope PROFILER_CONCATENATE(profilerScope, __LINE__){ NAME }
 
 #endif
-
@@ -11,7 +11,12 @@ Paul Licameli split from AudacityProject.cpp
 #include "ProjectFileIO.h"
 
 #include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
 #include <sqlite3.h>
+#include <wx/app.h>
 #include <wx/crt.h>
 #include <wx/frame.h>
 #include <wx/progdlg.h>
@@ -19,12 +24,16 @@ Paul Licameli split from AudacityProject.cpp
 #include <wx/xml/xml.h>
 
 #include "ActiveProjects.h"
+#include "AudioIOBase.h"
 #include "DBConnection.h"
 #include "FileNames.h"
+#include "Internat.h"
+#include "Profiler.h"
 #include "Project.h"
 #include "ProjectFileIORegistry.h"
 #include "ProjectSerializer.h"
 #include "ProjectSettings.h"
+#include "ProjectStatus.h"
 #include "SampleBlock.h"
 #include "Sequence.h"
 #include "Tags.h"
@@ -36,6 +45,7 @@ Paul Licameli split from AudacityProject.cpp
 #include "widgets/NumericTextCtrl.h"
 #include "widgets/ProgressDialog.h"
 #include "xml/XMLFileReader.h"
+#include "xml/XMLWriter.h"
 
 wxDEFINE_EVENT(EVT_PROJECT_TITLE_CHANGE, wxCommandEvent);
 
@@ -116,7 +126,8 @@ static const char *ProjectFileSchema =
    // blockID is a 64 bit number.
    //
    // Rows are immutable -- never updated after addition, but may be
-   // deleted.
+   // deleted -- except for placeholders, which lack summaries and samples
+   // until they are copied from the file that pendingblocks describes.
    //
    // summin to summary64K are summaries at 3 distance scales.
    "CREATE TABLE IF NOT EXISTS <schema>.sampleblocks"
@@ -131,6 +142,112 @@ static const char *ProjectFileSchema =
    "  samples              BLOB"
    ");";
 
+// Also executed when opening files of earlier versions, which lack these
+static const char *AddedTablesSchema =
+   // CREATE SQL autosavetracks
+   // autosavetracks holds the autosave document in pieces, so that an
+   // autosave need rewrite only the tracks that changed.
+   // id 0 is the project document without any tracks.
+   // ids from 1 are the documents of single tracks, in track order.
+   // dict and doc are as in autosave; each row has its own dict.
+   // If autosave has a row, it takes precedence over this table.
+   "CREATE TABLE IF NOT EXISTS <schema>.autosavetracks"
+   "("
+   "  id                   INTEGER PRIMARY KEY,"
+   "  dict                 BLOB,"
+   "  doc                  BLOB"
+   ");"
+   ""
+   // CREATE SQL spectrogramtiles
+   // spectrogramtiles caches spectrogram columns computed from the samples
+   // of one sample block, for one choice of window and of hop (the distance
+   // in samples between column centers).  It is not copied with the sample
+   // blocks; it is only rebuilt when needed.
+   //
+   // columns is int16 values in hundredths of a dB, NBins per column,
+   // column-major.
+   "CREATE TABLE IF NOT EXISTS <schema>.spectrogramtiles"
+   "("
+   "  blockid              INTEGER,"
+   "  windowtype           INTEGER,"
+   "  windowsize           INTEGER,"
+   "  zeropadding          INTEGER,"
+   "  hop                  INTEGER,"
+   "  columns              BLOB,"
+   "  UNIQUE(blockid, windowtype, windowsize, zeropadding, hop)"
+   ");"
+   ""
+   // CREATE SQL spectrogramsettings
+   // spectrogramsettings lists the choices of window and hop that have
+   // tiles, and when each was last drawn, as a count that increases.  Tiles
+   // are kept only for the few most recently drawn.
+   "CREATE TABLE IF NOT EXISTS <schema>.spectrogramsettings"
+   "("
+   "  windowtype           INTEGER,"
+   "  windowsize           INTEGER,"
+   "  zeropadding          INTEGER,"
+   "  hop                  INTEGER,"
+   "  lastused             INTEGER,"
+   "  UNIQUE(windowtype, windowsize, zeropadding, hop)"
+   ");"
+   ""
+   // Tiles go with their sample blocks, however those are deleted
+   "CREATE TRIGGER IF NOT EXISTS <schema>.sampleblocks_delete"
+   "  AFTER DELETE ON sampleblocks"
+   "  BEGIN"
+   "    DELETE FROM spectrogramtiles WHERE blockid = old.blockid;"
+   "  END;"
+   ""
+   // CREATE SQL pendingblocks
+   // pendingblocks tells where to find the samples of placeholder rows of
+   // sampleblocks:  in one channel of an uncompressed file outside the
+   // project, from which they are still to be copied.
+   //
+   // dataoffset to frames describe the interleaved samples of the whole
+   // file; filesize detects some changes to it.  start is the first frame
+   // of the block, and length its count of samples.
+   "CREATE TABLE IF NOT EXISTS <schema>.pendingblocks"
+   "("
+   "  blockid              INTEGER PRIMARY KEY,"
+   "  path                 TEXT,"
+   "  filesize             INTEGER,"
+   "  dataoffset           INTEGER,"
+   "  samplebytes          INTEGER,"
+   "  isfloat              INTEGER,"
+   "  bigendian            INTEGER,"
+   "  channels             INTEGER,"
+   "  frames               INTEGER,"
+   "  channel              INTEGER,"
+   "  start                INTEGER,"
+   "  length               INTEGER"
+   ");"
+   ""
+   "CREATE TRIGGER IF NOT EXISTS <schema>.sampleblocks_delete_pending"
+   "  AFTER DELETE ON sampleblocks"
+   "  BEGIN"
+   "    DELETE FROM pendingblocks WHERE blockid = old.blockid;"
+   "  END;"
+   ""
+   // CREATE SQL samplesums
+   // samplesums holds the sum and the sum of squares of all samples of a
+   // sample block, so that the mean and RMS of long regions need read only
+   // the blocks at the ends.  Rows are written only when blocks are
+   // committed or materialized, never by analysis.  Like spectrogramtiles it
+   // is not copied with the sample blocks; the sums of blocks without rows
+   // are computed again in each session that needs them.
+   "CREATE TABLE IF NOT EXISTS <schema>.samplesums"
+   "("
+   "  blockid              INTEGER PRIMARY KEY,"
+   "  sumsamples           REAL,"
+   "  sumsquares           REAL"
+   ");"
+   ""
+   "CREATE TRIGGER IF NOT EXISTS <schema>.sampleblocks_delete_sums"
+   "  AFTER DELETE ON sampleblocks"
+   "  BEGIN"
+   "    DELETE FROM samplesums WHERE blockid = old.blockid;"
+   "  END;";
+
 // This singleton handles initialization/shutdown of the SQLite library.
 // It is needed because our local SQLite is built with SQLITE_OMIT_AUTOINIT
 // defined.
@@ -254,6 +371,7 @@ ProjectFileIO::ProjectFileIO(AudacityProject &project)
 
 ProjectFileIO::~ProjectFileIO()
 {
+   CancelBackgroundCompact();
 }
 
 DBConnection &ProjectFileIO::GetConnection()
@@ -338,6 +456,9 @@ bool ProjectFileIO::CloseConnection()
    auto &curConn = CurrConn();
    wxASSERT(curConn);
 
+   // Its copy would be of a file no longer in use
+   CancelBackgroundCompact();
+
    if (!curConn->Close())
    {
       return false;
@@ -356,6 +477,8 @@ void ProjectFileIO::SaveConnection()
    // Should do nothing in proper usage, but be sure not to leak a connection:
    DiscardConnection();
 
+   CancelBackgroundCompact();
+
    mPrevConn = std::move(CurrConn());
    mPrevFileName = mFileName;
    mPrevTemporary = mTemporary;
@@ -589,10 +712,14 @@ bool ProjectFileIO::CheckVersion()
    // upgrade.
    if (version < ProjectFileVersion)
    {
-      return UpgradeSchema();
+      if (!UpgradeSchema())
+      {
+         return false;
+      }
    }
 
-   return true;
+   // Add tables that are newer than the version number
+   return InstallAddedTables(db);
 }
 
 bool ProjectFileIO::InstallSchema(sqlite3 *db, const char *schema /* = "main" */)
@@ -612,6 +739,25 @@ bool ProjectFileIO::InstallSchema(sqlite3 *db, const char *schema /* = "main" */
       return false;
    }
 
+   return InstallAddedTables(db, schema);
+}
+
+bool ProjectFileIO::InstallAddedTables(sqlite3 *db, const char *schema /* = "main" */)
+{
+   int rc;
+
+   wxString sql{ AddedTablesSchema };
+   sql.Replace("<schema>", schema);
+
+   rc = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      SetDBError(
+         XO("Unable to initialize the project file")
+      );
+      return false;
+   }
+
    return true;
 }
 
@@ -857,6 +1003,20 @@ bool ProjectFileIO::CopyTo(const FilePath &destpath,
          }
       }
 
+      // Placeholder blocks go with the description of where their samples
+      // are still to be found
+      if (sqlite3_exec(db,
+         "INSERT INTO outbound.pendingblocks"
+         "  SELECT * FROM main.pendingblocks"
+         "  WHERE blockid IN (SELECT blockid FROM outbound.sampleblocks);",
+         nullptr, nullptr, nullptr) != SQLITE_OK)
+      {
+         SetDBError(
+            XO("Failed to update the project file")
+         );
+         return false;
+      }
+
       // Write the doc.
       //
       // If we're compacting a temporary project (user initiated from the File
@@ -940,6 +1100,9 @@ Connection &ProjectFileIO::CurrConn()
 
 void ProjectFileIO::Compact(const std::shared_ptr<TrackList> &tracks, bool force /* = false */)
 {
+   // This supersedes any compaction already running
+   CancelBackgroundCompact();
+
    // Haven't compacted yet
    mWasCompacted = false;
 
@@ -966,58 +1129,64 @@ void ProjectFileIO::Compact(const std::shared_ptr<TrackList> &tracks, bool force
       }
    }
 
-   wxString origName = mFileName;
-   wxString backName = origName + "_compact_back";
-   wxString tempName = origName + "_compact_temp";
+   wxString tempName = mFileName + "_compact_temp";
 
    // Copy the original database to a new database. Only prune sample blocks if
    // we have a tracklist.
    if (CopyTo(tempName, XO("Compacting project"), IsTemporary(), tracks != nullptr, tracks))
    {
-      // Must close the database to rename it
-      if (CloseConnection())
+      // Remember that we compacted
+      mWasCompacted = ReplaceWithCompacted(tempName);
+   }
+
+   return;
+}
+
+bool ProjectFileIO::ReplaceWithCompacted(const FilePath &tempName)
+{
+   wxString origName = mFileName;
+   wxString backName = origName + "_compact_back";
+
+   // Must close the database to rename it
+   if (CloseConnection())
+   {
+      // Only use the new file if it is actually smaller than the original.
+      //
+      // If the original file doesn't have anything to compact (original and new
+      // are basically identical), the file could grow by a few pages because of
+      // differences in how SQLite constructs the b-tree.
+      //
+      // In this case, just toss the new file and continue to use the original.
+      //
+      // Also, do this after closing the connection so that the -wal file
+      // gets cleaned up.
+      if (wxFileName::GetSize(tempName) < wxFileName::GetSize(origName))
       {
-         // Only use the new file if it is actually smaller than the original.
-         //
-         // If the original file doesn't have anything to compact (original and new
-         // are basically identical), the file could grow by a few pages because of
-         // differences in how SQLite constructs the b-tree.
-         //
-         // In this case, just toss the new file and continue to use the original.
-         //
-         // Also, do this after closing the connection so that the -wal file
-         // gets cleaned up.
-         if (wxFileName::GetSize(tempName) < wxFileName::GetSize(origName))
+         // Rename the original to backup
+         if (wxRenameFile(origName, backName))
          {
-            // Rename the original to backup
-            if (wxRenameFile(origName, backName))
+            // Rename the temporary to original
+            if (wxRenameFile(tempName, origName))
             {
-               // Rename the temporary to original
-               if (wxRenameFile(tempName, origName))
-               {
-                  // Open the newly compacted original file
-                  OpenConnection(origName);
-
-                  // Remove the old original file
-                  wxRemoveFile(backName);
+               // Open the newly compacted original file
+               OpenConnection(origName);
 
-                  // Remember that we compacted
-                  mWasCompacted = true;
+               // Remove the old original file
+               wxRemoveFile(backName);
 
-                  return;
-               }
-
-               wxRenameFile(backName, origName);
+               return true;
             }
-         }
 
-         OpenConnection(origName);
+            wxRenameFile(backName, origName);
+         }
       }
 
-      wxRemoveFile(tempName);
+      OpenConnection(origName);
    }
 
-   return;
+   wxRemoveFile(tempName);
+
+   return false;
 }
 
 bool ProjectFileIO::WasCompacted()
@@ -1030,6 +1199,408 @@ bool ProjectFileIO::HadUnused()
    return mHadUnused;
 }
 
+struct ProjectFileIO::BackgroundCompaction
+{
+   // Blocks to copy in each statement; small enough that a stop request is
+   // noticed quickly
+   enum : int { ChunkSize = 64 };
+
+   ~BackgroundCompaction()
+   {
+      Stop();
+      sqlite3_close(db);
+   }
+
+   void Stop()
+   {
+      {
+         std::lock_guard<std::mutex> lock{ mutex };
+         stop = true;
+      }
+      condition.notify_one();
+      if (thread.joinable())
+         thread.join();
+   }
+
+   void Work();
+
+   // Ask the main thread to do something with the file IO object, if it
+   // still exists then
+   template< typename Function > void Post(const Function &function)
+   {
+      auto wFileIO = this->wFileIO;
+      wxTheApp->CallAfter( [wFileIO, function]{
+         if (auto pFileIO = wFileIO.lock())
+            function(*pFileIO);
+      } );
+   }
+
+   std::weak_ptr<ProjectFileIO> wFileIO;
+   FilePath tempName;
+
+   // The project file as "main" and the new file as "outbound", used only by
+   // the thread once it starts
+   sqlite3 *db{};
+
+   std::thread thread;
+
+   std::mutex mutex;
+   std::condition_variable condition;
+   // These are guarded by mutex
+   bool stop{ false };
+   // The thread asked the main thread to finish
+   bool ready{ false };
+   // The main thread could not finish yet
+   bool retry{ false };
+
+   std::atomic<int64_t> copied{ 0 };
+   std::atomic<bool> failed{ false };
+   int64_t total{ 0 };
+   int64_t reclaimable{ 0 };
+};
+
+void ProjectFileIO::BackgroundCompaction::Work()
+{
+   Profiler::SetThreadName("Compaction");
+
+   const auto finish = [this]{
+      ready = true;
+      Post( [](ProjectFileIO &fileIO){ fileIO.FinishBackgroundCompact(); } );
+   };
+
+   // Waits while audio streams, leaving the disk to recording and playback;
+   // returns false if stopped
+   const auto throttle = [this](std::unique_lock<std::mutex> &lock){
+      while (!stop && AudioIOBase::Get()->IsBusy())
+         condition.wait_for( lock, std::chrono::milliseconds(100) );
+      return !stop;
+   };
+
+   sqlite3_stmt *stmt = nullptr;
+   auto cleanup = finally([&]
+   {
+      if (stmt)
+      {
+         sqlite3_finalize(stmt);
+      }
+   });
+
+   // Copy in ascending order of blockid, so that the last one copied tells
+   // where to resume.  Blocks are only ever inserted or deleted, or else
+   // placeholders are filled in, so what changes during the copy is caught
+   // up when finishing.
+   int rc = sqlite3_prepare_v2(db,
+                               "INSERT INTO outbound.sampleblocks"
+                               "  SELECT * FROM main.sampleblocks"
+                               "  WHERE blockid > ?1"
+                               "  ORDER BY blockid LIMIT ?2;",
+                               -1,
+                               &stmt,
+                               nullptr);
+
+   if (rc != SQLITE_OK)
+   {
+      wxLogDebug(wxT("Background compaction: %s"), sqlite3_errmsg(db));
+      failed = true;
+   }
+
+   SampleBlockID last = 0;
+   int percent = -1;
+   std::unique_lock<std::mutex> lock{ mutex };
+   while (!failed && throttle(lock))
+   {
+      lock.unlock();
+
+      int changes = 0;
+      {
+         PROFILE_SCOPE("Compaction chunk");
+
+         sqlite3_bind_int64(stmt, 1, last);
+         sqlite3_bind_int(stmt, 2, ChunkSize);
+         rc = sqlite3_step(stmt);
+         if (rc == SQLITE_DONE)
+         {
+            changes = sqlite3_changes(db);
+            if (changes > 0)
+               last = sqlite3_last_insert_rowid(db);
+         }
+         else
+            wxLogDebug(wxT("Background compaction: %s"), sqlite3_errmsg(db));
+         sqlite3_reset(stmt);
+      }
+
+      lock.lock();
+      if (rc != SQLITE_DONE)
+      {
+         failed = true;
+         break;
+      }
+      if (changes == 0)
+         break;
+
+      copied += changes;
+      auto newPercent = total
+         ? int(std::min<int64_t>(100, 100 * copied / total))
+         : 100;
+      if (newPercent != percent)
+      {
+         percent = newPercent;
+         const auto reclaimable = this->reclaimable;
+         Post( [percent, reclaimable](ProjectFileIO &fileIO){
+            if (fileIO.IsCompactingInBackground())
+               ProjectStatus::Get( fileIO.mProject ).Set(
+                  XO("Compacting project: %d%% done, about %s to reclaim")
+                     .Format( percent, Internat::FormatSize(reclaimable) ) );
+         } );
+      }
+   }
+
+   // The main thread must swap files at a quiet moment; it sets retry if the
+   // moment it got was not quiet
+   while (failed || throttle(lock))
+   {
+      retry = false;
+      finish();
+      condition.wait( lock, [this]{ return stop || retry; } );
+      if (stop)
+         break;
+      condition.wait_for( lock, std::chrono::seconds(1),
+         [this]{ return stop; } );
+   }
+}
+
+bool ProjectFileIO::StartBackgroundCompact()
+{
+   if (mBackgroundCompaction)
+   {
+      return false;
+   }
+
+   // Opens the database if not yet open
+   DB();
+
+   unsigned long long blockcount = 0;
+   auto cb = [&blockcount](int cols, char **vals, char **)
+   {
+      // Convert
+      wxString(vals[0]).ToULongLong(&blockcount);
+      return 0;
+   };
+
+   if (!Query("SELECT Count(*) FROM sampleblocks;", cb))
+   {
+      return false;
+   }
+
+   auto compaction = std::make_unique<BackgroundCompaction>();
+   compaction->wFileIO = shared_from_this();
+   compaction->tempName = mFileName + "_compact_temp";
+   compaction->total = blockcount;
+   compaction->reclaimable = std::max<int64_t>(0,
+      int64_t(wxFileName::GetSize(mFileName).GetValue()) - GetTotalUsage());
+
+   // Remove what a crash might have left, then make the new file
+   wxRemoveFile(compaction->tempName);
+   auto cleanup = finally([&]
+   {
+      if (compaction)
+      {
+         auto tempName = compaction->tempName;
+         compaction.reset();
+         wxRemoveFile(tempName);
+      }
+   });
+
+   // Open another connection, so that reading for the copy doesn't block
+   // the main thread
+   int rc = sqlite3_open(mFileName, &compaction->db);
+   if (rc != SQLITE_OK)
+   {
+      SetError(
+         XO("Failed to open copy of project file")
+      );
+      return false;
+   }
+
+   wxString sql;
+   sql.Printf("ATTACH DATABASE '%s' AS outbound;"
+              "PRAGMA outbound.synchronous = OFF;"
+              "PRAGMA outbound.journal_mode = OFF;",
+              compaction->tempName);
+   rc = sqlite3_exec(compaction->db, sql, nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      SetError(
+         XO("Unable to attach destination database"),
+         Verbatim(sqlite3_errmsg(compaction->db))
+      );
+      return false;
+   }
+
+   if (!InstallSchema(compaction->db, "outbound"))
+   {
+      // Message already set
+      return false;
+   }
+
+   auto pCompaction = compaction.get();
+   pCompaction->thread = std::thread([pCompaction]{ pCompaction->Work(); });
+   mBackgroundCompaction = std::move(compaction);
+
+   return true;
+}
+
+void ProjectFileIO::CancelBackgroundCompact()
+{
+   if (!mBackgroundCompaction)
+   {
+      return;
+   }
+
+   auto tempName = mBackgroundCompaction->tempName;
+   mBackgroundCompaction.reset();
+   wxRemoveFile(tempName);
+}
+
+bool ProjectFileIO::IsCompactingInBackground() const
+{
+   return mBackgroundCompaction != nullptr;
+}
+
+ProjectFileIO::CompactProgress ProjectFileIO::GetCompactProgress() const
+{
+   if (!mBackgroundCompaction)
+   {
+      return { 0, 0, 0 };
+   }
+
+   auto &compaction = *mBackgroundCompaction;
+   return { compaction.copied, compaction.total, compaction.reclaimable };
+}
+
+void ProjectFileIO::FinishBackgroundCompact()
+{
+   auto pCompaction = mBackgroundCompaction.get();
+   if (!pCompaction)
+   {
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lock{ pCompaction->mutex };
+
+      // Ignore a request made before the last retry
+      if (!pCompaction->ready)
+      {
+         return;
+      }
+
+      // Closing the connection must wait while audio streams, while a modal
+      // dialog or progress indicator may be in the middle of an edit, or
+      // while a transaction is open
+      if (!pCompaction->failed &&
+          (AudioIOBase::Get()->IsBusy() ||
+           !GetProjectFrame( mProject ).IsEnabled() ||
+           !sqlite3_get_autocommit(DB())))
+      {
+         pCompaction->ready = false;
+         pCompaction->retry = true;
+         pCompaction->condition.notify_one();
+         return;
+      }
+   }
+
+   // Stop the thread and close its connection
+   const bool failed = pCompaction->failed;
+   const FilePath tempName = pCompaction->tempName;
+   mBackgroundCompaction.reset();
+
+   // Clear the progress message
+   auto &projectStatus = ProjectStatus::Get( mProject );
+   projectStatus.Set({});
+
+   auto cleanup = finally([&]
+   {
+      if (wxFileExists(tempName))
+      {
+         wxRemoveFile(tempName);
+      }
+   });
+
+   if (failed)
+   {
+      return;
+   }
+
+   auto db = DB();
+   int rc;
+
+   // Attach the destination database
+   wxString sql;
+   sql.Printf("ATTACH DATABASE '%s' AS outbound;", tempName);
+
+   rc = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      SetDBError(
+         XO("Unable to attach destination database")
+      );
+      return;
+   }
+
+   CurrConn()->FastMode("outbound");
+
+   // Catch up with the blocks inserted and deleted since the thread began,
+   // and copy the documents as they are now
+   rc = sqlite3_exec(db,
+                     "BEGIN;"
+                     "INSERT INTO outbound.sampleblocks"
+                     "  SELECT * FROM main.sampleblocks"
+                     "  WHERE blockid NOT IN"
+                     "    (SELECT blockid FROM outbound.sampleblocks);"
+                     "DELETE FROM outbound.sampleblocks"
+                     "  WHERE blockid NOT IN"
+                     "    (SELECT blockid FROM main.sampleblocks);"
+                     "INSERT OR REPLACE INTO outbound.sampleblocks"
+                     "  SELECT * FROM main.sampleblocks"
+                     "  WHERE samples IS NOT NULL AND blockid IN"
+                     "    (SELECT blockid FROM outbound.sampleblocks"
+                     "       WHERE samples IS NULL);"
+                     "INSERT INTO outbound.pendingblocks"
+                     "  SELECT * FROM main.pendingblocks;"
+                     "INSERT INTO outbound.tags SELECT * FROM main.tags;"
+                     "INSERT INTO outbound.project SELECT * FROM main.project;"
+                     "INSERT INTO outbound.autosave SELECT * FROM main.autosave;"
+                     "INSERT INTO outbound.autosavetracks"
+                     "  SELECT * FROM main.autosavetracks;"
+                     "COMMIT;",
+                     nullptr,
+                     nullptr,
+                     nullptr);
+   if (rc != SQLITE_OK)
+   {
+      SetDBError(
+         XO("Failed to copy the project to the compacted file")
+      );
+      sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+   }
+
+   if (sqlite3_exec(db, "DETACH DATABASE outbound;", nullptr, nullptr, nullptr) != SQLITE_OK ||
+       rc != SQLITE_OK)
+   {
+      return;
+   }
+
+   auto before = wxFileName::GetSize(mFileName);
+   if (ReplaceWithCompacted(tempName))
+   {
+      auto after = wxFileName::GetSize(mFileName);
+      projectStatus.Set(
+         XO("Compacting actually freed %s of disk space.")
+            .Format(Internat::FormatSize((before - after).GetValue())) );
+   }
+}
+
 void ProjectFileIO::UpdatePrefs()
 {
    SetProjectTitle();
@@ -1090,6 +1661,10 @@ void ProjectFileIO::SetFileName(const FilePath &fileName)
 {
    auto &project = mProject;
 
+   // This happens whenever the connection changes, after which the rows of
+   // autosavetracks may not be what the last AutoSave wrote
+   mAutoSaveDigests.clear();
+
    if (!mFileName.empty())
    {
       ActiveProjects::Remove(mFileName);
@@ -1275,15 +1850,29 @@ void ProjectFileIO::WriteXML(XMLWriter &xmlFile,
                              bool recording /* = false */,
                              const std::shared_ptr<TrackList> &tracks /* = nullptr */)
 // may throw
+{
+   auto &tracklist = tracks ? *tracks : TrackList::Get(mProject);
+
+   //TIMER_START( "AudacityProject::WriteXML", xml_writer_timer );
+
+   WriteXMLStart(xmlFile);
+
+   for (auto pTrack : SavedTracks(tracklist, recording))
+      pTrack->WriteXML(xmlFile);
+
+   xmlFile.EndTag(wxT("project"));
+
+   //TIMER_STOP( xml_writer_timer );
+}
+
+void ProjectFileIO::WriteXMLStart(XMLWriter &xmlFile) const
+// may throw
 {
    auto &proj = mProject;
-   auto &tracklist = tracks ? *tracks : TrackList::Get(proj);
    auto &viewInfo = ViewInfo::Get(proj);
    auto &tags = Tags::Get(proj);
    const auto &settings = ProjectSettings::Get(proj);
 
-   //TIMER_START( "AudacityProject::WriteXML", xml_writer_timer );
-
    xmlFile.StartTag(wxT("project"));
    xmlFile.WriteAttr(wxT("xmlns"), wxT("http://audacity.sourceforge.net/xml/"));
 
@@ -1301,8 +1890,12 @@ void ProjectFileIO::WriteXML(XMLWriter &xmlFile,
                      settings.GetBandwidthSelectionFormatName().Internal());
 
    tags.WriteXML(xmlFile);
+}
 
-   unsigned int ndx = 0;
+std::vector<const Track*> ProjectFileIO::SavedTracks(
+   TrackList &tracklist, bool recording)
+{
+   std::vector<const Track*> result;
    tracklist.Any().Visit([&](Track *t)
    {
       auto useTrack = t;
@@ -1320,27 +1913,101 @@ void ProjectFileIO::WriteXML(XMLWriter &xmlFile,
          // when pushing.  Don't auto-save it.
          return;
       }
-      useTrack->WriteXML(xmlFile);
+      result.push_back(useTrack);
    });
+   return result;
+}
 
-   xmlFile.EndTag(wxT("project"));
+namespace {
+//! Computes a digest of what a track writes, without keeping the text, to
+//! tell whether it differs from what the last autosave wrote
+class XMLDigestWriter final : public XMLWriter
+{
+public:
+   void Write(const wxString &data) override
+   {
+      // 64 bit FNV-1a
+      const auto chars = data.wc_str();
+      for (size_t ii = 0, len = data.length(); ii < len; ++ii)
+         mDigest = (mDigest ^ static_cast<unsigned long long>(chars[ii]))
+            * 1099511628211ULL;
+   }
 
-   //TIMER_STOP( xml_writer_timer );
+   unsigned long long GetDigest() const { return mDigest; }
+
+private:
+   unsigned long long mDigest{ 14695981039346656037ULL };
+};
 }
 
 bool ProjectFileIO::AutoSave(bool recording)
 {
-   ProjectSerializer autosave;
+   // Edits of track contents raise no events, so tell which tracks changed
+   // by a digest of each, compared with the digest of what the last
+   // autosave wrote for the same position; serialize only the others
+   const auto tracks = SavedTracks(TrackList::Get(mProject), recording);
+   std::vector<unsigned long long> digests;
+   digests.reserve(tracks.size());
+   for (auto pTrack : tracks)
+   {
+      XMLDigestWriter digest;
+      pTrack->WriteXML(digest);
+      digests.push_back(digest.GetDigest());
+   }
+
+   // The rest of the project is small, so write it every time
+   ProjectSerializer autosave(4096);
    WriteXMLHeader(autosave);
-   WriteXML(autosave, recording);
+   WriteXMLStart(autosave);
+   autosave.EndTag(wxT("project"));
+
+   TransactionScope trans(GetConnection(), "AutoSave");
 
-   if (WriteDoc("autosave", autosave))
+   if (!WriteDoc("autosavetracks", autosave, "main", 0))
    {
-      mModified = true;
-      return true;
+      return false;
    }
 
-   return false;
+   const auto nTracks = tracks.size();
+   for (size_t ii = 0; ii < nTracks; ++ii)
+   {
+      if (ii < mAutoSaveDigests.size() && mAutoSaveDigests[ii] == digests[ii])
+      {
+         // Clean
+         continue;
+      }
+
+      // Start small; most tracks are far smaller than a whole project
+      ProjectSerializer doc(4096);
+      tracks[ii]->WriteXML(doc);
+      if (!WriteDoc("autosavetracks", doc, "main", ii + 1))
+      {
+         return false;
+      }
+   }
+
+   // Remove rows of tracks past the end, and any whole document that would
+   // take precedence
+   char sql[256];
+   sqlite3_snprintf(sizeof(sql), sql,
+      "DELETE FROM autosavetracks WHERE id > %lld;"
+      "DELETE FROM autosave;",
+      (long long) nTracks);
+   if (sqlite3_exec(DB(), sql, nullptr, nullptr, nullptr) != SQLITE_OK)
+   {
+      SetDBError(
+         XO("Failed to update the project file.\nThe following command failed:\n\n%s").Format(sql)
+      );
+      return false;
+   }
+
+   trans.Commit();
+
+   // Remember what the rows now hold
+   mAutoSaveDigests = std::move(digests);
+   mModified = true;
+
+   return true;
 }
 
 bool ProjectFileIO::AutoSaveDelete(sqlite3 *db /* = nullptr */)
@@ -1352,7 +2019,10 @@ bool ProjectFileIO::AutoSaveDelete(sqlite3 *db /* = nullptr */)
       db = DB();
    }
 
-   rc = sqlite3_exec(db, "DELETE FROM autosave;", nullptr, nullptr, nullptr);
+   rc = sqlite3_exec(db,
+      "DELETE FROM autosave;"
+      "DELETE FROM autosavetracks;",
+      nullptr, nullptr, nullptr);
    if (rc != SQLITE_OK)
    {
       SetDBError(
@@ -1362,26 +2032,122 @@ bool ProjectFileIO::AutoSaveDelete(sqlite3 *db /* = nullptr */)
    }
 
    mModified = false;
+   mAutoSaveDigests.clear();
+
+   return true;
+}
+
+bool ProjectFileIO::GetAutoSaveTracksDoc(const char *schema, wxString &project)
+{
+   project.clear();
+
+   // Files of earlier versions, attached read-only, may lack the table
+   char sql[256];
+   sqlite3_snprintf(sizeof(sql), sql,
+      "SELECT Count(*) FROM %s.sqlite_master"
+      "   WHERE type = 'table' AND name = 'autosavetracks';",
+      schema);
+   wxString result;
+   if (!GetValue(sql, result))
+   {
+      return false;
+   }
+   if (wxStrtol<char **>(result, nullptr, 10) == 0)
+   {
+      return true;
+   }
+
+   sqlite3_snprintf(sizeof(sql), sql,
+      "SELECT id, dict || doc FROM %s.autosavetracks ORDER BY id;",
+      schema);
+
+   sqlite3_stmt *stmt = nullptr;
+   auto cleanup = finally([&]
+   {
+      if (stmt)
+      {
+         sqlite3_finalize(stmt);
+      }
+   });
+
+   int rc = sqlite3_prepare_v2(DB(), sql, -1, &stmt, nullptr);
+   if (rc != SQLITE_OK)
+   {
+      SetDBError(
+         XO("Unable to prepare project file command:\n\n%s").Format(sql)
+      );
+      return false;
+   }
+
+   // Each row decodes separately, with its own dict
+   wxString tracks;
+   while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+   {
+      wxMemoryBuffer buffer;
+      buffer.AppendData(sqlite3_column_blob(stmt, 1),
+                        sqlite3_column_bytes(stmt, 1));
+
+      auto doc = ProjectSerializer::Decode(buffer);
+      if (doc.empty())
+      {
+         SetError(XO("Unable to decode project document"));
+         return false;
+      }
+
+      if (sqlite3_column_int64(stmt, 0) == 0)
+      {
+         project = doc;
+      }
+      else
+      {
+         tracks += doc;
+      }
+   }
+
+   if (rc != SQLITE_DONE)
+   {
+      SetDBError(
+         XO("Failed to retrieve data from the project file.\nThe following command failed:\n\n%s").Format(sql)
+      );
+      return false;
+   }
+
+   if (project.empty())
+   {
+      // No autosave was written in parts
+      return true;
+   }
+
+   // Merge the tracks into the project element
+   auto end = project.rfind(wxT("</project>"));
+   if (end == wxString::npos)
+   {
+      SetError(XO("Unable to decode project document"));
+      project.clear();
+      return false;
+   }
+   project.insert(end, tracks);
 
    return true;
 }
 
 bool ProjectFileIO::WriteDoc(const char *table,
                              const ProjectSerializer &autosave,
-                             const char *schema /* = "main" */)
+                             const char *schema /* = "main" */,
+                             int id /* = 1 */)
 {
    auto db = DB();
    int rc;
 
-   // For now, we always use an ID of 1. This will replace the previously
-   // writen row every time.
+   // This will replace the previously writen row with the same id
    char sql[256];
    sqlite3_snprintf(sizeof(sql),
                     sql,
-                    "INSERT INTO %s.%s(id, dict, doc) VALUES(1, ?1, ?2)"
+                    "INSERT INTO %s.%s(id, dict, doc) VALUES(%d, ?1, ?2)"
                     "       ON CONFLICT(id) DO UPDATE SET dict = ?1, doc = ?2;",
                     schema,
-                    table);
+                    table,
+                    id);
 
    sqlite3_stmt *stmt = nullptr;
    auto cleanup = finally([&]
@@ -1476,24 +2242,36 @@ bool ProjectFileIO::ImportProject(const FilePath &fileName)
          // Error already set
          return false;
       }
+   }
+
+   wxString project;
+
+   // Or the autosave doc may have been written in parts
+   if (buffer.GetDataLen() == 0)
+   {
+      if (!GetAutoSaveTracksDoc("inbound", project))
+      {
+         // Error already set
+         return false;
+      }
 
       // Missing both the autosave and project docs. This can happen if the
       // system were to crash before the first autosave into a temporary file.
-      if (buffer.GetDataLen() == 0)
+      if (project.empty())
       {
          SetError(XO("Unable to load project or autosave documents"));
          return false;
       }
    }
-
-   wxString project;
-
-   project = ProjectSerializer::Decode(buffer);
-   if (project.size() == 0)
+   else
    {
-      SetError(XO("Unable to decode project document"));
+      project = ProjectSerializer::Decode(buffer);
+      if (project.size() == 0)
+      {
+         SetError(XO("Unable to decode project document"));
 
-      return false;
+         return false;
+      }
    }
 
    // Parse the project doc
@@ -1578,15 +2356,33 @@ bool ProjectFileIO::ImportProject(const FilePath &fileName)
    {
       // Cleanup...
       sqlite3_stmt *stmt = nullptr;
+      sqlite3_stmt *pendingStmt = nullptr;
       auto cleanup = finally([&]
       {
-         // Ensure the prepared statement gets cleaned up
+         // Ensure the prepared statements get cleaned up
          if (stmt)
          {
             sqlite3_finalize(stmt);
          }
+         if (pendingStmt)
+         {
+            sqlite3_finalize(pendingStmt);
+         }
       });
 
+      // Projects of earlier versions have no pendingblocks table, and no
+      // placeholder blocks either, so failure to prepare is not an error
+      sqlite3_prepare_v2(db,
+                         "INSERT INTO main.pendingblocks"
+                         "   SELECT ?2, path, filesize, dataoffset, samplebytes,"
+                         "          isfloat, bigendian, channels, frames,"
+                         "          channel, start, length"
+                         "   FROM inbound.pendingblocks"
+                         "   WHERE blockid = ?1;",
+                         -1,
+                         &pendingStmt,
+                         nullptr);
+
       // Prepare the statement to copy the sample block from the inbound project to the
       // active project.  All columns other than the blockid column get copied.
       wxString columns(wxT("sampleformat, summin, summax, sumrms, summary256, summary64k, samples"));
@@ -1656,7 +2452,8 @@ bool ProjectFileIO::ImportProject(const FilePath &fileName)
          }
 
          // Replace the original blockid with the new one
-         attr->SetValue(wxString::Format(wxT("%lld"), sqlite3_last_insert_rowid(db)));
+         const auto newid = sqlite3_last_insert_rowid(db);
+         attr->SetValue(wxString::Format(wxT("%lld"), newid));
 
          // Reset the statement for the next iteration
          if (sqlite3_reset(stmt) != SQLITE_OK)
@@ -1664,6 +2461,27 @@ bool ProjectFileIO::ImportProject(const FilePath &fileName)
             THROW_INCONSISTENCY_EXCEPTION;
          }
 
+         // A placeholder block still needs to know where its samples are
+         if (pendingStmt)
+         {
+            if (sqlite3_bind_int64(pendingStmt, 1, blockid) != SQLITE_OK ||
+                sqlite3_bind_int64(pendingStmt, 2, newid) != SQLITE_OK)
+            {
+               wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+            }
+
+            rc = sqlite3_step(pendingStmt);
+            sqlite3_reset(pendingStmt);
+            if (rc != SQLITE_DONE)
+            {
+               SetDBError(
+                  XO("Failed to import sample block.\nThe following command failed:\n\n%s").Format(sql)
+               );
+
+               break;
+            }
+         }
+
          // Remember that we copied this node in case the user cancels
          result = progress.Update(++count, total);
          if (result != ProgressResult::Success)
@@ -1747,9 +2565,19 @@ bool ProjectFileIO::LoadProject(const FilePath &fileName)
       // Error already set
       return false;
    }
+
+   // Or the autosave doc may have been written in parts
+   if (buffer.GetDataLen() == 0)
+   {
+      if (!GetAutoSaveTracksDoc("main", project))
+      {
+         // Error already set
+         return false;
+      }
+   }
  
    // If we didn't have an autosave doc, load the project doc instead
-   if (buffer.GetDataLen() == 0)
+   if (buffer.GetDataLen() == 0 && project.empty())
    {
       usedAutosave = false;
 
@@ -1763,18 +2591,21 @@ bool ProjectFileIO::LoadProject(const FilePath &fileName)
    // Missing both the autosave and project docs. This can happen if the
    // system were to crash before the first autosave into a temporary file.
    // This should be a recoverable scenario.
-   if (buffer.GetDataLen() == 0)
+   if (buffer.GetDataLen() == 0 && project.empty())
    {
       mRecovered = true;
    }
    else
    {
-      project = ProjectSerializer::Decode(buffer);
       if (project.empty())
       {
-         SetError(XO("Unable to decode project document"));
+         project = ProjectSerializer::Decode(buffer);
+         if (project.empty())
+         {
+            SetError(XO("Unable to decode project document"));
 
-         return false;
+            return false;
+         }
       }
 
       XMLFileReader xmlFile;
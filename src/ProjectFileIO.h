@@ -13,6 +13,7 @@ Paul Licameli split from AudacityProject.h
 
 #include <memory>
 #include <unordered_set>
+#include <vector>
 
 #include "ClientData.h" // to inherit
 #include "Prefs.h" // to inherit
@@ -27,6 +28,7 @@ class AudacityProject;
 class DBConnection;
 class ProjectSerializer;
 class SqliteSampleBlock;
+class Track;
 class TrackList;
 class WaveTrack;
 
@@ -123,6 +125,28 @@ public:
    // Remove all unused space within a project file
    void Compact(const std::shared_ptr<TrackList> &tracks, bool force = false);
 
+   // Copy the sample blocks into a new file on another thread, a chunk at a
+   // time and pausing while audio streams, while the project stays open.
+   // When the copy is complete, the files are swapped during a later pass of
+   // the event loop when no stream or transaction is active.  Returns false
+   // if it could not start, or if compaction is already under way.
+   bool StartBackgroundCompact();
+
+   // Stop any background compaction and discard its file
+   void CancelBackgroundCompact();
+
+   bool IsCompactingInBackground() const;
+
+   struct CompactProgress
+   {
+      // Sample blocks copied so far, of those in the file at the start
+      int64_t copied;
+      int64_t total;
+      // Bytes of the file not used by any sample block at the start
+      int64_t reclaimable;
+   };
+   CompactProgress GetCompactProgress() const;
+
    // The last compact check did actually compact the project file if true
    bool WasCompacted();
 
@@ -142,6 +166,11 @@ public:
 private:
    void WriteXMLHeader(XMLWriter &xmlFile) const;
    void WriteXML(XMLWriter &xmlFile, bool recording = false, const std::shared_ptr<TrackList> &tracks = nullptr) /* not override */;
+   // The project start tag, its attributes, and tags, but no tracks
+   void WriteXMLStart(XMLWriter &xmlFile) const;
+   // The tracks that WriteXML writes, in order
+   static std::vector<const Track*> SavedTracks(
+      TrackList &tracklist, bool recording);
 
    // XMLTagHandler callback methods
    bool HandleXMLTag(const wxChar *tag, const wxChar **attrs) override;
@@ -179,10 +208,15 @@ private:
 
    bool CheckVersion();
    bool InstallSchema(sqlite3 *db, const char *schema = "main");
+   bool InstallAddedTables(sqlite3 *db, const char *schema = "main");
    bool UpgradeSchema();
 
    // Write project or autosave XML (binary) documents
-   bool WriteDoc(const char *table, const ProjectSerializer &autosave, const char *schema = "main");
+   bool WriteDoc(const char *table, const ProjectSerializer &autosave, const char *schema = "main", int id = 1);
+
+   // Merge the rows of the autosavetracks table into one document, or leave
+   // it empty if there are none
+   bool GetAutoSaveTracksDoc(const char *schema, wxString &project);
 
    // Application defined function to verify blockid exists is in set of blockids
    static void InSet(sqlite3_context *context, int argc, sqlite3_value **argv);
@@ -204,6 +238,14 @@ private:
 
    bool ShouldCompact(const std::shared_ptr<TrackList> &tracks);
 
+   // Close the connection, and if the compacted copy is smaller, put it in
+   // place of the project file; reopen either way.  Returns true if replaced.
+   bool ReplaceWithCompacted(const FilePath &tempName);
+
+   // Copy blocks created since background compaction started, and the
+   // documents, then swap the files.  Called on the main thread.
+   void FinishBackgroundCompact();
+
    // Gets values from SQLite B-tree structures
    static unsigned int get2(const unsigned char *ptr);
    static unsigned int get4(const unsigned char *ptr);
@@ -236,6 +278,14 @@ private:
    Connection mPrevConn;
    FilePath mPrevFileName;
    bool mPrevTemporary;
+
+   // Digests of what the rows of autosavetracks hold for the tracks, by
+   // position, if the last AutoSave wrote them on the current connection
+   std::vector<unsigned long long> mAutoSaveDigests;
+
+   // State shared with the background compaction thread, if it is running
+   struct BackgroundCompaction;
+   std::unique_ptr<BackgroundCompaction> mBackgroundCompaction;
 };
 
 class wxTopLevelWindow;
@@ -41,12 +41,36 @@
 
 #include "Experimental.h"
 
-#include <vector>
+#include <atomic>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 
-#include <wx/thread.h>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define FFT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and clang compile only the functions so marked for the wider
+// instruction sets; MSVC compiles any intrinsic anywhere
+#if defined(FFT_X86) && defined(__GNUC__)
+#define FFT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FFT_TARGET(isa)
+#endif
+
+// The vector kernels must give the same results as the scalar code, bit for
+// bit, so no compiler may fuse a multiply and an add in this file, whatever
+// -march it is given; GCC has no pragma for that, so src/CMakeLists.txt
+// passes it -ffp-contract=off
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#elif defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
 
 #ifndef M_PI
 #define	M_PI		3.14159265358979323846  /* pi */
@@ -97,53 +121,300 @@ HFFT InitializeFFT(size_t fftlen)
    return h;
 }
 
-enum : size_t { MAX_HFFT = 10 };
+namespace {
 
-// Maintain a pool:
-static std::vector< std::unique_ptr<FFTParam> > hFFTArray(MAX_HFFT);
-wxCriticalSection getFFTMutex;
+// One shared plan for each power of two size, built on first use.  A plan
+// never changes once published, so threads read it without locking.  Plans
+// are intentionally never freed, so that handles held in other static
+// objects stay valid during exit.
+std::atomic<FFTParam*> sPlans[8 * sizeof(size_t)];
+
+// Index into sPlans, or -1 for a size that gets no shared plan
+int PlanIndex(size_t fftlen)
+{
+   if (fftlen < 2 || (fftlen & (fftlen - 1)))
+      return -1;
+   int index = 0;
+   while (fftlen >>= 1)
+      ++index;
+   return index;
+}
+
+}
 
 /* Get a handle to the FFT tables of the desired length */
 /* This version keeps common tables rather than allocating a NEW table every time */
 HFFT GetFFT(size_t fftlen)
 {
-   // To do:  smarter policy about when to retain in the pool and when to
-   // allocate a unique instance.
-
-   wxCriticalSectionLocker locker{ getFFTMutex };
-   
-   size_t h = 0;
-   auto n = fftlen/2;
-   auto size = hFFTArray.size();
-   for(;
-       (h < size) && hFFTArray[h] && (n != hFFTArray[h]->Points);
-       h++)
-      ;
-   if(h < size) {
-      if(hFFTArray[h] == NULL) {
-         hFFTArray[h].reset( InitializeFFT(fftlen).release() );
-      }
-      return HFFT{ hFFTArray[h].get() };
-   } else {
-      // All buffers used, so fall back to allocating a NEW set of tables
+   const auto index = PlanIndex(fftlen);
+   if (index < 0)
       return InitializeFFT(fftlen);
+
+   auto &plan = sPlans[index];
+   auto pPlan = plan.load(std::memory_order_acquire);
+   if (!pPlan) {
+      // Threads that miss at once may each build the tables, but only one
+      // set is published, and the others are discarded
+      auto pNew = InitializeFFT(fftlen);
+      if (plan.compare_exchange_strong(pPlan, pNew.get(),
+            std::memory_order_acq_rel, std::memory_order_acquire))
+         pPlan = pNew.release();
    }
+   return HFFT{ pPlan };
 }
 
 /* Release a previously requested handle to the FFT tables */
 void FFTDeleter::operator() (FFTParam *hFFT) const
 {
-   wxCriticalSectionLocker locker{ getFFTMutex };
-
-   auto it = hFFTArray.begin(), end = hFFTArray.end();
-   while (it != end && it->get() != hFFT)
-      ++it;
-   if ( it != end )
+   const auto index = PlanIndex(hFFT->Points * 2);
+   if (index >= 0 && sPlans[index].load(std::memory_order_relaxed) == hFFT)
       ;
    else
       delete hFFT;
 }
 
+/*
+*  Vectorized butterflies.  Each pass does all groups of one stage, several
+*  butterflies at a time, so the group must have at least as many butterflies
+*  as fit in a vector; narrower stages fall back to narrower kernels.
+*
+*  A vector holds interleaved (real, imaginary) pairs of B.  Swapping within
+*  pairs and multiplying by (sin, -sin) or (-sin, sin) gives both v1 and v2 in
+*  one multiply-add, and the operations round the same as the scalar code
+*  (there is no fused multiply-add), so the results are identical.
+*/
+#ifdef FFT_X86
+namespace {
+
+const float AlternatingSigns[16] =
+   { 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1 };
+
+using Pass = void (*)(fft_type *buffer, const fft_type *end,
+   const fft_type *sptr, size_t ButterfliesPerGroup);
+
+FFT_TARGET("sse2")
+void ForwardPassSSE2(fft_type *buffer, const fft_type *end,
+   const fft_type *sptr, size_t ButterfliesPerGroup)
+{
+   const auto step = ButterfliesPerGroup * 2;
+   const auto signs = _mm_loadu_ps(AlternatingSigns);
+   for (auto group = buffer; group < end; group += 2 * step, sptr += 2) {
+      // v2 comes out negated, which the sums below allow for
+      const auto sin = _mm_mul_ps(_mm_set1_ps(sptr[0]), signs);
+      const auto cos = _mm_set1_ps(sptr[1]);
+      for (auto A = group, B = group + step; A < group + step; A += 4, B += 4) {
+         const auto b = _mm_loadu_ps(B);
+         const auto swapped = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1));
+         const auto v = _mm_add_ps(_mm_mul_ps(b, cos), _mm_mul_ps(swapped, sin));
+         const auto newB = _mm_add_ps(_mm_loadu_ps(A), v);
+         _mm_storeu_ps(B, newB);
+         _mm_storeu_ps(A, _mm_sub_ps(newB, _mm_add_ps(v, v)));
+      }
+   }
+}
+
+FFT_TARGET("sse2")
+void InversePassSSE2(fft_type *buffer, const fft_type *end,
+   const fft_type *sptr, size_t ButterfliesPerGroup)
+{
+   const auto step = ButterfliesPerGroup * 2;
+   const auto signs = _mm_loadu_ps(AlternatingSigns);
+   const auto half = _mm_set1_ps(0.5f);
+   for (auto group = buffer; group < end; group += 2 * step, sptr += 2) {
+      const auto sin = _mm_mul_ps(_mm_set1_ps(-sptr[0]), signs);
+      const auto cos = _mm_set1_ps(sptr[1]);
+      for (auto A = group, B = group + step; A < group + step; A += 4, B += 4) {
+         const auto b = _mm_loadu_ps(B);
+         const auto swapped = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1));
+         const auto v = _mm_add_ps(_mm_mul_ps(b, cos), _mm_mul_ps(swapped, sin));
+         const auto newB = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(A), v), half);
+         _mm_storeu_ps(B, newB);
+         _mm_storeu_ps(A, _mm_sub_ps(newB, v));
+      }
+   }
+}
+
+FFT_TARGET("avx2")
+void ForwardPassAVX2(fft_type *buffer, const fft_type *end,
+   const fft_type *sptr, size_t ButterfliesPerGroup)
+{
+   const auto step = ButterfliesPerGroup * 2;
+   const auto signs = _mm256_loadu_ps(AlternatingSigns);
+   for (auto group = buffer; group < end; group += 2 * step, sptr += 2) {
+      const auto sin = _mm256_mul_ps(_mm256_set1_ps(sptr[0]), signs);
+      const auto cos = _mm256_set1_ps(sptr[1]);
+      for (auto A = group, B = group + step; A < group + step; A += 8, B += 8) {
+         const auto b = _mm256_loadu_ps(B);
+         const auto swapped = _mm256_permute_ps(b, _MM_SHUFFLE(2, 3, 0, 1));
+         const auto v = _mm256_add_ps(
+            _mm256_mul_ps(b, cos), _mm256_mul_ps(swapped, sin));
+         const auto newB = _mm256_add_ps(_mm256_loadu_ps(A), v);
+         _mm256_storeu_ps(B, newB);
+         _mm256_storeu_ps(A, _mm256_sub_ps(newB, _mm256_add_ps(v, v)));
+      }
+   }
+}
+
+FFT_TARGET("avx2")
+void InversePassAVX2(fft_type *buffer, const fft_type *end,
+   const fft_type *sptr, size_t ButterfliesPerGroup)
+{
+   const auto step = ButterfliesPerGroup * 2;
+   const auto signs = _mm256_loadu_ps(AlternatingSigns);
+   const auto half = _mm256_set1_ps(0.5f);
+   for (auto group = buffer; group < end; group += 2 * step, sptr += 2) {
+      const auto sin = _mm256_mul_ps(_mm256_set1_ps(-sptr[0]), signs);
+      const auto cos = _mm256_set1_ps(sptr[1]);
+      for (auto A = group, B = group + step; A < group + step; A += 8, B += 8) {
+         const auto b = _mm256_loadu_ps(B);
+         const auto swapped = _mm256_permute_ps(b, _MM_SHUFFLE(2, 3, 0, 1));
+         const auto v = _mm256_add_ps(
+            _mm256_mul_ps(b, cos), _mm256_mul_ps(swapped, sin));
+         const auto newB =
+            _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(A), v), half);
+         _mm256_storeu_ps(B, newB);
+         _mm256_storeu_ps(A, _mm256_sub_ps(newB, v));
+      }
+   }
+}
+
+// AVX-512 implies FMA, and the compiler may fuse a multiply with an add,
+// rounding once where the scalar code rounds twice; the explicitly rounded
+// multiply prevents that.  (The masked forms, with all lanes selected, avoid
+// spurious warnings from some compilers about the unmasked intrinsics.)
+FFT_TARGET("avx512f")
+inline __m512 Multiply512(__m512 a, __m512 b)
+{
+   return _mm512_mask_mul_round_ps(a, 0xFFFF, a, b,
+      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+
+FFT_TARGET("avx512f")
+inline __m512 SwapPairs512(__m512 a)
+{
+   return _mm512_mask_permute_ps(a, 0xFFFF, a, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+FFT_TARGET("avx512f")
+void ForwardPassAVX512(fft_type *buffer, const fft_type *end,
+   const fft_type *sptr, size_t ButterfliesPerGroup)
+{
+   const auto step = ButterfliesPerGroup * 2;
+   const auto signs = _mm512_loadu_ps(AlternatingSigns);
+   for (auto group = buffer; group < end; group += 2 * step, sptr += 2) {
+      const auto sin = _mm512_mul_ps(_mm512_set1_ps(sptr[0]), signs);
+      const auto cos = _mm512_set1_ps(sptr[1]);
+      for (auto A = group, B = group + step; A < group + step; A += 16, B += 16) {
+         const auto b = _mm512_loadu_ps(B);
+         const auto v = _mm512_add_ps(
+            Multiply512(b, cos), Multiply512(SwapPairs512(b), sin));
+         const auto newB = _mm512_add_ps(_mm512_loadu_ps(A), v);
+         _mm512_storeu_ps(B, newB);
+         _mm512_storeu_ps(A, _mm512_sub_ps(newB, _mm512_add_ps(v, v)));
+      }
+   }
+}
+
+FFT_TARGET("avx512f")
+void InversePassAVX512(fft_type *buffer, const fft_type *end,
+   const fft_type *sptr, size_t ButterfliesPerGroup)
+{
+   const auto step = ButterfliesPerGroup * 2;
+   const auto signs = _mm512_loadu_ps(AlternatingSigns);
+   const auto half = _mm512_set1_ps(0.5f);
+   for (auto group = buffer; group < end; group += 2 * step, sptr += 2) {
+      const auto sin = _mm512_mul_ps(_mm512_set1_ps(-sptr[0]), signs);
+      const auto cos = _mm512_set1_ps(sptr[1]);
+      for (auto A = group, B = group + step; A < group + step; A += 16, B += 16) {
+         const auto b = _mm512_loadu_ps(B);
+         const auto v = _mm512_add_ps(
+            Multiply512(b, cos), Multiply512(SwapPairs512(b), sin));
+         const auto newB =
+            Multiply512(_mm512_add_ps(_mm512_loadu_ps(A), v), half);
+         _mm512_storeu_ps(B, newB);
+         _mm512_storeu_ps(A, _mm512_sub_ps(newB, v));
+      }
+   }
+}
+
+struct Kernel {
+   FFTKernel kernel;
+   size_t butterflies; // per vector
+   Pass forward;
+   Pass inverse;
+};
+
+// Widest first
+const Kernel Kernels[] = {
+   { FFTKernel::AVX512, 8, ForwardPassAVX512, InversePassAVX512 },
+   { FFTKernel::AVX2,   4, ForwardPassAVX2,   InversePassAVX2 },
+   { FFTKernel::SSE2,   2, ForwardPassSSE2,   InversePassSSE2 },
+};
+
+FFTKernel DetectFFTKernel()
+{
+#ifdef _MSC_VER
+   int info[4];
+   __cpuid(info, 0);
+   const auto maxLeaf = info[0];
+   __cpuid(info, 1);
+   const bool sse2 = (info[3] & (1 << 26)) != 0;
+   // The operating system must also save the wider registers
+   const bool osxsave = (info[2] & (1 << 27)) != 0;
+   const bool avx = (info[2] & (1 << 28)) != 0;
+   const auto xcr0 = osxsave ? _xgetbv(0) : 0;
+   bool avx2 = false, avx512 = false;
+   if (maxLeaf >= 7) {
+      __cpuidex(info, 7, 0);
+      avx2 = avx && (info[1] & (1 << 5)) && (xcr0 & 0x06) == 0x06;
+      avx512 = (info[1] & (1 << 16)) && (xcr0 & 0xE6) == 0xE6;
+   }
+#else
+   __builtin_cpu_init();
+   const bool sse2 = __builtin_cpu_supports("sse2");
+   const bool avx2 = __builtin_cpu_supports("avx2");
+   const bool avx512 = __builtin_cpu_supports("avx512f");
+#endif
+   return avx512 ? FFTKernel::AVX512
+      : avx2 ? FFTKernel::AVX2
+      : sse2 ? FFTKernel::SSE2
+      : FFTKernel::Scalar;
+}
+
+// The widest kernel, not wider than maxKernel, that does whole vectors of
+// the stage; or null, for the scalar code
+const Kernel *ChooseKernel(FFTKernel maxKernel, size_t ButterfliesPerGroup)
+{
+   for (const auto &kernel : Kernels)
+      if (kernel.kernel <= maxKernel &&
+          kernel.butterflies <= ButterfliesPerGroup)
+         return &kernel;
+   return nullptr;
+}
+
+}
+#endif
+
+FFTKernel BestFFTKernel()
+{
+#ifdef FFT_X86
+   static const auto kernel = DetectFFTKernel();
+   return kernel;
+#else
+   return FFTKernel::Scalar;
+#endif
+}
+
+const char *FFTKernelName(FFTKernel kernel)
+{
+   switch (kernel) {
+      case FFTKernel::SSE2: return "SSE2";
+      case FFTKernel::AVX2: return "AVX2";
+      case FFTKernel::AVX512: return "AVX-512";
+      default: return "scalar";
+   }
+}
+
 /*
 *  Forward FFT routine.  Must call GetFFT(fftlen) first!
 *
@@ -163,6 +434,11 @@ void FFTDeleter::operator() (FFTParam *hFFT) const
 *        good when using fixed point arithmetic)
 */
 void RealFFTf(fft_type *buffer, const FFTParam *h)
+{
+   RealFFTf(buffer, h, BestFFTKernel());
+}
+
+void RealFFTf(fft_type *buffer, const FFTParam *h, FFTKernel maxKernel)
 {
    fft_type *A,*B;
    const fft_type *sptr;
@@ -185,6 +461,13 @@ void RealFFTf(fft_type *buffer, const FFTParam *h)
 
    while(ButterfliesPerGroup > 0)
    {
+#ifdef FFT_X86
+      if (auto kernel = ChooseKernel(maxKernel, ButterfliesPerGroup)) {
+         kernel->forward(buffer, endptr1, h->SinTable.get(), ButterfliesPerGroup);
+         ButterfliesPerGroup >>= 1;
+         continue;
+      }
+#endif
       A = buffer;
       B = buffer + ButterfliesPerGroup * 2;
       sptr = h->SinTable.get();
@@ -265,6 +548,11 @@ void RealFFTf(fft_type *buffer, const FFTParam *h)
 *        good when using fixed point arithmetic)
 */
 void InverseRealFFTf(fft_type *buffer, const FFTParam *h)
+{
+   InverseRealFFTf(buffer, h, BestFFTKernel());
+}
+
+void InverseRealFFTf(fft_type *buffer, const FFTParam *h, FFTKernel maxKernel)
 {
    fft_type *A,*B;
    const fft_type *sptr;
@@ -322,6 +610,13 @@ void InverseRealFFTf(fft_type *buffer, const FFTParam *h)
 
    while(ButterfliesPerGroup > 0)
    {
+#ifdef FFT_X86
+      if (auto kernel = ChooseKernel(maxKernel, ButterfliesPerGroup)) {
+         kernel->inverse(buffer, endptr1, h->SinTable.get(), ButterfliesPerGroup);
+         ButterfliesPerGroup >>= 1;
+         continue;
+      }
+#endif
       A = buffer;
       B = buffer + ButterfliesPerGroup * 2;
       sptr = h->SinTable.get();
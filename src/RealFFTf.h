@@ -25,9 +25,22 @@ using HFFT = std::unique_ptr<
    FFTParam, FFTDeleter
 >;
 
+// Power of two sizes share one set of tables, which never changes, so this
+// may be called from any thread, and it takes no lock once the tables exist
 HFFT GetFFT(size_t);
 void RealFFTf(fft_type *, const FFTParam *);
 void InverseRealFFTf(fft_type *, const FFTParam *);
+
+// Instruction sets for the butterflies of the transforms, chosen at run time.
+// All of them give results identical to the scalar code.
+enum class FFTKernel { Scalar, SSE2, AVX2, AVX512 };
+// The widest kernel this processor supports, which the transforms use
+FFTKernel BestFFTKernel();
+const char *FFTKernelName(FFTKernel);
+// As above, but using no kernel wider than maxKernel, for comparisons
+void RealFFTf(fft_type *, const FFTParam *, FFTKernel maxKernel);
+void InverseRealFFTf(fft_type *, const FFTParam *, FFTKernel maxKernel);
+
 void ReorderToTime(const FFTParam *hFFT, const fft_type *buffer, fft_type *TimeOut);
 void ReorderToFreq(const FFTParam *hFFT, const fft_type *buffer,
 		   fft_type *RealOut, fft_type *ImagOut);
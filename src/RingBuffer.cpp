@@ -51,6 +51,16 @@ size_t RingBuffer::Free( size_t start, size_t end )
    return std::max<size_t>(mBufferSize - Filled( start, end ), 4) - 4;
 }
 
+auto RingBuffer::MakeSpans( size_t pos, size_t samples ) -> Spans
+{
+   const auto size = SAMPLE_SIZE(mFormat);
+   const auto first = std::min( samples, mBufferSize - pos );
+   return {
+      { mBuffer.ptr() + pos * size, first },
+      { mBuffer.ptr(), samples - first }
+   };
+}
+
 //
 // For the writer only:
 // Only writer writes the end, so it can read it again relaxed
@@ -133,6 +143,22 @@ size_t RingBuffer::Clear(sampleFormat format, size_t samplesToClear)
    return cleared;
 }
 
+auto RingBuffer::GetWriteSpans(size_t samples) -> Spans
+{
+   auto start = mStart.load( std::memory_order_acquire );
+   auto end = mEnd.load( std::memory_order_relaxed );
+   return MakeSpans( end, std::min( samples, Free( start, end ) ) );
+}
+
+void RingBuffer::CommitWrite(size_t samples)
+{
+   auto end = mEnd.load( std::memory_order_relaxed );
+
+   // Atomically update the end pointer with release, so the nonatomic writes
+   // done in place to the buffer don't get reordered after
+   mEnd.store((end + samples) % mBufferSize, std::memory_order_release);
+}
+
 //
 // For the reader only:
 // Only reader writes the start, so it can read it again relaxed
@@ -194,3 +220,21 @@ size_t RingBuffer::Discard(size_t samplesToDiscard)
 
    return samplesToDiscard;
 }
+
+auto RingBuffer::GetReadSpans(size_t samples) -> Spans
+{
+   // Must match the writer's release with acquire for well defined reads of
+   // the buffer
+   auto end = mEnd.load( std::memory_order_acquire );
+   auto start = mStart.load( std::memory_order_relaxed );
+   return MakeSpans( start, std::min( samples, Filled( start, end ) ) );
+}
+
+void RingBuffer::CommitRead(size_t samples)
+{
+   auto start = mStart.load( std::memory_order_relaxed );
+
+   // Communicate to writer that we have consumed some data, with release
+   // ordering, so that the reads done in place happen-before reuse of space
+   mStart.store((start + samples) % mBufferSize, std::memory_order_release);
+}
@@ -13,12 +13,21 @@
 
 #include "SampleFormat.h"
 #include <atomic>
+#include <utility>
 
 class RingBuffer {
  public:
    RingBuffer(sampleFormat format, size_t size);
    ~RingBuffer();
 
+   //! A contiguous run of samples, in the format of the buffer
+   struct Span {
+      samplePtr ptr;
+      size_t samples;
+   };
+   //! The storage may wrap around, so there are at most two spans
+   using Spans = std::pair< Span, Span >;
+
    //
    // For the writer only:
    //
@@ -29,6 +38,12 @@ class RingBuffer {
               size_t padding = 0);
    size_t Clear(sampleFormat format, size_t samples);
 
+   //! Storage for up to the given number of samples, to be written in place
+   Spans GetWriteSpans(size_t samples);
+   //! Make the first samples written in the spans available to the reader
+   /*! At most the total size of the spans last gotten */
+   void CommitWrite(size_t samples);
+
    //
    // For the reader only:
    //
@@ -37,9 +52,16 @@ class RingBuffer {
    size_t Get(samplePtr buffer, sampleFormat format, size_t samples);
    size_t Discard(size_t samples);
 
+   //! Up to the given number of filled samples, to be read in place
+   Spans GetReadSpans(size_t samples);
+   //! Let the writer reuse the first samples of the spans
+   /*! At most the total size of the spans last gotten */
+   void CommitRead(size_t samples);
+
  private:
    size_t Filled( size_t start, size_t end );
    size_t Free( size_t start, size_t end );
+   Spans MakeSpans( size_t pos, size_t samples );
 
    enum : size_t { CacheLine = 64 };
    /*
@@ -8,11 +8,14 @@ SampleBlock.cpp
 
 #include "Audacity.h"
 #include "InconsistencyException.h"
+#include "PCMFileReference.h"
 #include "SampleBlock.h"
 #include "SampleFormat.h"
 
 #include <wx/defs.h>
 
+wxDEFINE_EVENT(EVT_SAMPLE_BLOCKS_SUMMARIZED, wxCommandEvent);
+
 static SampleBlockFactoryFactory& installedFactory()
 {
    static SampleBlockFactoryFactory theFactory;
@@ -38,6 +41,22 @@ SampleBlockFactoryPtr SampleBlockFactory::New( AudacityProject &project )
 
 SampleBlockFactory::~SampleBlockFactory() = default;
 
+SampleBlockFactory::BatchScope::~BatchScope() = default;
+
+auto SampleBlockFactory::BeginBatch() -> BatchScopePtr
+{
+   return {};
+}
+
+auto SampleBlockFactory::GetCacheStatistics() const -> CacheStatistics
+{
+   return {};
+}
+
+void SampleBlockFactory::SetPinnedBlocks( SampleBlockIDs )
+{
+}
+
 SampleBlockPtr SampleBlockFactory::Create(samplePtr src,
    size_t numsamples,
    sampleFormat srcformat)
@@ -68,8 +87,44 @@ SampleBlockPtr SampleBlockFactory::CreateFromXML(
    return result;
 }
 
+SampleBlockPtr SampleBlockFactory::CreateReference(
+   const std::shared_ptr<const PCMFileReference> &pReference,
+   unsigned channel, unsigned long long start,
+   size_t numsamples, sampleFormat format)
+{
+   auto result =
+      DoCreateReference(pReference, channel, start, numsamples, format);
+   if (!result)
+      THROW_INCONSISTENCY_EXCEPTION;
+   return result;
+}
+
+SampleBlockPtr SampleBlockFactory::DoCreateReference(
+   const std::shared_ptr<const PCMFileReference> &pReference,
+   unsigned channel, unsigned long long start,
+   size_t numsamples, sampleFormat format)
+{
+   SampleBuffer buffer(numsamples, format);
+   pReference->Read(channel, start, buffer.ptr(), format, numsamples);
+   return DoCreate(buffer.ptr(), numsamples, format);
+}
+
 SampleBlock::~SampleBlock() = default;
 
+bool SampleBlock::IsSummaryAvailable() const
+{
+   return true;
+}
+
+bool SampleBlock::GetSpectrumTile(const SpectrumKey &, std::vector<float> &)
+{
+   return false;
+}
+
+void SampleBlock::SetSpectrumTile(const SpectrumKey &, const float *, size_t)
+{
+}
+
 size_t SampleBlock::GetSamples(samplePtr dest,
                    sampleFormat destformat,
                    size_t sampleoffset,
@@ -105,3 +160,23 @@ size_t SampleBlock::GetSamples(samplePtr dest,
    }
 }
 
+SampleSums SampleBlock::GetSums(size_t start, size_t len, bool mayThrow)
+{
+   try{ return DoGetSums(start, len); }
+   catch( ... ) {
+      if( mayThrow )
+         throw;
+      return {};
+   }
+}
+
+SampleSums SampleBlock::GetSums(bool mayThrow)
+{
+   try{ return DoGetSums(); }
+   catch( ... ) {
+      if( mayThrow )
+         throw;
+      return {};
+   }
+}
+
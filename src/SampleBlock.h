@@ -14,8 +14,12 @@ SampleBlock.h
 #include <functional>
 #include <memory>
 #include <unordered_set>
+#include <vector>
+
+#include <wx/event.h>
 
 class AudacityProject;
+class PCMFileReference;
 class ProjectFileIO;
 class XMLWriter;
 
@@ -36,6 +40,23 @@ public:
    float RMS = 0;
 };
 
+//! Totals of a run of samples, from which its mean and RMS follow exactly
+class SampleSums
+{
+public:
+   double sum = 0;
+   double sumSquares = 0;
+   sampleCount count = 0;
+
+   SampleSums &operator += (const SampleSums &other)
+   {
+      sum += other.sum;
+      sumSquares += other.sumSquares;
+      count += other.count;
+      return *this;
+   }
+};
+
 class SqliteSampleBlockFactory;
 
 ///\brief Abstract class allows access to contents of a block of sound samples,
@@ -66,6 +87,10 @@ public:
    virtual bool
       GetSummary64k(float *dest, size_t frameoffset, size_t numframes) = 0;
 
+   //! Whether the summaries are computed yet, so that displays may draw
+   //! placeholders instead; default returns true
+   virtual bool IsSummaryAvailable() const;
+
    /// Gets extreme values for the specified region
    // If !mayThrow and there is an error, ignores it and returns zeroes.
    // That may be appropriate when only attempting to display samples, not edit.
@@ -77,10 +102,40 @@ public:
    // That may be appropriate when only attempting to display samples, not edit.
    MinMaxRMS GetMinMaxRMS(bool mayThrow = true) const;
 
+   /// Gets sums of the specified region, reading its samples
+   // If !mayThrow and there is an error, ignores it and returns zeroes.
+   SampleSums GetSums(size_t start, size_t len, bool mayThrow = true);
+
+   /// Gets sums of the entire block, usually without reading samples
+   // If !mayThrow and there is an error, ignores it and returns zeroes.
+   SampleSums GetSums(bool mayThrow = true);
+
    virtual size_t GetSpaceUsage() const = 0;
 
    virtual void SaveXML(XMLWriter &xmlFile) = 0;
 
+   //! Identifies spectrogram columns that depend on this block's samples only
+   struct SpectrumKey
+   {
+      int windowType;
+      size_t windowSize;
+      size_t zeroPaddingFactor;
+      //! Samples between the centers of successive columns
+      size_t hop;
+   };
+
+   //! Retrieve columns stored by SetSpectrumTile with an equal key
+   /*! Non-throwing.  Default finds nothing.  Values may be rounded.
+    @return whether found */
+   virtual bool GetSpectrumTile(
+      const SpectrumKey &key, std::vector<float> &columns);
+
+   //! Store columns for later retrieval, perhaps in later sessions
+   /*! Non-throwing, because storage is only a cache; it may be dropped, or
+    written later.  Default does nothing. */
+   virtual void SetSpectrumTile(
+      const SpectrumKey &key, const float *columns, size_t count);
+
 protected:
    virtual size_t DoGetSamples(samplePtr dest,
                      sampleFormat destformat,
@@ -90,6 +145,10 @@ protected:
    virtual MinMaxRMS DoGetMinMaxRMS(size_t start, size_t len) = 0;
 
    virtual MinMaxRMS DoGetMinMaxRMS() const = 0;
+
+   virtual SampleSums DoGetSums(size_t start, size_t len) = 0;
+
+   virtual SampleSums DoGetSums() = 0;
 };
 
 // Makes a useful function object
@@ -117,6 +176,7 @@ public:
    virtual ~SampleBlockFactory();
 
    // Returns a non-null pointer or else throws an exception
+   // May be called from several threads at once, each for its own sequence
    SampleBlockPtr Create(samplePtr src,
       size_t numsamples,
       sampleFormat srcformat);
@@ -131,6 +191,14 @@ public:
       sampleFormat srcformat,
       const wxChar **attrs);
 
+   //! Returns a non-null pointer or else throws an exception
+   /*! The block holds numsamples samples of one channel of the file, from
+    frame start, converted to format (int16Sample or floatSample) */
+   SampleBlockPtr CreateReference(
+      const std::shared_ptr<const PCMFileReference> &pReference,
+      unsigned channel, unsigned long long start,
+      size_t numsamples, sampleFormat format);
+
    using SampleBlockIDs = std::unordered_set<SampleBlockID>;
    /*! @return ids of all sample blocks created by this factory and still extant */
    virtual SampleBlockIDs GetActiveBlockIDs() = 0;
@@ -142,6 +210,36 @@ public:
    virtual BlockDeletionCallback SetBlockDeletionCallback(
       BlockDeletionCallback callback ) = 0;
 
+   //! Base class of objects that group the storage of many new blocks
+   class BatchScope
+   {
+   public:
+      virtual ~BatchScope();
+   };
+   using BatchScopePtr = std::unique_ptr< BatchScope >;
+
+   //! Hint that many blocks will be created soon, as for an import
+   /*! The factory may then store new blocks in fewer, larger commits, until
+    the returned object is destroyed.  Create() still throws for any block that
+    could not be stored, so callers keep the same exception safety guarantees.
+    @return null if the factory does not batch, or a batch is already active */
+   virtual BatchScopePtr BeginBatch();
+
+   //! Counts of reads of sample data answered from memory, or from storage
+   struct CacheStatistics
+   {
+      unsigned long long hits = 0;
+      unsigned long long misses = 0;
+      size_t bytes = 0;
+      size_t capacity = 0;
+   };
+   //! Default returns all zeroes
+   virtual CacheStatistics GetCacheStatistics() const;
+
+   //! Keep the samples of these blocks in memory once read, until replaced
+   /*! Default does nothing */
+   virtual void SetPinnedBlocks( SampleBlockIDs ids );
+
 protected:
    // The override should throw more informative exceptions on error than the
    // default InconsistencyException thrown by Create
@@ -160,6 +258,18 @@ protected:
    virtual SampleBlockPtr DoCreateFromXML(
       sampleFormat srcformat,
       const wxChar **attrs) = 0;
+
+   //! Default reads the samples from the file now and passes them to
+   //! DoCreate; the override may instead read them later
+   virtual SampleBlockPtr DoCreateReference(
+      const std::shared_ptr<const PCMFileReference> &pReference,
+      unsigned channel, unsigned long long start,
+      size_t numsamples, sampleFormat format);
 };
 
+//! Sent to the project when summaries of some of its blocks have become
+//! available
+wxDECLARE_EXPORTED_EVENT(AUDACITY_DLL_API,
+   EVT_SAMPLE_BLOCKS_SUMMARIZED, wxCommandEvent);
+
 #endif
@@ -46,6 +46,11 @@
 #include "Dither.h"
 #include "Internat.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SAMPLE_FORMAT_SSE2
+#include <emmintrin.h>
+#endif
+
 static DitherType gLowQualityDither = DitherType::none;
 static DitherType gHighQualityDither = DitherType::none;
 static Dither gDitherAlgorithm;
@@ -106,7 +111,19 @@ void CopySamples(samplePtr src, sampleFormat srcFormat,
                  unsigned int srcStride /* = 1 */,
                  unsigned int dstStride /* = 1 */)
 {
-   gDitherAlgorithm.Apply(
+   CopySamples(gDitherAlgorithm, src, srcFormat, dst, dstFormat, len,
+      highQuality, srcStride, dstStride);
+}
+
+void CopySamples(Dither &dither,
+                 samplePtr src, sampleFormat srcFormat,
+                 samplePtr dst, sampleFormat dstFormat,
+                 unsigned int len,
+                 bool highQuality, /* = true */
+                 unsigned int srcStride /* = 1 */,
+                 unsigned int dstStride /* = 1 */)
+{
+   dither.Apply(
       highQuality ? gHighQualityDither : gLowQualityDither,
       src, srcFormat, dst, dstFormat, len, srcStride, dstStride);
 }
@@ -121,3 +138,86 @@ void CopySamplesNoDither(samplePtr src, sampleFormat srcFormat,
       DitherType::none,
       src, srcFormat, dst, dstFormat, len, srcStride, dstStride);
 }
+
+namespace {
+
+template< typename Sample >
+void DeinterleaveFrames(const Sample *src, Sample *const *dests,
+   unsigned int nChannels, size_t start, size_t len)
+{
+   src += start * nChannels;
+   for (auto ii = start; ii < len; ++ii)
+      for (unsigned int channel = 0; channel < nChannels; ++channel)
+         dests[channel][ii] = *src++;
+}
+
+}
+
+void DeinterleaveSamples(samplePtr src, sampleFormat format,
+                         const samplePtr *dests, unsigned int nChannels,
+                         size_t len)
+{
+   // Frames done by the vectorized loops; the scalar loops finish the rest
+   size_t done = 0;
+
+   if (format == floatSample) {
+      const auto fsrc = reinterpret_cast<const float *>(src);
+      const auto fdests = reinterpret_cast<float *const *>(dests);
+#ifdef SAMPLE_FORMAT_SSE2
+      if (nChannels == 2) {
+         const auto left = fdests[0], right = fdests[1];
+         for (; done + 4 <= len; done += 4) {
+            const auto a = _mm_loadu_ps(fsrc + 2 * done);
+            const auto b = _mm_loadu_ps(fsrc + 2 * done + 4);
+            _mm_storeu_ps(left + done, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(right + done, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+         }
+      }
+      else if (nChannels == 4) {
+         for (; done + 4 <= len; done += 4) {
+            auto p = fsrc + 4 * done;
+            auto r0 = _mm_loadu_ps(p), r1 = _mm_loadu_ps(p + 4),
+               r2 = _mm_loadu_ps(p + 8), r3 = _mm_loadu_ps(p + 12);
+            // Rows of frames become rows of channels
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(fdests[0] + done, r0);
+            _mm_storeu_ps(fdests[1] + done, r1);
+            _mm_storeu_ps(fdests[2] + done, r2);
+            _mm_storeu_ps(fdests[3] + done, r3);
+         }
+      }
+#endif
+      DeinterleaveFrames(fsrc, fdests, nChannels, done, len);
+   }
+   else if (format == int16Sample) {
+      const auto ssrc = reinterpret_cast<const short *>(src);
+      const auto sdests = reinterpret_cast<short *const *>(dests);
+#ifdef SAMPLE_FORMAT_SSE2
+      if (nChannels == 2) {
+         const auto left = sdests[0], right = sdests[1];
+         for (; done + 8 <= len; done += 8) {
+            const auto a = _mm_loadu_si128(
+               reinterpret_cast<const __m128i *>(ssrc + 2 * done));
+            const auto b = _mm_loadu_si128(
+               reinterpret_cast<const __m128i *>(ssrc + 2 * done + 8));
+            // Each 32 bit lane holds one frame, left channel in the low half.
+            // Sign-extend each half to 32 bits, then pack them again.
+            const auto leftA = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+            const auto leftB = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(left + done),
+               _mm_packs_epi32(leftA, leftB));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(right + done),
+               _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+         }
+      }
+#endif
+      DeinterleaveFrames(ssrc, sdests, nChannels, done, len);
+   }
+   else {
+      const auto size = SAMPLE_SIZE(format);
+      for (unsigned int channel = 0; channel < nChannels; ++channel)
+         for (size_t ii = 0; ii < len; ++ii)
+            memcpy(dests[channel] + ii * size,
+               src + (ii * nChannels + channel) * size, size);
+   }
+}
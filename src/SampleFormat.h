@@ -130,6 +130,18 @@ void      CopySamples(samplePtr src, sampleFormat srcFormat,
                       unsigned int srcStride=1,
                       unsigned int dstStride=1);
 
+class Dither;
+
+//! Like CopySamples, but with the given ditherer, not the shared one
+/*! Threads that convert at the same time must each use their own ditherer,
+ whose state carries from call to call */
+void      CopySamples(Dither &dither,
+                      samplePtr src, sampleFormat srcFormat,
+                      samplePtr dst, sampleFormat dstFormat,
+                      unsigned int len, bool highQuality=true,
+                      unsigned int srcStride=1,
+                      unsigned int dstStride=1);
+
 void      CopySamplesNoDither(samplePtr src, sampleFormat srcFormat,
                       samplePtr dst, sampleFormat dstFormat,
                       unsigned int len,
@@ -142,6 +154,12 @@ void      ClearSamples(samplePtr buffer, sampleFormat format,
 void      ReverseSamples(samplePtr buffer, sampleFormat format,
                          int start, int len);
 
+// Copy each channel of len interleaved frames into its own buffer, without
+// conversion.  Two or four channels of int16Sample or floatSample are fastest.
+void      DeinterleaveSamples(samplePtr src, sampleFormat format,
+                              const samplePtr *dests, unsigned int nChannels,
+                              size_t len);
+
 //
 // This must be called on startup and everytime NEW ditherers
 // are set in preferences.
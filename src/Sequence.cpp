@@ -368,6 +368,51 @@ float Sequence::GetRMS(sampleCount start, sampleCount len, bool mayThrow) const
    return sqrt(sumsq / length.as_double() );
 }
 
+SampleSums Sequence::GetSums(
+   sampleCount start, sampleCount len, bool mayThrow) const
+{
+   if (len == 0 || mBlock.size() == 0)
+      return {};
+
+   SampleSums sums;
+
+   unsigned int block0 = FindBlock(start);
+   unsigned int block1 = FindBlock(start + len - 1);
+
+   // Whole blocks in the middle have their sums already
+   for (unsigned b = block0 + 1; b < block1; b++)
+      sums += mBlock[b].sb->GetSums(mayThrow);
+
+   // Only the blocks at the ends may need samples read
+   {
+      const SeqBlock &theBlock = mBlock[block0];
+      const auto &sb = theBlock.sb;
+      // start lies within theBlock
+      auto s0 = ( start - theBlock.start ).as_size_t();
+      const auto maxl0 =
+         (theBlock.start + sb->GetSampleCount() - start).as_size_t();
+      const auto l0 = limitSampleBufferSize( maxl0, len );
+
+      sums += (s0 == 0 && l0 == sb->GetSampleCount())
+         ? sb->GetSums(mayThrow)
+         : sb->GetSums(s0, l0, mayThrow);
+   }
+
+   if (block1 > block0) {
+      const SeqBlock &theBlock = mBlock[block1];
+      const auto &sb = theBlock.sb;
+
+      // start + len - 1 lies within theBlock
+      const auto l0 = ( start + len - theBlock.start ).as_size_t();
+
+      sums += (l0 == sb->GetSampleCount())
+         ? sb->GetSums(mayThrow)
+         : sb->GetSums(0, l0, mayThrow);
+   }
+
+   return sums;
+}
+
 // Must pass in the correct factory for the result.  If it's not the same
 // as in this, then block contents must be copied.
 std::unique_ptr<Sequence> Sequence::Copy( const SampleBlockFactoryPtr &pFactory,
@@ -1340,6 +1385,9 @@ bool Sequence::GetWaveDisplay(float *min, float *max, float *rms, int* bl,
          : 1;
 
       int blockStatus = b;
+      if (divisor > 1 && !seqBlock.sb->IsSummaryAvailable())
+         // Summaries are not yet computed; draw the block as pending
+         blockStatus = -1 - b;
 
       // How many samples or triples are needed?
 
@@ -21,6 +21,7 @@
 
 class SampleBlock;
 class SampleBlockFactory;
+class SampleSums;
 using SampleBlockFactoryPtr = std::shared_ptr<SampleBlockFactory>;
 
 // This is an internal data structure!  For advanced use only.
@@ -151,6 +152,8 @@ class PROFILE_DLL_API Sequence final : public XMLTagHandler{
    std::pair<float, float> GetMinMax(
       sampleCount start, sampleCount len, bool mayThrow) const;
    float GetRMS(sampleCount start, sampleCount len, bool mayThrow) const;
+   //! Read samples only from the blocks at the ends of the region
+   SampleSums GetSums(sampleCount start, sampleCount len, bool mayThrow) const;
 
    //
    // Getting block size and alignment information
@@ -11,14 +11,178 @@ Paul Licameli -- split from SampleBlock.cpp and SampleBlock.h
 #include <float.h>
 #include <sqlite3.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <wx/app.h>
+
 #include "DBConnection.h"
+#include "PCMFileReference.h"
+#include "Prefs.h"
+#include "Profiler.h"
+#include "Project.h"
 #include "ProjectFileIO.h"
 #include "SampleFormat.h"
 #include "xml/XMLTagHandler.h"
 
 #include "SampleBlock.h" // to inherit
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+   (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SUMMARY_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+//! Extreme values, sum and sum of squares of a run of samples
+struct SummaryStats
+{
+   float min;
+   float max;
+   double sumsq;
+   double sum;
+};
+
+// Conversions as in CopySamples()
+inline float ToFloat(float sample) { return sample; }
+inline float ToFloat(short sample) { return sample * (1.0f / (1 << 15)); }
+inline float ToFloat(int sample) { return sample * (1.0f / (1 << 23)); }
+
+#ifdef SUMMARY_USE_SSE2
+inline __m128 Load4(const float *samples)
+{
+   return _mm_loadu_ps(samples);
+}
+
+inline __m128 Load4(const short *samples)
+{
+   // Sign-extend four 16 bit samples to 32 bits
+   auto x = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(samples));
+   x = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+   return _mm_mul_ps(_mm_cvtepi32_ps(x), _mm_set1_ps(1.0f / (1 << 15)));
+}
+
+inline __m128 Load4(const int *samples)
+{
+   const auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples));
+   return _mm_mul_ps(_mm_cvtepi32_ps(x), _mm_set1_ps(1.0f / (1 << 23)));
+}
+
+inline float ReduceMin(__m128 v)
+{
+   v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+   v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+   return _mm_cvtss_f32(v);
+}
+
+inline float ReduceMax(__m128 v)
+{
+   v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+   v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+   return _mm_cvtss_f32(v);
+}
+
+inline double ReduceSum(__m128d v)
+{
+   return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+#endif
+
+//! Summarize len > 0 samples, converting to float on the fly
+/*! The sums accumulate in double, at full precision for each sample.  Lanes
+ of SSE2 registers accumulate separately, so the sums may differ from serial
+ sums in the last bits */
+template< typename Sample >
+SummaryStats Summarize(const Sample *samples, size_t len)
+{
+   size_t ii = 0;
+   float min = ToFloat(samples[0]);
+   float max = min;
+   double sumsq = 0;
+   double sum = 0;
+
+#ifdef SUMMARY_USE_SSE2
+   if (len >= 4) {
+      auto vmin = _mm_set1_ps(min);
+      auto vmax = vmin;
+      auto vsumsq = _mm_setzero_pd();
+      auto vsum = _mm_setzero_pd();
+      for (; ii + 4 <= len; ii += 4) {
+         const auto x = Load4(samples + ii);
+         vmin = _mm_min_ps(vmin, x);
+         vmax = _mm_max_ps(vmax, x);
+         const auto lo = _mm_cvtps_pd(x);
+         const auto hi = _mm_cvtps_pd(_mm_movehl_ps(x, x));
+         vsumsq = _mm_add_pd(vsumsq,
+            _mm_add_pd(_mm_mul_pd(lo, lo), _mm_mul_pd(hi, hi)));
+         vsum = _mm_add_pd(vsum, _mm_add_pd(lo, hi));
+      }
+      min = ReduceMin(vmin);
+      max = ReduceMax(vmax);
+      sumsq = ReduceSum(vsumsq);
+      sum = ReduceSum(vsum);
+   }
+#endif
+
+   for (; ii < len; ++ii) {
+      const auto x = ToFloat(samples[ii]);
+      min = std::min(min, x);
+      max = std::max(max, x);
+      sumsq += double(x) * x;
+      sum += x;
+   }
+
+   return { min, max, sumsq, sum };
+}
+
+//! Summarize samples stored in the given format
+SummaryStats Summarize(
+   const char *samples, sampleFormat format, size_t start, size_t len)
+{
+   switch (format) {
+      case int16Sample:
+         return Summarize(reinterpret_cast<const short*>(samples) + start, len);
+      case int24Sample:
+         return Summarize(reinterpret_cast<const int*>(samples) + start, len);
+      case floatSample:
+      default:
+         return Summarize(reinterpret_cast<const float*>(samples) + start, len);
+   }
+}
+
+//! Sum len samples in runs of 256, as the summaries do
+SampleSums SumSamples(const float *samples, size_t len)
+{
+   SampleSums sums;
+   for (size_t ii = 0; ii < len; ii += 256) {
+      const auto stats =
+         Summarize(samples + ii, std::min<size_t>(256, len - ii));
+      sums.sum += stats.sum;
+      sums.sumSquares += stats.sumsq;
+   }
+   sums.count = len;
+   return sums;
+}
+
+}
+
 class SqliteSampleBlockFactory;
+class SqliteSampleBlockBatch;
+class SqliteSampleBlockCache;
+class SqliteSampleBlockMaterializer;
+class SqliteSpectrumTiles;
+class ReferenceSampleBlock;
 
 ///\brief Implementation of @ref SampleBlock using Sqlite database
 class SqliteSampleBlock final : public SampleBlock
@@ -31,11 +195,14 @@ public:
 
    void CloseLock() override;
 
-   void SetSamples(samplePtr src, size_t numsamples, sampleFormat srcformat);
-
    //! Numbers of bytes needed for 256 and for 64k summaries
    using Sizes = std::pair< size_t, size_t >;
+
+   //! Copy and summarize the samples, which are not yet committed
+   Sizes SetSamples(samplePtr src, size_t numsamples, sampleFormat srcformat);
    void Commit(Sizes sizes);
+   //! Free the copies of data that were kept for Commit()
+   void ReleaseBuffers();
 
    void Delete();
 
@@ -60,9 +227,17 @@ public:
    /// Gets extreme values for the entire block
    MinMaxRMS DoGetMinMaxRMS() const override;
 
+   SampleSums DoGetSums(size_t start, size_t len) override;
+   SampleSums DoGetSums() override;
+
    size_t GetSpaceUsage() const override;
    void SaveXML(XMLWriter &xmlFile) override;
 
+   bool GetSpectrumTile(
+      const SpectrumKey &key, std::vector<float> &columns) override;
+   void SetSpectrumTile(
+      const SpectrumKey &key, const float *columns, size_t count) override;
+
 private:
    bool IsSilent() const { return mBlockID <= 0; }
    void Load(SampleBlockID sbid);
@@ -76,7 +251,8 @@ private:
                   sqlite3_stmt *stmt,
                   sampleFormat srcformat,
                   size_t srcoffset,
-                  size_t srcbytes);
+                  size_t srcbytes,
+                  SqliteSampleBlockCache *pCache = nullptr);
 
    enum {
       fields = 3, /* min, max, rms */
@@ -85,6 +261,20 @@ private:
    Sizes SetSizes( size_t numsamples, sampleFormat srcformat );
    void CalcSummary(Sizes sizes);
 
+   //! Non-throwing; @return whether samplesums had a row for the block
+   bool LoadSums();
+   //! Non-throwing, and failure only costs recomputing the sums later
+   //! Called only at commit and materialization, never to analyze
+   void StoreSums();
+
+   //! Insert a row without samples or summaries, and a row of pendingblocks
+   //! telling where to find the samples
+   void CommitPlaceholder(const PCMFileReference &reference,
+      unsigned channel, unsigned long long start);
+   //! Fill in the placeholder row with what prepared computed, and forget
+   //! where the samples were
+   void CommitMaterialized(const SqliteSampleBlock &prepared, Sizes sizes);
+
 private:
    //! This must never be called for silent blocks
    DBConnection *Conn() const;
@@ -94,6 +284,10 @@ private:
    }
 
    friend SqliteSampleBlockFactory;
+   friend SqliteSampleBlockBatch;
+   friend SqliteSampleBlockMaterializer;
+   friend SqliteSpectrumTiles;
+   friend ReferenceSampleBlock;
 
    const std::shared_ptr<SqliteSampleBlockFactory> mpFactory;
    bool mValid{ false };
@@ -112,17 +306,264 @@ private:
    double mSumMax;
    double mSumRms;
 
+   // Kept in samplesums, not in the row of the block
+   double mSum;
+   double mSumSquares;
+   bool mHasSums{ false };
+
 #if defined(WORDS_BIGENDIAN)
 #error All sample block data is little endian...big endian not yet supported
 #endif
 };
 
+///\brief Implementation of @ref SampleBlock that reads its samples from a
+/// file outside the project, until they are copied into the database
+/*! The block has a row from the start, so that its id never changes, but
+ the row lacks samples and summaries until the factory's materializer fills
+ them in.  Then all reads go to the row, through a @ref SqliteSampleBlock
+ for the same id, which also deletes the row when the last reference goes.
+ */
+class ReferenceSampleBlock final
+   : public SampleBlock
+   , public std::enable_shared_from_this<ReferenceSampleBlock>
+{
+public:
+   //! @param pReference may be null if the file is missing; then the block
+   //! reads as silence
+   ReferenceSampleBlock(std::shared_ptr<SqliteSampleBlock> pBlock,
+      std::shared_ptr<const PCMFileReference> pReference,
+      unsigned channel, unsigned long long start);
+   ~ReferenceSampleBlock() override;
+
+   void CloseLock() override;
+   SampleBlockID GetBlockID() const override;
+
+   size_t DoGetSamples(samplePtr dest,
+                       sampleFormat destformat,
+                       size_t sampleoffset,
+                       size_t numsamples) override;
+   size_t GetSampleCount() const override;
+
+   bool GetSummary256(float *dest, size_t frameoffset, size_t numframes) override;
+   bool GetSummary64k(float *dest, size_t frameoffset, size_t numframes) override;
+   bool IsSummaryAvailable() const override;
+
+   MinMaxRMS DoGetMinMaxRMS(size_t start, size_t len) override;
+   MinMaxRMS DoGetMinMaxRMS() const override;
+
+   SampleSums DoGetSums(size_t start, size_t len) override;
+   SampleSums DoGetSums() override;
+
+   size_t GetSpaceUsage() const override;
+   void SaveXML(XMLWriter &xmlFile) override;
+
+   bool GetSpectrumTile(
+      const SpectrumKey &key, std::vector<float> &columns) override;
+   void SetSpectrumTile(
+      const SpectrumKey &key, const float *columns, size_t count) override;
+
+   bool IsMaterialized() const
+   { return mMaterialized.load(std::memory_order_acquire); }
+
+private:
+   friend SqliteSampleBlockMaterializer;
+
+   //! Read from the file, in the format of the block
+   /*! @return false, with dest filled with zeroes, if the file could not be
+    read */
+   bool ReadReference(samplePtr dest, size_t offset, size_t len) const;
+   //! Read from the file, converting to destformat
+   size_t ReadReference(samplePtr dest, sampleFormat destformat,
+      size_t offset, size_t len) const;
+   MinMaxRMS GetMinMaxRMSFromReference(size_t start, size_t len) const;
+   SampleSums GetSumsFromReference(size_t start, size_t len) const;
+   bool GetSummaryFromReference(float *dest, size_t numframes);
+
+   const std::shared_ptr<SqliteSampleBlock> mpBlock;
+   const std::shared_ptr<const PCMFileReference> mpReference;
+   const unsigned mChannel;
+   const unsigned long long mStart;
+
+   // Set only on the main thread, after the row of mpBlock is complete
+   std::atomic<bool> mMaterialized{ false };
+};
+
 // Silent blocks use nonpositive id values to encode a length
 // and don't occupy any rows in the database; share blocks for repeatedly
 // used length values
 static std::map< SampleBlockID, std::shared_ptr<SqliteSampleBlock> >
    sSilentBlocks;
 
+///\brief Least recently used cache of sample data read from the database
+/*! One cache serves all blocks of a factory, so all tracks of a project.
+ Entries for pinned block ids are not evicted.  It is locked, because blocks
+ are read by the audio thread too.
+ */
+class SqliteSampleBlockCache
+{
+public:
+   explicit SqliteSampleBlockCache( size_t capacity );
+
+   bool Enabled() const { return mCapacity > 0; }
+
+   //! Copy as GetBlob does, if data for the block are present
+   /*! @return whether they were present */
+   bool Read( SampleBlockID id, void *dest, sampleFormat destformat,
+      sampleFormat srcformat, size_t srcoffset, size_t srcbytes );
+
+   //! Store a copy of all data of the block, possibly evicting others
+   void Insert( SampleBlockID id, const void *src, size_t bytes );
+
+   void Erase( SampleBlockID id );
+
+   void SetPinned( SampleBlockFactory::SampleBlockIDs ids );
+
+   SampleBlockFactory::CacheStatistics GetStatistics() const;
+
+private:
+   struct Entry {
+      SampleBlockID id;
+      ArrayOf<char> data;
+      size_t bytes;
+   };
+   using Entries = std::list< Entry >;
+
+   void Evict();
+
+   mutable std::mutex mMutex;
+   const size_t mCapacity;
+   // Most recently used at front
+   Entries mEntries;
+   std::unordered_map< SampleBlockID, Entries::iterator > mIndex;
+   SampleBlockFactory::SampleBlockIDs mPinned;
+   size_t mBytes{ 0 };
+   unsigned long long mHits{ 0 };
+   unsigned long long mMisses{ 0 };
+};
+
+///\brief Copies the samples of @ref ReferenceSampleBlock objects into the
+/// database, in the background
+/*! A worker thread reads and summarizes one block at a time:  first those
+ whose summaries were wanted for display, most recently wanted first, then
+ the others in the order of their ids, which is the order of the file.  The
+ main thread writes the results in its idle time, when no transaction is
+ open, and then tells the project to redraw.
+ */
+class SqliteSampleBlockMaterializer
+{
+public:
+   explicit SqliteSampleBlockMaterializer(SqliteSampleBlockFactory &factory);
+   ~SqliteSampleBlockMaterializer();
+
+   //! Main thread only
+   void Add(const std::shared_ptr<ReferenceSampleBlock> &pBlock);
+
+   //! Move the block ahead of the others not yet begun.  Any thread.
+   void Prioritize(SampleBlockID id);
+
+   //! Main thread only
+   void Commit();
+
+private:
+   struct Result
+   {
+      std::shared_ptr<ReferenceSampleBlock> pBlock;
+      // Null if reading failed
+      std::shared_ptr<SqliteSampleBlock> pPrepared;
+      SqliteSampleBlock::Sizes sizes;
+   };
+
+   void Work();
+   void ScheduleCommit();
+
+   // Limits the prepared samples kept in memory while the main thread is busy
+   enum : size_t { MaxReady = 16 };
+
+   SqliteSampleBlockFactory &mFactory;
+   // Both assigned before the thread starts
+   std::weak_ptr<SqliteSampleBlockFactory> mwFactory;
+   std::weak_ptr<AudacityProject> mwProject;
+   std::thread mThread;
+
+   std::mutex mMutex;
+   std::condition_variable mChanged;
+
+   // These are guarded by mMutex
+   std::map< SampleBlockID, std::weak_ptr<ReferenceSampleBlock> > mPending;
+   std::vector< SampleBlockID > mUrgent;
+   std::vector< Result > mReady;
+   bool mCommitScheduled{ false };
+   bool mStop{ false };
+};
+
+///\brief Spectrogram tiles computed while drawing, written to the database
+/// later, in idle time
+/*! Drawing never writes to the database.  Tiles wait in memory, where they
+ may also be found, until the main thread writes them all in one transaction,
+ when no other transaction is open.
+
+ The file keeps tiles for at most MaxSettings choices of window and hop,
+ those most recently drawn; tiles of the others are deleted when another
+ choice is first written.  Each value is kept in 16 bits, in hundredths of a
+ decibel, which is finer than any color map shows.
+ */
+class SqliteSpectrumTiles
+{
+public:
+   using SpectrumKey = SampleBlock::SpectrumKey;
+
+   explicit SqliteSpectrumTiles(SqliteSampleBlockFactory &factory);
+
+   //! Find a tile not yet written, and note that the key is in use
+   bool Find(SampleBlockID id, const SpectrumKey &key,
+      std::vector<float> &columns);
+
+   //! Keep the tile to write later, or drop it if too much is waiting
+   void Add(SampleBlockID id, const SpectrumKey &key,
+      const float *columns, size_t count);
+
+   //! Forget the tiles of a deleted block
+   void Erase(SampleBlockID id);
+
+   //! Main thread only
+   void Commit();
+
+   using Value = short;
+   static Value Encode(float dB);
+   static float Decode(Value value);
+
+private:
+   struct Tile
+   {
+      SampleBlockID id;
+      SpectrumKey key;
+      std::vector< Value > columns;
+   };
+
+   void Use(const SpectrumKey &key);
+   void ScheduleCommit();
+   //! @return whether the key was not yet stored
+   bool Touch(DBConnection &connection, const SpectrumKey &key);
+   void Evict(DBConnection &connection);
+   void Write(DBConnection &connection, const Tile &tile);
+
+   // Limits the tiles kept in memory while the main thread is busy
+   enum : size_t { MaxPendingBytes = 16 * 1024 * 1024 };
+   // Limits the size of tiles in the file, to at most this many times
+   // an eighth of the size of the samples as floats
+   enum : size_t { MaxSettings = 2 };
+
+   SqliteSampleBlockFactory &mFactory;
+
+   std::mutex mMutex;
+   // These are guarded by mMutex
+   std::vector< Tile > mPending;
+   size_t mPendingBytes{ 0 };
+   // Keys drawn since the last commit
+   std::vector< SpectrumKey > mUsed;
+   bool mCommitScheduled{ false };
+};
+
 ///\brief Implementation of @ref SampleBlockFactory using Sqlite database
 class SqliteSampleBlockFactory final
    : public SampleBlockFactory
@@ -147,12 +588,38 @@ public:
       sampleFormat srcformat,
       const wxChar **attrs) override;
 
+   SampleBlockPtr DoCreateReference(
+      const std::shared_ptr<const PCMFileReference> &pReference,
+      unsigned channel, unsigned long long start,
+      size_t numsamples, sampleFormat format) override;
+
    BlockDeletionCallback SetBlockDeletionCallback(
       BlockDeletionCallback callback ) override;
 
+   BatchScopePtr BeginBatch() override;
+
+   CacheStatistics GetCacheStatistics() const override;
+
+   void SetPinnedBlocks( SampleBlockIDs ids ) override;
+
 private:
    friend SqliteSampleBlock;
-
+   friend SqliteSampleBlockBatch;
+   friend SqliteSampleBlockMaterializer;
+   friend SqliteSpectrumTiles;
+   friend ReferenceSampleBlock;
+
+   //! Make a block for an id not loaded before, which may be a reference
+   SampleBlockPtr Load(SampleBlockID sbid, sampleFormat srcformat);
+   //! @return null if the block has no row of pendingblocks
+   SampleBlockPtr LoadReference(
+      const std::shared_ptr<SqliteSampleBlock> &pBlock);
+   //! Share one mapping of each file among the blocks loaded from a project
+   std::shared_ptr<const PCMFileReference> ReopenReference(
+      const FilePath &path, unsigned long long fileSize,
+      const PCMFileReference::Layout &layout);
+
+   AudacityProject &mProject;
    const std::shared_ptr<ConnectionPtr> mppConnection;
 
    // Track all blocks that this factory has created, but don't control
@@ -160,14 +627,84 @@ private:
    // (Must also use weak pointers because the blocks have shared pointers
    // to the factory and we can't have a leaky cycle of shared pointers)
    using AllBlocksMap =
-      std::map< SampleBlockID, std::weak_ptr< SqliteSampleBlock > >;
+      std::map< SampleBlockID, std::weak_ptr< SampleBlock > >;
    AllBlocksMap mAllBlocks;
 
+   // Files referred to by blocks loaded from the project, and files found
+   // missing or changed, which are not tried again
+   std::map< FilePath, std::weak_ptr< const PCMFileReference > > mReferences;
+   std::set< FilePath > mMissingReferences;
+
    BlockDeletionCallback mCallback;
+
+   // Not null while new blocks are inserted in batches
+   SqliteSampleBlockBatch *mpBatch{};
+
+   // Serializes the parts of DoCreate that use the connection, mAllBlocks,
+   // and the batch, so that sequences may append on different threads
+   std::mutex mCreateMutex;
+
+   SqliteSampleBlockCache mCache;
+
+   SqliteSpectrumTiles mTiles{ *this };
+
+   // Destroyed first, stopping its thread before the rest goes
+   SqliteSampleBlockMaterializer mMaterializer{ *this };
+};
+
+///\brief Groups insertions of new sample blocks into fewer transactions
+/*! A savepoint is held open while blocks are created, and released when
+ enough bytes were written or enough time passed, and at destruction.
+
+ Each block keeps its copy of samples and summaries until the savepoint that
+ inserted it is released.  Some errors (such as a full disk) make SQLite roll
+ back the whole transaction, not only the failed statement; then rows of the
+ earlier blocks of the batch are inserted again with the same ids, because
+ sequences may already refer to them.  So a failure to create one block still
+ does not disturb others, just as when each block is committed alone.
+ */
+class SqliteSampleBlockBatch final : public SampleBlockFactory::BatchScope
+{
+public:
+   SqliteSampleBlockBatch( const std::shared_ptr<SqliteSampleBlockFactory> &pFactory,
+      DBConnection &connection );
+   ~SqliteSampleBlockBatch() override;
+
+   //! Called after the block is inserted; may release the savepoint
+   void Add( const std::shared_ptr<SqliteSampleBlock> &pBlock );
+
+   //! Called after failure to insert a block
+   void Recover();
+
+private:
+   using Clock = std::chrono::steady_clock;
+
+   bool Open();
+   bool Release();
+   void Flush( bool reopen );
+   void Abandon();
+   void Reinsert( const std::shared_ptr<SqliteSampleBlock> &pBlock );
+
+   // Limits on the uncommitted data retained in memory
+   enum : size_t { MaxPendingBytes = 32 * 1024 * 1024 };
+   enum : long { MaxPendingMilliseconds = 2000 };
+
+   const std::shared_ptr<SqliteSampleBlockFactory> mpFactory;
+   DBConnection &mConnection;
+
+   std::vector< std::weak_ptr<SqliteSampleBlock> > mPending;
+   size_t mPendingBytes{ 0 };
+   Clock::time_point mOpened;
+   bool mOpen{ false };
+   bool mRecovering{ false };
 };
 
 SqliteSampleBlockFactory::SqliteSampleBlockFactory( AudacityProject &project )
-   : mppConnection{ ConnectionPtr::Get(project).shared_from_this() }
+   : mProject{ project }
+   , mppConnection{ ConnectionPtr::Get(project).shared_from_this() }
+   , mCache{ static_cast<size_t>(
+      std::max(0L, gPrefs->Read(wxT("/Directories/SampleCacheMB"), 64L)) )
+         * 1024 * 1024 }
 {
    
 }
@@ -178,9 +715,17 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreate(
    samplePtr src, size_t numsamples, sampleFormat srcformat )
 {
    auto sb = std::make_shared<SqliteSampleBlock>(shared_from_this());
-   sb->SetSamples(src, numsamples, srcformat);
+   // Copying and summarizing may proceed on several threads at once, but
+   // the insertion may not:  the new block id is the connection's last
+   // inserted row id
+   const auto sizes = sb->SetSamples(src, numsamples, srcformat);
+   std::lock_guard<std::mutex> lock{ mCreateMutex };
+   sb->Commit( sizes );
    // block id has now been assigned
    mAllBlocks[ sb->GetBlockID() ] = sb;
+   if (mpBatch)
+      // This may throw, and then sb deletes its row again
+      mpBatch->Add(sb);
    return sb;
 }
 
@@ -254,14 +799,9 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreateFromXML(
                sb = pb;
             else {
                // First sight of this id
-               auto ssb =
-                  std::make_shared<SqliteSampleBlock>(shared_from_this());
-               wb = ssb;
-               sb = ssb;
-               ssb->mSampleFormat = srcformat;
                // This may throw database errors
-               // It initializes the rest of the fields
-               ssb->Load((SampleBlockID) nValue);
+               sb = Load((SampleBlockID) nValue, srcformat);
+               wb = sb;
             }
          }
          found++;
@@ -277,130 +817,514 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreateFromXML(
    return sb;
 }
 
-auto SqliteSampleBlockFactory::SetBlockDeletionCallback(
-   BlockDeletionCallback callback ) -> BlockDeletionCallback
+SampleBlockPtr SqliteSampleBlockFactory::DoCreateReference(
+   const std::shared_ptr<const PCMFileReference> &pReference,
+   unsigned channel, unsigned long long start,
+   size_t numsamples, sampleFormat format)
 {
-   auto result = mCallback;
-   mCallback = std::move( callback );
+   auto sb = std::make_shared<SqliteSampleBlock>(shared_from_this());
+   sb->SetSizes(numsamples, format);
+   std::lock_guard<std::mutex> lock{ mCreateMutex };
+   // If this throws after the first row was inserted, then sb deletes it
+   sb->CommitPlaceholder(*pReference, channel, start);
+   auto result = std::make_shared<ReferenceSampleBlock>(
+      std::move(sb), pReference, channel, start);
+   mAllBlocks[ result->GetBlockID() ] = result;
+   mMaterializer.Add(result);
    return result;
 }
 
-SqliteSampleBlock::SqliteSampleBlock(
-   const std::shared_ptr<SqliteSampleBlockFactory> &pFactory)
-:  mpFactory(pFactory)
+SampleBlockPtr SqliteSampleBlockFactory::Load(
+   SampleBlockID sbid, sampleFormat srcformat)
 {
-   mSampleFormat = floatSample;
-   mSampleBytes = 0;
-   mSampleCount = 0;
-
-   mSumMin = 0.0;
-   mSumMax = 0.0;
-   mSumRms = 0.0;
+   auto ssb = std::make_shared<SqliteSampleBlock>(shared_from_this());
+   ssb->mSampleFormat = srcformat;
+   // It initializes the rest of the fields
+   ssb->Load(sbid);
+
+   // Only a placeholder row lacks samples
+   if (ssb->mSampleBytes == 0)
+      if (auto pReference = LoadReference(ssb))
+         return pReference;
+   return ssb;
 }
 
-SqliteSampleBlock::~SqliteSampleBlock()
+SampleBlockPtr SqliteSampleBlockFactory::LoadReference(
+   const std::shared_ptr<SqliteSampleBlock> &pBlock)
 {
-   if (mpFactory) {
-      auto &callback = mpFactory->mCallback;
-      if (callback)
-         GuardedCall( [&]{ callback( *this ); } );
-   }
+   auto conn = pBlock->Conn();
 
-   if (IsSilent()) {
-      // The block object was constructed but failed to Load() or Commit().
-      // Or it's a silent block with no row in the database.
-      // Just let the stack unwind.  Don't violate the assertion in
-      // Delete(), which may do odd recursive things in debug builds when it
-      // yields to the UI to put up a dialog, but then dispatches timer
-      // events that try again to finish recording.
-      return;
+   // Prepare and cache statement...automatically finalized at DB close
+   sqlite3_stmt *stmt = conn->Prepare(DBConnection::LoadPendingBlock,
+      "SELECT path, filesize, dataoffset, samplebytes, isfloat, bigendian,"
+      "       channels, frames, channel, start, length"
+      "  FROM pendingblocks WHERE blockid = ?1;");
+
+   // Bind statement parameters
+   // Might return SQLITE_MISUSE which means it's our mistake that we violated
+   // preconditions; should return SQL_OK which is 0
+   if (sqlite3_bind_int64(stmt, 1, pBlock->mBlockID))
+   {
+      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
    }
 
-   // See ProjectFileIO::Bypass() for a description of mIO.mBypass
-   GuardedCall( [this]{
-      if (!mLocked && !Conn()->ShouldBypass())
-      {
-         // In case Delete throws, don't let an exception escape a destructor,
-         // but we can still enqueue the delayed handler so that an error message
-         // is presented to the user.
-         // The failure in this case may be a less harmful waste of space in the
-         // database, which should not cause aborting of the attempted edit.
-         Delete();
-      }
-   } );
+   // Clear statement bindings and rewind statement, however we leave
+   auto cleanup = finally([stmt]{
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+   });
+
+   // An empty block that is not a reference is not an error here
+   if (sqlite3_step(stmt) != SQLITE_ROW)
+      return {};
+
+   const auto path = wxString::FromUTF8(
+      reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)));
+   const auto fileSize = sqlite3_column_int64(stmt, 1);
+   const PCMFileReference::Layout layout{
+      static_cast<unsigned long long>(sqlite3_column_int64(stmt, 2)),
+      static_cast<unsigned>(sqlite3_column_int(stmt, 3)),
+      sqlite3_column_int(stmt, 4) != 0,
+      sqlite3_column_int(stmt, 5) != 0,
+      static_cast<unsigned>(sqlite3_column_int(stmt, 6)),
+      static_cast<unsigned long long>(sqlite3_column_int64(stmt, 7)),
+   };
+   const auto channel = static_cast<unsigned>(sqlite3_column_int(stmt, 8));
+   const auto start =
+      static_cast<unsigned long long>(sqlite3_column_int64(stmt, 9));
+   const auto length = static_cast<size_t>(sqlite3_column_int64(stmt, 10));
+
+   pBlock->SetSizes(length, pBlock->mSampleFormat);
+
+   auto pReference = ReopenReference(path, fileSize, layout);
+   auto result = std::make_shared<ReferenceSampleBlock>(
+      pBlock, pReference, channel, start);
+   if (pReference)
+      mMaterializer.Add(result);
+   return result;
 }
 
-DBConnection *SqliteSampleBlock::Conn() const
+std::shared_ptr<const PCMFileReference>
+SqliteSampleBlockFactory::ReopenReference(const FilePath &path,
+   unsigned long long fileSize, const PCMFileReference::Layout &layout)
 {
-   if (!mpFactory)
-      return nullptr;
+   if (mMissingReferences.count(path))
+      return {};
 
-   auto &pConnection = mpFactory->mppConnection->mpConnection;
-   if (!pConnection) {
-      throw SimpleMessageBoxException
-      {
-         XO("Failed to open the project's database"),
-         XO("Warning"),
-         "Error:_Disk_full_or_not_writable"
-      };
+   auto &wReference = mReferences[path];
+   std::shared_ptr<const PCMFileReference> pReference = wReference.lock();
+   if (!pReference) {
+      pReference = PCMFileReference::Reopen(path, fileSize, layout);
+      if (!pReference) {
+         wxLogWarning(wxT("Audio file %s is missing or changed; "
+            "the parts of the project that were not yet copied from it "
+            "are silent"), path);
+         mMissingReferences.insert(path);
+         mReferences.erase(path);
+         return {};
+      }
+      wReference = pReference;
    }
-   return pConnection.get();
+   return pReference;
 }
 
-void SqliteSampleBlock::CloseLock()
+auto SqliteSampleBlockFactory::SetBlockDeletionCallback(
+   BlockDeletionCallback callback ) -> BlockDeletionCallback
 {
-   mLocked = true;
+   auto result = mCallback;
+   mCallback = std::move( callback );
+   return result;
 }
 
-SampleBlockID SqliteSampleBlock::GetBlockID() const
+auto SqliteSampleBlockFactory::GetCacheStatistics() const -> CacheStatistics
 {
-   return mBlockID;
+   return mCache.GetStatistics();
 }
 
-sampleFormat SqliteSampleBlock::GetSampleFormat() const
+void SqliteSampleBlockFactory::SetPinnedBlocks( SampleBlockIDs ids )
 {
-   return mSampleFormat;
+   mCache.SetPinned( std::move( ids ) );
 }
 
-size_t SqliteSampleBlock::GetSampleCount() const
+SqliteSampleBlockCache::SqliteSampleBlockCache( size_t capacity )
+   : mCapacity{ capacity }
 {
-   return mSampleCount;
 }
 
-size_t SqliteSampleBlock::DoGetSamples(samplePtr dest,
-                                     sampleFormat destformat,
-                                     size_t sampleoffset,
-                                     size_t numsamples)
+bool SqliteSampleBlockCache::Read( SampleBlockID id,
+   void *dest, sampleFormat destformat,
+   sampleFormat srcformat, size_t srcoffset, size_t srcbytes )
 {
-   if (IsSilent()) {
-      auto size = SAMPLE_SIZE(destformat);
-      memset(dest, 0, numsamples * size);
-      return numsamples;
+   if (!Enabled())
+      return false;
+
+   std::lock_guard<std::mutex> lock{ mMutex };
+   auto found = mIndex.find( id );
+   if (found == mIndex.end()) {
+      ++mMisses;
+      return false;
    }
+   ++mHits;
 
-   // Prepare and cache statement...automatically finalized at DB close
-   sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::GetSamples,
-      "SELECT samples FROM sampleblocks WHERE blockid = ?1;");
+   // Move to the front
+   auto iter = found->second;
+   mEntries.splice( mEntries.begin(), mEntries, iter );
 
-   return GetBlob(dest,
-                  destformat,
-                  stmt,
-                  mSampleFormat,
-                  sampleoffset * SAMPLE_SIZE(mSampleFormat),
-                  numsamples * SAMPLE_SIZE(mSampleFormat)) / SAMPLE_SIZE(mSampleFormat);
+   const auto &entry = *iter;
+   srcoffset = std::min(srcoffset, entry.bytes);
+   const auto minbytes = std::min(srcbytes, entry.bytes - srcoffset);
+   CopySamples(entry.data.get() + srcoffset,
+               srcformat,
+               (samplePtr) dest,
+               destformat,
+               minbytes / SAMPLE_SIZE(srcformat));
+   if (srcbytes - minbytes)
+      memset(((samplePtr) dest) + minbytes, 0, srcbytes - minbytes);
+   return true;
 }
 
-void SqliteSampleBlock::SetSamples(samplePtr src,
-                                   size_t numsamples,
-                                   sampleFormat srcformat)
+void SqliteSampleBlockCache::Insert(
+   SampleBlockID id, const void *src, size_t bytes )
 {
-   auto sizes = SetSizes(numsamples, srcformat);
-   mSamples.reinit(mSampleBytes);
-   memcpy(mSamples.get(), src, mSampleBytes);
+   if (!Enabled() || bytes > mCapacity)
+      return;
+
+   ArrayOf<char> data{ bytes };
+   memcpy(data.get(), src, bytes);
+
+   std::lock_guard<std::mutex> lock{ mMutex };
+   if (mIndex.count( id ))
+      // Another thread read the same block meanwhile
+      return;
+   mEntries.push_front( { id, std::move( data ), bytes } );
+   mIndex[ id ] = mEntries.begin();
+   mBytes += bytes;
+   Evict();
+}
+
+void SqliteSampleBlockCache::Erase( SampleBlockID id )
+{
+   if (!Enabled())
+      return;
+
+   std::lock_guard<std::mutex> lock{ mMutex };
+   auto found = mIndex.find( id );
+   if (found != mIndex.end()) {
+      mBytes -= found->second->bytes;
+      mEntries.erase( found->second );
+      mIndex.erase( found );
+   }
+   mPinned.erase( id );
+}
+
+void SqliteSampleBlockCache::SetPinned(
+   SampleBlockFactory::SampleBlockIDs ids )
+{
+   std::lock_guard<std::mutex> lock{ mMutex };
+   mPinned.swap( ids );
+   // Formerly pinned entries may now be over the limit
+   Evict();
+}
+
+void SqliteSampleBlockCache::Evict()
+{
+   // Visit from least recently used, skipping pinned entries; if those alone
+   // exceed the capacity, then let them
+   auto iter = mEntries.end();
+   while (mBytes > mCapacity && iter != mEntries.begin()) {
+      --iter;
+      if (mPinned.count( iter->id ))
+         continue;
+      mBytes -= iter->bytes;
+      mIndex.erase( iter->id );
+      iter = mEntries.erase( iter );
+   }
+}
+
+auto SqliteSampleBlockCache::GetStatistics() const
+   -> SampleBlockFactory::CacheStatistics
+{
+   std::lock_guard<std::mutex> lock{ mMutex };
+   return { mHits, mMisses, mBytes, mCapacity };
+}
+
+auto SqliteSampleBlockFactory::BeginBatch() -> BatchScopePtr
+{
+   auto &pConnection = mppConnection->mpConnection;
+   if (mpBatch || !pConnection || pConnection->ShouldBypass())
+      return {};
+   return std::make_unique<SqliteSampleBlockBatch>(
+      shared_from_this(), *pConnection);
+}
+
+SqliteSampleBlockBatch::SqliteSampleBlockBatch(
+   const std::shared_ptr<SqliteSampleBlockFactory> &pFactory,
+   DBConnection &connection )
+   : mpFactory{ pFactory }
+   , mConnection{ connection }
+{
+   // If the savepoint can't open, blocks are just committed one at a time
+   Open();
+   mpFactory->mpBatch = this;
+}
+
+SqliteSampleBlockBatch::~SqliteSampleBlockBatch()
+{
+   // Blocks made from now on are committed one at a time
+   mpFactory->mpBatch = nullptr;
+   // Do not throw from a destructor
+   GuardedCall( [this]{
+      if (!Release()) {
+         // Don't leave the connection in the savepoint
+         std::lock_guard<std::mutex> lock{ mpFactory->mCreateMutex };
+         Abandon();
+      }
+      Flush( false );
+   } );
+}
+
+bool SqliteSampleBlockBatch::Open()
+{
+   mOpen = sqlite3_exec(mConnection.DB(),
+      "SAVEPOINT SampleBlockBatch;", nullptr, nullptr, nullptr) == SQLITE_OK;
+   mOpened = Clock::now();
+   return mOpen;
+}
+
+bool SqliteSampleBlockBatch::Release()
+{
+   if (!mOpen)
+      return true;
+   if (sqlite3_exec(mConnection.DB(),
+      "RELEASE SampleBlockBatch;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+      wxLogDebug(wxT("SqliteSampleBlockBatch::Release - SQLITE error %s"),
+         sqlite3_errmsg(mConnection.DB()));
+      return false;
+   }
+   mOpen = false;
+   return true;
+}
+
+void SqliteSampleBlockBatch::Abandon()
+{
+   // Undo and end the savepoint, then insert the pending blocks again,
+   // outside of it, because sequences already refer to them
+   const auto db = mConnection.DB();
+   if (sqlite3_exec(db, "ROLLBACK TO SampleBlockBatch;",
+          nullptr, nullptr, nullptr) != SQLITE_OK ||
+       sqlite3_exec(db, "RELEASE SampleBlockBatch;",
+          nullptr, nullptr, nullptr) != SQLITE_OK)
+      wxLogDebug(wxT("SqliteSampleBlockBatch::Abandon - SQLITE error %s"),
+         sqlite3_errmsg(db));
+   mOpen = false;
+
+   // Try every block, and report the first failure afterward
+   std::exception_ptr pException;
+   for (auto &pending : mPending)
+      if (auto pBlock = pending.lock()) {
+         try {
+            Reinsert(pBlock);
+         }
+         catch ( ... ) {
+            if (!pException)
+               pException = std::current_exception();
+         }
+      }
+   mPending.clear();
+   mPendingBytes = 0;
+   if (pException)
+      std::rethrow_exception(pException);
+}
+
+void SqliteSampleBlockBatch::Reinsert(
+   const std::shared_ptr<SqliteSampleBlock> &pBlock )
+{
+   pBlock->Commit(
+      pBlock->SetSizes(pBlock->mSampleCount, pBlock->mSampleFormat));
+}
+
+void SqliteSampleBlockBatch::Flush( bool reopen )
+{
+   if (!Release())
+      // Keep the pending blocks; a later flush may succeed
+      mConnection.ThrowException( true );
+
+   for (auto &pending : mPending)
+      if (auto pBlock = pending.lock())
+         pBlock->ReleaseBuffers();
+   mPending.clear();
+   mPendingBytes = 0;
+
+   if (reopen)
+      Open();
+}
+
+void SqliteSampleBlockBatch::Add(
+   const std::shared_ptr<SqliteSampleBlock> &pBlock )
+{
+   if (!mOpen) {
+      // Not batching after all
+      pBlock->ReleaseBuffers();
+      return;
+   }
+
+   mPending.push_back(pBlock);
+   auto sizes = pBlock->SetSizes(pBlock->mSampleCount, pBlock->mSampleFormat);
+   mPendingBytes += pBlock->mSampleBytes + sizes.first + sizes.second;
+
+   if (mPendingBytes >= MaxPendingBytes ||
+       Clock::now() - mOpened >=
+          std::chrono::milliseconds{ MaxPendingMilliseconds })
+      Flush( true );
+}
+
+void SqliteSampleBlockBatch::Recover()
+{
+   // If the transaction is still open, only the failed statement was undone
+   if (!mOpen || mRecovering || !sqlite3_get_autocommit(mConnection.DB()))
+      return;
+
+   auto recovering = valueRestorer( mRecovering, true );
+   if (!Open())
+      return;
+
+   // Insert the lost rows again.  This may throw too.
+   for (auto &pending : mPending)
+      if (auto pBlock = pending.lock())
+         Reinsert(pBlock);
+}
+
+SqliteSampleBlock::SqliteSampleBlock(
+   const std::shared_ptr<SqliteSampleBlockFactory> &pFactory)
+:  mpFactory(pFactory)
+{
+   mSampleFormat = floatSample;
+   mSampleBytes = 0;
+   mSampleCount = 0;
+
+   mSumMin = 0.0;
+   mSumMax = 0.0;
+   mSumRms = 0.0;
+   mSum = 0.0;
+   mSumSquares = 0.0;
+}
+
+SqliteSampleBlock::~SqliteSampleBlock()
+{
+   if (mpFactory) {
+      auto &callback = mpFactory->mCallback;
+      if (callback)
+         GuardedCall( [&]{ callback( *this ); } );
+   }
+
+   if (IsSilent()) {
+      // The block object was constructed but failed to Load() or Commit().
+      // Or it's a silent block with no row in the database.
+      // Just let the stack unwind.  Don't violate the assertion in
+      // Delete(), which may do odd recursive things in debug builds when it
+      // yields to the UI to put up a dialog, but then dispatches timer
+      // events that try again to finish recording.
+      return;
+   }
+
+   mpFactory->mCache.Erase( mBlockID );
+   mpFactory->mTiles.Erase( mBlockID );
+
+   // See ProjectFileIO::Bypass() for a description of mIO.mBypass
+   GuardedCall( [this]{
+      if (!mLocked && !Conn()->ShouldBypass())
+      {
+         // In case Delete throws, don't let an exception escape a destructor,
+         // but we can still enqueue the delayed handler so that an error message
+         // is presented to the user.
+         // The failure in this case may be a less harmful waste of space in the
+         // database, which should not cause aborting of the attempted edit.
+         Delete();
+      }
+   } );
+}
+
+DBConnection *SqliteSampleBlock::Conn() const
+{
+   if (!mpFactory)
+      return nullptr;
+
+   auto &pConnection = mpFactory->mppConnection->mpConnection;
+   if (!pConnection) {
+      throw SimpleMessageBoxException
+      {
+         XO("Failed to open the project's database"),
+         XO("Warning"),
+         "Error:_Disk_full_or_not_writable"
+      };
+   }
+   return pConnection.get();
+}
+
+void SqliteSampleBlock::CloseLock()
+{
+   mLocked = true;
+}
+
+SampleBlockID SqliteSampleBlock::GetBlockID() const
+{
+   return mBlockID;
+}
+
+sampleFormat SqliteSampleBlock::GetSampleFormat() const
+{
+   return mSampleFormat;
+}
+
+size_t SqliteSampleBlock::GetSampleCount() const
+{
+   return mSampleCount;
+}
+
+size_t SqliteSampleBlock::DoGetSamples(samplePtr dest,
+                                     sampleFormat destformat,
+                                     size_t sampleoffset,
+                                     size_t numsamples)
+{
+   if (IsSilent()) {
+      auto size = SAMPLE_SIZE(destformat);
+      memset(dest, 0, numsamples * size);
+      return numsamples;
+   }
+
+   const auto srcoffset = sampleoffset * SAMPLE_SIZE(mSampleFormat);
+   const auto srcbytes = numsamples * SAMPLE_SIZE(mSampleFormat);
+
+   // Avoid the database for recently read blocks
+   auto &cache = mpFactory->mCache;
+   if (cache.Read(
+      mBlockID, dest, destformat, mSampleFormat, srcoffset, srcbytes))
+      return numsamples;
+
+   // Prepare and cache statement...automatically finalized at DB close
+   sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::GetSamples,
+      "SELECT samples FROM sampleblocks WHERE blockid = ?1;");
+
+   return GetBlob(dest,
+                  destformat,
+                  stmt,
+                  mSampleFormat,
+                  srcoffset,
+                  srcbytes,
+                  &cache) / SAMPLE_SIZE(mSampleFormat);
+}
+
+auto SqliteSampleBlock::SetSamples(samplePtr src,
+                                   size_t numsamples,
+                                   sampleFormat srcformat) -> Sizes
+{
+   auto sizes = SetSizes(numsamples, srcformat);
+   mSamples.reinit(mSampleBytes);
+   memcpy(mSamples.get(), src, mSampleBytes);
 
    CalcSummary( sizes );
 
-   Commit( sizes );
+   return sizes;
 }
 
 bool SqliteSampleBlock::GetSummary256(float *dest,
@@ -474,9 +1398,7 @@ MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS(size_t start, size_t len)
    if (IsSilent())
       return {};
 
-   float min = FLT_MAX;
-   float max = -FLT_MAX;
-   float sumsq = 0;
+   SummaryStats stats{ FLT_MAX, -FLT_MAX, 0, 0 };
 
    if (!mValid)
    {
@@ -492,25 +1414,11 @@ MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS(size_t start, size_t len)
       float *samples = (float *) blockData.ptr();
 
       size_t copied = DoGetSamples((samplePtr) samples, floatSample, start, len);
-      for (size_t i = 0; i < copied; ++i, ++samples)
-      {
-         float sample = *samples;
-
-         if (sample > max)
-         {
-            max = sample;
-         }
-
-         if (sample < min)
-         {
-            min = sample;
-         }
-
-         sumsq += (sample * sample);
-      }
+      if (copied > 0)
+         stats = Summarize(samples, copied);
    }
 
-   return { min, max, (float) sqrt(sumsq / len) };
+   return { stats.min, stats.max, (float) sqrt(stats.sumsq / len) };
 }
 
 /// Retrieves the minimum, maximum, and maximum RMS of this entire
@@ -521,6 +1429,112 @@ MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS() const
    return { (float) mSumMin, (float) mSumMax, (float) mSumRms };
 }
 
+/// Retrieves the sum and sum of squares of the specified sample data in
+/// this block, which must be read
+SampleSums SqliteSampleBlock::DoGetSums(size_t start, size_t len)
+{
+   if (!mValid)
+   {
+      Load(mBlockID);
+   }
+
+   if (start >= mSampleCount)
+      return {};
+   len = std::min(len, mSampleCount - start);
+
+   if (IsSilent())
+      return { 0, 0, len };
+
+   SampleBuffer blockData(len, floatSample);
+   float *samples = (float *) blockData.ptr();
+
+   size_t copied = DoGetSamples((samplePtr) samples, floatSample, start, len);
+   auto sums = SumSamples(samples, copied);
+   sums.count = len;
+   return sums;
+}
+
+/// Retrieves the sum and sum of squares of this entire block.  Blocks
+/// committed before samplesums existed are read once, and then remembered.
+SampleSums SqliteSampleBlock::DoGetSums()
+{
+   if (IsSilent())
+      return { 0, 0, mSampleCount };
+
+   if (!mValid)
+   {
+      Load(mBlockID);
+   }
+
+   if (!mHasSums && !LoadSums())
+   {
+      // A block of a project saved without sums.  Keep them in memory only:
+      // analysis must not write the file, so samplesums is filled only when
+      // blocks are committed or materialized
+      const auto sums = DoGetSums(0, mSampleCount);
+      mSum = sums.sum;
+      mSumSquares = sums.sumSquares;
+      mHasSums = true;
+   }
+
+   return { mSum, mSumSquares, mSampleCount };
+}
+
+bool SqliteSampleBlock::LoadSums()
+{
+   try {
+      // Prepare and cache statement...automatically finalized at DB close
+      auto stmt = Conn()->Prepare(DBConnection::GetSampleSums,
+         "SELECT sumsamples, sumsquares FROM samplesums WHERE blockid = ?1;");
+      if (sqlite3_bind_int64(stmt, 1, mBlockID))
+      {
+         wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+      }
+
+      if (sqlite3_step(stmt) == SQLITE_ROW)
+      {
+         mSum = sqlite3_column_double(stmt, 0);
+         mSumSquares = sqlite3_column_double(stmt, 1);
+         mHasSums = true;
+      }
+
+      // Clear statement bindings and rewind statement
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+   }
+   catch ( const AudacityException & ) {
+   }
+   return mHasSums;
+}
+
+void SqliteSampleBlock::StoreSums()
+{
+   try {
+      // Prepare and cache statement...automatically finalized at DB close
+      auto stmt = Conn()->Prepare(DBConnection::SetSampleSums,
+         "INSERT OR REPLACE INTO samplesums (blockid, sumsamples, sumsquares)"
+         "  VALUES(?1, ?2, ?3);");
+      if (sqlite3_bind_int64(stmt, 1, mBlockID) ||
+          sqlite3_bind_double(stmt, 2, mSum) ||
+          sqlite3_bind_double(stmt, 3, mSumSquares))
+      {
+         wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+      }
+
+      if (sqlite3_step(stmt) != SQLITE_DONE)
+      {
+         wxLogDebug(wxT("SqliteSampleBlock::StoreSums - SQLITE error %s"),
+            sqlite3_errmsg(DB()));
+      }
+
+      // Clear statement bindings and rewind statement
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+   }
+   catch ( const AudacityException & ) {
+   }
+}
+
 size_t SqliteSampleBlock::GetSpaceUsage() const
 {
    if (IsSilent())
@@ -534,7 +1548,8 @@ size_t SqliteSampleBlock::GetBlob(void *dest,
                                   sqlite3_stmt *stmt,
                                   sampleFormat srcformat,
                                   size_t srcoffset,
-                                  size_t srcbytes)
+                                  size_t srcbytes,
+                                  SqliteSampleBlockCache *pCache)
 {
    auto db = DB();
 
@@ -575,6 +1590,10 @@ size_t SqliteSampleBlock::GetBlob(void *dest,
    samplePtr src = (samplePtr) sqlite3_column_blob(stmt, 0);
    size_t blobbytes = (size_t) sqlite3_column_bytes(stmt, 0);
 
+   // Remember the whole blob, not only the requested part
+   if (pCache)
+      pCache->Insert(mBlockID, src, blobbytes);
+
    srcoffset = std::min(srcoffset, blobbytes);
    minbytes = std::min(srcbytes, blobbytes - srcoffset);
 
@@ -664,6 +1683,8 @@ void SqliteSampleBlock::Load(SampleBlockID sbid)
 
 void SqliteSampleBlock::Commit(Sizes sizes)
 {
+   PROFILE_SCOPE("SqliteSampleBlock::Commit");
+
    const auto mSummary256Bytes = sizes.first;
    const auto mSummary64kBytes = sizes.second;
 
@@ -671,10 +1692,12 @@ void SqliteSampleBlock::Commit(Sizes sizes)
    int rc;
 
    // Prepare and cache statement...automatically finalized at DB close
+   // A null blockid lets the database assign it; a positive one is given
+   // only when a batch restores the row of a block
    sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::InsertSampleBlock,
       "INSERT INTO sampleblocks (sampleformat, summin, summax, sumrms,"
-      "                          summary256, summary64k, samples)"
-      "                         VALUES(?1,?2,?3,?4,?5,?6,?7);");
+      "                          summary256, summary64k, samples, blockid)"
+      "                         VALUES(?1,?2,?3,?4,?5,?6,?7,?8);");
 
    // Bind statement parameters
    // Might return SQLITE_MISUSE which means it's our mistake that we violated
@@ -685,7 +1708,10 @@ void SqliteSampleBlock::Commit(Sizes sizes)
        sqlite3_bind_double(stmt, 4, mSumRms) ||
        sqlite3_bind_blob(stmt, 5, mSummary256.get(), mSummary256Bytes, SQLITE_STATIC) ||
        sqlite3_bind_blob(stmt, 6, mSummary64k.get(), mSummary64kBytes, SQLITE_STATIC) ||
-       sqlite3_bind_blob(stmt, 7, mSamples.get(), mSampleBytes, SQLITE_STATIC))
+       sqlite3_bind_blob(stmt, 7, mSamples.get(), mSampleBytes, SQLITE_STATIC) ||
+       (mBlockID > 0
+          ? sqlite3_bind_int64(stmt, 8, mBlockID)
+          : sqlite3_bind_null(stmt, 8)))
    {
       wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
    }
@@ -700,6 +1726,10 @@ void SqliteSampleBlock::Commit(Sizes sizes)
       sqlite3_clear_bindings(stmt);
       sqlite3_reset(stmt);
 
+      // The error may have undone other blocks of a batch too
+      if (auto pBatch = mpFactory->mpBatch)
+         pBatch->Recover();
+
       // Just showing the user a simple message, not the library error too
       // which isn't internationalized
       Conn()->ThrowException( true );
@@ -708,25 +1738,177 @@ void SqliteSampleBlock::Commit(Sizes sizes)
    // Retrieve returned data
    mBlockID = sqlite3_last_insert_rowid(db);
 
-   // Reset local arrays
-   mSamples.reset();
-   mSummary256.reset();
-   mSummary64k.reset();
+   // Reset local arrays, unless a batch needs them until it is released
+   if (!mpFactory->mpBatch)
+      ReleaseBuffers();
 
    // Clear statement bindings and rewind statement
    sqlite3_clear_bindings(stmt);
    sqlite3_reset(stmt);
 
    mValid = true;
+
+   StoreSums();
 }
 
-void SqliteSampleBlock::Delete()
+void SqliteSampleBlock::ReleaseBuffers()
 {
-   auto db = DB();
-   int rc;
-
-   wxASSERT(!IsSilent());
-
+   mSamples.reset();
+   mSummary256.reset();
+   mSummary64k.reset();
+}
+
+void SqliteSampleBlock::CommitPlaceholder(const PCMFileReference &reference,
+   unsigned channel, unsigned long long start)
+{
+   auto db = DB();
+
+   // Prepare and cache statement...automatically finalized at DB close
+   sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::InsertPlaceholderBlock,
+      "INSERT INTO sampleblocks (sampleformat, summin, summax, sumrms)"
+      "                         VALUES(?1,0,0,0);");
+
+   // Bind statement parameters
+   // Might return SQLITE_MISUSE which means it's our mistake that we violated
+   // preconditions; should return SQL_OK which is 0
+   if (sqlite3_bind_int(stmt, 1, mSampleFormat))
+   {
+      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+   }
+
+   // Execute the statement
+   auto rc = sqlite3_step(stmt);
+
+   // Clear statement bindings and rewind statement
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+
+   if (rc != SQLITE_DONE)
+   {
+      wxLogDebug(wxT("SqliteSampleBlock::CommitPlaceholder - SQLITE error %s"), sqlite3_errmsg(db));
+
+      // Just showing the user a simple message, not the library error too
+      // which isn't internationalized
+      Conn()->ThrowException( true );
+   }
+
+   // From now on, the destructor deletes the row
+   mBlockID = sqlite3_last_insert_rowid(db);
+   mValid = true;
+
+   const auto &layout = reference.GetLayout();
+   const auto path = reference.GetPath().ToUTF8();
+   stmt = Conn()->Prepare(DBConnection::InsertPendingBlock,
+      "INSERT INTO pendingblocks (blockid, path, filesize, dataoffset,"
+      "                           samplebytes, isfloat, bigendian, channels,"
+      "                           frames, channel, start, length)"
+      "                          VALUES(?1,?2,?3,?4,?5,?6,?7,?8,?9,?10,?11,?12);");
+
+   if (sqlite3_bind_int64(stmt, 1, mBlockID) ||
+       sqlite3_bind_text(stmt, 2, path.data(), -1, SQLITE_STATIC) ||
+       sqlite3_bind_int64(stmt, 3, reference.GetFileSize()) ||
+       sqlite3_bind_int64(stmt, 4, layout.offset) ||
+       sqlite3_bind_int(stmt, 5, layout.bytes) ||
+       sqlite3_bind_int(stmt, 6, layout.isFloat) ||
+       sqlite3_bind_int(stmt, 7, layout.bigEndian) ||
+       sqlite3_bind_int(stmt, 8, layout.channels) ||
+       sqlite3_bind_int64(stmt, 9, layout.frames) ||
+       sqlite3_bind_int(stmt, 10, channel) ||
+       sqlite3_bind_int64(stmt, 11, start) ||
+       sqlite3_bind_int64(stmt, 12, mSampleCount))
+   {
+      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+   }
+
+   rc = sqlite3_step(stmt);
+
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+
+   if (rc != SQLITE_DONE)
+   {
+      wxLogDebug(wxT("SqliteSampleBlock::CommitPlaceholder - SQLITE error %s"), sqlite3_errmsg(db));
+      Conn()->ThrowException( true );
+   }
+}
+
+void SqliteSampleBlock::CommitMaterialized(
+   const SqliteSampleBlock &prepared, Sizes sizes)
+{
+   PROFILE_SCOPE("SqliteSampleBlock::CommitMaterialized");
+
+   auto db = DB();
+
+   wxASSERT(prepared.mSampleFormat == mSampleFormat);
+   wxASSERT(prepared.mSampleCount == mSampleCount);
+
+   // Prepare and cache statement...automatically finalized at DB close
+   sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::UpdateSampleBlock,
+      "UPDATE sampleblocks SET summin = ?1, summax = ?2, sumrms = ?3,"
+      "                        summary256 = ?4, summary64k = ?5, samples = ?6"
+      "  WHERE blockid = ?7;");
+
+   // Bind statement parameters
+   // Might return SQLITE_MISUSE which means it's our mistake that we violated
+   // preconditions; should return SQL_OK which is 0
+   if (sqlite3_bind_double(stmt, 1, prepared.mSumMin) ||
+       sqlite3_bind_double(stmt, 2, prepared.mSumMax) ||
+       sqlite3_bind_double(stmt, 3, prepared.mSumRms) ||
+       sqlite3_bind_blob(stmt, 4, prepared.mSummary256.get(), sizes.first, SQLITE_STATIC) ||
+       sqlite3_bind_blob(stmt, 5, prepared.mSummary64k.get(), sizes.second, SQLITE_STATIC) ||
+       sqlite3_bind_blob(stmt, 6, prepared.mSamples.get(), prepared.mSampleBytes, SQLITE_STATIC) ||
+       sqlite3_bind_int64(stmt, 7, mBlockID))
+   {
+      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+   }
+
+   // Execute the statement
+   auto rc = sqlite3_step(stmt);
+
+   // Clear statement bindings and rewind statement
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+
+   if (rc == SQLITE_DONE)
+   {
+      stmt = Conn()->Prepare(DBConnection::DeletePendingBlock,
+         "DELETE FROM pendingblocks WHERE blockid = ?1;");
+      if (sqlite3_bind_int64(stmt, 1, mBlockID))
+      {
+         wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+      }
+      rc = sqlite3_step(stmt);
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+   }
+
+   if (rc != SQLITE_DONE)
+   {
+      wxLogDebug(wxT("SqliteSampleBlock::CommitMaterialized - SQLITE error %s"), sqlite3_errmsg(db));
+
+      // Just showing the user a simple message, not the library error too
+      // which isn't internationalized
+      Conn()->ThrowException( true );
+   }
+
+   mSumMin = prepared.mSumMin;
+   mSumMax = prepared.mSumMax;
+   mSumRms = prepared.mSumRms;
+   mSampleBytes = prepared.mSampleBytes;
+
+   mSum = prepared.mSum;
+   mSumSquares = prepared.mSumSquares;
+   mHasSums = true;
+   StoreSums();
+}
+
+void SqliteSampleBlock::Delete()
+{
+   auto db = DB();
+   int rc;
+
+   wxASSERT(!IsSilent());
+
    // Prepare and cache statement...automatically finalized at DB close
    sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::DeleteSampleBlock,
       "DELETE FROM sampleblocks WHERE blockid = ?1;");
@@ -759,6 +1941,284 @@ void SqliteSampleBlock::Delete()
    sqlite3_reset(stmt);
 }
 
+// Bind the key as parameters first to first + 3
+static void BindSpectrumKey(sqlite3_stmt *stmt,
+   const SampleBlock::SpectrumKey &key, int first)
+{
+   if (sqlite3_bind_int(stmt, first, key.windowType) ||
+       sqlite3_bind_int64(stmt, first + 1, key.windowSize) ||
+       sqlite3_bind_int64(stmt, first + 2, key.zeroPaddingFactor) ||
+       sqlite3_bind_int64(stmt, first + 3, key.hop))
+   {
+      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+   }
+}
+
+static bool SameSpectrumKey(
+   const SampleBlock::SpectrumKey &a, const SampleBlock::SpectrumKey &b)
+{
+   return a.windowType == b.windowType &&
+      a.windowSize == b.windowSize &&
+      a.zeroPaddingFactor == b.zeroPaddingFactor &&
+      a.hop == b.hop;
+}
+
+SqliteSpectrumTiles::SqliteSpectrumTiles(SqliteSampleBlockFactory &factory)
+   : mFactory{ factory }
+{
+}
+
+auto SqliteSpectrumTiles::Encode(float dB) -> Value
+{
+   const auto hundredths = std::floor(0.5 + 100.0 * dB);
+   return Value( std::max(-32768.0, std::min(32767.0, hundredths)) );
+}
+
+float SqliteSpectrumTiles::Decode(Value value)
+{
+   return value / 100.0f;
+}
+
+bool SqliteSpectrumTiles::Find(SampleBlockID id, const SpectrumKey &key,
+   std::vector<float> &columns)
+{
+   std::lock_guard<std::mutex> lock{ mMutex };
+   Use(key);
+   for (const auto &tile : mPending)
+      if (tile.id == id && SameSpectrumKey(tile.key, key)) {
+         columns.resize(tile.columns.size());
+         std::transform(tile.columns.begin(), tile.columns.end(),
+            columns.begin(), Decode);
+         return true;
+      }
+   return false;
+}
+
+void SqliteSpectrumTiles::Add(SampleBlockID id, const SpectrumKey &key,
+   const float *columns, size_t count)
+{
+   std::lock_guard<std::mutex> lock{ mMutex };
+   Use(key);
+   const auto bytes = count * sizeof(Value);
+   if (mPendingBytes + bytes > MaxPendingBytes)
+      // Drawing computes it again if needed
+      return;
+   Tile tile{ id, key, std::vector< Value >(count) };
+   std::transform(columns, columns + count, tile.columns.begin(), Encode);
+   mPending.push_back(std::move(tile));
+   mPendingBytes += bytes;
+   ScheduleCommit();
+}
+
+void SqliteSpectrumTiles::Erase(SampleBlockID id)
+{
+   std::lock_guard<std::mutex> lock{ mMutex };
+   auto end = std::remove_if(mPending.begin(), mPending.end(),
+      [&](const Tile &tile){ return tile.id == id; });
+   for (auto iter = end; iter != mPending.end(); ++iter)
+      mPendingBytes -= iter->columns.size() * sizeof(Value);
+   mPending.erase(end, mPending.end());
+}
+
+void SqliteSpectrumTiles::Use(const SpectrumKey &key)
+{
+   // mMutex is held
+   for (const auto &used : mUsed)
+      if (SameSpectrumKey(used, key))
+         return;
+   mUsed.push_back(key);
+}
+
+void SqliteSpectrumTiles::ScheduleCommit()
+{
+   // mMutex is held
+   if (mCommitScheduled || !wxTheApp)
+      return;
+   mCommitScheduled = true;
+   // Called by a block, which owns the factory, so the factory is surely
+   // owned by a shared pointer
+   std::weak_ptr<SqliteSampleBlockFactory> wFactory =
+      mFactory.shared_from_this();
+   wxTheApp->CallAfter( [wFactory]{
+      if (auto pFactory = wFactory.lock())
+         pFactory->mTiles.Commit();
+   } );
+}
+
+void SqliteSpectrumTiles::Commit()
+{
+   std::vector< Tile > pending;
+   std::vector< SpectrumKey > used;
+
+   auto &pConnection = mFactory.mppConnection->mpConnection;
+   {
+      std::lock_guard<std::mutex> lock{ mMutex };
+      mCommitScheduled = false;
+      if (pConnection && !sqlite3_get_autocommit(pConnection->DB()))
+         // Don't join a transaction that may yet be rolled back; the next
+         // tile drawn schedules another try, and until then, drawing finds
+         // the tiles here
+         return;
+      pending.swap(mPending);
+      used.swap(mUsed);
+      mPendingBytes = 0;
+   }
+
+   if (!pConnection || pending.empty())
+      return;
+
+   PROFILE_SCOPE("SqliteSpectrumTiles::Commit");
+   try {
+      TransactionScope trans{ *pConnection, "SpectrogramTiles" };
+      bool added = false;
+      for (const auto &key : used)
+         added = Touch(*pConnection, key) || added;
+      if (added)
+         Evict(*pConnection);
+      for (const auto &tile : pending)
+         Write(*pConnection, tile);
+      trans.Commit();
+   }
+   catch ( const AudacityException & ) {
+      // Only a cache; drawing computes the tiles again
+   }
+}
+
+bool SqliteSpectrumTiles::Touch(
+   DBConnection &connection, const SpectrumKey &key)
+{
+   auto db = connection.DB();
+   auto stmt = connection.Prepare(DBConnection::TouchSpectrumSettings,
+      "UPDATE spectrogramsettings"
+      "  SET lastused = (SELECT MAX(lastused) + 1 FROM spectrogramsettings)"
+      "  WHERE windowtype = ?1 AND windowsize = ?2"
+      "  AND zeropadding = ?3 AND hop = ?4;");
+   BindSpectrumKey(stmt, key, 1);
+   auto rc = sqlite3_step(stmt);
+   const bool found = (rc == SQLITE_DONE && sqlite3_changes(db) > 0);
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+   if (rc != SQLITE_DONE)
+      connection.ThrowException( true );
+   if (found)
+      return false;
+
+   stmt = connection.Prepare(DBConnection::AddSpectrumSettings,
+      "INSERT INTO spectrogramsettings"
+      "  (windowtype, windowsize, zeropadding, hop, lastused)"
+      "  VALUES(?1, ?2, ?3, ?4,"
+      "    (SELECT IFNULL(MAX(lastused), 0) + 1 FROM spectrogramsettings));");
+   BindSpectrumKey(stmt, key, 1);
+   rc = sqlite3_step(stmt);
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+   if (rc != SQLITE_DONE)
+      connection.ThrowException( true );
+   return true;
+}
+
+void SqliteSpectrumTiles::Evict(DBConnection &connection)
+{
+   const auto sql = wxString::Format(
+      "DELETE FROM spectrogramsettings WHERE rowid NOT IN"
+      "  (SELECT rowid FROM spectrogramsettings"
+      "   ORDER BY lastused DESC LIMIT %d);"
+      "DELETE FROM spectrogramtiles"
+      "  WHERE (windowtype, windowsize, zeropadding, hop) NOT IN"
+      "  (SELECT windowtype, windowsize, zeropadding, hop"
+      "   FROM spectrogramsettings);",
+      (int)MaxSettings );
+   if (sqlite3_exec(connection.DB(), sql, nullptr, nullptr, nullptr)
+       != SQLITE_OK)
+      connection.ThrowException( true );
+}
+
+void SqliteSpectrumTiles::Write(DBConnection &connection, const Tile &tile)
+{
+   // Prepare and cache statement...automatically finalized at DB close
+   auto stmt = connection.Prepare(DBConnection::SetSpectrumTile,
+      "INSERT OR REPLACE INTO spectrogramtiles"
+      "  (blockid, windowtype, windowsize, zeropadding, hop, columns)"
+      "  SELECT ?1, ?2, ?3, ?4, ?5, ?6"
+      // The block may have been deleted, or the key evicted, since drawing
+      "  WHERE EXISTS (SELECT 1 FROM sampleblocks WHERE blockid = ?1)"
+      "  AND EXISTS (SELECT 1 FROM spectrogramsettings"
+      "    WHERE windowtype = ?2 AND windowsize = ?3"
+      "    AND zeropadding = ?4 AND hop = ?5);");
+   if (sqlite3_bind_int64(stmt, 1, tile.id) ||
+       sqlite3_bind_blob(stmt, 6, tile.columns.data(),
+          tile.columns.size() * sizeof(Value), SQLITE_STATIC))
+   {
+      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+   }
+   BindSpectrumKey(stmt, tile.key, 2);
+
+   if (sqlite3_step(stmt) != SQLITE_DONE)
+   {
+      wxLogDebug(wxT("SqliteSpectrumTiles::Write - SQLITE error %s"),
+         sqlite3_errmsg(connection.DB()));
+   }
+
+   // Clear statement bindings and rewind statement
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+}
+
+bool SqliteSampleBlock::GetSpectrumTile(
+   const SpectrumKey &key, std::vector<float> &columns)
+{
+   // Non-throwing, it returns true for success
+   if (IsSilent())
+      return false;
+
+   if (mpFactory->mTiles.Find(mBlockID, key, columns))
+      return true;
+
+   try {
+      // Prepare and cache statement...automatically finalized at DB close
+      auto stmt = Conn()->Prepare(DBConnection::GetSpectrumTile,
+         "SELECT columns FROM spectrogramtiles"
+         "  WHERE blockid = ?1 AND windowtype = ?2 AND windowsize = ?3"
+         "  AND zeropadding = ?4 AND hop = ?5;");
+      if (sqlite3_bind_int64(stmt, 1, mBlockID))
+      {
+         wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+      }
+      BindSpectrumKey(stmt, key, 2);
+
+      bool found = false;
+      if (sqlite3_step(stmt) == SQLITE_ROW)
+      {
+         using Value = SqliteSpectrumTiles::Value;
+         auto src = (const Value *) sqlite3_column_blob(stmt, 0);
+         auto count = sqlite3_column_bytes(stmt, 0) / sizeof(Value);
+         columns.resize(count);
+         std::transform(src, src + count, columns.begin(),
+            SqliteSpectrumTiles::Decode);
+         found = true;
+      }
+
+      // Clear statement bindings and rewind statement
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+
+      return found;
+   }
+   catch ( const AudacityException & ) {
+   }
+   return false;
+}
+
+void SqliteSampleBlock::SetSpectrumTile(
+   const SpectrumKey &key, const float *columns, size_t count)
+{
+   // Non-throwing, and failure only costs recomputing the tile later
+   if (IsSilent())
+      return;
+
+   mpFactory->mTiles.Add(mBlockID, key, columns, count);
+}
+
 void SqliteSampleBlock::SaveXML(XMLWriter &xmlFile)
 {
    xmlFile.WriteAttr(wxT("blockid"), mBlockID);
@@ -779,31 +2239,14 @@ auto SqliteSampleBlock::SetSizes(
 /// Calculates summary block data describing this sample data.
 ///
 /// This method also has the side effect of setting the mSumMin,
-/// mSumMax, and mSumRms members of this class.
+/// mSumMax, mSumRms, mSum and mSumSquares members of this class.
 ///
 void SqliteSampleBlock::CalcSummary(Sizes sizes)
 {
    const auto mSummary256Bytes = sizes.first;
    const auto mSummary64kBytes = sizes.second;
 
-   Floats samplebuffer;
-   float *samples;
-
-   if (mSampleFormat == floatSample)
-   {
-      samples = (float *) mSamples.get();
-   }
-   else
-   {
-      samplebuffer.reinit((unsigned) mSampleCount);
-      CopySamples(mSamples.get(),
-                  mSampleFormat,
-                  (samplePtr) samplebuffer.get(),
-                  floatSample,
-                  mSampleCount);
-      samples = samplebuffer.get();
-   }
-   
+   // Samples are converted to float in registers, not in another buffer
    mSummary256.reinit(mSummary256Bytes);
    mSummary64k.reinit(mSummary64kBytes);
 
@@ -814,6 +2257,7 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
    float max;
    float sumsq;
    double totalSquares = 0.0;
+   double total = 0.0;
    double fraction = 0.0;
 
    // Recalc 256 summaries
@@ -822,10 +2266,6 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
 
    for (int i = 0; i < sumLen; ++i)
    {
-      min = samples[i * 256];
-      max = samples[i * 256];
-      sumsq = min * min;
-
       int jcount = 256;
       if (jcount > mSampleCount - i * 256)
       {
@@ -833,27 +2273,16 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
          fraction = 1.0 - (jcount / 256.0);
       }
 
-      for (int j = 1; j < jcount; ++j)
-      {
-         float f1 = samples[i * 256 + j];
-         sumsq += f1 * f1;
-
-         if (f1 < min)
-         {
-            min = f1;
-         }
-         else if (f1 > max)
-         {
-            max = f1;
-         }
-      }
+      const auto stats =
+         Summarize(mSamples.get(), mSampleFormat, i * 256, jcount);
 
-      totalSquares += sumsq;
+      totalSquares += stats.sumsq;
+      total += stats.sum;
 
-      summary256[i * fields] = min;
-      summary256[i * fields + 1] = max;
+      summary256[i * fields] = stats.min;
+      summary256[i * fields + 1] = stats.max;
       // The rms is correct, but this may be for less than 256 samples in last loop.
-      summary256[i * fields + 2] = (float) sqrt(sumsq / jcount);
+      summary256[i * fields + 2] = (float) sqrt(stats.sumsq / jcount);
    }
 
    for (int i = sumLen, frames256 = mSummary256Bytes / bytesPerFrame;
@@ -869,6 +2298,9 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
 
    // Calculate now while we can do it accurately
    mSumRms = sqrt(totalSquares / mSampleCount);
+   mSum = total;
+   mSumSquares = totalSquares;
+   mHasSums = true;
 
    // Recalc 64K summaries
    sumLen = (mSampleCount + 65535) / 65536;
@@ -937,6 +2369,372 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
    mSumMax = max;
 }
 
+ReferenceSampleBlock::ReferenceSampleBlock(
+   std::shared_ptr<SqliteSampleBlock> pBlock,
+   std::shared_ptr<const PCMFileReference> pReference,
+   unsigned channel, unsigned long long start)
+   : mpBlock{ std::move(pBlock) }
+   , mpReference{ std::move(pReference) }
+   , mChannel{ channel }
+   , mStart{ start }
+{
+}
+
+// mpBlock deletes the row, if this was the last reference to it
+ReferenceSampleBlock::~ReferenceSampleBlock() = default;
+
+void ReferenceSampleBlock::CloseLock()
+{
+   mpBlock->CloseLock();
+}
+
+SampleBlockID ReferenceSampleBlock::GetBlockID() const
+{
+   return mpBlock->GetBlockID();
+}
+
+size_t ReferenceSampleBlock::GetSampleCount() const
+{
+   return mpBlock->GetSampleCount();
+}
+
+bool ReferenceSampleBlock::ReadReference(
+   samplePtr dest, size_t offset, size_t len) const
+{
+   const auto format = mpBlock->GetSampleFormat();
+   if (mpReference)
+      return mpReference->Read(mChannel, mStart + offset, dest, format, len);
+   ClearSamples(dest, format, 0, len);
+   return false;
+}
+
+size_t ReferenceSampleBlock::ReadReference(samplePtr dest,
+   sampleFormat destformat, size_t offset, size_t len) const
+{
+   const auto count = GetSampleCount();
+   offset = std::min(offset, count);
+   const auto available = std::min(len, count - offset);
+
+   const auto format = mpBlock->GetSampleFormat();
+   if (destformat == format)
+      ReadReference(dest, offset, available);
+   else {
+      SampleBuffer buffer(available, format);
+      ReadReference(buffer.ptr(), offset, available);
+      CopySamples(buffer.ptr(), format, dest, destformat, available);
+   }
+
+   if (available < len)
+      ClearSamples(dest, destformat, available, len - available);
+   return len;
+}
+
+size_t ReferenceSampleBlock::DoGetSamples(samplePtr dest,
+   sampleFormat destformat, size_t sampleoffset, size_t numsamples)
+{
+   if (IsMaterialized())
+      return mpBlock->DoGetSamples(dest, destformat, sampleoffset, numsamples);
+   return ReadReference(dest, destformat, sampleoffset, numsamples);
+}
+
+bool ReferenceSampleBlock::GetSummaryFromReference(
+   float *dest, size_t numframes)
+{
+   // Summarizing here would read all of a zoomed out display from the
+   // file at once; draw placeholders until the materializer is done,
+   // but do this block next
+   if (mpReference)
+      mpBlock->mpFactory->mMaterializer.Prioritize(GetBlockID());
+   memset(dest, 0, 3 * numframes * sizeof( float ));
+   return false;
+}
+
+bool ReferenceSampleBlock::GetSummary256(float *dest,
+                                         size_t frameoffset,
+                                         size_t numframes)
+{
+   if (IsMaterialized())
+      return mpBlock->GetSummary256(dest, frameoffset, numframes);
+   return GetSummaryFromReference(dest, numframes);
+}
+
+bool ReferenceSampleBlock::GetSummary64k(float *dest,
+                                         size_t frameoffset,
+                                         size_t numframes)
+{
+   if (IsMaterialized())
+      return mpBlock->GetSummary64k(dest, frameoffset, numframes);
+   return GetSummaryFromReference(dest, numframes);
+}
+
+bool ReferenceSampleBlock::IsSummaryAvailable() const
+{
+   // Blocks of a missing file display as silence, not as placeholders
+   return !mpReference || IsMaterialized();
+}
+
+MinMaxRMS ReferenceSampleBlock::GetMinMaxRMSFromReference(
+   size_t start, size_t len) const
+{
+   SummaryStats stats{ FLT_MAX, -FLT_MAX, 0, 0 };
+
+   const auto count = GetSampleCount();
+   if (start < count)
+   {
+      len = std::min(len, count - start);
+
+      SampleBuffer blockData(len, floatSample);
+      float *samples = (float *) blockData.ptr();
+
+      if (ReadReference((samplePtr) samples, floatSample, start, len) > 0)
+         stats = Summarize(samples, len);
+   }
+
+   return { stats.min, stats.max, (float) sqrt(stats.sumsq / len) };
+}
+
+MinMaxRMS ReferenceSampleBlock::DoGetMinMaxRMS(size_t start, size_t len)
+{
+   if (IsMaterialized())
+      return mpBlock->DoGetMinMaxRMS(start, len);
+   return GetMinMaxRMSFromReference(start, len);
+}
+
+MinMaxRMS ReferenceSampleBlock::DoGetMinMaxRMS() const
+{
+   if (IsMaterialized())
+      return mpBlock->DoGetMinMaxRMS();
+   // Effects need exact values, so read the whole block now
+   return GetMinMaxRMSFromReference(0, GetSampleCount());
+}
+
+SampleSums ReferenceSampleBlock::GetSumsFromReference(
+   size_t start, size_t len) const
+{
+   const auto count = GetSampleCount();
+   if (start >= count)
+      return {};
+   len = std::min(len, count - start);
+
+   SampleBuffer blockData(len, floatSample);
+   float *samples = (float *) blockData.ptr();
+
+   auto sums = SumSamples(samples,
+      ReadReference((samplePtr) samples, floatSample, start, len));
+   sums.count = len;
+   return sums;
+}
+
+SampleSums ReferenceSampleBlock::DoGetSums(size_t start, size_t len)
+{
+   if (IsMaterialized())
+      return mpBlock->DoGetSums(start, len);
+   return GetSumsFromReference(start, len);
+}
+
+SampleSums ReferenceSampleBlock::DoGetSums()
+{
+   if (IsMaterialized())
+      return mpBlock->DoGetSums();
+   return GetSumsFromReference(0, GetSampleCount());
+}
+
+size_t ReferenceSampleBlock::GetSpaceUsage() const
+{
+   return mpBlock->GetSpaceUsage();
+}
+
+void ReferenceSampleBlock::SaveXML(XMLWriter &xmlFile)
+{
+   // Where to find the samples is in the database, not the document
+   mpBlock->SaveXML(xmlFile);
+}
+
+bool ReferenceSampleBlock::GetSpectrumTile(
+   const SpectrumKey &key, std::vector<float> &columns)
+{
+   return mpBlock->GetSpectrumTile(key, columns);
+}
+
+void ReferenceSampleBlock::SetSpectrumTile(
+   const SpectrumKey &key, const float *columns, size_t count)
+{
+   mpBlock->SetSpectrumTile(key, columns, count);
+}
+
+SqliteSampleBlockMaterializer::SqliteSampleBlockMaterializer(
+   SqliteSampleBlockFactory &factory)
+   : mFactory{ factory }
+{
+}
+
+SqliteSampleBlockMaterializer::~SqliteSampleBlockMaterializer()
+{
+   {
+      std::lock_guard<std::mutex> lock{ mMutex };
+      mStop = true;
+   }
+   mChanged.notify_one();
+   if (mThread.joinable())
+      mThread.join();
+}
+
+void SqliteSampleBlockMaterializer::Add(
+   const std::shared_ptr<ReferenceSampleBlock> &pBlock)
+{
+   if (!mThread.joinable()) {
+      // Start on first use, when the project is surely owned by a shared
+      // pointer; the factory may outlive the project, if the clipboard
+      // holds tracks
+      mwFactory = mFactory.shared_from_this();
+      mwProject = mFactory.mProject.shared_from_this();
+      mThread = std::thread{ [this]{ Work(); } };
+   }
+
+   {
+      std::lock_guard<std::mutex> lock{ mMutex };
+      mPending[ pBlock->GetBlockID() ] = pBlock;
+   }
+   mChanged.notify_one();
+}
+
+void SqliteSampleBlockMaterializer::Prioritize(SampleBlockID id)
+{
+   {
+      std::lock_guard<std::mutex> lock{ mMutex };
+      if (!mPending.count(id))
+         return;
+      // Ids not yet begun are found again when popped, so repeated requests
+      // for the same block do no harm
+      mUrgent.push_back(id);
+   }
+   mChanged.notify_one();
+}
+
+void SqliteSampleBlockMaterializer::ScheduleCommit()
+{
+   // mMutex is held
+   if (mCommitScheduled || !wxTheApp)
+      return;
+   mCommitScheduled = true;
+   wxTheApp->CallAfter( [wFactory = mwFactory]{
+      if (auto pFactory = wFactory.lock())
+         pFactory->mMaterializer.Commit();
+   } );
+}
+
+void SqliteSampleBlockMaterializer::Work()
+{
+   Profiler::SetThreadName("Sample block materializer");
+
+   std::unique_lock<std::mutex> lock{ mMutex };
+   while (true) {
+      if (mReady.empty())
+         mChanged.wait(lock, [this]{ return mStop || !mPending.empty(); });
+      else
+         // Retry commits deferred by open transactions now and then
+         mChanged.wait_for(lock, std::chrono::milliseconds{ 100 }, [this]{
+            return mStop || (!mPending.empty() && mReady.size() < MaxReady);
+         });
+      if (mStop)
+         break;
+      if (!mReady.empty())
+         ScheduleCommit();
+      if (mPending.empty() || mReady.size() >= MaxReady)
+         continue;
+
+      // Choose the next block
+      auto iter = mPending.end();
+      while (iter == mPending.end() && !mUrgent.empty()) {
+         iter = mPending.find(mUrgent.back());
+         mUrgent.pop_back();
+      }
+      if (iter == mPending.end())
+         iter = mPending.begin();
+      Result result{ iter->second.lock() };
+      mPending.erase(iter);
+      if (!result.pBlock)
+         continue;
+
+      lock.unlock();
+      try {
+         PROFILE_SCOPE("SqliteSampleBlockMaterializer::Work");
+         auto &block = *result.pBlock;
+         const auto count = block.GetSampleCount();
+         const auto format = block.mpBlock->GetSampleFormat();
+         SampleBuffer buffer(count, format);
+         // Don't copy silence for a file that another program changed
+         if (block.ReadReference(buffer.ptr(), 0, count)) {
+            // A block without a factory only computes; it has no row
+            auto pPrepared = std::make_shared<SqliteSampleBlock>(nullptr);
+            result.sizes = pPrepared->SetSamples(buffer.ptr(), count, format);
+            result.pPrepared = std::move(pPrepared);
+         }
+      }
+      catch ( ... ) {
+         // The block keeps reading from the file
+      }
+      lock.lock();
+
+      // Blocks are released on the main thread only, because that may
+      // delete rows
+      mReady.push_back(std::move(result));
+      ScheduleCommit();
+   }
+}
+
+void SqliteSampleBlockMaterializer::Commit()
+{
+   std::vector< Result > ready;
+
+   auto &pConnection = mFactory.mppConnection->mpConnection;
+   {
+      std::lock_guard<std::mutex> lock{ mMutex };
+      mCommitScheduled = false;
+      if (!pConnection) {
+         // The project is closed; its blocks are materialized when it is
+         // opened again
+         mPending.clear();
+         mUrgent.clear();
+      }
+      else if (!sqlite3_get_autocommit(pConnection->DB()))
+         // Don't join a transaction that may yet be rolled back; the worker
+         // schedules another try
+         return;
+      ready.swap(mReady);
+   }
+   mChanged.notify_one();
+
+   if (!pConnection || ready.empty())
+      return;
+
+   bool committed = false;
+   try {
+      TransactionScope trans{ *pConnection, "MaterializeSampleBlocks" };
+      for (auto &result : ready)
+         if (result.pPrepared && !result.pBlock->mpBlock->mLocked)
+            result.pBlock->mpBlock->CommitMaterialized(
+               *result.pPrepared, result.sizes);
+      committed = trans.Commit();
+   }
+   catch ( const AudacityException & ) {
+      // Not an error the user must see now; the blocks still read from the
+      // file, and will be copied when the project is opened again
+   }
+
+   bool any = false;
+   for (auto &result : ready)
+      if (committed && result.pPrepared && !result.pBlock->mpBlock->mLocked) {
+         result.pBlock->mMaterialized.store(true, std::memory_order_release);
+         any = true;
+      }
+
+   if (any)
+      if (auto pProject = mwProject.lock())
+         pProject->QueueEvent(
+            safenew wxCommandEvent{ EVT_SAMPLE_BLOCKS_SUMMARIZED } );
+}
+
 // Inject our database implementation at startup
 static struct Injector
 {
@@ -0,0 +1,120 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  ThreadPool.cpp
+
+**********************************************************************/
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <wx/debug.h>
+
+#include "Profiler.h"
+
+size_t ThreadPool::HardwareThreadCount()
+{
+   return std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+ThreadPool::ThreadPool(size_t nThreads)
+{
+   for (size_t ii = 1; ii < nThreads; ++ii)
+      mWorkers.emplace_back( [this]{ Work(); } );
+}
+
+ThreadPool::~ThreadPool()
+{
+   {
+      std::lock_guard<std::mutex> lock{ mMutex };
+      mStop = true;
+   }
+   mWorkAvailable.notify_all();
+   for (auto &worker : mWorkers)
+      worker.join();
+}
+
+void ThreadPool::Run(size_t count, Task task, const void *context)
+{
+   if (count == 0)
+      return;
+
+   if (mWorkers.empty() || count == 1) {
+      // No need to involve the other threads
+      for (size_t ii = 0; ii < count; ++ii)
+         task( context, ii );
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lock{ mMutex };
+      // Not reentrant, and not meant to be shared by several callers
+      wxASSERT( !mTask );
+      mTask = task;
+      mContext = context;
+      mCount = count;
+      mNext.store( 0, std::memory_order_relaxed );
+      ++mGeneration;
+   }
+   mWorkAvailable.notify_all();
+
+   Drain( count, task, context );
+
+   std::exception_ptr pException;
+   {
+      // All indices are claimed now; wait for workers still running tasks.
+      // Clearing mTask under the same lock keeps late-waking workers from
+      // joining a batch that is already finished.
+      std::unique_lock<std::mutex> lock{ mMutex };
+      mWorkersIdle.wait( lock, [this]{ return mActive == 0; } );
+      mTask = nullptr;
+      mContext = nullptr;
+      std::swap( pException, mException );
+   }
+
+   if (pException)
+      std::rethrow_exception( pException );
+}
+
+void ThreadPool::Drain(size_t count, Task task, const void *context)
+{
+   size_t index;
+   while ((index = mNext.fetch_add( 1, std::memory_order_relaxed )) < count) {
+      try {
+         task( context, index );
+      }
+      catch ( ... ) {
+         std::lock_guard<std::mutex> lock{ mMutex };
+         if (!mException)
+            mException = std::current_exception();
+      }
+   }
+}
+
+void ThreadPool::Work()
+{
+   Profiler::SetThreadName("Thread pool");
+
+   unsigned long generation = 0;
+   std::unique_lock<std::mutex> lock{ mMutex };
+   while (true) {
+      mWorkAvailable.wait( lock, [&]{
+         return mStop || (mTask && mGeneration != generation); } );
+      if (mStop)
+         break;
+
+      generation = mGeneration;
+      ++mActive;
+      const auto task = mTask;
+      const auto context = mContext;
+      const auto count = mCount;
+
+      lock.unlock();
+      Drain( count, task, context );
+      lock.lock();
+
+      if (--mActive == 0)
+         mWorkersIdle.notify_one();
+   }
+}
@@ -0,0 +1,90 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  ThreadPool.h
+
+**********************************************************************//**
+
+\class ThreadPool
+\brief A fixed set of threads that cooperate with the calling thread to
+run one batch of indexed tasks at a time.
+
+Each thread, including the caller, repeatedly claims the next unclaimed
+index until none remain, so that tasks of unequal cost balance across the
+threads.  ForEach returns only after every task has finished.
+
+*//*******************************************************************/
+
+#ifndef __AUDACITY_THREAD_POOL__
+#define __AUDACITY_THREAD_POOL__
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool
+{
+public:
+   //! The number of hardware threads, or 1 if that is unknown
+   static size_t HardwareThreadCount();
+
+   //! Start nThreads - 1 worker threads; the caller of ForEach is the other
+   explicit ThreadPool(size_t nThreads);
+   ThreadPool(const ThreadPool&) = delete;
+   ThreadPool &operator=(const ThreadPool&) = delete;
+   ~ThreadPool();
+
+   //! Count of threads that run tasks, including the caller of ForEach
+   size_t GetThreadCount() const { return mWorkers.size() + 1; }
+
+   //! Call function(index) for each index in [0, count), concurrently
+   /*!
+    The function is not copied, and no memory is allocated, so this is
+    suitable for use in the audio thread.  Tasks must not depend on each
+    other's results.  If any task throws, the remaining tasks still run, and
+    then the first exception is rethrown to the caller.
+    */
+   template< typename Function >
+   void ForEach(size_t count, const Function &function)
+   {
+      Run( count, &Invoke< Function >,
+         static_cast< const void* >( &function ) );
+   }
+
+private:
+   using Task = void (*)(const void *context, size_t index);
+
+   template< typename Function >
+   static void Invoke(const void *context, size_t index)
+   {
+      (*static_cast< const Function* >( context ))( index );
+   }
+
+   void Run(size_t count, Task task, const void *context);
+   void Drain(size_t count, Task task, const void *context);
+   void Work();
+
+   std::vector<std::thread> mWorkers;
+
+   std::mutex mMutex;
+   std::condition_variable mWorkAvailable;
+   std::condition_variable mWorkersIdle;
+
+   // These are guarded by mMutex
+   Task mTask{};
+   const void *mContext{};
+   size_t mCount{ 0 };
+   unsigned long mGeneration{ 0 };
+   size_t mActive{ 0 };
+   std::exception_ptr mException;
+   bool mStop{ false };
+
+   std::atomic<size_t> mNext{ 0 };
+};
+
+#endif
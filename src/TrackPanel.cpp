@@ -73,6 +73,7 @@ is time to refresh some aspect of the screen.
 
 #include "Prefs.h"
 #include "RefreshCode.h"
+#include "SampleBlock.h"
 #include "TrackArtist.h"
 #include "TrackPanelAx.h"
 #include "TrackPanelResizerCell.h"
@@ -309,6 +310,8 @@ TrackPanel::TrackPanel(wxWindow * parent, wxWindowID id,
       EVT_TRACK_FOCUS_CHANGE, &TrackPanel::OnTrackFocusChange, this );
 
    theProject->Bind(EVT_UNDO_RESET, &TrackPanel::OnUndoReset, this);
+   theProject->Bind(EVT_SAMPLE_BLOCKS_SUMMARIZED,
+      &TrackPanel::OnSampleBlocksSummarized, this);
 
    wxTheApp->Bind(EVT_AUDIOIO_PLAYBACK,
                      &TrackPanel::OnAudioIO,
@@ -464,6 +467,13 @@ void TrackPanel::OnUndoReset( wxCommandEvent &event )
    Refresh( false );
 }
 
+void TrackPanel::OnSampleBlocksSummarized( wxCommandEvent &event )
+{
+   event.Skip();
+   // Redraw waveforms that were shown as pending
+   Refresh( false );
+}
+
 /// AS: OnPaint( ) is called during the normal course of
 ///  completing a repaint operation.
 void TrackPanel::OnPaint(wxPaintEvent & /* event */)
@@ -105,6 +105,7 @@ class AUDACITY_DLL_API TrackPanel final
    void OnTrackFocusChange( wxCommandEvent &event );
 
    void OnUndoReset( wxCommandEvent &event );
+   void OnSampleBlocksSummarized( wxCommandEvent &event );
 
    void Refresh
       (bool eraseBackground = true, const wxRect *rect = (const wxRect *) NULL)
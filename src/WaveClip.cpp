@@ -23,15 +23,19 @@
 
 #include "Experimental.h"
 
+#include <algorithm>
+#include <map>
 #include <math.h>
 #include <vector>
 #include <wx/log.h>
 
 #include "Sequence.h"
 #include "Spectrum.h"
+#include "ThreadPool.h"
 #include "Prefs.h"
 #include "Envelope.h"
 #include "Resample.h"
+#include "SampleBlock.h"
 #include "WaveTrack.h"
 #include "Profiler.h"
 #include "InconsistencyException.h"
@@ -40,10 +44,6 @@
 #include "prefs/SpectrogramSettings.h"
 #include "widgets/ProgressDialog.h"
 
-#ifdef _OPENMP
-#include <omp.h>
-#endif
-
 class WaveCache {
 public:
    WaveCache()
@@ -413,11 +413,15 @@ bool WaveClip::GetWaveDisplay(WaveDisplay &display, double t0,
       const bool ppsMatch = mWaveCache &&
          (fabs(tstep - 1.0 / mWaveCache->pps) * numPixels < (1.0 / mRate));
 
+      // Columns drawn while their summaries were still being computed
+      // must be fetched again
       const bool match =
          mWaveCache &&
          ppsMatch &&
          mWaveCache->len > 0 &&
-         mWaveCache->dirty == mDirty;
+         mWaveCache->dirty == mDirty &&
+         std::none_of(mWaveCache->bl.begin(), mWaveCache->bl.end(),
+            [](int status){ return status < 0; });
 
       if (match &&
          mWaveCache->start == t0 &&
@@ -608,6 +612,84 @@ void ComputeSpectrogramGainFactors
 
 }
 
+namespace {
+
+// Shared by all clips.  Spectrograms are computed for drawing, on the main
+// thread only, so the pool has one caller at a time.
+ThreadPool &SpectrogramThreadPool()
+{
+   static ThreadPool pool{ ThreadPool::HardwareThreadCount() };
+   return pool;
+}
+
+// Columns of a spectrogram tile are centered at multiples of this many
+// samples from the start of the block.  Only views zoomed out at least as far
+// use tiles; the tile then has at most a few columns for each pixel.  Scaling
+// with the zero padding keeps a tile to a quarter as many values as the block
+// has samples.
+size_t SpectrumTileHop(const SpectrogramSettings &settings)
+{
+   return 2 * settings.WindowSize() * settings.ZeroPaddingFactor();
+}
+
+// The first column of a tile, and the count of columns, for which the whole
+// window lies within the block, so that the tile depends on no other block
+std::pair<size_t, size_t> SpectrumTileColumns
+   (size_t blockLen, size_t windowSize, size_t hop)
+{
+   if (blockLen < windowSize)
+      return { 0, 0 };
+   const auto half = windowSize / 2;
+   const auto first = (half + hop - 1) / hop;
+   const auto last = (blockLen - windowSize + half) / hop;
+   return { first, last >= first ? last - first + 1 : 0 };
+}
+
+// Compute the columns of a tile as CalculateOneSpectrum computes each, except
+// for the frequency gain
+bool ComputeSpectrumTile
+   (const SpectrogramSettings &settings, SampleBlock &block, size_t hop,
+    std::vector<float> &columns)
+{
+   const auto windowSize = settings.WindowSize();
+   const auto fftLen = windowSize * settings.ZeroPaddingFactor();
+   const auto padding = (fftLen - windowSize) / 2;
+   const auto nBins = settings.NBins();
+   const auto blockLen = block.GetSampleCount();
+   const auto range = SpectrumTileColumns(blockLen, windowSize, hop);
+   if (range.second == 0)
+      return false;
+
+   Floats samples{ blockLen };
+   // Don't throw in this drawing operation
+   if (!block.GetSamples(
+      (samplePtr)samples.get(), floatSample, 0, blockLen, false))
+      return false;
+
+   columns.resize(range.second * nBins);
+   std::vector<float> scratch(fftLen);
+   for (size_t ii = 0; ii < range.second; ++ii) {
+      const auto from = (range.first + ii) * hop - windowSize / 2;
+      std::fill(scratch.begin(), scratch.end(), 0.0f);
+      std::copy(samples.get() + from, samples.get() + from + windowSize,
+         scratch.begin() + padding);
+      ComputeSpectrumUsingRealFFTf(scratch.data(), settings.hFFT.get(),
+         settings.window.get(), fftLen, &columns[ii * nBins]);
+   }
+   return true;
+}
+
+}
+
+void SpecCache::ReassignmentSink::AddTo(float *out, size_t nBins) const
+{
+   const auto dest = out + nBins * beginX;
+   for (size_t ii = 0, nn = columns.size(); ii < nn; ++ii)
+      dest[ii] += columns[ii];
+   for (const auto &pair : overflow)
+      out[pair.first] += pair.second;
+}
+
 bool SpecCache::Matches
    (int dirty_, double pixelsPerSecond,
     const SpectrogramSettings &settings, double rate) const
@@ -629,20 +711,12 @@ bool SpecCache::Matches
       algorithm == settings.algorithm;
 }
 
-bool SpecCache::CalculateOneSpectrum
-   (const SpectrogramSettings &settings,
-    WaveTrackCache &waveTrackCache,
+bool SpecCache::GetColumnSamples
+   (WaveTrackCache &waveTrackCache,
     const int xx, const sampleCount numSamples,
     double offset, double rate, double pixelsPerSecond,
-    int lowerBoundX, int upperBoundX,
-    const std::vector<float> &gainFactors,
-    float* __restrict scratch, float* __restrict out) const
+    size_t windowSize, float *dest) const
 {
-   bool result = false;
-   const bool reassignment =
-      (settings.algorithm == SpectrogramSettings::algReassignment);
-   const size_t windowSizeSetting = settings.WindowSize();
-
    sampleCount from;
 
    // xx may be for a column that is out of the visible bounds, but only
@@ -660,6 +734,65 @@ bool SpecCache::CalculateOneSpectrum
    else
       from = where[xx];
 
+   if (from < 0 || from >= numSamples)
+      return false;
+
+   auto myLen = windowSize;
+   float *adj = dest;
+
+   // Take a window of the track centered at this sample.
+   from -= windowSize >> 1;
+   if (from < 0) {
+      // Near the start of the clip, pad left with zeroes as needed.
+      // from is at least -windowSize / 2
+      for (auto ii = from; ii < 0; ++ii)
+         *adj++ = 0;
+      myLen += from.as_long_long(); // add a negative
+      from = 0;
+   }
+
+   if (from + myLen >= numSamples) {
+      // Near the end of the clip, pad right with zeroes as needed.
+      // newlen is bounded by myLen:
+      auto newlen = ( numSamples - from ).as_size_t();
+      for (decltype(myLen) ii = newlen; ii < myLen; ++ii)
+         adj[ii] = 0;
+      myLen = newlen;
+   }
+
+   if (myLen > 0) {
+      auto useBuffer = (const float*)(waveTrackCache.Get(
+         floatSample, sampleCount(
+            floor(0.5 + from.as_double() + offset * rate)
+         ),
+         myLen,
+         // Don't throw in this drawing operation
+         false)
+      );
+
+      if (useBuffer)
+         memcpy(adj, useBuffer, myLen * sizeof(float));
+      else
+         memset(adj, 0, myLen * sizeof(float));
+   }
+
+   return true;
+}
+
+bool SpecCache::CalculateOneSpectrum
+   (const SpectrogramSettings &settings,
+    const float *samples,
+    const int xx, double rate, double pixelsPerSecond,
+    int lowerBoundX, int upperBoundX,
+    const std::vector<float> &gainFactors,
+    float* __restrict scratch, float* __restrict out,
+    ReassignmentSink *pSink) const
+{
+   bool result = false;
+   const bool reassignment =
+      (settings.algorithm == SpectrogramSettings::algReassignment);
+   const size_t windowSizeSetting = settings.WindowSize();
+
    const bool autocorrelation =
       settings.algorithm == SpectrogramSettings::algPitchEAC;
    const size_t zeroPaddingFactorSetting = settings.ZeroPaddingFactor();
@@ -667,66 +800,21 @@ bool SpecCache::CalculateOneSpectrum
    const size_t fftLen = windowSizeSetting * zeroPaddingFactorSetting;
    auto nBins = settings.NBins();
 
-   if (from < 0 || from >= numSamples) {
-      if (xx >= 0 && xx < (int)len) {
+   if (!samples) {
+      // Reassignment zeroed the buffer before accumulating into it
+      if (!reassignment && xx >= 0 && xx < (int)len) {
          // Pixel column is out of bounds of the clip!  Should not happen.
          float *const results = &out[nBins * xx];
          std::fill(results, results + nBins, 0.0f);
       }
    }
    else {
-
-
       // We can avoid copying memory when ComputeSpectrum is used below
-      bool copy = !autocorrelation || (padding > 0) || reassignment;
-      float *useBuffer = 0;
-      float *adj = scratch + padding;
-
-      {
-         auto myLen = windowSizeSetting;
-         // Take a window of the track centered at this sample.
-         from -= windowSizeSetting >> 1;
-         if (from < 0) {
-            // Near the start of the clip, pad left with zeroes as needed.
-            // from is at least -windowSize / 2
-            for (auto ii = from; ii < 0; ++ii)
-               *adj++ = 0;
-            myLen += from.as_long_long(); // add a negative
-            from = 0;
-            copy = true;
-         }
-
-         if (from + myLen >= numSamples) {
-            // Near the end of the clip, pad right with zeroes as needed.
-            // newlen is bounded by myLen:
-            auto newlen = ( numSamples - from ).as_size_t();
-            for (decltype(myLen) ii = newlen; ii < myLen; ++ii)
-               adj[ii] = 0;
-            myLen = newlen;
-            copy = true;
-         }
-
-         if (myLen > 0) {
-            useBuffer = (float*)(waveTrackCache.Get(
-               floatSample, sampleCount(
-                  floor(0.5 + from.as_double() + offset * rate)
-               ),
-               myLen,
-               // Don't throw in this drawing operation
-               false)
-            );
-
-            if (copy) {
-               if (useBuffer)
-                  memcpy(adj, useBuffer, myLen * sizeof(float));
-               else
-                  memset(adj, 0, myLen * sizeof(float));
-            }
-         }
-      }
-
-      if (copy || !useBuffer)
+      const float *useBuffer = samples;
+      if (!autocorrelation || padding > 0) {
+         memcpy(scratch + padding, samples, windowSizeSetting * sizeof(float));
          useBuffer = scratch;
+      }
 
       if (autocorrelation) {
          // not reassignment, xx is surely within bounds.
@@ -817,14 +905,13 @@ bool SpecCache::CalculateOneSpectrum
                   result = true;
 
                   // This is non-negative, because bin and correctedX are
-                  auto ind = (int)nBins * correctedX + bin;
-#ifdef _OPENMP
-                  // This assignment can race if index reaches into another thread's bins.
-                  // The probability of a race very low, so this carries little overhead,
-                  // about 5% slower vs allowing it to race.
-                  #pragma omp atomic update
-#endif
-                  out[ind] += power;
+                  auto &sink = *pSink;
+                  if (correctedX >= sink.beginX && correctedX < sink.endX)
+                     sink.columns[
+                        nBins * (correctedX - sink.beginX) + bin] += power;
+                  else
+                     sink.overflow.emplace_back(
+                        nBins * correctedX + bin, power);
                }
             }
          }
@@ -841,7 +928,7 @@ bool SpecCache::CalculateOneSpectrum
 
          // This function mutates useBuffer
          ComputeSpectrumUsingRealFFTf
-            (useBuffer, settings.hFFT.get(), settings.window.get(), fftLen, results);
+            (scratch, settings.hFFT.get(), settings.window.get(), fftLen, results);
          if (!gainFactors.empty()) {
             // Apply a frequency-dependent gain factor
             for (size_t ii = 0; ii < nBins; ++ii)
@@ -876,8 +963,87 @@ void SpecCache::Grow(size_t len_, const SpectrogramSettings& settings,
    frequencyGain = settings.frequencyGain;
 }
 
+std::vector<bool> SpecCache::PopulateFromTiles
+   (const SpectrogramSettings &settings, const Sequence &sequence,
+    int copyBegin, int copyEnd, size_t numPixels,
+    double rate, double pixelsPerSecond,
+    const std::vector<float> &gainFactors)
+{
+   std::vector<bool> result;
+
+   const auto hop = SpectrumTileHop(settings);
+   if (rate / pixelsPerSecond < hop)
+      // Zoomed in too far for the tiles
+      return result;
+
+   const auto windowSize = settings.WindowSize();
+   const auto nBins = settings.NBins();
+   const SampleBlock::SpectrumKey key{
+      settings.windowType, windowSize, settings.ZeroPaddingFactor(), hop };
+
+   // Find the nearest tile column for each dirty pixel column, grouped by
+   // block
+   const auto &blocks = sequence.GetBlockArray();
+   std::map< size_t, std::vector< std::pair< int, size_t > > > requests;
+   for (int jj = 0; jj < 2; ++jj) {
+      const int lowerBoundX = jj == 0 ? 0 : copyEnd;
+      const int upperBoundX = jj == 0 ? copyBegin : numPixels;
+      for (auto xx = lowerBoundX; xx < upperBoundX; ++xx) {
+         const auto from = where[xx];
+         auto iter = std::upper_bound(blocks.begin(), blocks.end(), from,
+            [](sampleCount pos, const SeqBlock &block){
+               return pos < block.start; });
+         if (iter == blocks.begin())
+            continue;
+         --iter;
+         const auto &block = *iter;
+         const auto offset = (from - block.start).as_double();
+         const auto range = SpectrumTileColumns(
+            block.sb->GetSampleCount(), windowSize, hop);
+         const auto column = (size_t)std::max(0.0, floor(0.5 + offset / hop));
+         if (column >= range.first && column < range.first + range.second)
+            requests[iter - blocks.begin()].emplace_back(
+               xx, column - range.first);
+      }
+   }
+
+   std::vector<float> columns;
+   for (const auto &pair : requests) {
+      auto &block = *blocks[pair.first].sb;
+      const auto count = SpectrumTileColumns(
+         block.GetSampleCount(), windowSize, hop).second;
+      if (!block.GetSpectrumTile(key, columns) ||
+          columns.size() != count * nBins) {
+         // Computing the whole tile is worth it only if the view uses a good
+         // part of it; else leave these columns to be computed alone
+         if (4 * pair.second.size() < count ||
+             !ComputeSpectrumTile(settings, block, hop, columns))
+            continue;
+         block.SetSpectrumTile(key, columns.data(), columns.size());
+      }
+
+      if (result.empty())
+         result.resize(numPixels);
+      for (const auto &request : pair.second) {
+         const auto xx = request.first;
+         const auto src = &columns[nBins * request.second];
+         float *const results = &freq[nBins * xx];
+         std::copy(src, src + nBins, results);
+         if (!gainFactors.empty()) {
+            // Apply a frequency-dependent gain factor
+            for (size_t ii = 0; ii < nBins; ++ii)
+               results[ii] += gainFactors[ii];
+         }
+         result[xx] = true;
+      }
+   }
+
+   return result;
+}
+
 void SpecCache::Populate
    (const SpectrogramSettings &settings, WaveTrackCache &waveTrackCache,
+    const Sequence &sequence,
     int copyBegin, int copyEnd, size_t numPixels,
     sampleCount numSamples,
     double offset, double rate, double pixelsPerSecond)
@@ -901,106 +1067,151 @@ void SpecCache::Populate
 
    const size_t bufferSize = fftLen;
    const size_t scratchSize = reassignment ? 3 * bufferSize : bufferSize;
-   std::vector<float> scratch(scratchSize);
 
    std::vector<float> gainFactors;
    if (!autocorrelation)
       ComputeSpectrogramGainFactors(fftLen, rate, frequencyGainSetting, gainFactors);
 
+   // Reassignment mixes neighboring columns, so only plain STFT can use tiles
+   std::vector<bool> fromTiles;
+   if (settings.algorithm == SpectrogramSettings::algSTFT)
+      fromTiles = PopulateFromTiles(settings, sequence,
+         copyBegin, copyEnd, numPixels, rate, pixelsPerSecond, gainFactors);
+
+   // For reassignment: how far to look beyond the edges of the range to
+   // accumulate more time reassignments.
+   // I'm not sure what's a good stopping criterion?
+   const double pixelsPerSample = pixelsPerSecond / rate;
+   const int limit = std::min((int)(0.5 + fftLen * pixelsPerSample), 100);
+
+   // Windows of samples are read on this thread, because WaveTrackCache is
+   // not thread-safe, for a batch of columns at a time.  Then the pool
+   // computes the columns of the batch from the shared windows, in
+   // contiguous chunks, each with its own scratch space.
+   auto &pool = SpectrogramThreadPool();
+   const int batchSize =
+      std::max<size_t>(1, MaxBatchSamples / windowSizeSetting);
+   const size_t maxChunks =
+      // Fewer chunks make less reassigned power overflow the chunks
+      reassignment ? pool.GetThreadCount()
+      // More chunks than threads balance the load
+      : 4 * pool.GetThreadCount();
+   std::vector<float> windows(
+      std::min<size_t>(batchSize, numPixels) * windowSizeSetting);
+   std::vector<char> inClip(batchSize);
+
    // Loop over the ranges before and after the copied portion and compute anew.
    // One of the ranges may be empty.
    for (int jj = 0; jj < 2; ++jj) {
       const int lowerBoundX = jj == 0 ? 0 : copyEnd;
       const int upperBoundX = jj == 0 ? copyBegin : numPixels;
 
-#ifdef _OPENMP
-      // Storage for mutable per-thread data.
-      // private clause ensures one copy per thread
-      struct ThreadLocalStorage {
-         ThreadLocalStorage()  { }
-         ~ThreadLocalStorage() { }
-
-         void init(WaveTrackCache &waveTrackCache, size_t scratchSize) {
-            if (!cache) {
-               cache = std::make_unique<WaveTrackCache>(waveTrackCache.GetTrack());
-               scratch.resize(scratchSize);
-            }
+      for (auto batchBegin = lowerBoundX; batchBegin < upperBoundX;
+           batchBegin += batchSize) {
+         const auto batchEnd = std::min(upperBoundX, batchBegin + batchSize);
+         const size_t count = batchEnd - batchBegin;
+
+         for (auto xx = batchBegin; xx < batchEnd; ++xx) {
+            const auto ii = xx - batchBegin;
+            inClip[ii] = (fromTiles.empty() || !fromTiles[xx]) &&
+               GetColumnSamples(waveTrackCache, xx, numSamples,
+                  offset, rate, pixelsPerSecond,
+                  windowSizeSetting, &windows[ii * windowSizeSetting]);
          }
-         std::unique_ptr<WaveTrackCache> cache;
-         std::vector<float> scratch;
-      } tls;
 
-      #pragma omp parallel for private(tls)
-#endif
-      for (auto xx = lowerBoundX; xx < upperBoundX; ++xx)
-      {
-#ifdef _OPENMP
-         tls.init(waveTrackCache, scratchSize);
-         WaveTrackCache& cache = *tls.cache;
-         float* buffer = &tls.scratch[0];
-#else
-         WaveTrackCache& cache = waveTrackCache;
-         float* buffer = &scratch[0];
-#endif
-         CalculateOneSpectrum(
-            settings, cache, xx, numSamples,
-            offset, rate, pixelsPerSecond,
-            lowerBoundX, upperBoundX,
-            gainFactors, buffer, &freq[0]);
+         const auto nChunks = std::min(count, maxChunks);
+         // Each chunk accumulates reassigned power privately, for its own
+         // columns and a margin around them; that is added in below
+         std::vector<ReassignmentSink> sinks(reassignment ? nChunks : 0);
+
+         pool.ForEach(nChunks, [&](size_t chunk){
+            PROFILE_SCOPE("Spectrogram columns");
+            const int chunkBegin = batchBegin + chunk * count / nChunks;
+            const int chunkEnd = batchBegin + (chunk + 1) * count / nChunks;
+            std::vector<float> scratch(scratchSize);
+
+            ReassignmentSink *pSink = nullptr;
+            if (reassignment) {
+               pSink = &sinks[chunk];
+               const auto margin = std::min(limit, chunkEnd - chunkBegin);
+               pSink->beginX = std::max(lowerBoundX, chunkBegin - margin);
+               pSink->endX = std::min(upperBoundX, chunkEnd + margin);
+               pSink->columns.resize(nBins * (pSink->endX - pSink->beginX));
+            }
+
+            for (auto xx = chunkBegin; xx < chunkEnd; ++xx) {
+               if (!fromTiles.empty() && fromTiles[xx])
+                  continue;
+               const auto ii = xx - batchBegin;
+               CalculateOneSpectrum(
+                  settings,
+                  inClip[ii] ? &windows[ii * windowSizeSetting] : nullptr,
+                  xx, rate, pixelsPerSecond,
+                  lowerBoundX, upperBoundX,
+                  gainFactors, &scratch[0], &freq[0], pSink);
+            }
+         });
+
+         for (const auto &sink : sinks)
+            sink.AddTo(&freq[0], nBins);
       }
 
       if (reassignment) {
          // Need to look beyond the edges of the range to accumulate more
          // time reassignments.
-         // I'm not sure what's a good stopping criterion?
+         std::vector<float> scratch(scratchSize);
+         std::vector<float> window(windowSizeSetting);
+         ReassignmentSink sink;
+         const auto calculate = [&](int xx){
+            const bool valid = GetColumnSamples(waveTrackCache, xx,
+               numSamples, offset, rate, pixelsPerSecond,
+               windowSizeSetting, &window[0]);
+            return CalculateOneSpectrum(
+               settings, valid ? &window[0] : nullptr,
+               xx, rate, pixelsPerSecond,
+               lowerBoundX, upperBoundX,
+               gainFactors, &scratch[0], &freq[0], &sink);
+         };
+
          auto xx = lowerBoundX;
-         const double pixelsPerSample = pixelsPerSecond / rate;
-         const int limit = std::min((int)(0.5 + fftLen * pixelsPerSample), 100);
          for (int ii = 0; ii < limit; ++ii)
          {
-            const bool result =
-               CalculateOneSpectrum(
-                  settings, waveTrackCache, --xx, numSamples,
-                  offset, rate, pixelsPerSecond,
-                  lowerBoundX, upperBoundX,
-                  gainFactors, &scratch[0], &freq[0]);
-            if (!result)
+            if (!calculate(--xx))
                break;
          }
 
          xx = upperBoundX;
          for (int ii = 0; ii < limit; ++ii)
          {
-            const bool result =
-               CalculateOneSpectrum(
-                  settings, waveTrackCache, xx++, numSamples,
-                  offset, rate, pixelsPerSecond,
-                  lowerBoundX, upperBoundX,
-                  gainFactors, &scratch[0], &freq[0]);
-            if (!result)
+            if (!calculate(xx++))
                break;
          }
 
+         sink.AddTo(&freq[0], nBins);
+
          // Now Convert to dB terms.  Do this only after accumulating
          // power values, which may cross columns with the time correction.
-#ifdef _OPENMP
-         #pragma omp parallel for
-#endif
-         for (xx = lowerBoundX; xx < upperBoundX; ++xx) {
-            float *const results = &freq[nBins * xx];
-            for (size_t ii = 0; ii < nBins; ++ii) {
-               float &power = results[ii];
-               if (power <= 0)
-                  power = -160.0;
-               else
-                  power = 10.0*log10f(power);
-            }
-            if (!gainFactors.empty()) {
-               // Apply a frequency-dependent gain factor
-               for (size_t ii = 0; ii < nBins; ++ii)
-                  results[ii] += gainFactors[ii];
+         const size_t count = std::max(0, upperBoundX - lowerBoundX);
+         const auto nChunks = std::min(count, 4 * pool.GetThreadCount());
+         pool.ForEach(nChunks, [&](size_t chunk){
+            const int chunkBegin = lowerBoundX + chunk * count / nChunks;
+            const int chunkEnd = lowerBoundX + (chunk + 1) * count / nChunks;
+            for (auto xx = chunkBegin; xx < chunkEnd; ++xx) {
+               float *const results = &freq[nBins * xx];
+               for (size_t ii = 0; ii < nBins; ++ii) {
+                  float &power = results[ii];
+                  if (power <= 0)
+                     power = -160.0;
+                  else
+                     power = 10.0*log10f(power);
+               }
+               if (!gainFactors.empty()) {
+                  // Apply a frequency-dependent gain factor
+                  for (size_t ii = 0; ii < nBins; ++ii)
+                     results[ii] += gainFactors[ii];
+               }
             }
-         }
+         });
       }
    }
 }
@@ -1105,7 +1316,7 @@ bool WaveClip::GetSpectrogram(WaveTrackCache &waveTrackCache,
       t0, mRate, samplesPerPixel);
 
    mSpecCache->Populate
-      (settings, waveTrackCache, copyBegin, copyEnd, numPixels,
+      (settings, waveTrackCache, *mSequence, copyBegin, copyEnd, numPixels,
        mSequence->GetNumSamples(),
        mOffset, mRate, pixelsPerSecond);
 
@@ -1158,6 +1369,25 @@ float WaveClip::GetRMS(double t0, double t1, bool mayThrow) const
    return mSequence->GetRMS(s0, s1-s0, mayThrow);
 }
 
+SampleSums WaveClip::GetSums(double t0, double t1, bool mayThrow) const
+{
+   if (t0 > t1) {
+      if (mayThrow)
+         THROW_INCONSISTENCY_EXCEPTION;
+      return {};
+   }
+
+   if (t0 == t1)
+      return {};
+
+   sampleCount s0, s1;
+
+   TimeToSamplesClip(t0, &s0);
+   TimeToSamplesClip(t1, &s1);
+
+   return mSequence->GetSums(s0, s1-s0, mayThrow);
+}
+
 void WaveClip::ConvertToSampleFormat(sampleFormat format,
    const std::function<void(size_t)> & progressReport)
 {
@@ -1213,6 +1443,11 @@ std::shared_ptr<SampleBlock> WaveClip::AppendNewBlock(
 void WaveClip::AppendSharedBlock(const std::shared_ptr<SampleBlock> &pBlock)
 {
    mSequence->AppendSharedBlock( pBlock );
+
+   // No append buffer is flushed for shared blocks, so do what Flush would
+   // use No-fail-guarantee
+   UpdateEnvelopeTrackLen();
+   MarkChanged();
 }
 
 /*! @excsafety{Partial}
@@ -29,6 +29,7 @@ class Envelope;
 class ProgressDialog;
 class SampleBlock;
 class SampleBlockFactory;
+class SampleSums;
 using SampleBlockFactoryPtr = std::shared_ptr<SampleBlockFactory>;
 class Sequence;
 class SpectrogramSettings;
@@ -38,6 +39,8 @@ class wxFileNameWrapper;
 
 class SpecCache {
 public:
+   // Most samples that Populate reads at once, for a batch of columns
+   enum : size_t { MaxBatchSamples = 1 << 20 };
 
    // Make invalid cache
    SpecCache()
@@ -57,16 +60,40 @@ public:
    bool Matches(int dirty_, double pixelsPerSecond,
       const SpectrogramSettings &settings, double rate) const;
 
-   // Calculate one column of the spectrum
-   bool CalculateOneSpectrum
-      (const SpectrogramSettings &settings,
-       WaveTrackCache &waveTrackCache,
+   //! Where the reassignment algorithm accumulates power for one thread
+   struct ReassignmentSink
+   {
+      //! Power for columns [beginX, endX), nBins to each column
+      int beginX{ 0 };
+      int endX{ 0 };
+      std::vector<float> columns;
+      //! Power for other columns, as indices into freq, and values
+      std::vector< std::pair< size_t, float > > overflow;
+
+      //! Add all of the power into the columns of out
+      void AddTo(float *out, size_t nBins) const;
+   };
+
+   // Copy into dest the window of samples centered at column xx, padded with
+   // zeroes beyond the clip; return false if the center is beyond the clip
+   bool GetColumnSamples
+      (WaveTrackCache &waveTrackCache,
        const int xx, sampleCount numSamples,
        double offset, double rate, double pixelsPerSecond,
+       size_t windowSize, float *dest) const;
+
+   // Calculate one column of the spectrum from the window of samples, or
+   // null if the column is beyond the clip.  Reassignment accumulates into
+   // *pSink, not into out.
+   bool CalculateOneSpectrum
+      (const SpectrogramSettings &settings,
+       const float *samples,
+       const int xx, double rate, double pixelsPerSecond,
        int lowerBoundX, int upperBoundX,
        const std::vector<float> &gainFactors,
        float* __restrict scratch,
-       float* __restrict out) const;
+       float* __restrict out,
+       ReassignmentSink *pSink = nullptr) const;
 
    // Grow the cache while preserving the (possibly now invalid!) contents
    void Grow(size_t len_, const SpectrogramSettings& settings,
@@ -75,10 +102,20 @@ public:
    // Calculate the dirty columns at the begin and end of the cache
    void Populate
       (const SpectrogramSettings &settings, WaveTrackCache &waveTrackCache,
+       const Sequence &sequence,
        int copyBegin, int copyEnd, size_t numPixels,
        sampleCount numSamples,
        double offset, double rate, double pixelsPerSecond);
 
+   // Fill those dirty columns that can be taken from spectrogram tiles stored
+   // with the sample blocks, computing and storing tiles as needed.  Returns
+   // flags for the columns filled, or empty if none.
+   std::vector<bool> PopulateFromTiles
+      (const SpectrogramSettings &settings, const Sequence &sequence,
+       int copyBegin, int copyEnd, size_t numPixels,
+       double rate, double pixelsPerSecond,
+       const std::vector<float> &gainFactors);
+
    size_t       len { 0 }; // counts pixels, not samples
    int          algorithm;
    double       pps;
@@ -271,6 +308,7 @@ public:
    std::pair<float, float> GetMinMax(
       double t0, double t1, bool mayThrow = true) const;
    float GetRMS(double t0, double t1, bool mayThrow = true) const;
+   SampleSums GetSums(double t0, double t1, bool mayThrow = true) const;
 
    // Set/clear/get rectangle that this WaveClip fills on screen. This is
    // called by TrackArtist while actually drawing the tracks and clips.
@@ -43,6 +43,7 @@ from the project that will own the track.
 #include "float_cast.h"
 
 #include "Envelope.h"
+#include "SampleBlock.h"
 #include "Sequence.h"
 #include "Spectrum.h"
 
@@ -1878,6 +1879,27 @@ float WaveTrack::GetRMS(double t0, double t1, bool mayThrow) const
    return length > 0 ? sqrt(sumsq / length.as_double()) : 0.0;
 }
 
+SampleSums WaveTrack::GetSums(double t0, double t1, bool mayThrow) const
+{
+   if (t0 > t1) {
+      if (mayThrow)
+         THROW_INCONSISTENCY_EXCEPTION;
+      return {};
+   }
+
+   SampleSums sums;
+   if (t0 == t1)
+      return sums;
+
+   for (const auto &clip: mClips)
+   {
+      // As in GetRMS
+      if (t1 >= clip->GetStartTime() && t0 <= clip->GetEndTime())
+         sums += clip->GetSums(t0, t1, mayThrow);
+   }
+   return sums;
+}
+
 bool WaveTrack::Get(samplePtr buffer, sampleFormat format,
                     sampleCount start, size_t len, fillFormat fill,
                     bool mayThrow, sampleCount * pNumWithinClips) const
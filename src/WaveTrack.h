@@ -22,6 +22,7 @@
 class ProgressDialog;
 
 class SampleBlockFactory;
+class SampleSums;
 using SampleBlockFactoryPtr = std::shared_ptr<SampleBlockFactory>;
 
 class SpectrogramSettings;
@@ -267,6 +268,10 @@ private:
       double t0, double t1, bool mayThrow = true) const;
    // May assume precondition: t0 <= t1
    float GetRMS(double t0, double t1, bool mayThrow = true) const;
+   //! Totals of the samples of clips between the times, whose count excludes
+   //! the gaps between clips
+   // May assume precondition: t0 <= t1
+   SampleSums GetSums(double t0, double t1, bool mayThrow = true) const;
 
    //
    // MM: We now have more than one sequence and envelope per track, so
@@ -17,6 +17,8 @@ This class now lists
 - Clips
 - Labels
 - Boxes
+- Realtime effect timings
+- Audio thread statistics
 
 *//*******************************************************************/
 
@@ -28,6 +30,8 @@ This class now lists
 #include "CommandManager.h"
 #include "CommandTargets.h"
 #include "../effects/EffectManager.h"
+#include "../effects/RealtimeEffectManager.h"
+#include "../AudioIO.h"
 #include "../widgets/Overlay.h"
 #include "../TrackPanelAx.h"
 #include "../TrackPanel.h"
@@ -64,6 +68,8 @@ enum {
    kEnvelopes,
    kLabels,
    kBoxes,
+   kRealtimeEffects,
+   kAudioThread,
    nTypes
 };
 
@@ -78,6 +84,8 @@ static const EnumValueSymbol kTypes[nTypes] =
    { XO("Envelopes") },
    { XO("Labels") },
    { XO("Boxes") },
+   { wxT("RealtimeEffects"), XO("Realtime Effects") },
+   { wxT("AudioThread"), XO("Audio Thread") },
 };
 
 enum {
@@ -158,6 +166,8 @@ bool GetInfoCommand::ApplyInner(const CommandContext &context)
       case kEnvelopes    : return SendEnvelopes( context );
       case kLabels       : return SendLabels( context );
       case kBoxes        : return SendBoxes( context );
+      case kRealtimeEffects : return SendRealtimeEffects( context );
+      case kAudioThread  : return SendAudioThread( context );
       default:
          context.Status( "Command options not recognised" );
    }
@@ -606,6 +616,88 @@ bool GetInfoCommand::SendLabels(const CommandContext &context)
    return true;
 }
 
+/*******************************************************************
+Timings of realtime effects during playback, to find the ones that
+cause buffer underruns.  Durations are in nanoseconds; load is in
+millionths of the duration of the samples processed in a callback.
+*******************************************************************/
+bool GetInfoCommand::SendRealtimeEffects(const CommandContext &context)
+{
+   auto &em = RealtimeEffectManager::Get();
+   const auto timings = em.GetRealtimeTimings();
+
+   auto addSummary = [&](const RealtimeEffectManager::TimingSummary &summary){
+      context.AddItem( (double)summary.count, "count" );
+      context.AddItem( (double)summary.p50, "p50" );
+      context.AddItem( (double)summary.p99, "p99" );
+      context.AddItem( (double)summary.max, "max" );
+   };
+
+   context.StartStruct();
+   context.AddBool( em.RealtimeIsActive(), "active" );
+   context.AddBool( em.RealtimeIsSuspended(), "suspended" );
+   context.AddItem( (double)timings.deadlineMisses, "deadlineMisses" );
+
+   context.StartField( "callback" );
+   context.StartStruct();
+   addSummary( timings.callback );
+   context.EndStruct();
+   context.EndField();
+
+   context.StartField( "load" );
+   context.StartStruct();
+   addSummary( timings.load );
+   context.EndStruct();
+   context.EndField();
+
+   context.StartField( "groups" );
+   context.StartArray();
+   int i = 0;
+   for (const auto &summary : timings.groups) {
+      context.StartStruct();
+      context.AddItem( (double)i++, "group" );
+      addSummary( summary );
+      context.EndStruct();
+   }
+   context.EndArray();
+   context.EndField();
+
+   context.StartField( "effects" );
+   context.StartArray();
+   for (const auto &pair : timings.effects) {
+      context.StartStruct();
+      context.AddItem( pair.first->GetSymbol().Internal(), "name" );
+      addSummary( pair.second );
+      context.EndStruct();
+   }
+   context.EndArray();
+   context.EndField();
+   context.EndStruct();
+
+   return true;
+}
+
+/*******************************************************************
+How the audio thread kept the playback buffers filled during the current
+or last stream, to judge how small the playback queue may safely be.
+Latencies and the margin are in seconds.
+*******************************************************************/
+bool GetInfoCommand::SendAudioThread(const CommandContext &context)
+{
+   const auto stats = AudioIO::Get()->GetAudioThreadStatistics();
+
+   context.StartStruct();
+   context.AddItem( (double)stats.fills, "fills" );
+   context.AddItem( (double)stats.signalledFills, "signalledFills" );
+   context.AddItem( stats.meanWakeLatency, "meanWakeLatency" );
+   context.AddItem( stats.maxWakeLatency, "maxWakeLatency" );
+   context.AddItem( (double)stats.samplesProduced, "samplesProduced" );
+   context.AddItem( stats.minUnderrunMargin, "minUnderrunMargin" );
+   context.EndStruct();
+
+   return true;
+}
+
 /*******************************************************************
 The various Explore functions are called from the Send functions,
 and may be recursive.  'Send' is the top level.
@@ -324,29 +324,7 @@ void EffectBassTreble::InstanceInit(EffectBassTrebleState & data, float sampleRa
    data.hzBass = 250.0f;   // could be tunable in a more advanced version
    data.hzTreble = 4000.0f;   // could be tunable in a more advanced version
 
-   data.a0Bass = 1;
-   data.a1Bass = 0;
-   data.a2Bass = 0;
-   data.b0Bass = 0;
-   data.b1Bass = 0;
-   data.b2Bass = 0;
-
-   data.a0Treble = 1;
-   data.a1Treble = 0;
-   data.a2Treble = 0;
-   data.b0Treble = 0;
-   data.b1Treble = 0;
-   data.b2Treble = 0;
-
-   data.xn1Bass = 0;
-   data.xn2Bass = 0;
-   data.yn1Bass = 0;
-   data.yn2Bass = 0;
-
-   data.xn1Treble = 0;
-   data.xn2Treble = 0;
-   data.yn1Treble = 0;
-   data.yn2Treble = 0;
+   data.filter = BiquadCascade{ 2, 1 };
 
    data.bass = -1;
    data.treble = -1;
@@ -363,7 +341,6 @@ size_t EffectBassTreble::InstanceProcess(EffectBassTrebleState & data,
                                               float **outBlock,
                                               size_t blockLen)
 {
-   float *ibuf = inBlock[0];
    float *obuf = outBlock[0];
 
    // Set value to ensure correct rounding
@@ -372,20 +349,27 @@ size_t EffectBassTreble::InstanceProcess(EffectBassTrebleState & data,
 
    data.gain = DB_TO_LINEAR(mGain);
 
+   double a0, a1, a2, b0, b1, b2;
+
    // Compute coefficients of the low shelf biquand IIR filter
-   if (data.bass != oldBass)
+   if (data.bass != oldBass) {
       Coefficents(data.hzBass, data.slope, mBass, data.samplerate, kBass,
-                  data.a0Bass, data.a1Bass, data.a2Bass,
-                  data.b0Bass, data.b1Bass, data.b2Bass);
+                  a0, a1, a2, b0, b1, b2);
+      data.filter.SetCoefficients(0,
+         b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0);
+   }
 
    // Compute coefficients of the high shelf biquand IIR filter
-   if (data.treble != oldTreble)
+   if (data.treble != oldTreble) {
       Coefficents(data.hzTreble, data.slope, mTreble, data.samplerate, kTreble,
-                  data.a0Treble, data.a1Treble, data.a2Treble,
-                  data.b0Treble, data.b1Treble, data.b2Treble);
+                  a0, a1, a2, b0, b1, b2);
+      data.filter.SetCoefficients(1,
+         b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0);
+   }
 
+   data.filter.Process(inBlock, outBlock, blockLen);
    for (decltype(blockLen) i = 0; i < blockLen; i++) {
-      obuf[i] = DoFilter(data, ibuf[i]) * data.gain;
+      obuf[i] *= data.gain;
    }
 
    return blockLen;
@@ -424,29 +408,6 @@ void EffectBassTreble::Coefficents(double hz, double slope, double gain, double
    }
 }
 
-float EffectBassTreble::DoFilter(EffectBassTrebleState & data, float in)
-{
-   // Bass filter
-   float out = (data.b0Bass * in + data.b1Bass * data.xn1Bass + data.b2Bass * data.xn2Bass -
-         data.a1Bass * data.yn1Bass - data.a2Bass * data.yn2Bass) / data.a0Bass;
-   data.xn2Bass = data.xn1Bass;
-   data.xn1Bass = in;
-   data.yn2Bass = data.yn1Bass;
-   data.yn1Bass = out;
-
-   // Treble filter
-   in = out;
-   out = (data.b0Treble * in + data.b1Treble * data.xn1Treble + data.b2Treble * data.xn2Treble -
-         data.a1Treble * data.yn1Treble - data.a2Treble * data.yn2Treble) / data.a0Treble;
-   data.xn2Treble = data.xn1Treble;
-   data.xn1Treble = in;
-   data.yn2Treble = data.yn1Treble;
-   data.yn1Treble = out;
-
-   return out;
-}
-
-
 void EffectBassTreble::OnBassText(wxCommandEvent & WXUNUSED(evt))
 {
    double oldBass = mBass;
@@ -11,8 +11,15 @@ Max Maisel
 
 #include "Biquad.h"
 #include "Audacity.h"
+#include <algorithm>
 #include <cmath>
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+   (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BIQUAD_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 #define square(a) ((a)*(a))
 #define PI M_PI
 
@@ -338,3 +345,136 @@ double Biquad::ChebyPoly(int Order, double NormFreq)   // NormFreq = 1 at the f0
    }
    return fSum;
 }
+
+namespace {
+// Samples of each channel, converted to double, that go through all the
+// sections before the next chunk; small enough for the stack
+enum : size_t { ChunkSize = 256 };
+}
+
+BiquadCascade::BiquadCascade(size_t nSections, size_t nChannels)
+   : mSections(nSections, Coefficients{ 1, 0, 0, 0, 0 })
+   , mChannels{ nChannels }
+   , mState(nSections * nVariables * nChannels, 0.0)
+{
+}
+
+BiquadCascade::BiquadCascade(
+   const Biquad *sections, size_t nSections, size_t nChannels)
+   : BiquadCascade(nSections, nChannels)
+{
+   for (size_t ii = 0; ii < nSections; ++ii) {
+      const auto &section = sections[ii];
+      SetCoefficients(ii,
+         section.fNumerCoeffs[Biquad::B0],
+         section.fNumerCoeffs[Biquad::B1],
+         section.fNumerCoeffs[Biquad::B2],
+         section.fDenomCoeffs[Biquad::A1],
+         section.fDenomCoeffs[Biquad::A2]);
+   }
+}
+
+void BiquadCascade::SetCoefficients(size_t section,
+   double b0, double b1, double b2, double a1, double a2)
+{
+   mSections[section] = { b0, b1, b2, a1, a2 };
+}
+
+void BiquadCascade::Reset()
+{
+   std::fill(mState.begin(), mState.end(), 0.0);
+}
+
+void BiquadCascade::Process(
+   const float *const *in, float *const *out, size_t len)
+{
+   size_t channel = 0;
+#ifdef BIQUAD_USE_SSE2
+   for (; channel + 1 < mChannels; channel += 2)
+      ProcessPair(channel, in, out, len);
+#endif
+   for (; channel < mChannels; ++channel)
+      ProcessChannel(channel, in[channel], out[channel], len);
+}
+
+void BiquadCascade::ProcessChannel(
+   size_t channel, const float *in, float *out, size_t len)
+{
+   double buffer[ChunkSize];
+   for (size_t start = 0; start < len; start += ChunkSize) {
+      const auto count = std::min<size_t>(ChunkSize, len - start);
+      for (size_t ii = 0; ii < count; ++ii)
+         buffer[ii] = in[start + ii];
+
+      // Each section runs over the whole chunk with its state in registers
+      for (size_t section = 0; section < mSections.size(); ++section) {
+         const auto c = mSections[section];
+         auto x1 = State(section, X1, channel), x2 = State(section, X2, channel),
+            y1 = State(section, Y1, channel), y2 = State(section, Y2, channel);
+         for (size_t ii = 0; ii < count; ++ii) {
+            const auto x = buffer[ii];
+            const auto y =
+               x * c.b0 + x1 * c.b1 + x2 * c.b2 - y1 * c.a1 - y2 * c.a2;
+            x2 = x1, x1 = x, y2 = y1, y1 = y;
+            buffer[ii] = y;
+         }
+         State(section, X1, channel) = x1, State(section, X2, channel) = x2,
+            State(section, Y1, channel) = y1, State(section, Y2, channel) = y2;
+      }
+
+      for (size_t ii = 0; ii < count; ++ii)
+         out[start + ii] = buffer[ii];
+   }
+}
+
+void BiquadCascade::ProcessPair(
+   size_t channel, const float *const *in, float *const *out, size_t len)
+{
+#ifdef BIQUAD_USE_SSE2
+   // Lane 0 is channel, lane 1 is channel + 1; the arithmetic is the same
+   // as in ProcessChannel, so results don't depend on pairing
+   const float *in0 = in[channel], *in1 = in[channel + 1];
+   float *out0 = out[channel], *out1 = out[channel + 1];
+
+   __m128d buffer[ChunkSize];
+   for (size_t start = 0; start < len; start += ChunkSize) {
+      const auto count = std::min<size_t>(ChunkSize, len - start);
+      for (size_t ii = 0; ii < count; ++ii)
+         buffer[ii] = _mm_set_pd(in1[start + ii], in0[start + ii]);
+
+      for (size_t section = 0; section < mSections.size(); ++section) {
+         const auto &c = mSections[section];
+         const auto b0 = _mm_set1_pd(c.b0), b1 = _mm_set1_pd(c.b1),
+            b2 = _mm_set1_pd(c.b2), a1 = _mm_set1_pd(c.a1),
+            a2 = _mm_set1_pd(c.a2);
+         auto x1 = _mm_loadu_pd(&State(section, X1, channel)),
+            x2 = _mm_loadu_pd(&State(section, X2, channel)),
+            y1 = _mm_loadu_pd(&State(section, Y1, channel)),
+            y2 = _mm_loadu_pd(&State(section, Y2, channel));
+         for (size_t ii = 0; ii < count; ++ii) {
+            const auto x = buffer[ii];
+            auto y = _mm_add_pd(
+               _mm_add_pd(_mm_mul_pd(x, b0), _mm_mul_pd(x1, b1)),
+               _mm_mul_pd(x2, b2));
+            y = _mm_sub_pd(
+               _mm_sub_pd(y, _mm_mul_pd(y1, a1)), _mm_mul_pd(y2, a2));
+            x2 = x1, x1 = x, y2 = y1, y1 = y;
+            buffer[ii] = y;
+         }
+         _mm_storeu_pd(&State(section, X1, channel), x1);
+         _mm_storeu_pd(&State(section, X2, channel), x2);
+         _mm_storeu_pd(&State(section, Y1, channel), y1);
+         _mm_storeu_pd(&State(section, Y2, channel), y2);
+      }
+
+      for (size_t ii = 0; ii < count; ++ii) {
+         out0[start + ii] = _mm_cvtsd_f64(buffer[ii]);
+         out1[start + ii] =
+            _mm_cvtsd_f64(_mm_unpackhi_pd(buffer[ii], buffer[ii]));
+      }
+   }
+#else
+   ProcessChannel(channel, in[channel], out[channel], len);
+   ProcessChannel(channel + 1, in[channel + 1], out[channel + 1], len);
+#endif
+}
@@ -12,6 +12,7 @@ Max Maisel
 #ifndef __BIQUAD_H__
 #define __BIQUAD_H__
 
+#include <vector>
 #include "MemoryX.h"
 
 /// \brief Represents a biquad digital filter.
@@ -76,4 +77,51 @@ struct Biquad
    static double ChebyPoly(int Order, double NormFreq);
 };
 
+/// \brief A cascade of biquad sections applied to several channels, a block
+/// at a time.
+///
+/// Each channel has its own state.  Arithmetic is in double, as in
+/// Biquad::ProcessOne, and values pass between sections without rounding to
+/// float.  Pairs of channels are filtered together where SSE2 is available.
+class BiquadCascade
+{
+public:
+   BiquadCascade() = default;
+   //! Sections that pass the signal unchanged
+   BiquadCascade(size_t nSections, size_t nChannels);
+   //! Coefficients of the given sections, with state reset
+   BiquadCascade(const Biquad *sections, size_t nSections, size_t nChannels);
+
+   size_t GetSectionCount() const { return mSections.size(); }
+   size_t GetChannelCount() const { return mChannels; }
+
+   //! Change coefficients, keeping the state; a0 is taken as 1
+   void SetCoefficients(size_t section,
+      double b0, double b1, double b2, double a1, double a2);
+   void Reset();
+
+   //! Filter len samples of each channel; out may equal in
+   void Process(const float *const *in, float *const *out, size_t len);
+
+private:
+   struct Coefficients
+   {
+      double b0, b1, b2, a1, a2;
+   };
+
+   // The variables of one section for one channel
+   enum { X1, X2, Y1, Y2, nVariables };
+   //! Adjacent channels have adjacent values
+   double &State(size_t section, int variable, size_t channel)
+   { return mState[(section * nVariables + variable) * mChannels + channel]; }
+
+   void ProcessChannel(size_t channel, const float *in, float *out, size_t len);
+   void ProcessPair(size_t channel,
+      const float *const *in, float *const *out, size_t len);
+
+   std::vector<Coefficients> mSections;
+   size_t mChannels{ 0 };
+   std::vector<double> mState;
+};
+
 #endif
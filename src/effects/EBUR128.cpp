@@ -10,6 +10,8 @@ Max Maisel
 
 #include "EBUR128.h"
 
+#include <algorithm>
+
 EBUR128::EBUR128(double rate, size_t channels)
    : mChannelCount(channels)
    , mRate(rate)
@@ -18,9 +20,13 @@ EBUR128::EBUR128(double rate, size_t channels)
    mBlockOverlap = ceil(0.1 * mRate); // 100 ms overlap
    mLoudnessHist.reinit(HIST_BIN_COUNT, false);
    mBlockRingBuffer.reinit(mBlockSize);
-   mWeightingFilter.reinit(mChannelCount, false);
+   mWeightingFilter = BiquadCascade{ CalcWeightingFilter(mRate).get(), 2,
+      mChannelCount };
+   mWeighted.reinit(mChannelCount);
    for(size_t channel = 0; channel < mChannelCount; ++channel)
-      mWeightingFilter[channel] = CalcWeightingFilter(mRate);
+      mWeighted[channel].reinit(ChunkSize);
+   mInputs.reinit(mChannelCount);
+   mOutputs.reinit(mChannelCount);
 }
 
 void EBUR128::Initialize()
@@ -29,11 +35,7 @@ void EBUR128::Initialize()
    mBlockRingPos = 0;
    mBlockRingSize = 0;
    memset(mLoudnessHist.get(), 0, HIST_BIN_COUNT*sizeof(long int));
-   for(size_t channel = 0; channel < mChannelCount; ++channel)
-   {
-      mWeightingFilter[channel][0].Reset();
-      mWeightingFilter[channel][1].Reset();
-   }
+   mWeightingFilter.Reset();
 }
 
 // fs: sample rate
@@ -85,18 +87,31 @@ ArrayOf<Biquad> EBUR128::CalcWeightingFilter(double fs)
    return std::move(pBiquad);
 }
 
-void EBUR128::ProcessSampleFromChannel(float x_in, size_t channel)
+void EBUR128::ProcessSamples(const float *const *channels, size_t len)
 {
-   double value;
-   value = mWeightingFilter[channel][0].ProcessOne(x_in);
-   value = mWeightingFilter[channel][1].ProcessOne(value);
-   if(channel == 0)
-      mBlockRingBuffer[mBlockRingPos] = value * value;
-   else
+   for(size_t start = 0; start < len; start += ChunkSize)
    {
-      // Add the power of additional channels to the power of first channel.
-      // As a result, stereo tracks appear about 3 LUFS louder, as specified.
-      mBlockRingBuffer[mBlockRingPos] += value * value;
+      const auto count = std::min<size_t>(ChunkSize, len - start);
+      for(size_t channel = 0; channel < mChannelCount; ++channel)
+      {
+         mInputs[channel] = channels[channel] + start;
+         mOutputs[channel] = mWeighted[channel].get();
+      }
+      mWeightingFilter.Process(mInputs.get(), mOutputs.get(), count);
+
+      for(size_t i = 0; i < count; ++i)
+      {
+         // Add the power of additional channels to the power of first channel.
+         // As a result, stereo tracks appear about 3 LUFS louder, as specified.
+         double sum = 0;
+         for(size_t channel = 0; channel < mChannelCount; ++channel)
+         {
+            const double value = mWeighted[channel][i];
+            sum += value * value;
+         }
+         mBlockRingBuffer[mBlockRingPos] = sum;
+         NextSample();
+      }
    }
 }
 
@@ -26,7 +26,8 @@ public:
 
    static ArrayOf<Biquad> CalcWeightingFilter(double fs);
    void Initialize();
-   void ProcessSampleFromChannel(float x_in, size_t channel);
+   //! Weight and accumulate len samples of every channel
+   void ProcessSamples(const float *const *channels, size_t len);
    void NextSample();
    double IntegrativeLoudness();
    inline double IntegrativeLoudnessToLUFS(double loudness)
@@ -37,6 +38,8 @@ private:
    void AddBlockToHistogram(size_t validLen);
 
    static const size_t HIST_BIN_COUNT = 65536;
+   /// Samples of each channel filtered at once
+   enum : size_t { ChunkSize = 4096 };
    /// EBU R128 absolute threshold
    static constexpr double GAMMA_A = (-70.0 + 0.691) / 10.0;
    ArrayOf<long int> mLoudnessHist;
@@ -49,11 +52,12 @@ private:
    size_t mChannelCount;
    double mRate;
 
-   /// This is be an array of arrays of the type
-   /// mWeightingFilter[CHANNEL][FILTER] with
-   /// CHANNEL = LEFT/RIGHT (0/1) and
-   /// FILTER  = HSF/HPF    (0/1)
-   ArrayOf<ArrayOf<Biquad>> mWeightingFilter;
+   /// The HSF and HPF filters, for all channels together
+   BiquadCascade mWeightingFilter;
+   /// Weighted samples of each channel
+   ArrayOf<Floats> mWeighted;
+   ArrayOf<const float*> mInputs;
+   ArrayOf<float*> mOutputs;
 };
 
 #endif
@@ -31,6 +31,7 @@
 #include "../LabelTrack.h"
 #include "../Mix.h"
 #include "../PluginManager.h"
+#include "../Profiler.h"
 #include "../ProjectAudioManager.h"
 #include "../ProjectFileIO.h"
 #include "../ProjectSettings.h"
@@ -1544,6 +1545,8 @@ bool Effect::ProcessTrack(int count,
                           ArrayOf< float * > &inBufPos,
                           ArrayOf< float *> &outBufPos)
 {
+   PROFILE_SCOPE("Effect::ProcessTrack");
+
    bool rc = true;
 
    // Give the plugin a chance to initialize
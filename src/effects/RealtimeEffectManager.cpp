@@ -16,9 +16,82 @@
 #include "audacity/EffectInterface.h"
 #include "MemoryX.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <thread>
 #include <wx/time.h>
 
+#if defined(__WXMSW__)
+#include <windows.h>
+#elif defined(__WXMAC__)
+#include <dispatch/dispatch.h>
+#include <pthread.h>
+#include <sched.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#endif
+
+#include "../Profiler.h"
+#include "../ThreadPool.h"
+
+//! The most recent values that one thread at a time records, for the main
+//! thread to summarize meanwhile; a summary may mix values of neighboring
+//! callbacks, which is good enough for statistics
+class RealtimeTimingHistory
+{
+public:
+   // More than ten seconds of callbacks of 512 samples at 44.1 kHz
+   enum : size_t { Size = 1024 };
+
+   void Add(long long value)
+   {
+      const auto written = mWritten.load(std::memory_order_relaxed);
+      mValues[written % Size].store(value, std::memory_order_relaxed);
+      mWritten.store(written + 1, std::memory_order_release);
+   }
+
+   RealtimeEffectManager::TimingSummary Summarize() const
+   {
+      const auto count = std::min<size_t>(
+         mWritten.load(std::memory_order_acquire), Size);
+      if (count == 0)
+         return {};
+
+      std::vector<long long> values(count);
+      for (size_t ii = 0; ii < count; ++ii)
+         values[ii] = mValues[ii].load(std::memory_order_relaxed);
+
+      const auto percentile = [&](size_t percent){
+         auto nth = values.begin() + std::min(count - 1, count * percent / 100);
+         std::nth_element(values.begin(), nth, values.end());
+         return *nth;
+      };
+      RealtimeEffectManager::TimingSummary result;
+      result.count = count;
+      result.p50 = percentile(50);
+      result.p99 = percentile(99);
+      result.max = *std::max_element(values.begin(), values.end());
+      return result;
+   }
+
+private:
+   std::atomic<long long> mValues[Size]{};
+   std::atomic<size_t> mWritten{ 0 };
+};
+
+namespace {
+long long Nanoseconds(std::chrono::steady_clock::duration duration)
+{
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+      .count();
+}
+}
+
 class RealtimeEffectState
 {
 public:
@@ -33,6 +106,10 @@ public:
       unsigned chans, float **inbuf, float **outbuf, size_t numSamples);
    bool IsRealtimeActive();
 
+   //! Called by the audio thread at the end of each callback
+   void RecordCallback();
+   const RealtimeTimingHistory &GetHistory() const { return mHistory; }
+
 private:
    EffectClientInterface &mEffect;
 
@@ -40,8 +117,308 @@ private:
    int mCurrentProcessor;
 
    std::atomic<int> mRealtimeSuspendCount{ 1 };    // Effects are initially suspended
+
+   // Groups may be processed on several threads, but the effect sees only
+   // one at a time
+   std::atomic_flag mBusy = ATOMIC_FLAG_INIT;
+
+   // Time in this effect during the current callback, for all groups;
+   // these are guarded by mBusy
+   long long mCallbackNanoseconds{ 0 };
+   bool mCalled{ false };
+
+   RealtimeTimingHistory mHistory;
+};
+
+namespace {
+//! Counting semaphore whose Post neither locks nor allocates, so that the
+//! audio thread may wake a worker without waiting on any other thread
+class Semaphore
+{
+public:
+   Semaphore();
+   ~Semaphore();
+   Semaphore(const Semaphore&) = delete;
+   Semaphore &operator=(const Semaphore&) = delete;
+
+   void Post();
+   void Wait();
+
+private:
+#if defined(__WXMSW__)
+   HANDLE mHandle;
+#elif defined(__WXMAC__)
+   dispatch_semaphore_t mSemaphore;
+#else
+   sem_t mSemaphore;
+#endif
+};
+
+#if defined(__WXMSW__)
+
+Semaphore::Semaphore()
+   : mHandle{ ::CreateSemaphore(nullptr, 0, LONG_MAX, nullptr) }
+{
+}
+
+Semaphore::~Semaphore()
+{
+   ::CloseHandle(mHandle);
+}
+
+void Semaphore::Post()
+{
+   ::ReleaseSemaphore(mHandle, 1, nullptr);
+}
+
+void Semaphore::Wait()
+{
+   ::WaitForSingleObject(mHandle, INFINITE);
+}
+
+#elif defined(__WXMAC__)
+
+Semaphore::Semaphore()
+   : mSemaphore{ dispatch_semaphore_create(0) }
+{
+}
+
+Semaphore::~Semaphore()
+{
+   dispatch_release(mSemaphore);
+}
+
+void Semaphore::Post()
+{
+   dispatch_semaphore_signal(mSemaphore);
+}
+
+void Semaphore::Wait()
+{
+   dispatch_semaphore_wait(mSemaphore, DISPATCH_TIME_FOREVER);
+}
+
+#else
+
+Semaphore::Semaphore()
+{
+   sem_init(&mSemaphore, 0, 0);
+}
+
+Semaphore::~Semaphore()
+{
+   sem_destroy(&mSemaphore);
+}
+
+void Semaphore::Post()
+{
+   sem_post(&mSemaphore);
+}
+
+void Semaphore::Wait()
+{
+   while (sem_wait(&mSemaphore) != 0 && errno == EINTR)
+      ;
+}
+
+#endif
+
+//! The audio thread may wait for a worker in the middle of a group, so ask
+//! for realtime scheduling; without the privilege, this quietly does nothing
+void RaiseThreadPriority()
+{
+#if defined(__WXMSW__)
+   ::SetThreadPriority(::GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#else
+   sched_param param{};
+   param.sched_priority =
+      (sched_get_priority_min(SCHED_FIFO) +
+       sched_get_priority_max(SCHED_FIFO)) / 2;
+   pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#endif
+}
+}
+
+//! Threads that help the audio thread with the groups of one callback
+/*! They are started on the main thread, before playback.  Handing off a
+ batch neither allocates nor locks; a worker that parked after finding no
+ batch for a while is woken with a semaphore.  A worker helps with a batch
+ only if it joins while the audio thread still has groups to hand out, and
+ the audio thread waits on an atomic counter for just the workers that
+ joined, never for one that is still asleep. */
+class RealtimeEffectManager::Workers
+{
+public:
+   //! Start nThreads - 1 workers; the caller of ForEach is the other
+   explicit Workers(size_t nThreads);
+   ~Workers();
+
+   size_t GetThreadCount() const { return mWorkers.size() + 1; }
+
+   //! Call function(index) for each index in [0, count), concurrently
+   template< typename Function >
+   void ForEach(size_t count, const Function &function)
+   {
+      Run( count, &Invoke< Function >,
+         static_cast< const void* >( &function ) );
+   }
+
+private:
+   using Task = void (*)(const void *context, size_t index);
+
+   template< typename Function >
+   static void Invoke(const void *context, size_t index)
+   {
+      (*static_cast< const Function* >( context ))( index );
+   }
+
+   struct Worker {
+      Semaphore wake;
+      std::atomic<bool> parked{ false };
+      std::thread thread;
+   };
+
+   void Run(size_t count, Task task, const void *context);
+   void Wake();
+   void Drain();
+   void Work(Worker &worker);
+
+   std::vector<std::unique_ptr<Worker>> mWorkers;
+
+   // Written by Run before it opens the batch, then only read
+   Task mTask{};
+   const void *mContext{};
+   size_t mCount{ 0 };
+
+   // Bit 0 is set while the batch is open for workers to join; the rest
+   // counts, in steps of two, the workers that joined and are not done
+   enum : size_t { Open = 1, Joined = 2 };
+   std::atomic<size_t> mState{ 0 };
+
+   std::atomic<size_t> mNext{ 0 };
+   std::atomic<unsigned long> mGeneration{ 0 };
+   std::atomic<bool> mFailed{ false };
+   std::exception_ptr mException;
+   std::atomic<bool> mStop{ false };
 };
 
+RealtimeEffectManager::Workers::Workers(size_t nThreads)
+{
+   for (size_t ii = 1; ii < nThreads; ++ii) {
+      mWorkers.push_back(std::make_unique<Worker>());
+      auto &worker = *mWorkers.back();
+      worker.thread = std::thread( [this, &worker]{ Work(worker); } );
+   }
+}
+
+RealtimeEffectManager::Workers::~Workers()
+{
+   mStop.store(true);
+   Wake();
+   for (auto &pWorker : mWorkers)
+      pWorker->thread.join();
+}
+
+void RealtimeEffectManager::Workers::Run(
+   size_t count, Task task, const void *context)
+{
+   if (mWorkers.empty() || count <= 1) {
+      for (size_t ii = 0; ii < count; ++ii)
+         task( context, ii );
+      return;
+   }
+
+   mTask = task;
+   mContext = context;
+   mCount = count;
+   mNext.store(0, std::memory_order_relaxed);
+   mFailed.store(false, std::memory_order_relaxed);
+   mState.store(Open, std::memory_order_release);
+   mGeneration.fetch_add(1);
+   Wake();
+
+   Drain();
+
+   // No index remains unclaimed, so let no more workers join, then wait for
+   // those that did to finish their last groups before the context goes away
+   mState.fetch_and(~size_t(Open), std::memory_order_relaxed);
+   while (mState.load(std::memory_order_acquire) != 0)
+      std::this_thread::yield();
+
+   if (mFailed.load(std::memory_order_relaxed)) {
+      auto pException = std::move(mException);
+      mException = nullptr;
+      std::rethrow_exception(pException);
+   }
+}
+
+void RealtimeEffectManager::Workers::Wake()
+{
+   // Post only to a worker that is parked or about to be, and at most once
+   for (auto &pWorker : mWorkers)
+      if (pWorker->parked.exchange(false))
+         pWorker->wake.Post();
+}
+
+void RealtimeEffectManager::Workers::Drain()
+{
+   size_t index;
+   while ((index = mNext.fetch_add(1, std::memory_order_relaxed)) < mCount) {
+      try {
+         mTask( mContext, index );
+      }
+      catch ( ... ) {
+         if (!mFailed.exchange(true))
+            mException = std::current_exception();
+      }
+   }
+}
+
+void RealtimeEffectManager::Workers::Work(Worker &worker)
+{
+   Profiler::SetThreadName("Realtime effects");
+   RaiseThreadPriority();
+
+   using Clock = std::chrono::steady_clock;
+   // Spin only briefly before parking; waking costs the audio thread no more
+   // than a semaphore post, and it doesn't wait for the worker to wake
+   const auto spinTime = std::chrono::microseconds(100);
+
+   unsigned long seen = 0;
+   while (true) {
+      auto generation = mGeneration.load(std::memory_order_acquire);
+      const auto spinStart = Clock::now();
+      while (generation == seen && !mStop.load()) {
+         if (Clock::now() - spinStart < spinTime)
+            std::this_thread::yield();
+         else {
+            worker.parked.store(true);
+            if (mGeneration.load() == seen && !mStop.load())
+               worker.wake.Wait();
+            else if (!worker.parked.exchange(false))
+               // Wake saw the flag first, and so posts; consume that
+               worker.wake.Wait();
+         }
+         generation = mGeneration.load(std::memory_order_acquire);
+      }
+      if (generation == seen)
+         // Stopped
+         break;
+      seen = generation;
+
+      // Join the batch only if the audio thread hasn't finished handing it
+      // out; a late worker skips it
+      auto state = mState.load(std::memory_order_relaxed);
+      while ((state & Open) && !mState.compare_exchange_weak(
+         state, state + Joined, std::memory_order_acquire))
+         ;
+      if (state & Open) {
+         Drain();
+         mState.fetch_sub(Joined, std::memory_order_release);
+      }
+   }
+}
+
 RealtimeEffectManager & RealtimeEffectManager::Get()
 {
    static RealtimeEffectManager rem;
@@ -49,24 +426,57 @@ RealtimeEffectManager & RealtimeEffectManager::Get()
 }
 
 RealtimeEffectManager::RealtimeEffectManager()
+   : mCallbackHistory{ std::make_unique<RealtimeTimingHistory>() }
+   , mLoadHistory{ std::make_unique<RealtimeTimingHistory>() }
 {
-   mRealtimeLock.Enter();
    mRealtimeActive = false;
    mRealtimeSuspended = true;
-   mRealtimeLatency = 0;
-   mRealtimeLock.Leave();
+   Publish();
 }
 
 RealtimeEffectManager::~RealtimeEffectManager()
 {
+   delete mChain.exchange(nullptr);
+}
+
+void RealtimeEffectManager::Publish()
+{
+   auto chain = std::make_unique<Chain>();
+   for (auto &state : mStates)
+      chain->states.push_back(state.get());
+   chain->suspended = mRealtimeSuspended;
+   chain->rate = mRealtimeRate;
+   chain->workers = mWorkers.get();
+
+   std::unique_ptr<const Chain> old{ mChain.exchange(chain.release()) };
+
+   // Once the audio thread is seen not to hold the old snapshot, it can't
+   // pick it up again, because AcquireChain checks for a newer one
+   while (old && mChainInUse.load() == old.get())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+const RealtimeEffectManager::Chain *RealtimeEffectManager::AcquireChain()
+{
+   auto chain = mChain.load();
+   while (true) {
+      mChainInUse.store(chain);
+      // Publish may have replaced the snapshot before seeing it in use
+      const auto latest = mChain.load();
+      if (latest == chain)
+         return chain;
+      chain = latest;
+   }
+}
+
+void RealtimeEffectManager::ReleaseChain()
+{
+   mChainInUse.store(nullptr);
 }
 
 #if defined(EXPERIMENTAL_EFFECTS_RACK)
 void RealtimeEffectManager::RealtimeSetEffects(const EffectArray & effects)
 {
-   // Block RealtimeProcess()
-   RealtimeSuspend();
-
    decltype( mStates ) newStates;
    auto begin = mStates.begin(), end = mStates.end();
    for ( auto pEffect : effects ) {
@@ -80,6 +490,11 @@ void RealtimeEffectManager::RealtimeSetEffects(const EffectArray & effects)
          pEffect->RealtimeInitialize();
          newStates.emplace_back(
             std::make_unique< RealtimeEffectState >( *pEffect ) );
+         auto &state = newStates.back();
+         for (size_t i = 0, cnt = mRealtimeChans.size(); i < cnt; i++)
+            state->RealtimeAddProcessor(i, mRealtimeChans[i], mRealtimeRates[i]);
+         if (!mRealtimeSuspended)
+            state->RealtimeResume();
       }
       else {
          // Preserve state for effect that remains in the chain
@@ -87,18 +502,16 @@ void RealtimeEffectManager::RealtimeSetEffects(const EffectArray & effects)
       }
    }
 
-   // Remaining states that were not moved need to clean up
-   for ( auto &state : mStates ) {
+   // Install the NEW chain, while the old one is still alive
+   mStates.swap( newStates );
+   Publish();
+
+   // Remaining states that were not moved need to clean up, now that the
+   // audio thread is done with them
+   for ( auto &state : newStates ) {
       if ( state )
          state->GetEffect().RealtimeFinalize();
    }
-
-   // Get rid of the old chain
-   // And install the NEW one
-   mStates.swap( newStates );
-
-   // Allow RealtimeProcess() to, well, process 
-   RealtimeResume();
 }
 #endif
 
@@ -114,12 +527,7 @@ bool RealtimeEffectManager::RealtimeIsSuspended()
 
 void RealtimeEffectManager::RealtimeAddEffect(EffectClientInterface *effect)
 {
-   // Block RealtimeProcess()
-   RealtimeSuspend();
-
-   // Add to list of active effects
-   mStates.emplace_back( std::make_unique< RealtimeEffectState >( *effect ) );
-   auto &state = mStates.back();
+   auto state = std::make_unique< RealtimeEffectState >( *effect );
 
    // Initialize effect if realtime is already active
    if (mRealtimeActive)
@@ -133,35 +541,39 @@ void RealtimeEffectManager::RealtimeAddEffect(EffectClientInterface *effect)
          state->RealtimeAddProcessor(i, mRealtimeChans[i], mRealtimeRates[i]);
       }
    }
-   
 
-   // Allow RealtimeProcess() to, well, process 
-   RealtimeResume();
+   // A new state begins suspended; match the others
+   if (!mRealtimeSuspended)
+      state->RealtimeResume();
+
+   // Add to list of active effects, and only now let the audio thread see it,
+   // without interrupting the other effects
+   mStates.push_back( std::move( state ) );
+   Publish();
 }
 
 void RealtimeEffectManager::RealtimeRemoveEffect(EffectClientInterface *effect)
 {
-   // Block RealtimeProcess()
-   RealtimeSuspend();
-
-   if (mRealtimeActive)
-   {
-      // Cleanup realtime processing
-      effect->RealtimeFinalize();
-   }
-      
    // Remove from list of active effects
+   std::unique_ptr< RealtimeEffectState > removed;
    auto end = mStates.end();
    auto found = std::find_if( mStates.begin(), end,
       [&](const decltype(mStates)::value_type &state){
          return &state->GetEffect() == effect;
       }
    );
-   if (found != end)
+   if (found != end) {
+      removed = std::move( *found );
       mStates.erase(found);
+      // Returns when the audio thread can no longer be using the effect
+      Publish();
+   }
 
-   // Allow RealtimeProcess() to, well, process 
-   RealtimeResume();
+   if (mRealtimeActive)
+   {
+      // Cleanup realtime processing
+      effect->RealtimeFinalize();
+   }
 }
 
 void RealtimeEffectManager::RealtimeInitialize(double rate)
@@ -172,10 +584,14 @@ void RealtimeEffectManager::RealtimeInitialize(double rate)
    // (Re)Set processor parameters
    mRealtimeChans.clear();
    mRealtimeRates.clear();
+   mGroupHistories.clear();
 
    // RealtimeAdd/RemoveEffect() needs to know when we're active so it can
    // initialize newly added effects
    mRealtimeActive = true;
+   mRealtimeRate = rate;
+   mRealtimeLatency = 0;
+   mRealtimeDeadlineMisses = 0;
 
    // Tell each effect to get ready for action
    for (auto &state : mStates) {
@@ -194,6 +610,20 @@ void RealtimeEffectManager::RealtimeAddProcessor(int group, unsigned chans, floa
 
    mRealtimeChans.push_back(chans);
    mRealtimeRates.push_back(rate);
+   while (mGroupHistories.size() < mRealtimeChans.size())
+      mGroupHistories.push_back(std::make_unique<RealtimeTimingHistory>());
+
+   // Groups can be processed concurrently, with up to one thread each.
+   // This happens before the stream starts, so the audio thread isn't
+   // waiting for any batch of the old workers.
+   const auto nThreads =
+      std::min(mRealtimeChans.size(), ThreadPool::HardwareThreadCount());
+   if (nThreads > 1 &&
+       (!mWorkers || mWorkers->GetThreadCount() < nThreads)) {
+      auto oldWorkers = std::move(mWorkers);
+      mWorkers = std::make_unique<Workers>(nThreads);
+      Publish();
+   }
 }
 
 void RealtimeEffectManager::RealtimeFinalize()
@@ -212,29 +642,30 @@ void RealtimeEffectManager::RealtimeFinalize()
    mRealtimeChans.clear();
    mRealtimeRates.clear();
 
+   // Don't leave threads waiting between plays
+   if (mWorkers) {
+      auto oldWorkers = std::move(mWorkers);
+      Publish();
+   }
+
    // No longer active
    mRealtimeActive = false;
 }
 
 void RealtimeEffectManager::RealtimeSuspend()
 {
-   mRealtimeLock.Enter();
-
    // Already suspended...bail
    if (mRealtimeSuspended)
-   {
-      mRealtimeLock.Leave();
       return;
-   }
 
-   // Show that we aren't going to be doing anything
+   // Show that we aren't going to be doing anything, and wait until the
+   // audio thread agrees
    mRealtimeSuspended = true;
+   Publish();
 
    // And make sure the effects don't either
    for (auto &state : mStates)
       state->RealtimeSuspend();
-
-   mRealtimeLock.Leave();
 }
 
 void RealtimeEffectManager::RealtimeSuspendOne( EffectClientInterface &effect )
@@ -251,14 +682,9 @@ void RealtimeEffectManager::RealtimeSuspendOne( EffectClientInterface &effect )
 
 void RealtimeEffectManager::RealtimeResume()
 {
-   mRealtimeLock.Enter();
-
    // Already running...bail
    if (!mRealtimeSuspended)
-   {
-      mRealtimeLock.Leave();
       return;
-   }
 
    // Tell the effects to get ready for more action
    for (auto &state : mStates)
@@ -266,8 +692,7 @@ void RealtimeEffectManager::RealtimeResume()
 
    // And we should too
    mRealtimeSuspended = false;
-
-   mRealtimeLock.Leave();
+   Publish();
 }
 
 void RealtimeEffectManager::RealtimeResumeOne( EffectClientInterface &effect )
@@ -287,21 +712,22 @@ void RealtimeEffectManager::RealtimeResumeOne( EffectClientInterface &effect )
 //
 void RealtimeEffectManager::RealtimeProcessStart()
 {
-   // Protect ourselves from the main thread
-   mRealtimeLock.Enter();
+   // Hold one snapshot of the chain for all groups of this callback
+   auto chain = AcquireChain();
+
+   mCallbackTime = {};
+   mCallbackSamples = 0;
 
    // Can be suspended because of the audio stream being paused or because effects
    // have been suspended.
-   if (!mRealtimeSuspended)
+   if (!chain->suspended)
    {
-      for (auto &state : mStates)
+      for (auto state : chain->states)
       {
          if (state->IsRealtimeActive())
             state->GetEffect().RealtimeProcessStart();
       }
    }
-
-   mRealtimeLock.Leave();
 }
 
 //
@@ -309,20 +735,83 @@ void RealtimeEffectManager::RealtimeProcessStart()
 //
 size_t RealtimeEffectManager::RealtimeProcess(int group, unsigned chans, float **buffers, size_t numSamples)
 {
-   // Protect ourselves from the main thread
-   mRealtimeLock.Enter();
+   // Only this thread stores the snapshot it acquired in RealtimeProcessStart
+   auto chain = mChainInUse.load(std::memory_order_relaxed);
 
    // Can be suspended because of the audio stream being paused or because effects
    // have been suspended, so allow the samples to pass as-is.
-   if (mRealtimeSuspended || mStates.empty())
-   {
-      mRealtimeLock.Leave();
+   if (!chain || chain->suspended || chain->states.empty())
       return numSamples;
-   }
 
    // Remember when we started so we can calculate the amount of latency we
    // are introducing
-   wxMilliClock_t start = wxGetUTCTimeMillis();
+   const auto start = std::chrono::steady_clock::now();
+
+   auto result = ProcessGroup(*chain, group, chans, buffers, numSamples);
+
+   mCallbackTime += std::chrono::steady_clock::now() - start;
+   mCallbackSamples = std::max(mCallbackSamples, numSamples);
+
+   return result;
+}
+
+size_t RealtimeEffectManager::RealtimeGetConcurrency()
+{
+   auto chain = mChainInUse.load(std::memory_order_relaxed);
+   if (!chain || chain->suspended || !chain->workers)
+      return 1;
+   // A group passes the effects in order, and each effect takes one group
+   // at a time, so more threads than effects would only wait
+   return std::max<size_t>(1, std::min(
+      chain->states.size(), chain->workers->GetThreadCount()));
+}
+
+//
+// This will be called in a different thread than the main GUI thread.
+//
+void RealtimeEffectManager::RealtimeProcessGroups(size_t count,
+   const int *groups, const unsigned *chans, float ***buffers,
+   size_t *numSamples)
+{
+   auto chain = mChainInUse.load(std::memory_order_relaxed);
+   if (!chain || chain->suspended || chain->states.empty() || count == 0)
+      return;
+
+   const auto start = std::chrono::steady_clock::now();
+   for (size_t ii = 0; ii < count; ++ii)
+      mCallbackSamples = std::max(mCallbackSamples, numSamples[ii]);
+
+   const auto process = [&](size_t ii){
+      numSamples[ii] = ProcessGroup(*chain,
+         groups[ii], chans[ii], buffers[ii], numSamples[ii]);
+   };
+   const auto nThreads = std::min(count, RealtimeGetConcurrency());
+   if (nThreads <= 1)
+      for (size_t ii = 0; ii < count; ++ii)
+         process(ii);
+   else {
+      // Each thread takes the next unclaimed group until none remain
+      std::atomic<size_t> next{ 0 };
+      chain->workers->ForEach(nThreads, [&](size_t){
+         size_t ii;
+         while ((ii = next.fetch_add(1, std::memory_order_relaxed)) < count)
+            process(ii);
+      });
+   }
+
+   mCallbackTime += std::chrono::steady_clock::now() - start;
+}
+
+size_t RealtimeEffectManager::ProcessGroup(const Chain &chain,
+   int group, unsigned chans, float **buffers, size_t numSamples)
+{
+   const auto start = std::chrono::steady_clock::now();
+   auto recordTime = finally([&]{
+      // Only one thread processes a group in a callback
+      if (group >= 0 && group < (int)mGroupHistories.size())
+         mGroupHistories[group]->Add(
+            Nanoseconds(std::chrono::steady_clock::now() - start));
+   });
 
    // Allocate the in/out buffer arrays
    float **ibuf = (float **) alloca(chans * sizeof(float *));
@@ -339,7 +828,7 @@ size_t RealtimeEffectManager::RealtimeProcess(int group, unsigned chans, float *
    // Now call each effect in the chain while swapping buffer pointers to feed the
    // output of one effect as the input to the next effect
    size_t called = 0;
-   for (auto &state : mStates)
+   for (auto state : chain.states)
    {
       if (state->IsRealtimeActive())
       {
@@ -368,11 +857,6 @@ size_t RealtimeEffectManager::RealtimeProcess(int group, unsigned chans, float *
       }
    }
 
-   // Remember the latency
-   mRealtimeLatency = (int) (wxGetUTCTimeMillis() - start).GetValue();
-
-   mRealtimeLock.Leave();
-
    //
    // This is wrong...needs to handle tails
    //
@@ -384,26 +868,68 @@ size_t RealtimeEffectManager::RealtimeProcess(int group, unsigned chans, float *
 //
 void RealtimeEffectManager::RealtimeProcessEnd()
 {
-   // Protect ourselves from the main thread
-   mRealtimeLock.Enter();
+   auto chain = mChainInUse.load(std::memory_order_relaxed);
 
    // Can be suspended because of the audio stream being paused or because effects
    // have been suspended.
-   if (!mRealtimeSuspended)
+   if (chain && !chain->suspended)
    {
-      for (auto &state : mStates)
+      for (auto state : chain->states)
       {
          if (state->IsRealtimeActive())
             state->GetEffect().RealtimeProcessEnd();
       }
    }
 
-   mRealtimeLock.Leave();
+   // Remember the latency, and whether it was too much for the samples
+   if (mCallbackSamples > 0) {
+      const auto nanoseconds = Nanoseconds(mCallbackTime);
+      mRealtimeLatency.store( (int)(nanoseconds / 1000000),
+         std::memory_order_relaxed);
+      mCallbackHistory->Add(nanoseconds);
+
+      if (chain && chain->rate > 0) {
+         const auto deadline = mCallbackSamples * 1e9 / chain->rate;
+         mLoadHistory->Add( (long long)(nanoseconds * 1e6 / deadline) );
+         if (nanoseconds > deadline)
+            mRealtimeDeadlineMisses.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      // Workers, if any, are done with the states, which Run ensures this
+      // thread sees
+      if (chain)
+         for (auto state : chain->states)
+            state->RecordCallback();
+   }
+
+   // Let the main thread reclaim the snapshot, if it was replaced
+   ReleaseChain();
 }
 
 int RealtimeEffectManager::GetRealtimeLatency()
 {
-   return mRealtimeLatency;
+   return mRealtimeLatency.load(std::memory_order_relaxed);
+}
+
+unsigned long RealtimeEffectManager::GetRealtimeDeadlineMisses()
+{
+   return mRealtimeDeadlineMisses.load(std::memory_order_relaxed);
+}
+
+auto RealtimeEffectManager::GetRealtimeTimings() -> RealtimeTimings
+{
+   // The main thread is the one that changes states and groups, so they
+   // remain while summarized
+   RealtimeTimings result;
+   result.callback = mCallbackHistory->Summarize();
+   result.load = mLoadHistory->Summarize();
+   for (auto &pHistory : mGroupHistories)
+      result.groups.push_back(pHistory->Summarize());
+   for (auto &state : mStates)
+      result.effects.emplace_back(
+         &state->GetEffect(), state->GetHistory().Summarize());
+   result.deadlineMisses = GetRealtimeDeadlineMisses();
+   return result;
 }
 
 RealtimeEffectState::RealtimeEffectState( EffectClientInterface &effect )
@@ -530,6 +1056,16 @@ size_t RealtimeEffectState::RealtimeProcess(int group,
 
    int processor = mGroupProcessor[group];
 
+   while (mBusy.test_and_set(std::memory_order_acquire))
+      std::this_thread::yield();
+   auto cleanup = finally([this]{ mBusy.clear(std::memory_order_release); });
+   const auto start = std::chrono::steady_clock::now();
+   auto recordTime = finally([&]{
+      mCallbackNanoseconds +=
+         Nanoseconds(std::chrono::steady_clock::now() - start);
+      mCalled = true;
+   });
+
    // Call the client until we run out of input or output channels
    while (ichans > 0 && ochans > 0)
    {
@@ -623,3 +1159,11 @@ bool RealtimeEffectState::IsRealtimeActive()
 {
    return mRealtimeSuspendCount == 0;
 }
+
+void RealtimeEffectState::RecordCallback()
+{
+   if (mCalled)
+      mHistory.Add(mCallbackNanoseconds);
+   mCallbackNanoseconds = 0;
+   mCalled = false;
+}
@@ -11,13 +11,22 @@
 #ifndef __AUDACITY_REALTIME_EFFECT_MANAGER__
 #define __AUDACITY_REALTIME_EFFECT_MANAGER__
 
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <utility>
 #include <vector>
-#include <wx/thread.h>
 
 class EffectClientInterface;
 class RealtimeEffectState;
+class RealtimeTimingHistory;
 
+/*! The main thread changes the chain of effects and publishes each version
+ as an immutable snapshot; the audio thread reads the snapshot without
+ locking, from RealtimeProcessStart through RealtimeProcessEnd.  A replaced
+ snapshot, and any effect removed with it, is cleaned up only after the
+ audio thread has let go of it, so the main thread may wait for the duration
+ of one callback, but the audio thread never waits for the main thread. */
 class AUDACITY_DLL_API RealtimeEffectManager final
 {
 public:
@@ -41,17 +50,90 @@ public:
    void RealtimeResumeOne( EffectClientInterface &effect );
    void RealtimeProcessStart();
    size_t RealtimeProcess(int group, unsigned chans, float **buffers, size_t numSamples);
+   //! How many groups the caller should collect for one call of
+   //! RealtimeProcessGroups; call between RealtimeProcessStart and End
+   size_t RealtimeGetConcurrency();
+   //! Like RealtimeProcess for each of count groups, replacing each
+   //! numSamples with the result; the groups may be processed concurrently
+   void RealtimeProcessGroups(size_t count, const int *groups,
+      const unsigned *chans, float ***buffers, size_t *numSamples);
    void RealtimeProcessEnd();
+   //! Milliseconds spent in effects during the last callback
    int GetRealtimeLatency();
+   //! Count of callbacks, since RealtimeInitialize, whose effects took
+   //! longer than the duration of the samples they processed
+   unsigned long GetRealtimeDeadlineMisses();
+
+   //! Distribution over recent callbacks, in nanoseconds, or for load, in
+   //! millionths of the duration of the samples processed
+   struct TimingSummary
+   {
+      size_t count{ 0 };
+      long long p50{ 0 };
+      long long p99{ 0 };
+      long long max{ 0 };
+   };
+   struct RealtimeTimings
+   {
+      //! All effects, for all groups, in each callback
+      TimingSummary callback;
+      TimingSummary load;
+      //! All effects, for each group
+      std::vector<TimingSummary> groups;
+      //! Each effect, for all groups, in chain order
+      std::vector< std::pair<EffectClientInterface*, TimingSummary> > effects;
+      unsigned long deadlineMisses{ 0 };
+   };
+   //! Call on the main thread; summarizes while the audio thread records
+   RealtimeTimings GetRealtimeTimings();
 
 private:
    RealtimeEffectManager();
    ~RealtimeEffectManager();
 
-   wxCriticalSection mRealtimeLock;
+   class Workers;
+
+   //! What the audio thread sees of the manager
+   struct Chain
+   {
+      std::vector<RealtimeEffectState*> states;
+      bool suspended;
+      double rate;
+      //! Null if groups are processed on the audio thread only
+      Workers *workers;
+   };
+
+   //! Called by the main thread after changing mStates or mRealtimeSuspended
+   /*! Returns only when the audio thread no longer uses the previous
+    snapshot, so states absent from the new one may then be destroyed */
+   void Publish();
+   //! Called by the audio thread; the result is valid until ReleaseChain
+   const Chain *AcquireChain();
+   void ReleaseChain();
+   size_t ProcessGroup(const Chain &chain,
+      int group, unsigned chans, float **buffers, size_t numSamples);
+
+   // These are used by the main thread only
    std::vector< std::unique_ptr<RealtimeEffectState> > mStates;
-   int mRealtimeLatency;
    bool mRealtimeSuspended;
+   double mRealtimeRate{ 0 };
+   std::unique_ptr<Workers> mWorkers;
+   // Added before the stream starts, one for each group; written by
+   // whichever thread processes the group
+   std::vector< std::unique_ptr<RealtimeTimingHistory> > mGroupHistories;
+   // Written by the audio thread
+   std::unique_ptr<RealtimeTimingHistory> mCallbackHistory;
+   std::unique_ptr<RealtimeTimingHistory> mLoadHistory;
+
+   // These are used by the audio thread only, for one callback
+   std::chrono::steady_clock::duration mCallbackTime{};
+   size_t mCallbackSamples{ 0 };
+
+   std::atomic<const Chain*> mChain{ nullptr };
+   //! Set by the audio thread to the snapshot it reads, else null
+   std::atomic<const Chain*> mChainInUse{ nullptr };
+   std::atomic<int> mRealtimeLatency{ 0 };
+   std::atomic<unsigned long> mRealtimeDeadlineMisses{ 0 };
    bool mRealtimeActive;
    std::vector<unsigned> mRealtimeChans;
    std::vector<double> mRealtimeRates;
@@ -219,20 +219,15 @@ unsigned EffectScienFilter::GetAudioOutCount()
 
 bool EffectScienFilter::ProcessInitialize(sampleCount WXUNUSED(totalLen), ChannelNames WXUNUSED(chanMap))
 {
-   for (int iPair = 0; iPair < (mOrder + 1) / 2; iPair++)
-      mpBiquad[iPair].Reset();
+   // The sections, with state reset, for the one channel
+   mCascade = BiquadCascade{ mpBiquad.get(), size_t((mOrder + 1) / 2), 1 };
 
    return true;
 }
 
 size_t EffectScienFilter::ProcessBlock(float **inBlock, float **outBlock, size_t blockLen)
 {
-   float *ibuf = inBlock[0];
-   for (int iPair = 0; iPair < (mOrder + 1) / 2; iPair++)
-   {
-      mpBiquad[iPair].Process(ibuf, outBlock[0], blockLen);
-      ibuf = outBlock[0];
-   }
+   mCascade.Process(inBlock, outBlock, blockLen);
 
    return blockLen;
 }
@@ -53,6 +53,7 @@
 #include "../FileFormats.h"
 #include "../Mix.h"
 #include "../Prefs.h"
+#include "../Profiler.h"
 #include "../prefs/ImportExportPrefs.h"
 #include "../Project.h"
 #include "../ProjectHistory.h"
@@ -217,8 +218,21 @@ void ExportPlugin::OptionsCreate(ShuttleGui &S, int WXUNUSED(format))
    S.EndHorizontalLay();
 }
 
+bool ExportPlugin::CanPrepareExport(int WXUNUSED(index))
+{
+   return false;
+}
+
+std::unique_ptr<ExportJob> ExportPlugin::PrepareExport(
+   AudacityProject *, unsigned, const wxFileNameWrapper &, bool,
+   double, double, MixerSpec *, const Tags *, int)
+{
+   wxASSERT(false);
+   return {};
+}
+
 //Create a mixer by computing the time warp factor
-std::unique_ptr<Mixer> ExportPlugin::CreateMixer(const TrackList &tracks,
+std::unique_ptr<PipelinedMixer> ExportPlugin::CreateMixer(const TrackList &tracks,
          bool selectionOnly,
          double startTime, double stopTime,
          unsigned numOutChannels, size_t outBufferSize, bool outInterleaved,
@@ -237,15 +251,22 @@ std::unique_ptr<Mixer> ExportPlugin::CreateMixer(const TrackList &tracks,
          pTrack->SharedPointer< const WaveTrack >() );
    const auto timeTrack = *tracks.Any<const TimeTrack>().begin();
    auto envelope = timeTrack ? timeTrack->GetEnvelope() : nullptr;
+   // Encoders ask for small blocks; mix several at once, so that passing
+   // them between threads costs little
+   const size_t minChunkSize = 65536;
+   const auto chunkSize = outBufferSize *
+      std::max<size_t>(1, (minChunkSize + outBufferSize - 1) / outBufferSize);
    // MB: the stop time should not be warped, this was a bug.
-   return std::make_unique<Mixer>(inputTracks,
+   auto pMixer = std::make_unique<Mixer>(inputTracks,
                   // Throw, to stop exporting, if read fails:
                   true,
                   Mixer::WarpOptions(envelope),
                   startTime, stopTime,
-                  numOutChannels, outBufferSize, outInterleaved,
+                  numOutChannels, chunkSize, outInterleaved,
                   outRate, outFormat,
                   highQuality, mixerSpec);
+   return std::make_unique<PipelinedMixer>(std::move(pMixer),
+      numOutChannels, chunkSize, outInterleaved, outFormat);
 }
 
 void ExportPlugin::InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
@@ -267,6 +288,194 @@ void ExportPlugin::InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
       pDialog, Verbatim( title.GetName() ), message );
 }
 
+ProgressResult ExportPlugin::RunJob(ExportJob &job,
+   std::unique_ptr<ProgressDialog> &pDialog, const wxFileNameWrapper &title)
+{
+   InitProgress( pDialog, title, job.GetMessage() );
+   auto &progress = *pDialog;
+   const auto result = job.Run( [&](double current, double total){
+      return progress.Update( current, total );
+   } );
+   job.ReportError();
+   return result;
+}
+
+//----------------------------------------------------------------------------
+// PipelinedMixer
+//----------------------------------------------------------------------------
+
+PipelinedMixer::PipelinedMixer(std::unique_ptr<Mixer> pMixer,
+   unsigned numChannels, size_t chunkSize, bool interleaved,
+   sampleFormat format)
+   : mpMixer{ std::move(pMixer) }
+   , mNumChannels{ numChannels }
+   , mChunkSize{ chunkSize }
+   , mInterleaved{ interleaved }
+   , mFormat{ format }
+   , mTime{ mpMixer->MixGetCurrentTime() }
+{
+   for (auto &chunk : mChunks)
+      chunk.buffer.Allocate(mChunkSize * mNumChannels, mFormat);
+}
+
+PipelinedMixer::~PipelinedMixer()
+{
+   {
+      std::lock_guard<std::mutex> lock{ mMutex };
+      mStop = true;
+   }
+   mConsumed.notify_one();
+   if (mThread.joinable())
+      mThread.join();
+}
+
+size_t PipelinedMixer::Process(size_t maxSamples)
+{
+   if (mEnded)
+      return 0;
+
+   mOffset += mCount;
+   mCount = 0;
+   if (mpCurrent && mOffset >= mpCurrent->count) {
+      // Give the chunk back to the mixing thread
+      {
+         std::lock_guard<std::mutex> lock{ mMutex };
+         ++mRead;
+      }
+      mConsumed.notify_one();
+      mpCurrent = nullptr;
+   }
+
+   if (!mpCurrent) {
+      // Start on first use, so that a prepared export does not mix until
+      // it runs
+      if (!mThread.joinable())
+         mThread = std::thread{ [this]{ Produce(); } };
+
+      std::unique_lock<std::mutex> lock{ mMutex };
+      mProduced.wait(lock, [this]{ return mWritten > mRead || mpException; });
+      if (mWritten == mRead)
+         // Mixing failed after all samples before the failure were consumed
+         std::rethrow_exception(mpException);
+      mpCurrent = &mChunks[mRead % NumChunks];
+      mOffset = 0;
+   }
+
+   const auto &chunk = *mpCurrent;
+   if (chunk.count == 0) {
+      mEnded = true;
+      mTime = chunk.t1;
+      return 0;
+   }
+
+   mCount = std::min(maxSamples, chunk.count - mOffset);
+   mTime = chunk.t0 +
+      (chunk.t1 - chunk.t0) * (mOffset + mCount) / chunk.count;
+   return mCount;
+}
+
+samplePtr PipelinedMixer::GetBuffer()
+{
+   wxASSERT(mpCurrent);
+   return mpCurrent->buffer.ptr() +
+      mOffset * mNumChannels * SAMPLE_SIZE(mFormat);
+}
+
+samplePtr PipelinedMixer::GetBuffer(int channel)
+{
+   wxASSERT(mpCurrent && !mInterleaved);
+   return mpCurrent->buffer.ptr() +
+      (channel * mChunkSize + mOffset) * SAMPLE_SIZE(mFormat);
+}
+
+double PipelinedMixer::MixGetCurrentTime()
+{
+   return mTime;
+}
+
+void PipelinedMixer::Produce()
+{
+   Profiler::SetThreadName("Export mixer");
+
+   std::vector<samplePtr> destinations(mNumChannels);
+   try {
+      while (true) {
+         Chunk *pChunk;
+         {
+            std::unique_lock<std::mutex> lock{ mMutex };
+            mConsumed.wait(lock, [this]{
+               return mStop || mWritten - mRead < NumChunks; });
+            if (mStop)
+               return;
+            // Not the chunk that the consumer is reading
+            pChunk = &mChunks[mWritten % NumChunks];
+         }
+
+         auto &chunk = *pChunk;
+         chunk.t0 = mpMixer->MixGetCurrentTime();
+         {
+            PROFILE_SCOPE("PipelinedMixer::Produce");
+            if (mInterleaved) {
+               chunk.count = mpMixer->Process(mChunkSize);
+               memcpy(chunk.buffer.ptr(), mpMixer->GetBuffer(),
+                  chunk.count * mNumChannels * SAMPLE_SIZE(mFormat));
+            }
+            else {
+               for (unsigned c = 0; c < mNumChannels; ++c)
+                  destinations[c] = chunk.buffer.ptr() +
+                     c * mChunkSize * SAMPLE_SIZE(mFormat);
+               chunk.count = mpMixer->Process(mChunkSize, destinations.data());
+            }
+         }
+         chunk.t1 = mpMixer->MixGetCurrentTime();
+
+         {
+            std::lock_guard<std::mutex> lock{ mMutex };
+            ++mWritten;
+         }
+         mProduced.notify_one();
+
+         // An empty chunk marks the end
+         if (chunk.count == 0)
+            return;
+      }
+   }
+   catch ( ... ) {
+      {
+         std::lock_guard<std::mutex> lock{ mMutex };
+         mpException = std::current_exception();
+      }
+      mProduced.notify_one();
+   }
+}
+
+//----------------------------------------------------------------------------
+// ExportJob
+//----------------------------------------------------------------------------
+
+ExportJob::ExportJob(const TranslatableString &message)
+   : mMessage{ message }
+{
+}
+
+ExportJob::~ExportJob() = default;
+
+void ExportJob::ReportError()
+{
+   if (mReportError) {
+      auto report = std::move(mReportError);
+      mReportError = nullptr;
+      report();
+   }
+}
+
+void ExportJob::SetError(std::function<void()> report)
+{
+   // Keep the first error only
+   if (!mReportError)
+      mReportError = std::move(report);
+}
+
 //----------------------------------------------------------------------------
 // Export
 //----------------------------------------------------------------------------
@@ -11,7 +11,12 @@
 #ifndef __AUDACITY_EXPORT__
 #define __AUDACITY_EXPORT__
 
+#include <condition_variable>
+#include <exception>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <wx/filename.h> // member variable
 #include "audacity/Types.h"
@@ -58,6 +63,103 @@ class AUDACITY_DLL_API FormatInfo
       bool mCanMetaData;
 };
 
+//----------------------------------------------------------------------------
+// PipelinedMixer
+//----------------------------------------------------------------------------
+//! Runs a Mixer on a thread of its own, a few buffers ahead of the encoder
+//! that consumes the samples
+/*! It has the part of the interface of Mixer that export plug-ins use.
+ Process returns fewer samples than asked only at the end, if each request
+ is for the buffer size given to ExportPlugin::CreateMixer. */
+class AUDACITY_DLL_API PipelinedMixer
+{
+public:
+   //! @param chunkSize a multiple of the size of the encoder's requests
+   PipelinedMixer(std::unique_ptr<Mixer> pMixer, unsigned numChannels,
+      size_t chunkSize, bool interleaved, sampleFormat format);
+   ~PipelinedMixer();
+
+   size_t Process(size_t maxSamples);
+   samplePtr GetBuffer();
+   samplePtr GetBuffer(int channel);
+   //! Time of the end of the samples last returned by Process
+   double MixGetCurrentTime();
+
+private:
+   struct Chunk
+   {
+      SampleBuffer buffer;
+      size_t count;
+      double t0, t1;
+   };
+
+   void Produce();
+
+   // Enough to absorb some unevenness in the times of mixing and encoding
+   enum : size_t { NumChunks = 4 };
+
+   const std::unique_ptr<Mixer> mpMixer;
+   const unsigned mNumChannels;
+   const size_t mChunkSize;
+   const bool mInterleaved;
+   const sampleFormat mFormat;
+
+   Chunk mChunks[NumChunks];
+   std::thread mThread;
+
+   std::mutex mMutex;
+   std::condition_variable mProduced;
+   std::condition_variable mConsumed;
+   // These are guarded by mMutex
+   size_t mWritten{ 0 };
+   size_t mRead{ 0 };
+   bool mStop{ false };
+   std::exception_ptr mpException;
+
+   // These are used by the consuming thread only
+   const Chunk *mpCurrent{ nullptr };
+   size_t mOffset{ 0 };
+   size_t mCount{ 0 };
+   double mTime;
+   bool mEnded{ false };
+};
+
+//----------------------------------------------------------------------------
+// ExportJob
+//----------------------------------------------------------------------------
+//! The mixing and encoding of an export, begun by ExportPlugin::PrepareExport,
+//! which needs no user interface and so may run on any thread
+class AUDACITY_DLL_API ExportJob /* not final */
+{
+public:
+   //! Receives the time exported so far, and says whether to go on
+   using ProgressCallback =
+      std::function< ProgressResult(double current, double total) >;
+
+   explicit ExportJob(const TranslatableString &message);
+   virtual ~ExportJob();
+
+   //! For a progress dialog
+   const TranslatableString &GetMessage() const { return mMessage; }
+
+   /** \brief Write the file, on any thread
+    *
+    * @return as for ExportPlugin::Export; errors are not shown until
+    * ReportError */
+   virtual ProgressResult Run(const ProgressCallback &progress) = 0;
+
+   //! Alert the user to an error that Run met; main thread only
+   void ReportError();
+
+protected:
+   //! Defer a message box to ReportError
+   void SetError(std::function<void()> report);
+
+private:
+   const TranslatableString mMessage;
+   std::function<void()> mReportError;
+};
+
 //----------------------------------------------------------------------------
 // ExportPlugin
 //----------------------------------------------------------------------------
@@ -133,19 +235,46 @@ public:
                        const Tags *metadata = NULL,
                        int subformat = 0) = 0;
 
+   //! Whether PrepareExport is implemented for the sub-format
+   virtual bool CanPrepareExport(int index);
+
+   /** \brief Do the part of Export that needs the main thread, so that the
+    * rest may run on another, perhaps while other files are exported
+    *
+    * Reads preferences and the project, opens the file, and makes the mixer.
+    * The arguments are as for Export.
+    * @return null, after alerting the user, if export can't proceed.  The
+    * job must be run or destroyed before the tracks change. */
+   virtual std::unique_ptr<ExportJob> PrepareExport(AudacityProject *project,
+                       unsigned channels,
+                       const wxFileNameWrapper &fName,
+                       bool selectedOnly,
+                       double t0,
+                       double t1,
+                       MixerSpec *mixerSpec = NULL,
+                       const Tags *metadata = NULL,
+                       int subformat = 0);
+
+   // Create or recycle a dialog.
+   static void InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
+         const TranslatableString &title, const TranslatableString &message);
+   static void InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
+         const wxFileNameWrapper &title, const TranslatableString &message);
+
 protected:
-   std::unique_ptr<Mixer> CreateMixer(const TrackList &tracks,
+   //! The mixer runs on its own thread, so that mixing and encoding overlap
+   std::unique_ptr<PipelinedMixer> CreateMixer(const TrackList &tracks,
          bool selectionOnly,
          double startTime, double stopTime,
          unsigned numOutChannels, size_t outBufferSize, bool outInterleaved,
          double outRate, sampleFormat outFormat,
          bool highQuality = true, MixerSpec *mixerSpec = NULL);
 
-   // Create or recycle a dialog.
-   static void InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
-         const TranslatableString &title, const TranslatableString &message);
-   static void InitProgress(std::unique_ptr<ProgressDialog> &pDialog,
-         const wxFileNameWrapper &title, const TranslatableString &message);
+   //! Run a prepared job on this thread with a progress dialog, as Export
+   //! does
+   static ProgressResult RunJob(ExportJob &job,
+         std::unique_ptr<ProgressDialog> &pDialog,
+         const wxFileNameWrapper &title);
 
 private:
    std::vector<FormatInfo> mFormatInfos;
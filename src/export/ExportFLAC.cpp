@@ -222,6 +222,16 @@ public:
                MixerSpec *mixerSpec = NULL,
                const Tags *metadata = NULL,
                int subformat = 0) override;
+   bool CanPrepareExport(int index) override;
+   std::unique_ptr<ExportJob> PrepareExport(AudacityProject *project,
+               unsigned channels,
+               const wxFileNameWrapper &fName,
+               bool selectedOnly,
+               double t0,
+               double t1,
+               MixerSpec *mixerSpec = NULL,
+               const Tags *metadata = NULL,
+               int subformat = 0) override;
 
 private:
 
@@ -244,8 +254,127 @@ ExportFLAC::ExportFLAC()
    SetDescription(XO("FLAC Files"),0);
 }
 
+//----------------------------------------------------------------------------
+
+class ExportFLACJob final : public ExportJob
+{
+public:
+   ExportFLACJob(const TranslatableString &message,
+      unsigned numChannels, double t0, double t1)
+      : ExportJob{ message }
+      , mNumChannels{ numChannels }
+      , mT0{ t0 }
+      , mT1{ t1 }
+   {}
+   ~ExportFLACJob() override;
+
+   ProgressResult Run(const ProgressCallback &progress) override;
+
+   FLAC::Encoder::File encoder;
+#ifndef LEGACY_FLAC
+   wxFFile f;     // will be closed when the job is destroyed
+#endif
+   // Whether the encoder must be finished if Run does not succeed
+   bool initialized{ false };
+   std::unique_ptr<PipelinedMixer> mixer;
+   sampleFormat format;
+
+private:
+   const unsigned mNumChannels;
+   const double mT0, mT1;
+};
+
+ExportFLACJob::~ExportFLACJob()
+{
+   if (initialized) {
+#ifndef LEGACY_FLAC
+      f.Detach(); // libflac closes the file
+#endif
+      encoder.finish();
+   }
+}
+
+ProgressResult ExportFLACJob::Run(const ProgressCallback &progress)
+{
+   auto updateResult = ProgressResult::Success;
+
+   ArraysOf<FLAC__int32> tmpsmplbuf{ mNumChannels, SAMPLES_PER_RUN, true };
+
+   while (updateResult == ProgressResult::Success) {
+      auto samplesThisRun = mixer->Process(SAMPLES_PER_RUN);
+      if (samplesThisRun == 0) { //stop encoding
+         break;
+      }
+      else {
+         for (size_t i = 0; i < mNumChannels; i++) {
+            samplePtr mixed = mixer->GetBuffer(i);
+            if (format == int24Sample) {
+               for (decltype(samplesThisRun) j = 0; j < samplesThisRun; j++) {
+                  tmpsmplbuf[i][j] = ((int *)mixed)[j];
+               }
+            }
+            else {
+               for (decltype(samplesThisRun) j = 0; j < samplesThisRun; j++) {
+                  tmpsmplbuf[i][j] = ((short *)mixed)[j];
+               }
+            }
+         }
+         if (! encoder.process(
+               reinterpret_cast<FLAC__int32**>( tmpsmplbuf.get() ),
+               samplesThisRun) ) {
+            // TODO: more precise message
+            SetError([]{ ShowDiskFullExportErrorDialog(); });
+            updateResult = ProgressResult::Cancelled;
+            break;
+         }
+         if (updateResult == ProgressResult::Success)
+            updateResult =
+               progress(mixer->MixGetCurrentTime() - mT0, mT1 - mT0);
+      }
+   }
+
+   if (updateResult == ProgressResult::Success ||
+       updateResult == ProgressResult::Stopped) {
+      // The destructor must not finish again
+      initialized = false;
+#ifndef LEGACY_FLAC
+      f.Detach(); // libflac closes the file
+#endif
+      if (!encoder.finish())
+         return ProgressResult::Failed;
+#ifdef LEGACY_FLAC
+      if (!f.Flush() || !f.Close())
+         return ProgressResult::Failed;
+#endif
+   }
+
+   return updateResult;
+}
+
 ProgressResult ExportFLAC::Export(AudacityProject *project,
                         std::unique_ptr<ProgressDialog> &pDialog,
+                        unsigned numChannels,
+                        const wxFileNameWrapper &fName,
+                        bool selectionOnly,
+                        double t0,
+                        double t1,
+                        MixerSpec *mixerSpec,
+                        const Tags *metadata,
+                        int subformat)
+{
+   auto pJob = PrepareExport(project, numChannels, fName, selectionOnly,
+      t0, t1, mixerSpec, metadata, subformat);
+   if (!pJob)
+      return ProgressResult::Cancelled;
+   return RunJob(*pJob, pDialog, fName);
+}
+
+bool ExportFLAC::CanPrepareExport(int WXUNUSED(index))
+{
+   return true;
+}
+
+std::unique_ptr<ExportJob> ExportFLAC::PrepareExport(AudacityProject *project,
                         unsigned numChannels,
                         const wxFileNameWrapper &fName,
                         bool selectionOnly,
@@ -260,14 +389,18 @@ ProgressResult ExportFLAC::Export(AudacityProject *project,
    const auto &tracks = TrackList::Get( *project );
 
    wxLogNull logNo;            // temporarily disable wxWidgets error messages
-   auto updateResult = ProgressResult::Success;
 
    long levelPref;
    FLACLevel.Read().ToLong( &levelPref );
 
    auto bitDepthPref = FLACBitDepth.Read();
 
-   FLAC::Encoder::File encoder;
+   auto pJob = std::make_unique<ExportFLACJob>(
+      selectionOnly
+         ? XO("Exporting the selected audio as FLAC")
+         : XO("Exporting the audio as FLAC"),
+      numChannels, t0, t1);
+   auto &encoder = pJob->encoder;
 
    bool success = true;
    success = success &&
@@ -281,7 +414,7 @@ ProgressResult ExportFLAC::Export(AudacityProject *project,
    if (success && !GetMetadata(project, metadata)) {
       // TODO: more precise message
       ShowExportErrorDialog("FLAC:283");
-      return ProgressResult::Cancelled;
+      return {};
    }
 
    if (success && mMetadata) {
@@ -334,17 +467,17 @@ ProgressResult ExportFLAC::Export(AudacityProject *project,
    if (!success) {
       // TODO: more precise message
       ShowExportErrorDialog("FLAC:336");
-      return ProgressResult::Cancelled;
+      return {};
    }
 
 #ifdef LEGACY_FLAC
    encoder.init();
 #else
-   wxFFile f;     // will be closed when it goes out of scope
+   auto &f = pJob->f;
    const auto path = fName.GetFullPath();
    if (!f.Open(path, wxT("w+b"))) {
       AudacityMessageBox( XO("FLAC export couldn't open %s").Format( path ) );
-      return ProgressResult::Cancelled;
+      return {};
    }
 
    // Even though there is an init() method that takes a filename, use the one that
@@ -355,83 +488,20 @@ ProgressResult ExportFLAC::Export(AudacityProject *project,
       AudacityMessageBox(
          XO("FLAC encoder failed to initialize\nStatus: %d")
             .Format( status ) );
-      return ProgressResult::Cancelled;
+      return {};
    }
 #endif
+   pJob->initialized = true;
 
    mMetadata.reset();
 
-   auto cleanup2 = finally( [&] {
-      if (!(updateResult == ProgressResult::Success ||
-            updateResult == ProgressResult::Stopped)) {
-#ifndef LEGACY_FLAC
-         f.Detach(); // libflac closes the file
-#endif
-         encoder.finish();
-      }
-   } );
-
-   auto mixer = CreateMixer(tracks, selectionOnly,
+   pJob->format = format;
+   pJob->mixer = CreateMixer(tracks, selectionOnly,
                             t0, t1,
                             numChannels, SAMPLES_PER_RUN, false,
                             rate, format, true, mixerSpec);
 
-   ArraysOf<FLAC__int32> tmpsmplbuf{ numChannels, SAMPLES_PER_RUN, true };
-
-   InitProgress( pDialog, fName,
-      selectionOnly
-         ? XO("Exporting the selected audio as FLAC")
-         : XO("Exporting the audio as FLAC") );
-   auto &progress = *pDialog;
-
-   while (updateResult == ProgressResult::Success) {
-      auto samplesThisRun = mixer->Process(SAMPLES_PER_RUN);
-      if (samplesThisRun == 0) { //stop encoding
-         break;
-      }
-      else {
-         for (size_t i = 0; i < numChannels; i++) {
-            samplePtr mixed = mixer->GetBuffer(i);
-            if (format == int24Sample) {
-               for (decltype(samplesThisRun) j = 0; j < samplesThisRun; j++) {
-                  tmpsmplbuf[i][j] = ((int *)mixed)[j];
-               }
-            }
-            else {
-               for (decltype(samplesThisRun) j = 0; j < samplesThisRun; j++) {
-                  tmpsmplbuf[i][j] = ((short *)mixed)[j];
-               }
-            }
-         }
-         if (! encoder.process(
-               reinterpret_cast<FLAC__int32**>( tmpsmplbuf.get() ),
-               samplesThisRun) ) {
-            // TODO: more precise message
-            ShowDiskFullExportErrorDialog();
-            updateResult = ProgressResult::Cancelled;
-            break;
-         }
-         if (updateResult == ProgressResult::Success)
-            updateResult =
-               progress.Update(mixer->MixGetCurrentTime() - t0, t1 - t0);
-      }
-   }
-
-   if (updateResult == ProgressResult::Success ||
-       updateResult == ProgressResult::Stopped) {
-#ifndef LEGACY_FLAC
-      f.Detach(); // libflac closes the file
-#endif
-      if (!encoder.finish())
-         // Do not reassign updateResult, see cleanup2
-         return ProgressResult::Failed;
-#ifdef LEGACY_FLAC
-      if (!f.Flush() || !f.Close())
-         return ProgressResult::Failed;
-#endif
-   }
-
-   return updateResult;
+   return pJob;
 }
 
 void ExportFLAC::OptionsCreate(ShuttleGui &S, int format)
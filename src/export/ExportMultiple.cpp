@@ -18,6 +18,9 @@
 #include "../Audacity.h"
 #include "ExportMultiple.h"
 
+#include <atomic>
+#include <thread>
+
 #include <wx/defs.h>
 #include <wx/button.h>
 #include <wx/checkbox.h>
@@ -36,7 +39,9 @@
 #include <wx/stattext.h>
 #include <wx/textctrl.h>
 #include <wx/textdlg.h>
+#include <wx/utils.h>
 
+#include "../AudacityException.h"
 #include "../FileFormats.h"
 #include "../FileNames.h"
 #include "../LabelTrack.h"
@@ -44,9 +49,11 @@
 #include "../ProjectSettings.h"
 #include "../ProjectWindow.h"
 #include "../Prefs.h"
+#include "../Profiler.h"
 #include "../SelectionState.h"
 #include "../ShuttleGui.h"
 #include "../Tags.h"
+#include "../ThreadPool.h"
 #include "../WaveTrack.h"
 #include "../widgets/HelpSystem.h"
 #include "../widgets/AudacityMessageBox.h"
@@ -69,6 +76,98 @@ namespace {
       double t1;           /**< End time for the export */
       unsigned channels;   /**< Number of channels for ExportMultipleByTrack */
    };  // end of ExportKit declaration
+
+   /** \brief Names one file of an export multiple set, backing up any file
+    * it replaces, and keeps or discards the new file when export ends */
+   class ExportDestination
+   {
+   public:
+      /*! @param pClaimed if not null, paths that other files of the set will
+       use, though they may not exist yet; the paths this destination uses,
+       new or backup, are added to it */
+      ExportDestination(const wxFileName &inName, bool overwrite,
+         FilePaths *pClaimed = nullptr)
+      {
+         const auto taken = [&](const wxFileName &name){
+            return name.FileExists() || (pClaimed &&
+               pClaimed->Index(name.GetFullPath(), false) != wxNOT_FOUND);
+         };
+
+         wxFileName name;
+         if (overwrite) {
+            name = inName;
+            mBackup.Assign(name);
+
+            int suffix = 0;
+            do {
+               mBackup.SetName(name.GetName() +
+                                 wxString::Format(wxT("%d"), suffix));
+               ++suffix;
+            }
+            while (taken(mBackup));
+            ::wxRenameFile(inName.GetFullPath(), mBackup.GetFullPath());
+            if (pClaimed)
+               pClaimed->push_back(mBackup.GetFullPath());
+         }
+         else {
+            name = inName;
+            int i = 2;
+            wxString base(name.GetName());
+            while (taken(name)) {
+               name.SetName(wxString::Format(wxT("%s-%d"), base, i++));
+            }
+         }
+         mFullPath = name.GetFullPath();
+         if (pClaimed && !overwrite)
+            pClaimed->push_back(mFullPath);
+      }
+
+      const wxString &GetFullPath() const { return mFullPath; }
+
+      //! Call after the file is closed
+      void Finish(ProgressResult success)
+      {
+         bool ok =
+            success == ProgressResult::Stopped ||
+            success == ProgressResult::Success;
+         if (mBackup.IsOk()) {
+            if ( ok )
+               // Remove backup
+               ::wxRemoveFile(mBackup.GetFullPath());
+            else {
+               // Restore original
+               ::wxRemoveFile(mFullPath);
+               ::wxRenameFile(mBackup.GetFullPath(), mFullPath);
+            }
+         }
+         else {
+            if ( ! ok )
+               // Remove any new, and only partially written, file.
+               ::wxRemoveFile(mFullPath);
+         }
+      }
+
+   private:
+      wxFileName mBackup;
+      wxString mFullPath;
+   };
+
+   //! State of one file of ExportMultipleDialog::DoExportConcurrently
+   struct ConcurrentExport
+   {
+      size_t index;
+      double duration;
+      std::unique_ptr<ExportDestination> pDestination;
+      std::unique_ptr<ExportJob> pJob;
+      std::thread thread;
+
+      // Written by the thread
+      std::atomic<double> done{ 0.0 };
+      std::atomic<bool> finished{ false };
+      ProgressResult result{ ProgressResult::Cancelled };
+      std::exception_ptr pException;
+   };
+
    /* we are going to want an set of these kits, and don't know how many until
     * runtime. I would dearly like to use a std::vector, but it seems that
     * this isn't done anywhere else in Audacity, presumably for a reason?, so
@@ -857,6 +956,16 @@ ProgressResult ExportMultipleDialog::ExportMultipleByLabel(bool byName,
    /* Go round again and do the exporting (so this run is slow but
     * non-interactive) */
    std::unique_ptr<ProgressDialog> pDialog;
+   if (mPlugins[mPluginIndex]->CanPrepareExport(mSubFormatIndex)) {
+      std::vector<ExportTask> tasks;
+      for (const auto &kit : exportSettings)
+         // Bug 1440 fix.
+         if (!kit.destfile.GetName().empty())
+            tasks.push_back(
+               { channels, kit.destfile, kit.t0, kit.t1, &kit.filetags,
+                 nullptr });
+      return DoExportConcurrently(pDialog, tasks);
+   }
    for (count = 0; count < numFiles; count++) {
       /* get the settings to use for the export from the array */
       activeSetting = exportSettings[count];
@@ -999,6 +1108,19 @@ ProgressResult ExportMultipleDialog::ExportMultipleByTrack(bool byName,
    ExportKit activeSetting;  // pointer to the settings in use for this export
    std::unique_ptr<ProgressDialog> pDialog;
 
+   if (mPlugins[mPluginIndex]->CanPrepareExport(mSubFormatIndex)) {
+      std::vector<ExportTask> tasks;
+      for (auto tr : mTracks->Leaders<WaveTrack>() -
+         (anySolo ? &WaveTrack::GetNotSolo : &WaveTrack::GetMute)) {
+         const auto &kit = exportSettings[count++];
+         if (!kit.destfile.GetName().empty())
+            tasks.push_back(
+               { kit.channels, kit.destfile, kit.t0, kit.t1, &kit.filetags,
+                 tr });
+      }
+      return DoExportConcurrently(pDialog, tasks);
+   }
+
    for (auto tr : mTracks->Leaders<WaveTrack>() - 
       (anySolo ? &WaveTrack::GetNotSolo : &WaveTrack::GetMute)) {
 
@@ -1050,8 +1172,6 @@ ProgressResult ExportMultipleDialog::DoExport(std::unique_ptr<ProgressDialog> &p
                               double t1,
                               const Tags &tags)
 {
-   wxFileName name;
-
    wxLogDebug(wxT("Doing multiple Export: File name \"%s\""), (inName.GetFullName()));
    wxLogDebug(wxT("Channels: %i, Start: %lf, End: %lf "), channels, t0, t1);
    if (selectedOnly)
@@ -1059,51 +1179,13 @@ ProgressResult ExportMultipleDialog::DoExport(std::unique_ptr<ProgressDialog> &p
    else
       wxLogDebug(wxT("Whole Project"));
 
-   wxFileName backup;
-   if (mOverwrite->GetValue()) {
-      name = inName;
-      backup.Assign(name);
-
-      int suffix = 0;
-      do {
-         backup.SetName(name.GetName() +
-                           wxString::Format(wxT("%d"), suffix));
-         ++suffix;
-      }
-      while (backup.FileExists());
-      ::wxRenameFile(inName.GetFullPath(), backup.GetFullPath());
-   }
-   else {
-      name = inName;
-      int i = 2;
-      wxString base(name.GetName());
-      while (name.FileExists()) {
-         name.SetName(wxString::Format(wxT("%s-%d"), base, i++));
-      }
-   }
+   ExportDestination destination{ inName, mOverwrite->GetValue() };
 
    ProgressResult success = ProgressResult::Cancelled;
-   const wxString fullPath{name.GetFullPath()};
+   const wxString fullPath{ destination.GetFullPath() };
 
    auto cleanup = finally( [&] {
-      bool ok =
-         success == ProgressResult::Stopped ||
-         success == ProgressResult::Success;
-      if (backup.IsOk()) {
-         if ( ok )
-            // Remove backup
-            ::wxRemoveFile(backup.GetFullPath());
-         else {
-            // Restore original
-            ::wxRemoveFile(fullPath);
-            ::wxRenameFile(backup.GetFullPath(), fullPath);
-         }
-      }
-      else {
-         if ( ! ok )
-            // Remove any new, and only partially written, file.
-            ::wxRemoveFile(fullPath);
-      }
+      destination.Finish(success);
    } );
 
    // Call the format export routine
@@ -1128,6 +1210,188 @@ ProgressResult ExportMultipleDialog::DoExport(std::unique_ptr<ProgressDialog> &p
    return success;
 }
 
+ProgressResult ExportMultipleDialog::DoExportConcurrently(
+   std::unique_ptr<ProgressDialog> &pDialog,
+   const std::vector<ExportTask> &tasks)
+{
+   const auto pPlugin = mPlugins[mPluginIndex];
+   const bool overwrite = mOverwrite->GetValue();
+
+   double total = 0;
+   for (const auto &task : tasks)
+      total += task.t1 - task.t0;
+
+   // Mixing and encoding of each file are independent of the others
+   const auto nThreads =
+      std::min(tasks.size(), ThreadPool::HardwareThreadCount());
+
+   // Read by the threads, so that Stop or Cancel applies to all files
+   std::atomic<ProgressResult> request{ ProgressResult::Success };
+   auto ok = ProgressResult::Success;
+   bool failed = false;
+
+   std::vector< std::unique_ptr<ConcurrentExport> > running;
+   auto cleanup = finally( [&] {
+      // Don't leave threads running if an exception escapes
+      request.store(ProgressResult::Cancelled);
+      for (auto &pExport : running)
+         if (pExport->thread.joinable())
+            pExport->thread.join();
+   } );
+
+   // Choose every file name, and back up every file to be replaced, before
+   // any export begins.  Files are written and kept or restored out of
+   // order, so no new or backup file may take a path that another needs.
+   std::vector< std::unique_ptr<ExportDestination> > destinations;
+   {
+      FilePaths claimed;
+      if (overwrite)
+         // Not available for backups
+         for (const auto &task : tasks)
+            claimed.push_back(task.name.GetFullPath());
+      for (const auto &task : tasks)
+         destinations.push_back(std::make_unique<ExportDestination>(
+            task.name, overwrite, &claimed));
+   }
+   auto restore = finally( [&] {
+      // Put back the files replaced by any that were never begun
+      for (auto &pDestination : destinations)
+         if (pDestination)
+            pDestination->Finish(ProgressResult::Cancelled);
+   } );
+
+   // In the order of the tasks, whatever order the files finish in
+   FilePaths exported(tasks.size());
+   double finished = 0;
+   size_t next = 0;
+
+   while (true) {
+      // Prepare more files while threads are free
+      while (!failed && next < tasks.size() && running.size() < nThreads &&
+             request.load() == ProgressResult::Success) {
+         const auto &task = tasks[next];
+         auto pExport = std::make_unique<ConcurrentExport>();
+         pExport->index = next++;
+         pExport->duration = task.t1 - task.t0;
+         pExport->pDestination = std::move(destinations[pExport->index]);
+         {
+            // The mixer remembers the tracks selected now
+            SelectionStateChanger changer{ mSelectionState, *mTracks };
+            if (task.track)
+               for (auto channel : TrackList::Channels(task.track))
+                  channel->SetSelected(true);
+            pExport->pJob = pPlugin->PrepareExport(mProject, task.channels,
+               pExport->pDestination->GetFullPath(), task.track != nullptr,
+               task.t0, task.t1, nullptr, task.tags, mSubFormatIndex);
+         }
+         if (!pExport->pJob) {
+            // The user was already told why
+            pExport->pDestination->Finish(ProgressResult::Cancelled);
+            ok = ProgressResult::Cancelled;
+            failed = true;
+            break;
+         }
+
+         if (!pDialog)
+            ExportPlugin::InitProgress(pDialog,
+               XO("Export Multiple"), pExport->pJob->GetMessage());
+
+         auto &current = *pExport;
+         current.thread = std::thread{ [&current, &request]{
+            Profiler::SetThreadName("Export");
+            try {
+               current.result = current.pJob->Run(
+                  [&](double done, double){
+                     current.done.store(done, std::memory_order_relaxed);
+                     return request.load(std::memory_order_relaxed);
+                  } );
+            }
+            catch ( ... ) {
+               current.result = ProgressResult::Failed;
+               current.pException = std::current_exception();
+            }
+            current.finished.store(true, std::memory_order_release);
+         } };
+         running.push_back(std::move(pExport));
+      }
+
+      if (running.empty()) {
+         if (request.load() == ProgressResult::Stopped &&
+             !failed && next < tasks.size()) {
+            AudacityMessageDialog dlgMessage(
+               nullptr,
+               XO("Continue to export remaining files?"),
+               XO("Export"),
+               wxYES_NO | wxNO_DEFAULT | wxICON_WARNING);
+            if (dlgMessage.ShowModal() == wxID_YES ) {
+               request.store(ProgressResult::Success);
+               pDialog->Reinit();
+               continue;
+            }
+         }
+         break;
+      }
+
+      double done = finished;
+      for (const auto &pExport : running)
+         done += std::min(pExport->duration,
+            pExport->done.load(std::memory_order_relaxed));
+      const auto result = pDialog->Update(done, total);
+      if (result == ProgressResult::Cancelled)
+         request.store(result);
+      else if (result != ProgressResult::Success) {
+         // Don't let Stop override Cancel
+         auto expected = ProgressResult::Success;
+         request.compare_exchange_strong(expected, result);
+      }
+
+      bool any = false;
+      for (auto iter = running.begin(); iter != running.end();) {
+         auto &current = **iter;
+         if (!current.finished.load(std::memory_order_acquire)) {
+            ++iter;
+            continue;
+         }
+         any = true;
+         current.thread.join();
+
+         if (current.pException)
+            GuardedCall( [&]{ std::rethrow_exception(current.pException); } );
+         current.pJob->ReportError();
+         // Close the file before it is kept or removed
+         current.pJob.reset();
+         current.pDestination->Finish(current.result);
+
+         if (current.result == ProgressResult::Success ||
+             current.result == ProgressResult::Stopped)
+            exported[current.index] = current.pDestination->GetFullPath();
+         else if (request.load() == ProgressResult::Success) {
+            // Failed by itself, not by the user's request; finish the
+            // others already begun but begin no more
+            ok = current.result;
+            failed = true;
+         }
+
+         finished += current.duration;
+         iter = running.erase(iter);
+      }
+      if (!any)
+         wxMilliSleep(50);
+   }
+
+   for (const auto &path : exported)
+      if (!path.empty())
+         mExported.push_back(path);
+
+   if (request.load() != ProgressResult::Success)
+      ok = request.load();
+
+   Refresh();
+   Update();
+
+   return ok;
+}
+
 wxString ExportMultipleDialog::MakeFileName(const wxString &input)
 {
    wxString newname = input; // name we are generating
@@ -79,6 +79,29 @@ private:
                  double t0,
                  double t1,
                  const Tags &tags);
+
+   //! One file of a set for DoExportConcurrently
+   struct ExportTask
+   {
+      unsigned channels;
+      wxFileName name;
+      double t0;
+      double t1;
+      const Tags *tags;
+      //! If not null, export only the channels of this track
+      Track *track;
+   };
+
+   /** \brief Export a set of files, several at once, each with its own mixer
+    * and encoder on its own thread
+    *
+    * Requires that the plug-in can prepare exports.  Files are prepared in
+    * order on the main thread, as threads become free, so they are named as
+    * DoExport would name them one at a time.
+    * @return as for DoExport, for the whole set */
+   ProgressResult DoExportConcurrently(std::unique_ptr<ProgressDialog> &pDialog,
+                 const std::vector<ExportTask> &tasks);
+
    /** \brief Takes an arbitrary text string and converts it to a form that can
     * be used as a file name, if necessary prompting the user to edit the file
     * name produced */
@@ -395,12 +395,24 @@ public:
                          MixerSpec *mixerSpec = NULL,
                          const Tags *metadata = NULL,
                          int subformat = 0) override;
+   bool CanPrepareExport(int index) override;
+   std::unique_ptr<ExportJob> PrepareExport(AudacityProject *project,
+                         unsigned channels,
+                         const wxFileNameWrapper &fName,
+                         bool selectedOnly,
+                         double t0,
+                         double t1,
+                         MixerSpec *mixerSpec = NULL,
+                         const Tags *metadata = NULL,
+                         int subformat = 0) override;
    // optional
    wxString GetFormat(int index) override;
    FileExtension GetExtension(int index) override;
    unsigned GetMaxChannels(int index) override;
 
 private:
+   friend class ExportPCMJob;
+
    void ReportTooBigError(wxWindow * pParent);
    ArrayOf<char> AdjustString(const wxString & wxStr, int sf_format);
    bool AddStrings(AudacityProject *project, SNDFILE *sf, const Tags *tags, int sf_format);
@@ -454,13 +466,153 @@ void ExportPCM::ReportTooBigError(wxWindow * pParent)
 #endif
 }
 
+//----------------------------------------------------------------------------
+// ExportPCMJob
+//----------------------------------------------------------------------------
+
+class ExportPCMJob final : public ExportJob
+{
+public:
+   ExportPCMJob(ExportPCM &plugin, const TranslatableString &message,
+      const wxFileNameWrapper &fName, const Tags &metadata,
+      int sf_format, double t0, double t1)
+      : ExportJob{ message }
+      , mPlugin{ plugin }
+      , mFileName{ fName }
+      , mMetadata{ metadata }
+      , mSfFormat{ sf_format }
+      , mT0{ t0 }
+      , mT1{ t1 }
+   {}
+
+   ProgressResult Run(const ProgressCallback &progress) override;
+
+   // Closed in reverse order: sf wraps f
+   wxFile f;
+   SFFile sf;
+   std::unique_ptr<PipelinedMixer> mixer;
+   sampleFormat format;
+   size_t maxBlockLen;
+
+private:
+   ExportPCM &mPlugin;
+   const wxFileNameWrapper mFileName;
+   const Tags mMetadata;
+   const int mSfFormat;
+   const double mT0, mT1;
+};
+
+ProgressResult ExportPCMJob::Run(const ProgressCallback &progress)
+{
+   const auto fileFormat = mSfFormat & SF_FORMAT_TYPEMASK;
+   auto updateResult = ProgressResult::Success;
+
+   while (updateResult == ProgressResult::Success) {
+      sf_count_t samplesWritten;
+      size_t numSamples = mixer->Process(maxBlockLen);
+
+      if (numSamples == 0)
+         break;
+
+      samplePtr mixed = mixer->GetBuffer();
+
+      if (format == int16Sample)
+         samplesWritten = SFCall<sf_count_t>(sf_writef_short, sf.get(), (short *)mixed, numSamples);
+      else
+         samplesWritten = SFCall<sf_count_t>(sf_writef_float, sf.get(), (float *)mixed, numSamples);
+
+      if (static_cast<size_t>(samplesWritten) != numSamples) {
+         char buffer2[1000];
+         sf_error_str(sf.get(), buffer2, 1000);
+         //Used to give this error message
+#if 0
+         AudacityMessageBox(
+            XO(
+            /* i18n-hint: %s will be the error message from libsndfile, which
+             * is usually something unhelpful (and untranslated) like "system
+             * error" */
+"Error while writing %s file (disk full?).\nLibsndfile says \"%s\"")
+               .Format( formatStr, wxString::FromAscii(buffer2) ));
+#else
+         // But better to give the same error message as for
+         // other cases of disk exhaustion.
+         // The thrown exception doesn't escape but GuardedCall
+         // will enqueue a message.
+         const auto &fName = mFileName;
+         GuardedCall([&fName]{
+            throw FileException{
+               FileException::Cause::Write, fName }; });
+#endif
+         updateResult = ProgressResult::Cancelled;
+         break;
+      }
+
+      updateResult = progress(mixer->MixGetCurrentTime() - mT0, mT1 - mT0);
+   }
+   mixer.reset();
+
+   // Install the WAV metata in a "LIST" chunk at the end of the file
+   if (updateResult == ProgressResult::Success ||
+       updateResult == ProgressResult::Stopped) {
+      if (fileFormat == SF_FORMAT_WAV ||
+          fileFormat == SF_FORMAT_WAVEX) {
+         if (!mPlugin.AddStrings(nullptr, sf.get(), &mMetadata, mSfFormat)) {
+            // TODO: more precise message
+            SetError([]{ ShowExportErrorDialog("PCM:675"); });
+            return ProgressResult::Cancelled;
+         }
+      }
+      if (0 != sf.close()) {
+         // TODO: more precise message
+         SetError([]{ ShowExportErrorDialog("PCM:681"); });
+         return ProgressResult::Cancelled;
+      }
+      f.Close();
+   }
+
+   if (updateResult == ProgressResult::Success ||
+       updateResult == ProgressResult::Stopped)
+      if ((fileFormat == SF_FORMAT_AIFF) ||
+          (fileFormat == SF_FORMAT_WAV))
+         // Note: file has closed, and gets reopened and closed again here:
+         if (!mPlugin.AddID3Chunk(mFileName, &mMetadata, mSfFormat) ) {
+            // TODO: more precise message
+            SetError([]{ ShowExportErrorDialog("PCM:694"); });
+            return ProgressResult::Cancelled;
+         }
+
+   return updateResult;
+}
+
+ProgressResult ExportPCM::Export(AudacityProject *project,
+                                 std::unique_ptr<ProgressDialog> &pDialog,
+                                 unsigned numChannels,
+                                 const wxFileNameWrapper &fName,
+                                 bool selectionOnly,
+                                 double t0,
+                                 double t1,
+                                 MixerSpec *mixerSpec,
+                                 const Tags *metadata,
+                                 int subformat)
+{
+   auto pJob = PrepareExport(project, numChannels, fName, selectionOnly,
+      t0, t1, mixerSpec, metadata, subformat);
+   if (!pJob)
+      return ProgressResult::Cancelled;
+   return RunJob(*pJob, pDialog, fName);
+}
+
+bool ExportPCM::CanPrepareExport(int WXUNUSED(index))
+{
+   return true;
+}
+
 /**
  *
  * @param subformat Control whether we are doing a "preset" export to a popular
  * file type, or giving the user full control over libsndfile.
  */
-ProgressResult ExportPCM::Export(AudacityProject *project,
-                                 std::unique_ptr<ProgressDialog> &pDialog,
+std::unique_ptr<ExportJob> ExportPCM::PrepareExport(AudacityProject *project,
                                  unsigned numChannels,
                                  const wxFileNameWrapper &fName,
                                  bool selectionOnly,
@@ -508,194 +660,119 @@ ProgressResult ExportPCM::Export(AudacityProject *project,
    }
 
    int fileFormat = sf_format & SF_FORMAT_TYPEMASK;
-   
-   auto updateResult = ProgressResult::Success;
-   {
-      wxFile f;   // will be closed when it goes out of scope
-      SFFile       sf; // wraps f
-
-      wxString     formatStr;
-      SF_INFO      info;
-      //int          err;
 
-      //This whole operation should not occur while a file is being loaded on OD,
-      //(we are worried about reading from a file being written to,) so we block.
-      //Furthermore, we need to do this because libsndfile is not threadsafe.
-      formatStr = SFCall<wxString>(sf_header_name, fileFormat);
+   wxString     formatStr;
+   SF_INFO      info;
+   //int          err;
 
-      // Use libsndfile to export file
+   //This whole operation should not occur while a file is being loaded on OD,
+   //(we are worried about reading from a file being written to,) so we block.
+   //Furthermore, we need to do this because libsndfile is not threadsafe.
+   formatStr = SFCall<wxString>(sf_header_name, fileFormat);
 
-      info.samplerate = (unsigned int)(rate + 0.5);
-      info.frames = (unsigned int)((t1 - t0)*rate + 0.5);
-      info.channels = numChannels;
-      info.format = sf_format;
-      info.sections = 1;
-      info.seekable = 0;
+   // Use libsndfile to export file
 
-      // Bug 46.  Trap here, as sndfile.c does not trap it properly.
-      if( (numChannels != 1) && ((sf_format & SF_FORMAT_SUBMASK) == SF_FORMAT_GSM610) )
-      {
-         AudacityMessageBox( XO("GSM 6.10 requires mono") );
-         return ProgressResult::Cancelled;
-      }
+   info.samplerate = (unsigned int)(rate + 0.5);
+   info.frames = (unsigned int)((t1 - t0)*rate + 0.5);
+   info.channels = numChannels;
+   info.format = sf_format;
+   info.sections = 1;
+   info.seekable = 0;
 
-      if (sf_format == SF_FORMAT_WAVEX + SF_FORMAT_GSM610) {
-         AudacityMessageBox(
-            XO("WAVEX and GSM 6.10 formats are not compatible") );
-         return ProgressResult::Cancelled;
-      }
+   // Bug 46.  Trap here, as sndfile.c does not trap it properly.
+   if( (numChannels != 1) && ((sf_format & SF_FORMAT_SUBMASK) == SF_FORMAT_GSM610) )
+   {
+      AudacityMessageBox( XO("GSM 6.10 requires mono") );
+      return {};
+   }
 
-      // If we can't export exactly the format they requested,
-      // try the default format for that header type...
-      // 
-      // LLL: I don't think this is valid since libsndfile checks
-      // for all allowed subtypes explicitly and doesn't provide
-      // for an unspecified subtype.
-      if (!sf_format_check(&info))
-         info.format = (info.format & SF_FORMAT_TYPEMASK);
-      if (!sf_format_check(&info)) {
-         AudacityMessageBox( XO("Cannot export audio in this format.") );
-         return ProgressResult::Cancelled;
-      }
-      const auto path = fName.GetFullPath();
-      if (f.Open(path, wxFile::write)) {
-         // Even though there is an sf_open() that takes a filename, use the one that
-         // takes a file descriptor since wxWidgets can open a file with a Unicode name and
-         // libsndfile can't (under Windows).
-         sf.reset(SFCall<SNDFILE*>(sf_open_fd, f.fd(), SFM_WRITE, &info, FALSE));
-         //add clipping for integer formats.  We allow floats to clip.
-         sf_command(sf.get(), SFC_SET_CLIPPING, NULL, sf_subtype_is_integer(sf_format)?SF_TRUE:SF_FALSE) ;
-      }
+   if (sf_format == SF_FORMAT_WAVEX + SF_FORMAT_GSM610) {
+      AudacityMessageBox(
+         XO("WAVEX and GSM 6.10 formats are not compatible") );
+      return {};
+   }
 
-      if (!sf) {
-         AudacityMessageBox( XO("Cannot export audio to %s").Format( path ) );
-         return ProgressResult::Cancelled;
-      }
-      // Retrieve tags if not given a set
-      if (metadata == NULL)
-         metadata = &Tags::Get( *project );
-
-      // Install the meta data at the beginning of the file (except for
-      // WAV and WAVEX formats)
-      if (fileFormat != SF_FORMAT_WAV &&
-          fileFormat != SF_FORMAT_WAVEX) {
-         if (!AddStrings(project, sf.get(), metadata, sf_format)) {
-            return ProgressResult::Cancelled;
-         }
-      }
+   // If we can't export exactly the format they requested,
+   // try the default format for that header type...
+   // 
+   // LLL: I don't think this is valid since libsndfile checks
+   // for all allowed subtypes explicitly and doesn't provide
+   // for an unspecified subtype.
+   if (!sf_format_check(&info))
+      info.format = (info.format & SF_FORMAT_TYPEMASK);
+   if (!sf_format_check(&info)) {
+      AudacityMessageBox( XO("Cannot export audio in this format.") );
+      return {};
+   }
 
-      sampleFormat format;
-      if (sf_subtype_more_than_16_bits(info.format))
-         format = floatSample;
-      else
-         format = int16Sample;
-
-      // Bug 2200
-      // Only trap size limit for file types we know have an upper size limit.
-      // The error message mentions aiff and wav.
-      if( (fileFormat == SF_FORMAT_WAV) ||
-          (fileFormat == SF_FORMAT_WAVEX) ||
-          (fileFormat == SF_FORMAT_AIFF ))
+   // Bug 2200
+   // Only trap size limit for file types we know have an upper size limit.
+   // The error message mentions aiff and wav.
+   if( (fileFormat == SF_FORMAT_WAV) ||
+       (fileFormat == SF_FORMAT_WAVEX) ||
+       (fileFormat == SF_FORMAT_AIFF ))
+   {
+      float sampleCount = (float)(t1-t0)*rate*info.channels;
+      float byteCount = sampleCount * sf_subtype_bytes_per_sample( info.format);
+      // Test for 4 Gibibytes, rather than 4 Gigabytes
+      if( byteCount > 4.295e9)
       {
-         float sampleCount = (float)(t1-t0)*rate*info.channels;
-         float byteCount = sampleCount * sf_subtype_bytes_per_sample( info.format);
-         // Test for 4 Gibibytes, rather than 4 Gigabytes
-         if( byteCount > 4.295e9)
-         {
-            ReportTooBigError( wxTheApp->GetTopWindow() );
-            return ProgressResult::Failed;
-         }
+         ReportTooBigError( wxTheApp->GetTopWindow() );
+         return {};
       }
-      size_t maxBlockLen = 44100 * 5;
+   }
 
-      {
-         wxASSERT(info.channels >= 0);
-         auto mixer = CreateMixer(tracks, selectionOnly,
-                                  t0, t1,
-                                  info.channels, maxBlockLen, true,
-                                  rate, format, true, mixerSpec);
-
-         InitProgress( pDialog, fName,
-            (selectionOnly
-               ? XO("Exporting the selected audio as %s")
-               : XO("Exporting the audio as %s"))
-               .Format( formatStr ) );
-         auto &progress = *pDialog;
-
-         while (updateResult == ProgressResult::Success) {
-            sf_count_t samplesWritten;
-            size_t numSamples = mixer->Process(maxBlockLen);
-
-            if (numSamples == 0)
-               break;
-
-            samplePtr mixed = mixer->GetBuffer();
-
-            if (format == int16Sample)
-               samplesWritten = SFCall<sf_count_t>(sf_writef_short, sf.get(), (short *)mixed, numSamples);
-            else
-               samplesWritten = SFCall<sf_count_t>(sf_writef_float, sf.get(), (float *)mixed, numSamples);
-
-            if (static_cast<size_t>(samplesWritten) != numSamples) {
-               char buffer2[1000];
-               sf_error_str(sf.get(), buffer2, 1000);
-               //Used to give this error message
-#if 0
-               AudacityMessageBox(
-                  XO(
-                  /* i18n-hint: %s will be the error message from libsndfile, which
-                   * is usually something unhelpful (and untranslated) like "system
-                   * error" */
-"Error while writing %s file (disk full?).\nLibsndfile says \"%s\"")
-                     .Format( formatStr, wxString::FromAscii(buffer2) ));
-#else
-               // But better to give the same error message as for
-               // other cases of disk exhaustion.
-               // The thrown exception doesn't escape but GuardedCall
-               // will enqueue a message.
-               GuardedCall([&fName]{
-                  throw FileException{
-                     FileException::Cause::Write, fName }; });
-#endif
-               updateResult = ProgressResult::Cancelled;
-               break;
-            }
-            
-            updateResult = progress.Update(mixer->MixGetCurrentTime() - t0, t1 - t0);
-         }
-      }
-      
-      // Install the WAV metata in a "LIST" chunk at the end of the file
-      if (updateResult == ProgressResult::Success ||
-          updateResult == ProgressResult::Stopped) {
-         if (fileFormat == SF_FORMAT_WAV ||
-             fileFormat == SF_FORMAT_WAVEX) {
-            if (!AddStrings(project, sf.get(), metadata, sf_format)) {
-               // TODO: more precise message
-               ShowExportErrorDialog("PCM:675");
-               return ProgressResult::Cancelled;
-            }
-         }
-         if (0 != sf.close()) {
-            // TODO: more precise message
-            ShowExportErrorDialog("PCM:681");
-            return ProgressResult::Cancelled;
-         }
+   // Retrieve tags if not given a set
+   if (metadata == NULL)
+      metadata = &Tags::Get( *project );
+
+   auto pJob = std::make_unique<ExportPCMJob>(*this,
+      (selectionOnly
+         ? XO("Exporting the selected audio as %s")
+         : XO("Exporting the audio as %s"))
+         .Format( formatStr ),
+      fName, *metadata, sf_format, t0, t1);
+   auto &f = pJob->f;
+   auto &sf = pJob->sf;
+
+   const auto path = fName.GetFullPath();
+   if (f.Open(path, wxFile::write)) {
+      // Even though there is an sf_open() that takes a filename, use the one that
+      // takes a file descriptor since wxWidgets can open a file with a Unicode name and
+      // libsndfile can't (under Windows).
+      sf.reset(SFCall<SNDFILE*>(sf_open_fd, f.fd(), SFM_WRITE, &info, FALSE));
+      //add clipping for integer formats.  We allow floats to clip.
+      sf_command(sf.get(), SFC_SET_CLIPPING, NULL, sf_subtype_is_integer(sf_format)?SF_TRUE:SF_FALSE) ;
+   }
+
+   if (!sf) {
+      AudacityMessageBox( XO("Cannot export audio to %s").Format( path ) );
+      return {};
+   }
+
+   // Install the meta data at the beginning of the file (except for
+   // WAV and WAVEX formats)
+   if (fileFormat != SF_FORMAT_WAV &&
+       fileFormat != SF_FORMAT_WAVEX) {
+      if (!AddStrings(project, sf.get(), metadata, sf_format)) {
+         return {};
       }
    }
 
-   if (updateResult == ProgressResult::Success ||
-       updateResult == ProgressResult::Stopped)
-      if ((fileFormat == SF_FORMAT_AIFF) ||
-          (fileFormat == SF_FORMAT_WAV))
-         // Note: file has closed, and gets reopened and closed again here:
-         if (!AddID3Chunk(fName, metadata, sf_format) ) {
-            // TODO: more precise message
-            ShowExportErrorDialog("PCM:694");
-            return ProgressResult::Cancelled;
-         }
+   if (sf_subtype_more_than_16_bits(info.format))
+      pJob->format = floatSample;
+   else
+      pJob->format = int16Sample;
 
-   return updateResult;
+   pJob->maxBlockLen = 44100 * 5;
+
+   wxASSERT(info.channels >= 0);
+   pJob->mixer = CreateMixer(tracks, selectionOnly,
+                             t0, t1,
+                             info.channels, pJob->maxBlockLen, true,
+                             rate, pJob->format, true, mixerSpec);
+
+   return pJob;
 }
 
 ArrayOf<char> ExportPCM::AdjustString(const wxString & wxStr, int sf_format)
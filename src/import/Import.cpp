@@ -52,6 +52,7 @@ ImportLOF.cpp, and ImportAUP.cpp.
 #include "../FileNames.h"
 #include "../ShuttleGui.h"
 #include "../Project.h"
+#include "../SampleBlock.h"
 #include "../WaveTrack.h"
 
 #include "../Prefs.h"
@@ -618,7 +619,10 @@ bool Importer::Import( AudacityProject &project,
          else
             inFile->SetStreamUsage(0,TRUE);
 
+         // Store the many new sample blocks in fewer database commits
+         auto batch = trackFactory->GetSampleBlockFactory()->BeginBatch();
          auto res = inFile->Import(trackFactory, tracks, tags);
+         batch.reset();
 
          if (res == ProgressResult::Success || res == ProgressResult::Stopped)
          {
@@ -47,12 +47,22 @@
 #endif
 
 #include "../FileFormats.h"
+#include "../MemoryMappedFile.h"
+#include "../PCMFileReference.h"
 #include "../Prefs.h"
+#include "../Profiler.h"
+#include "../SampleBlock.h"
 #include "../ShuttleGui.h"
+#include "../ThreadPool.h"
 #include "../WaveTrack.h"
 #include "ImportPlugin.h"
 
 #include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 #ifdef USE_LIBID3TAG
    #include <id3tag.h>
@@ -84,6 +94,7 @@ public:
       const FilePath &Filename, AudacityProject*) override;
 };
 
+using NewChannelGroup = std::vector< std::shared_ptr<WaveTrack> >;
 
 class PCMImportFileHandle final : public ImportFileHandle
 {
@@ -108,6 +119,16 @@ public:
    {}
 
 private:
+   //! Append straight from the mapped file, without reading through libsndfile
+   ProgressResult ImportMapped(const MemoryMappedFile &mapping,
+      const PCMFileReference::Layout &layout, NewChannelGroup &channels);
+
+   //! Append blocks that read the file on demand, until the project copies
+   //! them in the background
+   ProgressResult ImportReference(
+      const std::shared_ptr<const PCMFileReference> &pReference,
+      SampleBlockFactory &factory, NewChannelGroup &channels);
+
    SFFile                mFile;
    const SF_INFO         mInfo;
    sampleFormat          mFormat;
@@ -288,7 +309,283 @@ struct id3_tag_deleter {
 using id3_tag_holder = std::unique_ptr<id3_tag, id3_tag_deleter>;
 #endif
 
-using NewChannelGroup = std::vector< std::shared_ptr<WaveTrack> >;
+// Appends the channels of each block at once
+static ThreadPool &ImportThreadPool()
+{
+   static ThreadPool pool{ ThreadPool::HardwareThreadCount() };
+   return pool;
+}
+
+namespace {
+
+unsigned ReadUInt(const unsigned char *p, unsigned bytes, bool bigEndian)
+{
+   unsigned result = 0;
+   for (unsigned ii = 0; ii < bytes; ++ii)
+      result |= unsigned(p[bigEndian ? ii : bytes - 1 - ii]) << (8 * (bytes - 1 - ii));
+   return result;
+}
+
+//! Find the samples of an uncompressed WAV or AIFF file, which libsndfile
+//! has already opened and described
+/*! @return false for other formats, or anything unexpected, so that the
+ file is read through libsndfile instead */
+bool FindMappedSamples(const MemoryMappedFile &mapping, const SF_INFO &info,
+   PCMFileReference::Layout &result)
+{
+   const auto data = mapping.Data();
+   const auto size = mapping.Size();
+   if (!data || size < 12 || info.channels < 1 || info.frames < 0)
+      return false;
+
+   unsigned bytes;
+   switch (info.format & SF_FORMAT_SUBMASK) {
+      case SF_FORMAT_PCM_16: bytes = 2; break;
+      case SF_FORMAT_PCM_24: bytes = 3; break;
+      case SF_FORMAT_PCM_32:
+      case SF_FORMAT_FLOAT: bytes = 4; break;
+      default: return false;
+   }
+   const bool isFloat = (info.format & SF_FORMAT_SUBMASK) == SF_FORMAT_FLOAT;
+
+   // Plain RIFF WAV files are little endian, and AIFF (but not AIFC) files
+   // are big endian
+   const auto type = info.format & SF_FORMAT_TYPEMASK;
+   bool bigEndian;
+   if ((type == SF_FORMAT_WAV || type == SF_FORMAT_WAVEX) &&
+       !memcmp(data, "RIFF", 4) && !memcmp(data + 8, "WAVE", 4))
+      bigEndian = false;
+   else if (type == SF_FORMAT_AIFF && !isFloat &&
+       !memcmp(data, "FORM", 4) && !memcmp(data + 8, "AIFF", 4))
+      bigEndian = true;
+   else
+      return false;
+
+   // Check the format chunk against what libsndfile found, then find the
+   // data chunk
+   bool formatChecked = false;
+   unsigned long long pos = 12;
+   while (pos + 8 <= size) {
+      const auto chunk = data + pos;
+      const unsigned long long chunkSize = ReadUInt(chunk + 4, 4, bigEndian);
+      const auto end = pos + 8 + chunkSize;
+      if (!bigEndian && !memcmp(chunk, "fmt ", 4) && end <= size &&
+          chunkSize >= 16) {
+         // nBlockAlign is the size of a frame
+         if (ReadUInt(chunk + 8 + 12, 2, false) != bytes * info.channels)
+            return false;
+         formatChecked = true;
+      }
+      else if (bigEndian && !memcmp(chunk, "COMM", 4) && end <= size &&
+          chunkSize >= 18) {
+         if (ReadUInt(chunk + 8, 2, true) != unsigned(info.channels) ||
+             (ReadUInt(chunk + 8 + 6, 2, true) + 7) / 8 != bytes)
+            return false;
+         formatChecked = true;
+      }
+      else if (!memcmp(chunk, bigEndian ? "SSND" : "data", 4)) {
+         auto offset = pos + 8;
+         if (bigEndian) {
+            // The sound data chunk begins with an offset and a block size
+            if (offset + 8 > size)
+               return false;
+            offset += 8 + ReadUInt(chunk + 8, 4, true);
+         }
+         const auto needed =
+            static_cast<unsigned long long>(info.frames) * info.channels * bytes;
+         if (!formatChecked || offset > size || size - offset < needed)
+            return false;
+         result = { offset, bytes, isFloat, bigEndian,
+            unsigned(info.channels),
+            static_cast<unsigned long long>(info.frames) };
+         return true;
+      }
+      // Chunks are padded to even sizes
+      pos = end + (chunkSize & 1);
+   }
+   return false;
+}
+
+//! Reads the blocks of one file, in order, on one thread that lives as long
+//! as the import, into a fixed ring of buffers, so that reading stays at
+//! most a ring's length ahead of the appending
+class BlockReader
+{
+public:
+   //! @param read fills a buffer with the next block and returns its length,
+   //! 0 at the end of the file
+   BlockReader(SampleBuffer *buffers, size_t nBuffers,
+      std::function< size_t(samplePtr) > read)
+      : mBuffers{ buffers }
+      , mLengths( nBuffers )
+      , mRead{ std::move(read) }
+   {
+      mThread = std::thread{ [this]{ Run(); } };
+   }
+
+   ~BlockReader()
+   {
+      {
+         std::lock_guard<std::mutex> lock{ mMutex };
+         mStop = true;
+      }
+      mChanged.notify_all();
+      mThread.join();
+   }
+
+   //! Give back the buffer from the previous call, and wait for the next
+   //! block
+   /*! @return its length, 0 at the end of the file; rethrows any exception
+    from reading */
+   size_t Next(samplePtr &data)
+   {
+      std::unique_lock<std::mutex> lock{ mMutex };
+      if (mTaken) {
+         ++mConsumed;
+         mChanged.notify_all();
+      }
+      mChanged.wait(lock, [&]{ return mFilled > mConsumed; });
+      mTaken = true;
+      if (mException)
+         std::rethrow_exception(mException);
+      const auto index = mConsumed % mLengths.size();
+      data = mBuffers[index].ptr();
+      return mLengths[index];
+   }
+
+private:
+   void Run()
+   {
+      Profiler::SetThreadName("Import read");
+      const auto nBuffers = mLengths.size();
+      for (size_t ii = 0;; ++ii) {
+         {
+            std::unique_lock<std::mutex> lock{ mMutex };
+            mChanged.wait(lock, [&]{
+               return mStop || ii - mConsumed < nBuffers; });
+            if (mStop)
+               return;
+         }
+
+         size_t length = 0;
+         std::exception_ptr exception;
+         try {
+            length = mRead(mBuffers[ii % nBuffers].ptr());
+         }
+         catch (...) {
+            exception = std::current_exception();
+         }
+
+         {
+            std::lock_guard<std::mutex> lock{ mMutex };
+            mLengths[ii % nBuffers] = length;
+            mException = exception;
+            ++mFilled;
+         }
+         mChanged.notify_all();
+         if (length == 0 || exception)
+            return;
+      }
+   }
+
+   SampleBuffer *const mBuffers;
+   std::vector<size_t> mLengths;
+   const std::function< size_t(samplePtr) > mRead;
+   std::thread mThread;
+
+   std::mutex mMutex;
+   std::condition_variable mChanged;
+   // These are guarded by mMutex
+   size_t mFilled{ 0 };
+   size_t mConsumed{ 0 };
+   bool mTaken{ false };
+   bool mStop{ false };
+   std::exception_ptr mException;
+};
+
+}
+
+ProgressResult PCMImportFileHandle::ImportMapped(
+   const MemoryMappedFile &mapping, const PCMFileReference::Layout &layout,
+   NewChannelGroup &channels)
+{
+   const auto nChannels = mInfo.channels;
+   const auto totalFrames = static_cast<size_t>(mInfo.frames);
+   const auto frameBytes = nChannels * layout.bytes;
+   const auto format = mFormat;
+   wxASSERT(format == int16Sample || format == floatSample);
+
+   // Where the file has the very format and byte order of the samples to
+   // append, the tracks copy straight from the mapping; otherwise each
+   // channel converts into its own buffer first
+   const bool direct =
+      layout.bigEndian == (wxBYTE_ORDER == wxBIG_ENDIAN) &&
+      (format == int16Sample ? layout.bytes == 2 && !layout.isFloat
+         : layout.isFloat);
+
+   // All channels of a few megabytes of frames are appended at once, so
+   // that the threads share the reading of the pages into the cache
+   const auto chunkFrames =
+      std::max<size_t>(4096, (4 * 1024 * 1024) / frameBytes);
+   std::vector<SampleBuffer> buffers(direct ? 0 : nChannels);
+   for (auto &buffer : buffers)
+      if (NULL == buffer.Allocate(chunkFrames, format).ptr())
+         return ProgressResult::Failed;
+
+   auto &pool = ImportThreadPool();
+   auto updateResult = ProgressResult::Success;
+   for (size_t start = 0;
+        start < totalFrames && updateResult == ProgressResult::Success;
+        start += chunkFrames) {
+      const auto len = std::min(chunkFrames, totalFrames - start);
+      const auto frames =
+         mapping.Data() + layout.offset + start * frameBytes;
+      pool.ForEach(nChannels, [&](size_t c){
+         const auto src = frames + c * layout.bytes;
+         if (direct)
+            channels[c]->Append(
+               (samplePtr)src, format, len, nChannels);
+         else {
+            PCMFileReference::Convert(
+               layout, src, frameBytes, buffers[c].ptr(), format, len);
+            channels[c]->Append(buffers[c].ptr(), format, len);
+         }
+      });
+
+      updateResult = mProgress->Update(
+         static_cast<long long>(start + len),
+         static_cast<long long>(totalFrames));
+   }
+   return updateResult;
+}
+
+ProgressResult PCMImportFileHandle::ImportReference(
+   const std::shared_ptr<const PCMFileReference> &pReference,
+   SampleBlockFactory &factory, NewChannelGroup &channels)
+{
+   const auto nChannels = mInfo.channels;
+   const auto totalFrames = pReference->GetLayout().frames;
+   const auto maxBlockSize = channels.front()->GetMaxBlockSize();
+
+   // Only rows for the blocks are written now, without samples, in one
+   // transaction
+   const auto batch = factory.BeginBatch();
+   auto updateResult = ProgressResult::Success;
+   for (unsigned long long start = 0;
+        start < totalFrames && updateResult == ProgressResult::Success;
+        start += maxBlockSize) {
+      const auto len = static_cast<size_t>(
+         std::min<unsigned long long>(maxBlockSize, totalFrames - start));
+      for (int c = 0; c < nChannels; ++c)
+         channels[c]->RightmostOrNewClip()->AppendSharedBlock(
+            factory.CreateReference(pReference, c, start, len, mFormat));
+
+      updateResult = mProgress->Update(
+         static_cast<long long>(start + len),
+         static_cast<long long>(totalFrames));
+   }
+   return updateResult;
+}
 
 ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
                                 TrackHolders &outTracks,
@@ -314,7 +611,29 @@ ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
    auto maxBlockSize = channels.begin()->get()->GetMaxBlockSize();
    auto updateResult = ProgressResult::Cancelled;
 
-   {
+   // Uncompressed WAV and AIFF files are appended from a mapping of the file,
+   // saving the copies into libsndfile's buffer and then into ours, but only
+   // when the tracks need no conversion, which would serialize the channels
+   // as in the copy mode below
+   auto pMapping = std::make_unique<const MemoryMappedFile>(mFilename);
+   PCMFileReference::Layout layout;
+   if ((mFormat == int16Sample || mFormat == floatSample) &&
+       FindMappedSamples(*pMapping, mInfo, layout)) {
+      // In the "edit" mode, the samples are read from the original file
+      // until they are copied in the background.  The mapping lasts only
+      // for the import; the reference reads the file, checking for errors.
+      std::shared_ptr<const PCMFileReference> pReference;
+      if (FileFormatsCopyOrEditSetting.Read() == wxT("edit"))
+         pReference = PCMFileReference::Open(mFilename, layout);
+      if (pReference) {
+         pMapping.reset();
+         updateResult = ImportReference(pReference,
+            *trackFactory->GetSampleBlockFactory(), channels);
+      }
+      else
+         updateResult = ImportMapped(*pMapping, layout, channels);
+   }
+   else {
       // Otherwise, we're in the "copy" mode, where we read in the actual
       // samples from the file and store our own local copy of the
       // samples in the tracks.
@@ -330,49 +649,74 @@ ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
       if (maxBlock < 1)
          return ProgressResult::Failed;
 
-      SampleBuffer srcbuffer, buffer;
-      wxASSERT(mInfo.channels >= 0);
-      while (NULL == srcbuffer.Allocate(maxBlock * mInfo.channels, mFormat).ptr() ||
-             NULL == buffer.Allocate(maxBlock, mFormat).ptr())
+      // Two interleaved buffers, so that the next block is read on another
+      // thread while the channels of the previous one are appended, and a
+      // buffer for each channel
+      const auto nChannels = mInfo.channels;
+      SampleBuffer srcbuffers[2];
+      std::vector<SampleBuffer> buffers(nChannels);
+      const auto allocate = [&]{
+         for (auto &srcbuffer : srcbuffers)
+            if (NULL == srcbuffer.Allocate(maxBlock * nChannels, mFormat).ptr())
+               return false;
+         for (auto &buffer : buffers)
+            if (NULL == buffer.Allocate(maxBlock, mFormat).ptr())
+               return false;
+         return true;
+      };
+      while (!allocate())
       {
          maxBlock /= 2;
          if (maxBlock < 1)
             return ProgressResult::Failed;
       }
-
-      decltype(fileTotalFrames) framescompleted = 0;
-
-      long block;
-      do {
-         block = maxBlock;
-
-         if (mFormat == int16Sample)
-            block = SFCall<sf_count_t>(sf_readf_short, mFile.get(), (short *)srcbuffer.ptr(), block);
-         //import 24 bit int as float and have the append function convert it.  This is how PCMAliasBlockFile worked too.
+      std::vector<samplePtr> dests;
+      for (const auto &buffer : buffers)
+         dests.push_back(buffer.ptr());
+
+      //import 24 bit int as float and have the append function convert it.  This is how PCMAliasBlockFile worked too.
+      const auto readFormat =
+         (mFormat == int16Sample) ? int16Sample : floatSample;
+      const auto read = [&](samplePtr srcbuffer) -> size_t {
+         PROFILE_SCOPE("PCMImportFileHandle::Import read");
+         sf_count_t block;
+         if (readFormat == int16Sample)
+            block = SFCall<sf_count_t>(sf_readf_short, mFile.get(), (short *)srcbuffer, maxBlock);
          else
-            block = SFCall<sf_count_t>(sf_readf_float, mFile.get(), (float *)srcbuffer.ptr(), block);
+            block = SFCall<sf_count_t>(sf_readf_float, mFile.get(), (float *)srcbuffer, maxBlock);
 
-         if(block < 0 || block > (long)maxBlock) {
+         if(block < 0 || block > (sf_count_t)maxBlock) {
             wxASSERT(false);
             block = maxBlock;
          }
+         return block;
+      };
 
-         if (block) {
-            auto iter = channels.begin();
-            for(int c=0; c<mInfo.channels; ++iter, ++c) {
-               if (mFormat==int16Sample) {
-                  for(int j=0; j<block; j++)
-                     ((short *)buffer.ptr())[j] =
-                        ((short *)srcbuffer.ptr())[mInfo.channels*j+c];
-               }
-               else {
-                  for(int j=0; j<block; j++)
-                     ((float *)buffer.ptr())[j] =
-                        ((float *)srcbuffer.ptr())[mInfo.channels*j+c];
-               }
+      // Channels append on several threads when no conversion is needed.
+      // Conversion dithers, and the ditherer's state is not shared safely.
+      const bool parallel = (readFormat == mFormat);
+      auto &pool = ImportThreadPool();
+      const auto appendChannel = [&](size_t c, size_t len) {
+         channels[c]->Append(dests[c], readFormat, len);
+      };
 
-               iter->get()->Append(buffer.ptr(), (mFormat == int16Sample)?int16Sample:floatSample, block);
-            }
+      decltype(fileTotalFrames) framescompleted = 0;
+
+      // Its destructor stops the reading, even if appending throws
+      BlockReader reader{ srcbuffers, 2, read };
+      size_t block;
+      do {
+         samplePtr srcbuffer;
+         block = reader.Next(srcbuffer);
+         if (block) {
+            DeinterleaveSamples(srcbuffer, readFormat,
+               dests.data(), nChannels, block);
+            if (parallel)
+               pool.ForEach(nChannels,
+                  [&](size_t c){ appendChannel(c, block); });
+            else
+               for (int c = 0; c < nChannels; ++c)
+                  appendChannel(c, block);
             framescompleted += block;
          }
 
@@ -380,10 +724,7 @@ ProgressResult PCMImportFileHandle::Import(WaveTrackFactory *trackFactory,
             framescompleted.as_long_long(),
             fileTotalFrames.as_long_long()
          );
-         if (updateResult != ProgressResult::Success)
-            break;
-
-      } while (block > 0);
+      } while (block > 0 && updateResult == ProgressResult::Success);
    }
 
    if (updateResult == ProgressResult::Failed || updateResult == ProgressResult::Cancelled) {
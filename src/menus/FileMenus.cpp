@@ -239,6 +239,14 @@ void OnCompact(const CommandContext &context)
       // And clear the clipboard
       clipboard.Clear();
 
+      // Let the user keep working while the file is copied; the status bar
+      // reports progress and the outcome
+      if (!isBatch && projectFileIO.StartBackgroundCompact())
+      {
+         currentTracks.reset();
+         return;
+      }
+
       // Refresh the before space usage since it may have changed due to the
       // above actions.
       auto before = wxFileName::GetSize(projectFileIO.GetFileName());